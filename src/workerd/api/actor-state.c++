@@ -691,6 +691,7 @@ jsg::JsRef<jsg::JsValue> DurableObjectStorage::transactionSync(
       return kj::mv(result);
     }, [&](jsg::Value exception) -> jsg::JsRef<jsg::JsValue> {
       sqlite.run(SqliteDatabase::TRUSTED, kj::str("ROLLBACK TO _cf_sync_savepoint_", depth));
+      sqlite.notifyRollback();
       js.throwException(kj::mv(exception));
     });
   } else {
@@ -896,6 +897,25 @@ kj::Array<jsg::Ref<api::WebSocket>> DurableObjectState::getWebSockets(
   return kj::Array<jsg::Ref<api::WebSocket>>();
 }
 
+uint DurableObjectState::broadcast(
+    jsg::Lock& js,
+    kj::OneOf<kj::Array<byte>, kj::String> message,
+    jsg::Optional<BroadcastOptions> options) {
+  auto& a = KJ_REQUIRE_NONNULL(IoContext::current().getActor());
+  KJ_IF_SOME(manager, a.getHibernationManager()) {
+    kj::Maybe<kj::StringPtr> tag;
+    kj::ArrayPtr<jsg::Ref<WebSocket>> except;
+    KJ_IF_SOME(o, options) {
+      tag = o.tag.map([](kj::StringPtr t) { return t; });
+      KJ_IF_SOME(e, o.except) {
+        except = e;
+      }
+    }
+    return manager.broadcast(js, kj::mv(message), tag, except);
+  }
+  return 0;
+}
+
 void DurableObjectState::setWebSocketAutoResponse(
       jsg::Optional<jsg::Ref<WebSocketRequestResponsePair>> maybeReqResp) {
   auto& a = KJ_REQUIRE_NONNULL(IoContext::current().getActor());
@@ -470,6 +470,21 @@ public:
   // Disconnected WebSockets are automatically removed from the list.
   kj::Array<jsg::Ref<api::WebSocket>> getWebSockets(jsg::Lock& js, jsg::Optional<kj::String> tag);
 
+  struct BroadcastOptions {
+    jsg::Optional<kj::String> tag;
+    jsg::Optional<kj::Array<jsg::Ref<WebSocket>>> except;
+
+    JSG_STRUCT(tag, except);
+    JSG_STRUCT_TS_OVERRIDE(DurableObjectBroadcastOptions);
+  };
+
+  // Sends `message` to every accepted WebSocket matching `options.tag` (or to all of them if no
+  // tag is provided), other than those listed in `options.except`. Equivalent to calling send()
+  // on each WebSocket returned by getWebSockets(), but hibernating WebSockets are not woken up to
+  // do so. Returns the number of WebSockets the message was sent to.
+  uint broadcast(jsg::Lock& js, kj::OneOf<kj::Array<byte>, kj::String> message,
+      jsg::Optional<BroadcastOptions> options);
+
   // Sets an object-wide websocket auto response message for a specific
   // request string. All websockets belonging to the same object must
   // reply to the request with the matching response, then store the timestamp at which
@@ -513,6 +528,7 @@ public:
       //   useful to apps in actual production? It's a convenient way to bail out when you discover
       //   your state is inconsistent.
       JSG_METHOD(abort);
+      JSG_METHOD(broadcast);
     }
 
     JSG_TS_ROOT();
@@ -559,6 +575,7 @@ private:
   api::DurableObjectStorageOperations::GetAlarmOptions,  \
   api::DurableObjectStorageOperations::PutOptions,       \
   api::DurableObjectStorageOperations::SetAlarmOptions,  \
+  api::DurableObjectState::BroadcastOptions,             \
   api::WebSocketRequestResponsePair
 
 }  // namespace workerd::api
@@ -699,9 +699,23 @@ kj::Promise<void> DigestStreamSink::write(const void* buffer, size_t size) {
 }
 
 kj::Promise<void> DigestStreamSink::write(kj::ArrayPtr<const kj::ArrayPtr<const byte>> pieces) {
-  for (auto& piece : pieces) {
-    co_await write(piece.begin(), piece.size());
+  KJ_SWITCH_ONEOF(state) {
+    KJ_CASE_ONEOF(closed, Closed) {
+      return kj::READY_NOW;
+    }
+    KJ_CASE_ONEOF(errored, Errored) {
+      return kj::cp(errored);
+    }
+    KJ_CASE_ONEOF(context, DigestContextPtr) {
+      // Hash every piece in one go, rather than suspending between pieces.
+      auto checkErrorsOnFinish = webCryptoOperationBegin(__func__, algorithm.name);
+      for (auto& piece : pieces) {
+        OSSLCALL(EVP_DigestUpdate(context.get(), piece.begin(), piece.size()));
+      }
+      return kj::READY_NOW;
+    }
   }
+  KJ_UNREACHABLE;
 }
 
 kj::Promise<void> DigestStreamSink::end() {
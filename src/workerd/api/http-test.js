@@ -205,3 +205,67 @@ export const inspect = {
     await messagePromise;
   }
 };
+
+export const headersCopyOnWrite = {
+  async test(ctrl, env, ctx) {
+    const original = new Headers([
+      ["X-Custom", "a"],
+      ["content-TYPE", "text/plain"],
+      ["Accept", "*/*"],
+      ["Set-Cookie", "a=1"],
+      ["Set-Cookie", "b=2"],
+    ]);
+
+    // Copies share storage until one of them is modified; neither sees the other's changes.
+    const copy = new Headers(original);
+    const request = new Request("http://example.com", { headers: original });
+    const cloned = request.clone();
+    copy.set("accept", "text/html");
+    copy.append("X-Custom", "b");
+    copy.delete("Content-Type");
+    cloned.headers.append("X-Other", "c");
+
+    assert.deepStrictEqual([...original], [
+      ["accept", "*/*"],
+      ["content-type", "text/plain"],
+      ["set-cookie", "a=1"],
+      ["set-cookie", "b=2"],
+      ["x-custom", "a"],
+    ]);
+    assert.deepStrictEqual([...copy], [
+      ["accept", "text/html"],
+      ["set-cookie", "a=1"],
+      ["set-cookie", "b=2"],
+      ["x-custom", "a, b"],
+    ]);
+    assert.deepStrictEqual([...request.headers], [...original]);
+    assert.strictEqual(cloned.headers.get("x-other"), "c");
+    assert.strictEqual(request.headers.get("x-other"), null);
+
+    // Lookups are case-insensitive whether or not the name is a common one.
+    assert.strictEqual(original.get("CONTENT-type"), "text/plain");
+    assert.strictEqual(original.get("x-CUSTOM"), "a");
+    assert.deepStrictEqual(original.getSetCookie(), ["a=1", "b=2"]);
+
+    // Enough headers that lookups switch from a linear scan to a binary search.
+    const many = new Headers();
+    for (let i = 31; i >= 0; i--) {
+      many.append(`X-Header-${i}`, `${i}`);
+    }
+    for (let i = 0; i < 32; i++) {
+      assert.strictEqual(many.get(`x-header-${i}`), `${i}`);
+    }
+    many.append("x-header-5", "again");
+    assert.strictEqual(many.get("X-Header-5"), "5, again");
+    assert.strictEqual([...many.keys()][0], "x-header-0");
+
+    // Once sorted, new entries are inserted in order rather than appended.
+    for (const name of ["X-Header-15a", "A-First", "Z-Last", "X-Header-2a"]) {
+      many.append(name, "new");
+      assert.strictEqual(many.get(name), "new");
+    }
+    const keys = [...many.keys()];
+    assert.strictEqual(keys.length, 36);
+    assert.deepStrictEqual(keys, [...keys].sort());
+  }
+};
@@ -21,6 +21,7 @@
 #include <workerd/jsg/url.h>
 #include <workerd/io/io-context.h>
 #include <set>
+#include <algorithm>
 #include <capnp/compat/http-over-capnp.capnp.h>
 
 namespace workerd::api {
@@ -83,11 +84,9 @@ jsg::ByteString normalizeHeaderValue(jsg::ByteString value) {
   return jsg::ByteString(kj::str(slice));
 }
 
-void requireValidHeaderName(const jsg::ByteString& name) {
+void requireValidHeaderName(kj::StringPtr name) {
   // TODO(cleanup): Code duplication with kj/compat/http.c++
 
-  warnIfBadHeaderString(name);
-
   constexpr auto HTTP_SEPARATOR_CHARS = kj::parse::anyOfChars("()<>@,;:\\\"/[]?={} \t");
   // RFC2616 section 2.2: https://www.w3.org/Protocols/rfc2616/rfc2616-sec2.html#sec2.2
 
@@ -104,6 +103,11 @@ void requireValidHeaderName(const jsg::ByteString& name) {
   }
 }
 
+void requireValidHeaderName(const jsg::ByteString& name) {
+  warnIfBadHeaderString(name);
+  requireValidHeaderName(kj::StringPtr(name));
+}
+
 void requireValidHeaderValue(kj::StringPtr value) {
   // TODO(cleanup): Code duplication with kj/compat/http.c++
 
@@ -114,6 +118,100 @@ void requireValidHeaderValue(kj::StringPtr value) {
 
 }  // namespace
 
+static kj::ArrayPtr<const kj::StringPtr> getCommonHeaderList();
+
+namespace {
+
+char toLowerAscii(char c) {
+  return 'A' <= c && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+// Compares `key`, which must already be lower-case, against `name` as if `name` were lower-cased
+// too, in the same order as kj::StringPtr's operator<.
+int compareHeaderKey(kj::StringPtr key, kj::StringPtr name) {
+  auto size = kj::min(key.size(), name.size());
+  for (auto i: kj::zeroTo(size)) {
+    auto a = static_cast<unsigned char>(key[i]);
+    auto b = static_cast<unsigned char>(toLowerAscii(name[i]));
+    if (a != b) return a < b ? -1 : 1;
+  }
+  return key.size() < name.size() ? -1 : key.size() > name.size() ? 1 : 0;
+}
+
+// The names in http-over-capnp.capnp's list of common headers, which Headers uses in place of
+// allocating its own copies. Unlike the names in a kj::HttpHeaderTable, these live forever, so
+// Headers objects can point at them no matter where they end up.
+struct InternedHeaderName {
+  kj::StringPtr key;   // lower-cased name
+  kj::StringPtr name;  // canonical capitalization
+};
+
+class InternedHeaderNames {
+public:
+  // No common header name is anywhere near this long.
+  static constexpr size_t MAX_NAME_SIZE = 64;
+
+  InternedHeaderNames() {
+    auto list = getCommonHeaderList().slice(1, getCommonHeaderList().size());
+    keys = KJ_MAP(name, list) { return toLower(kj::str(name)); };
+    for (auto i: kj::indices(list)) {
+      KJ_ASSERT(list[i].size() < MAX_NAME_SIZE);
+      names.insert(keys[i], InternedHeaderName { keys[i], list[i] });
+    }
+  }
+
+  // Looks up `name` case-insensitively.
+  kj::Maybe<const InternedHeaderName&> find(kj::StringPtr name) const {
+    if (name.size() >= MAX_NAME_SIZE) return kj::none;
+    char buffer[MAX_NAME_SIZE];
+    for (auto i: kj::indices(name)) {
+      buffer[i] = toLowerAscii(name[i]);
+    }
+    buffer[name.size()] = '\0';
+    return names.find(kj::StringPtr(buffer, name.size()));
+  }
+
+private:
+  kj::Array<kj::String> keys;
+  kj::HashMap<kj::StringPtr, InternedHeaderName> names;
+};
+
+const InternedHeaderNames& getInternedHeaderNames() {
+  static const InternedHeaderNames NAMES;
+  return NAMES;
+}
+
+}  // namespace
+
+Headers::Header Headers::Header::clone() const {
+  // `key` and `name` point either into our own strings, which must be copied along with them, or
+  // at interned strings, which needn't be.
+  auto copy = [](kj::StringPtr ptr, const jsg::ByteString& owned, jsg::ByteString& ownedCopy) {
+    if (ptr.begin() != owned.begin()) return ptr;
+    ownedCopy = jsg::ByteString(kj::str(owned));
+    return kj::StringPtr(ownedCopy);
+  };
+
+  Header result;
+  result.key = copy(key, ownedKey, result.ownedKey);
+  result.name = copy(name, ownedName, result.ownedName);
+  result.values.reserve(values.size());
+  for (auto& value: values) {
+    result.values.add(jsg::ByteString(kj::str(value)));
+  }
+  return result;
+}
+
+kj::Own<Headers::Storage> Headers::Storage::clone() const {
+  auto result = kj::refcounted<Storage>();
+  result->entries.reserve(entries.size());
+  for (auto& header: entries) {
+    result->entries.add(header.clone());
+  }
+  result->sorted = sorted;
+  return result;
+}
+
 Headers::Headers(jsg::Dict<jsg::ByteString, jsg::ByteString> dict)
     : guard(Guard::NONE) {
   for (auto& field: dict.fields) {
@@ -122,22 +220,26 @@ Headers::Headers(jsg::Dict<jsg::ByteString, jsg::ByteString> dict)
 }
 
 Headers::Headers(const Headers& other)
-    : guard(Guard::NONE) {
-  for (auto& header: other.headers) {
-    Header copy {
-      jsg::ByteString(kj::str(header.second.key)),
-      jsg::ByteString(kj::str(header.second.name)),
-      KJ_MAP(value, header.second.values) { return jsg::ByteString(kj::str(value)); },
-    };
-    kj::StringPtr keyRef = copy.key;
-    KJ_ASSERT(headers.insert(std::make_pair(keyRef, kj::mv(copy))).second);
-  }
-}
+    : guard(Guard::NONE),
+      // We only ever modify storage that isn't shared (see mutate()), so it's safe to share it
+      // even though `other` is const.
+      storage(kj::addRef(const_cast<Storage&>(*other.storage))) {}
 
 Headers::Headers(const kj::HttpHeaders& other, Guard guard)
     : guard(Guard::NONE) {
-  other.forEach([this](auto name, auto value) {
-    append(jsg::ByteString(kj::str(name)), jsg::ByteString(kj::str(value)));
+  // Like append(), but only copies names that aren't interned.
+  other.forEach([this](kj::StringPtr name, kj::StringPtr value) {
+    auto index = findIndex(name);
+    if (index == kj::none) {
+      requireValidHeaderName(name);
+    }
+    auto normalized = normalizeHeaderValue(jsg::ByteString(kj::str(value)));
+    requireValidHeaderValue(normalized);
+    KJ_IF_SOME(i, index) {
+      storage->entries[i].values.add(kj::mv(normalized));
+    } else {
+      addHeader(name, kj::none, kj::mv(normalized));
+    }
   });
 
   this->guard = guard;
@@ -149,12 +251,108 @@ jsg::Ref<Headers> Headers::clone() const {
   return kj::mv(result);
 }
 
+Headers::Storage& Headers::mutate() {
+  if (storage->isShared()) {
+    storage = storage->clone();
+  }
+  return *storage;
+}
+
+kj::ArrayPtr<Headers::Header> Headers::sortedEntries() {
+  // Sorting doesn't change what the storage holds, so it's fine to do even if it's shared.
+  auto& entries = storage->entries;
+  if (!storage->sorted) {
+    std::sort(entries.begin(), entries.end(), [](const Header& a, const Header& b) {
+      return a.key < b.key;
+    });
+    storage->sorted = true;
+  }
+  return entries;
+}
+
+kj::Maybe<size_t> Headers::findIndex(kj::StringPtr name) {
+  auto entries = storage->entries.asPtr();
+  if (!storage->sorted && entries.size() > MAX_LINEAR_SEARCH) {
+    entries = sortedEntries();
+  }
+
+  if (storage->sorted) {
+    auto iter = std::lower_bound(entries.begin(), entries.end(), name,
+        [](const Header& header, kj::StringPtr name) {
+      return compareHeaderKey(header.key, name) < 0;
+    });
+    if (iter != entries.end() && compareHeaderKey(iter->key, name) == 0) {
+      return size_t(iter - entries.begin());
+    }
+  } else {
+    for (auto i: kj::indices(entries)) {
+      if (compareHeaderKey(entries[i].key, name) == 0) {
+        return i;
+      }
+    }
+  }
+  return kj::none;
+}
+
+kj::Maybe<Headers::Header&> Headers::find(kj::StringPtr name) {
+  KJ_IF_SOME(i, findIndex(name)) {
+    return storage->entries[i];
+  }
+  return kj::none;
+}
+
+void Headers::addHeader(kj::StringPtr name, kj::Maybe<jsg::ByteString&> ownedName,
+                        jsg::ByteString value) {
+  Header header;
+  bool nameInterned = false;
+  KJ_IF_SOME(interned, getInternedHeaderNames().find(name)) {
+    header.key = interned.key;
+    if (name == interned.name) {
+      header.name = interned.name;
+      nameInterned = true;
+    } else if (name == interned.key) {
+      header.name = interned.key;
+      nameInterned = true;
+    }
+  } else {
+    header.ownedKey = toLower(name);
+    header.key = header.ownedKey;
+  }
+
+  if (!nameInterned) {
+    KJ_IF_SOME(owned, ownedName) {
+      header.ownedName = kj::mv(owned);
+    } else {
+      header.ownedName = jsg::ByteString(kj::str(name));
+    }
+    header.name = header.ownedName;
+  }
+
+  header.values.add(kj::mv(value));
+
+  auto& target = mutate();
+  auto& entries = target.entries;
+  if (!entries.empty() && !(entries.back().key < header.key)) {
+    if (target.sorted && entries.size() >= MAX_LINEAR_SEARCH) {
+      // We're past linear search, so the next lookup would only have to sort again. Keep the
+      // entries sorted instead, so that adding many headers doesn't re-sort after each one.
+      auto pos = std::upper_bound(entries.begin(), entries.end(), header,
+          [](const Header& a, const Header& b) { return a.key < b.key; }) - entries.begin();
+      entries.add(kj::mv(header));
+      std::rotate(entries.begin() + pos, entries.end() - 1, entries.end());
+      return;
+    }
+    target.sorted = false;
+  }
+  entries.add(kj::mv(header));
+}
+
 // Fill in the given HttpHeaders with these headers. Note that strings are inserted by
 // reference, so the output must be consumed immediately.
 void Headers::shallowCopyTo(kj::HttpHeaders& out) {
-  for (auto& entry: headers) {
-    for (auto& value: entry.second.values) {
-      out.add(entry.second.name, value);
+  for (auto& header: sortedEntries()) {
+    for (auto& value: header.values) {
+      out.add(header.name, value);
     }
   }
 }
@@ -165,34 +363,33 @@ bool Headers::hasLowerCase(kj::StringPtr name) {
     KJ_DREQUIRE(!('A' <= c && c <= 'Z'));
   }
 #endif
-  return headers.find(name) != headers.end();
+  return findIndex(name) != kj::none;
 }
 
 kj::Array<Headers::DisplayedHeader> Headers::getDisplayedHeaders(jsg::Lock& js) {
   if (FeatureFlags::get(js).getHttpHeadersGetSetCookie()) {
     kj::Vector<Headers::DisplayedHeader> copy;
-    for (auto& entry : headers) {
-      if (entry.first == "set-cookie") {
+    for (auto& header : sortedEntries()) {
+      if (header.key == "set-cookie") {
         // For set-cookie entries, we iterate each individually without
         // combining them.
-        for (auto& value : entry.second.values) {
+        for (auto& value : header.values) {
           copy.add(Headers::DisplayedHeader {
-            .key = jsg::ByteString(kj::str(entry.first)),
+            .key = jsg::ByteString(kj::str(header.key)),
             .value = jsg::ByteString(kj::str(value)),
           });
         }
       } else {
         copy.add(Headers::DisplayedHeader {
-          .key = jsg::ByteString(kj::str(entry.first)),
-          .value = jsg::ByteString(kj::strArray(entry.second.values, ", "))
+          .key = jsg::ByteString(kj::str(header.key)),
+          .value = jsg::ByteString(kj::strArray(header.values, ", "))
         });
       }
     }
     return copy.releaseAsArray();
   } else {
     // The old behavior before the standard getSetCookie() API was introduced...
-    auto headersCopy = KJ_MAP(mapEntry, headers) {
-      const auto& header = mapEntry.second;
+    auto headersCopy = KJ_MAP(header, sortedEntries()) {
       return DisplayedHeader {
         jsg::ByteString(kj::str(header.key)),
         jsg::ByteString(kj::strArray(header.values, ", "))
@@ -249,20 +446,18 @@ jsg::Ref<Headers> Headers::constructor(jsg::Lock& js, jsg::Optional<Initializer>
 
 kj::Maybe<jsg::ByteString> Headers::get(jsg::ByteString name) {
   requireValidHeaderName(name);
-  auto iter = headers.find(toLower(kj::mv(name)));
-  if (iter == headers.end()) {
-    return kj::none;
+  KJ_IF_SOME(header, find(name)) {
+    return jsg::ByteString(kj::strArray(header.values, ", "));
   } else {
-    return jsg::ByteString(kj::strArray(iter->second.values, ", "));
+    return kj::none;
   }
 }
 
 kj::ArrayPtr<jsg::ByteString> Headers::getSetCookie() {
-  auto iter = headers.find("set-cookie");
-  if (iter == headers.end()) {
-    return nullptr;
+  KJ_IF_SOME(header, find("set-cookie")) {
+    return header.values.asPtr();
   } else {
-    return iter->second.values.asPtr();
+    return nullptr;
   }
 }
 
@@ -281,7 +476,7 @@ kj::ArrayPtr<jsg::ByteString> Headers::getAll(jsg::ByteString name) {
 
 bool Headers::has(jsg::ByteString name) {
   requireValidHeaderName(name);
-  return headers.find(toLower(kj::mv(name))) != headers.end();
+  return findIndex(name) != kj::none;
 }
 
 void Headers::set(jsg::ByteString name, jsg::ByteString value) {
@@ -291,33 +486,41 @@ void Headers::set(jsg::ByteString name, jsg::ByteString value) {
 
 void Headers::setUnguarded(jsg::ByteString name, jsg::ByteString value) {
   requireValidHeaderName(name);
-  auto key = toLower(name);
   value = normalizeHeaderValue(kj::mv(value));
   requireValidHeaderValue(value);
-  auto [iter, emplaced] = headers.try_emplace(key, kj::mv(key), kj::mv(name), kj::mv(value));
-  if (!emplaced) {
+  KJ_IF_SOME(i, findIndex(name)) {
     // Overwrite existing value(s).
-    iter->second.values.clear();
-    iter->second.values.add(kj::mv(value));
+    auto& values = mutate().entries[i].values;
+    values.clear();
+    values.add(kj::mv(value));
+  } else {
+    addHeader(name, name, kj::mv(value));
   }
 }
 
 void Headers::append(jsg::ByteString name, jsg::ByteString value) {
   checkGuard();
   requireValidHeaderName(name);
-  auto key = toLower(name);
   value = normalizeHeaderValue(kj::mv(value));
   requireValidHeaderValue(value);
-  auto [iter, emplaced] = headers.try_emplace(key, kj::mv(key), kj::mv(name), kj::mv(value));
-  if (!emplaced) {
-    iter->second.values.add(kj::mv(value));
+  KJ_IF_SOME(i, findIndex(name)) {
+    mutate().entries[i].values.add(kj::mv(value));
+  } else {
+    addHeader(name, name, kj::mv(value));
   }
 }
 
 void Headers::delete_(jsg::ByteString name) {
   checkGuard();
   requireValidHeaderName(name);
-  headers.erase(toLower(kj::mv(name)));
+  KJ_IF_SOME(i, findIndex(name)) {
+    // Shift the later entries down, which keeps them in order.
+    auto& entries = mutate().entries;
+    for (auto j: kj::range(i + 1, entries.size())) {
+      entries[j - 1] = kj::mv(entries[j]);
+    }
+    entries.removeLast();
+  }
 }
 
 // There are a couple implementation details of the Headers iterators worth calling out.
@@ -353,22 +556,22 @@ jsg::Ref<Headers::EntryIterator> Headers::entries(jsg::Lock& js) {
 jsg::Ref<Headers::KeyIterator> Headers::keys(jsg::Lock& js) {
   if (FeatureFlags::get(js).getHttpHeadersGetSetCookie()) {
     kj::Vector<jsg::ByteString> keysCopy;
-    for (auto& entry : headers) {
+    for (auto& header : sortedEntries()) {
       // Set-Cookie headers must be handled specially. They should never be combined into a
       // single value, so the values iterator must separate them. It seems a bit silly, but
       // the keys iterator can end up having multiple set-cookie instances.
-      if (entry.first == "set-cookie") {
-        for (auto n = 0; n < entry.second.values.size(); n++) {
-          keysCopy.add(jsg::ByteString(kj::str(entry.first)));
+      if (header.key == "set-cookie") {
+        for (auto n = 0; n < header.values.size(); n++) {
+          keysCopy.add(jsg::ByteString(kj::str(header.key)));
         }
       } else {
-        keysCopy.add(jsg::ByteString(kj::str(entry.first)));
+        keysCopy.add(jsg::ByteString(kj::str(header.key)));
       }
     }
     return jsg::alloc<KeyIterator>(IteratorState<jsg::ByteString> { keysCopy.releaseAsArray() });
   } else {
-    auto keysCopy = KJ_MAP(mapEntry, headers) {
-      return jsg::ByteString(kj::str(mapEntry.second.key));
+    auto keysCopy = KJ_MAP(header, sortedEntries()) {
+      return jsg::ByteString(kj::str(header.key));
     };
     return jsg::alloc<KeyIterator>(IteratorState<jsg::ByteString> { kj::mv(keysCopy) });
   }
@@ -376,21 +579,21 @@ jsg::Ref<Headers::KeyIterator> Headers::keys(jsg::Lock& js) {
 jsg::Ref<Headers::ValueIterator> Headers::values(jsg::Lock& js) {
   if (FeatureFlags::get(js).getHttpHeadersGetSetCookie()) {
     kj::Vector<jsg::ByteString> values;
-    for (auto& entry : headers) {
+    for (auto& header : sortedEntries()) {
       // Set-Cookie headers must be handled specially. They should never be combined into a
       // single value, so the values iterator must separate them.
-      if (entry.first == "set-cookie") {
-        for (auto& value : entry.second.values) {
+      if (header.key == "set-cookie") {
+        for (auto& value : header.values) {
           values.add(jsg::ByteString(kj::str(value)));
         }
       } else {
-        values.add(jsg::ByteString(kj::strArray(entry.second.values, ", ")));
+        values.add(jsg::ByteString(kj::strArray(header.values, ", ")));
       }
     }
     return jsg::alloc<ValueIterator>(IteratorState<jsg::ByteString> { values.releaseAsArray() });
   } else {
-    auto valuesCopy = KJ_MAP(mapEntry, headers) {
-      return jsg::ByteString(kj::strArray(mapEntry.second.values, ", "));
+    auto valuesCopy = KJ_MAP(header, sortedEntries()) {
+      return jsg::ByteString(kj::strArray(header.values, ", "));
     };
     return jsg::alloc<ValueIterator>(IteratorState<jsg::ByteString> { kj::mv(valuesCopy) });
   }
@@ -513,15 +716,14 @@ void Headers::serialize(jsg::Lock& js, jsg::Serializer& serializer) {
 
   // Write the count of headers.
   uint count = 0;
-  for (auto& entry: headers) {
-    count += entry.second.values.size();
+  for (auto& header: storage->entries) {
+    count += header.values.size();
   }
   serializer.writeRawUint32(count);
 
   // Now write key/values.
   auto& commonHeaders = getCommonHeaderMap();
-  for (auto& entry: headers) {
-    auto& header = entry.second;
+  for (auto& header: sortedEntries()) {
     auto commonId = commonHeaders.find(header.key);
     for (auto& value: header.values) {
       KJ_IF_SOME(c, commonId) {
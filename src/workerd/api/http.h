@@ -173,47 +173,74 @@ public:
   JSG_SERIALIZABLE(rpc::SerializationTag::HEADERS);
 
   void visitForMemoryInfo(jsg::MemoryTracker& tracker) const {
-    for (const auto& entry : headers) {
-      tracker.trackField(entry.first, entry.second);
+    for (const auto& header : storage->entries) {
+      tracker.trackField(header.key, header);
     }
   }
 
 private:
   struct Header {
-    jsg::ByteString key;   // lower-cased name
-    jsg::ByteString name;
+    // The lower-cased name, used as the key, and the name with the casing it was first seen with.
+    // For common header names these usually point at immortal interned strings, so that they
+    // needn't be allocated per header; otherwise they point into `ownedKey` and `ownedName`.
+    kj::StringPtr key;
+    kj::StringPtr name;
+    jsg::ByteString ownedKey;
+    jsg::ByteString ownedName;
 
     // We intentionally do not comma-concatenate header values of the same name, as we need to be
     // able to re-serialize them separately. This is particularly important for the Set-Cookie
     // header, which uses a date format that requires a comma. This would normally suggest using a
-    // std::multimap, but we also need to be able to display the values in comma-concatenated form
-    // via Headers.entries()[1] in order to be Fetch-conformant. Storing a vector of strings in a
-    // std::map makes this easier, and also makes it easy to honor the "first header name casing is
+    // multimap, but we also need to be able to display the values in comma-concatenated form
+    // via Headers.entries()[1] in order to be Fetch-conformant. Storing a vector of strings per
+    // header makes this easier, and also makes it easy to honor the "first header name casing is
     // used for all duplicate header names" rule[2] that the Fetch spec mandates.
     //
     // See: 1: https://fetch.spec.whatwg.org/#concept-header-list-sort-and-combine
     //      2: https://fetch.spec.whatwg.org/#concept-header-list-append
     kj::Vector<jsg::ByteString> values;
 
-    explicit Header(jsg::ByteString key, jsg::ByteString name,
-                    kj::Vector<jsg::ByteString> values)
-        : key(kj::mv(key)), name(kj::mv(name)), values(kj::mv(values)) {}
-    explicit Header(jsg::ByteString key, jsg::ByteString name, jsg::ByteString value)
-        : key(kj::mv(key)), name(kj::mv(name)), values(1) {
-      values.add(kj::mv(value));
-    }
+    Header clone() const;
 
     JSG_MEMORY_INFO(Header) {
-      tracker.trackField("key", key);
-      tracker.trackField("name", name);
+      tracker.trackField("key", ownedKey);
+      tracker.trackField("name", ownedName);
       for (const auto& value : values) {
         tracker.trackField(nullptr, value);
       }
     }
   };
 
+  // Most requests have few enough headers that a linear scan beats sorting them. Past this many,
+  // we sort once, binary search from then on, and insert new entries in order.
+  static constexpr size_t MAX_LINEAR_SEARCH = 16;
+
+  // The header entries, in a flat array that's only sorted by key when something needs it sorted.
+  // Copies of a Headers object share their storage until one of them modifies it.
+  struct Storage: public kj::Refcounted {
+    kj::Vector<Header> entries;
+    bool sorted = true;
+
+    kj::Own<Storage> clone() const;
+  };
+
   Guard guard;
-  std::map<kj::StringPtr, Header> headers;
+  kj::Own<Storage> storage = kj::refcounted<Storage>();
+
+  // Returns the storage for modification, first copying it if it's shared with another Headers.
+  Storage& mutate();
+
+  // Returns the entries sorted by key.
+  kj::ArrayPtr<Header> sortedEntries();
+
+  // Finds the entry for `name`, matching case-insensitively, without allocating.
+  kj::Maybe<size_t> findIndex(kj::StringPtr name);
+  kj::Maybe<Header&> find(kj::StringPtr name);
+
+  // Adds an entry for `name`, which must not already exist. If `name` isn't a common header name,
+  // `ownedName` is moved into the entry if given, otherwise `name` is copied.
+  void addHeader(kj::StringPtr name, kj::Maybe<jsg::ByteString&> ownedName,
+                 jsg::ByteString value);
 
   void checkGuard() {
     JSG_REQUIRE(guard == Guard::NONE, TypeError, "Can't modify immutable headers.");
@@ -67,6 +67,34 @@ void SharedMemoryCache::unsuggest(const Limits& limits) const {
   resize(*data);
 }
 
+// Returns the number of shards to use for the given effective limits: as many
+// as possible, up to MAX_SHARDS, such that each shard can still hold at least
+// MIN_KEYS_PER_SHARD keys and a few values of the maximum size. Dividing the
+// limits evenly only approximates a single LRU when each share is large enough
+// for the hash distribution to even out.
+static uint chooseShardCount(const SharedMemoryCache::Limits& limits) {
+  uint count = SharedMemoryCache::MAX_SHARDS;
+  while (count > 1 &&
+      (limits.maxKeys / count < SharedMemoryCache::MIN_KEYS_PER_SHARD ||
+          limits.maxTotalValueSize / count < uint64_t{limits.maxValueSize} * 4)) {
+    count /= 2;
+  }
+  return count;
+}
+
+kj::Locked<SharedMemoryCache::Shard> SharedMemoryCache::lockShard(kj::StringPtr key) const {
+  uint hash = kj::hashCode(key);
+  for (;;) {
+    uint count = shardCount.load(std::memory_order_acquire);
+    auto lock = shards[hash & (count - 1)].lockExclusive();
+    // The shard count cannot change while we hold any shard's lock, so if it
+    // still matches, the key really belongs to the shard we locked.
+    if (shardCount.load(std::memory_order_relaxed) == count) {
+      return kj::mv(lock);
+    }
+  }
+}
+
 void SharedMemoryCache::resize(ThreadUnsafeData& data) const {
   data.effectiveLimits = Limits::min();
   for (const auto& limits: data.suggestedLimits) {
@@ -78,143 +106,209 @@ void SharedMemoryCache::resize(ThreadUnsafeData& data) const {
     handler(data);
   }
 
+  kj::Vector<kj::Locked<Shard>> locked(MAX_SHARDS);
+  for (auto& shard: shards) {
+    locked.add(shard.lockExclusive());
+  }
+
   // Fast path for clearing the cache.
   if (data.effectiveLimits.maxKeys == 0) {
-    data.totalValueSize = 0;
-    data.cache.clear();
+    for (auto& shard: locked) {
+      shard->limits = data.effectiveLimits;
+      shard->totalValueSize = 0;
+      shard->cache.clear();
+    }
     return;
   }
 
-  // First, remove any values that might be too large.
-  while (data.cache.size() != 0) {
-    MemoryCacheEntry& largestEntry = *data.cache.ordered<2>().begin();
-    if (largestEntry.size() <= data.effectiveLimits.maxValueSize) {
-      break;
+  uint oldCount = shardCount.load(std::memory_order_relaxed);
+  uint newCount = chooseShardCount(data.effectiveLimits);
+  if (newCount != oldCount) {
+    // Move entries and in-progress fallbacks into the shards that their keys
+    // now map to. This only happens when isolates with different limits attach
+    // or detach, so we don't mind that it is slow.
+    for (uint i = 0; i < oldCount; i++) {
+      Shard& from = *locked[i];
+      kj::Vector<kj::String> keysToMove;
+      for (auto& entry: from.cache) {
+        if ((kj::hashCode(entry.key) & (newCount - 1)) != i) {
+          keysToMove.add(kj::str(entry.key));
+        }
+      }
+      for (auto& key: keysToMove) {
+        MemoryCacheEntry entry = from.cache.release(KJ_ASSERT_NONNULL(from.cache.find(key)));
+        Shard& to = *locked[kj::hashCode(key) & (newCount - 1)];
+        from.totalValueSize -= entry.size();
+        to.totalValueSize += entry.size();
+        to.cache.insert(kj::mv(entry));
+      }
+
+      keysToMove.clear();
+      for (auto& inProgress: from.inProgress) {
+        if ((kj::hashCode(inProgress->key) & (newCount - 1)) != i) {
+          keysToMove.add(kj::str(inProgress->key));
+        }
+      }
+      for (auto& key: keysToMove) {
+        auto inProgress = from.inProgress.release(KJ_ASSERT_NONNULL(from.inProgress.find(key)));
+        locked[kj::hashCode(key) & (newCount - 1)]->inProgress.insert(kj::mv(inProgress));
+      }
     }
-    data.totalValueSize -= largestEntry.size();
-    data.cache.erase(largestEntry);
+    shardCount.store(newCount, std::memory_order_release);
   }
 
-  // Now just keep keep evicting until we are within limits.
-  while (data.totalValueSize > data.effectiveLimits.maxTotalValueSize ||
-      data.cache.size() > data.effectiveLimits.maxKeys) {
-    evictNextWhileLocked(data, true);
+  // Each shard gets an equal share of the total limits, rounded up. Individual
+  // values are still allowed to be as large as the effective limit.
+  Limits shardLimits = {
+    .maxKeys = (data.effectiveLimits.maxKeys + newCount - 1) / newCount,
+    .maxValueSize = data.effectiveLimits.maxValueSize,
+    .maxTotalValueSize = (data.effectiveLimits.maxTotalValueSize + newCount - 1) / newCount,
+  };
+
+  for (uint i = 0; i < newCount; i++) {
+    Shard& shard = *locked[i];
+    shard.limits = shardLimits;
+
+    // First, remove any values that might be too large.
+    while (shard.cache.size() != 0) {
+      MemoryCacheEntry& largestEntry = *shard.cache.ordered<2>().begin();
+      if (largestEntry.size() <= shard.limits.maxValueSize) {
+        break;
+      }
+      shard.totalValueSize -= largestEntry.size();
+      shard.cache.erase(largestEntry);
+    }
+
+    // Now just keep keep evicting until we are within limits.
+    while (shard.totalValueSize > shard.limits.maxTotalValueSize ||
+        shard.cache.size() > shard.limits.maxKeys) {
+      evictNextWhileLocked(shard, true);
+    }
   }
 }
 
-kj::Maybe<kj::Own<CacheValue>> SharedMemoryCache::getWhileLocked(
-    ThreadUnsafeData& data, const kj::String& key) const {
-  KJ_IF_SOME(existingCacheEntry, data.cache.find(key)) {
+kj::Maybe<SharedMemoryCache::Lookup> SharedMemoryCache::getWhileLocked(
+    Shard& shard, const kj::String& key, double staleWhileRevalidate) const {
+  KJ_IF_SOME(existingCacheEntry, shard.cache.find(key)) {
+    bool isStale = false;
     if (hasExpired(existingCacheEntry.expiration)) {
       // The cache entry has an associated expiration time and that time has
-      // passed (according to the calling IoContext's timer).
-      data.totalValueSize -= existingCacheEntry.size();
-      data.cache.erase(existingCacheEntry);
-      return kj::none;
+      // passed (according to the calling IoContext's timer). Unless the caller
+      // accepts stale values for long enough, the entry is gone.
+      auto staleUntil = existingCacheEntry.expiration.map([&](double e) {
+        return e + staleWhileRevalidate;
+      });
+      if (staleWhileRevalidate <= 0 || existingCacheEntry.value->isFailure ||
+          hasExpired(staleUntil)) {
+        shard.totalValueSize -= existingCacheEntry.size();
+        shard.cache.erase(existingCacheEntry);
+        return kj::none;
+      }
+      isStale = true;
     }
 
     // Obtain a reference to the cache value before we kj::mv the cache entry.
     auto cacheValue = kj::atomicAddRef(*existingCacheEntry.value);
 
     // Update the liveliness.
-    MemoryCacheEntry entry = data.cache.release(existingCacheEntry);
-    entry.liveliness = data.stepLiveliness();
-    data.cache.insert(kj::mv(entry));
+    MemoryCacheEntry entry = shard.cache.release(existingCacheEntry);
+    entry.liveliness = stepLiveliness();
+    shard.cache.insert(kj::mv(entry));
 
-    return kj::mv(cacheValue);
+    return Lookup{kj::mv(cacheValue), isStale};
   } else {
     return kj::none;
   }
 }
 
-void SharedMemoryCache::putWhileLocked(ThreadUnsafeData& data,
+void SharedMemoryCache::putWhileLocked(Shard& shard,
     const kj::String& key,
     kj::Own<CacheValue>&& value,
     kj::Maybe<double> expiration) const {
   size_t valueSize = value->bytes.size();
-  if (valueSize > data.effectiveLimits.maxValueSize) {
+  if (valueSize > shard.limits.maxValueSize) {
     // Silently drop the value. For consistency, also drop the previous value,
     // if one exists, such that a subsequent read() will not return an outdated
     // value. Note that removeIfExistsWhileLocked(key) will update the
     // totalValueSize if necessary, so we don't need to do that here.
-    removeIfExistsWhileLocked(data, key);
+    removeIfExistsWhileLocked(shard, key);
     return;
   }
 
   if (hasExpired(expiration)) {
-    removeIfExistsWhileLocked(data, key);
+    removeIfExistsWhileLocked(shard, key);
     return;
   }
 
-  kj::Maybe<MemoryCacheEntry&> existingEntry = data.cache.find(key.asPtr());
+  kj::Maybe<MemoryCacheEntry&> existingEntry = shard.cache.find(key.asPtr());
   KJ_IF_SOME(entry, existingEntry) {
     size_t oldValueSize = entry.size();
-    KJ_ASSERT(data.totalValueSize >= oldValueSize);
-    MemoryCacheEntry updatedEntry = data.cache.release(entry);
-    data.totalValueSize -= oldValueSize;
-    while (data.totalValueSize + valueSize > data.effectiveLimits.maxTotalValueSize) {
+    KJ_ASSERT(shard.totalValueSize >= oldValueSize);
+    MemoryCacheEntry updatedEntry = shard.cache.release(entry);
+    shard.totalValueSize -= oldValueSize;
+    while (shard.totalValueSize + valueSize > shard.limits.maxTotalValueSize) {
       // We have already released the existing entry for our key, so there is no
       // risk of evicting it.
-      evictNextWhileLocked(data);
+      evictNextWhileLocked(shard);
     }
-    updatedEntry.liveliness = data.stepLiveliness();
+    updatedEntry.liveliness = stepLiveliness();
     updatedEntry.value = kj::mv(value);
     updatedEntry.expiration = expiration;
-    data.cache.insert(kj::mv(updatedEntry));
-    data.totalValueSize += valueSize;
+    shard.cache.insert(kj::mv(updatedEntry));
+    shard.totalValueSize += valueSize;
   } else {
     // Ensure that adding a new key won't push us over the limit.
-    if (data.cache.size() >= data.effectiveLimits.maxKeys) {
-      evictNextWhileLocked(data);
+    if (shard.cache.size() >= shard.limits.maxKeys) {
+      evictNextWhileLocked(shard);
     }
     // Ensure that the size of the new value won't push us over the limit.
-    while (data.totalValueSize + valueSize > data.effectiveLimits.maxTotalValueSize) {
-      evictNextWhileLocked(data);
+    while (shard.totalValueSize + valueSize > shard.limits.maxTotalValueSize) {
+      evictNextWhileLocked(shard);
     }
     MemoryCacheEntry newEntry = {
       kj::str(key),
-      data.stepLiveliness(),
+      stepLiveliness(),
       kj::mv(value),
       expiration,
     };
-    data.cache.insert(kj::mv(newEntry));
-    data.totalValueSize += valueSize;
+    shard.cache.insert(kj::mv(newEntry));
+    shard.totalValueSize += valueSize;
   }
 }
 
 void SharedMemoryCache::evictNextWhileLocked(
-    ThreadUnsafeData& data,
+    Shard& shard,
     bool allowOutsideIoContext) const {
   // The caller is responsible for ensuring that the cache is not empty already.
-  KJ_REQUIRE(data.cache.size() > 0);
+  KJ_REQUIRE(shard.cache.size() > 0);
 
   // If there is an entry that has expired already, evict that one.
-  MemoryCacheEntry& maybeExpired = *data.cache.ordered<3>().begin();
-  KJ_ASSERT(data.totalValueSize >= maybeExpired.size());
+  MemoryCacheEntry& maybeExpired = *shard.cache.ordered<3>().begin();
+  KJ_ASSERT(shard.totalValueSize >= maybeExpired.size());
   if (hasExpired(maybeExpired.expiration, allowOutsideIoContext)) {
-    data.totalValueSize -= maybeExpired.size();
-    data.cache.erase(maybeExpired);
+    shard.totalValueSize -= maybeExpired.size();
+    shard.cache.erase(maybeExpired);
     return;
   }
 
   // Otherwise, if no entry has expired, evict the least recently used entry.
-  MemoryCacheEntry& leastRecentlyUsed = *data.cache.ordered<1>().begin();
-  KJ_ASSERT(data.totalValueSize >= leastRecentlyUsed.size());
-  data.totalValueSize -= leastRecentlyUsed.size();
-  data.cache.erase(leastRecentlyUsed);
+  MemoryCacheEntry& leastRecentlyUsed = *shard.cache.ordered<1>().begin();
+  KJ_ASSERT(shard.totalValueSize >= leastRecentlyUsed.size());
+  shard.totalValueSize -= leastRecentlyUsed.size();
+  shard.cache.erase(leastRecentlyUsed);
 }
 
 void SharedMemoryCache::removeIfExistsWhileLocked(
-    ThreadUnsafeData& data,
+    Shard& shard,
     const kj::String& key) const {
-  KJ_IF_SOME(entry, data.cache.find(key)) {
+  KJ_IF_SOME(entry, shard.cache.find(key)) {
     // This DOES NOT count as an eviction because it might happen while
     // replacing the existing cache entry with a new one, when the new one is
     // being evicted immediately. It is up to the caller to count that.
     size_t valueSize = entry.size();
-    KJ_ASSERT(valueSize <= data.totalValueSize);
-    data.totalValueSize -= valueSize;
-    data.cache.erase(entry);
+    KJ_ASSERT(valueSize <= shard.totalValueSize);
+    shard.totalValueSize -= valueSize;
+    shard.cache.erase(entry);
   }
 }
 
@@ -242,16 +336,32 @@ SharedMemoryCache::Use::~Use() noexcept(false) {
 
 kj::Maybe<kj::Own<CacheValue>> SharedMemoryCache::Use::getWithoutFallback(
     const kj::String& key) const {
-  auto data = cache->data.lockExclusive();
-  return cache->getWhileLocked(*data, key);
+  auto shard = cache->lockShard(key);
+  KJ_IF_SOME(lookup, cache->getWhileLocked(*shard, key)) {
+    if (!lookup.value->isFailure) {
+      return kj::mv(lookup.value);
+    }
+  }
+  return kj::none;
 }
 
-kj::OneOf<kj::Own<CacheValue>, kj::Promise<SharedMemoryCache::Use::GetWithFallbackOutcome>>
-SharedMemoryCache::Use::getWithFallback(const kj::String& key) const {
-  auto data = cache->data.lockExclusive();
-  KJ_IF_SOME(existingValue, cache->getWhileLocked(*data, key)) {
-    return kj::mv(existingValue);
-  } else KJ_IF_SOME(existingInProgress, data->inProgress.find(key)) {
+kj::OneOf<kj::Own<CacheValue>,
+    SharedMemoryCache::Use::StaleValue,
+    kj::Promise<SharedMemoryCache::Use::GetWithFallbackOutcome>>
+SharedMemoryCache::Use::getWithFallback(const kj::String& key, double staleWhileRevalidate) const {
+  auto shard = cache->lockShard(key);
+  KJ_IF_SOME(lookup, cache->getWhileLocked(*shard, key, staleWhileRevalidate)) {
+    if (!lookup.isStale) {
+      return kj::mv(lookup.value);
+    }
+    // Serve the stale value right away. Only one read gets to refresh it; while
+    // that refresh is in progress, others just keep getting the stale value.
+    if (shard->inProgress.find(key) != kj::none) {
+      return StaleValue{kj::mv(lookup.value), kj::none};
+    }
+    auto& newEntry = shard->inProgress.insert(kj::heap<InProgress>(kj::str(key)));
+    return StaleValue{kj::mv(lookup.value), prepareFallback(*newEntry)};
+  } else KJ_IF_SOME(existingInProgress, shard->inProgress.find(key)) {
     // We return a Promise, but we keep the fulfiller. We might fulfill it
     // from a different thread, so we need a cross-thread fulfiller here.
     auto pair = kj::newPromiseAndCrossThreadFulfiller<GetWithFallbackOutcome>();
@@ -262,7 +372,7 @@ SharedMemoryCache::Use::getWithFallback(const kj::String& key) const {
     // here, either with the produced value or with another fallback task.
     return pair.promise.attach(IoContext::current().registerPendingEvent());
   } else {
-    auto& newEntry = data->inProgress.insert(kj::heap<InProgress>(kj::str(key)));
+    auto& newEntry = shard->inProgress.insert(kj::heap<InProgress>(kj::str(key)));
     auto inProgress = newEntry.get();
     return kj::Promise<GetWithFallbackOutcome>(prepareFallback(*inProgress));
   }
@@ -293,13 +403,13 @@ SharedMemoryCache::Use::FallbackDoneCallback SharedMemoryCache::Use::prepareFall
       // The fallback succeeded. Store the value in the cache and propagate it to
       // all waiting requests, even if it has expired already.
       status.hasSettled = true;
-      auto data = cache->data.lockExclusive();
+      auto shard = cache->lockShard(inProgress.key);
       cache->putWhileLocked(
-          *data, kj::str(inProgress.key), kj::atomicAddRef(*result.value), result.expiration);
+          *shard, kj::str(inProgress.key), kj::atomicAddRef(*result.value), result.expiration);
       for (auto& waiter: inProgress.waiting) {
         waiter.fulfiller->fulfill(kj::atomicAddRef(*result.value));
       }
-      data->inProgress.eraseMatch(inProgress.key);
+      shard->inProgress.eraseMatch(inProgress.key);
     } else {
       // The fallback failed for some reason. We do not care much about why it
       // failed. If there are other queued fallbacks, handelFallbackFailure will
@@ -316,14 +426,14 @@ void SharedMemoryCache::Use::handleFallbackFailure(InProgress& inProgress) const
   // If there is another queued fallback, retrieve it and remove it from the
   // queue. Otherwise, just delete the queue entirely.
   {
-    auto data = cache->data.lockExclusive();
+    auto shard = cache->lockShard(inProgress.key);
     auto next = inProgress.waiting.begin();
     if (next != inProgress.waiting.end()) {
       nextFulfiller = kj::mv(next->fulfiller);
       inProgress.waiting.erase(next);
     } else {
       // Queue is empty, erase it.
-      data->inProgress.eraseMatch(inProgress.key);
+      shard->inProgress.eraseMatch(inProgress.key);
     }
   }
 
@@ -365,55 +475,117 @@ static kj::Own<CacheValue> hackySerialize(jsg::Lock& js, jsg::JsRef<jsg::JsValue
   });
 }
 
+// Resolves to the deserialized value, or rejects with the deserialized error if
+// the value is a negatively cached failure.
+static jsg::Promise<jsg::JsRef<jsg::JsValue>> deserializeResult(
+    jsg::Lock& js, const CacheValue& value) {
+  jsg::Deserializer deserializer(js, value.bytes.asPtr());
+  auto result = deserializer.readValue(js);
+  if (value.isFailure) {
+    return js.rejectedPromise<jsg::JsRef<jsg::JsValue>>(result);
+  }
+  return js.resolvedPromise(jsg::JsRef(js, result));
+}
+
+jsg::Promise<jsg::JsRef<jsg::JsValue>> MemoryCache::runFallback(jsg::Lock& js,
+    FallbackFunction& fallback,
+    kj::String key,
+    SharedMemoryCache::Use::FallbackDoneCallback callback,
+    kj::Maybe<double> negativeCacheTtl) {
+  auto& context = IoContext::current();
+  auto heapCallback = kj::heap(kj::mv(callback));
+
+  return js.evalNow([&]() { return fallback(js, kj::mv(key)); })
+      .then(js,
+          [callback = context.addObject(*heapCallback)](jsg::Lock& js,
+              CacheValueProduceResult result) mutable -> jsg::JsRef<jsg::JsValue> {
+    // NOTE: `callback` is IoPtr, not IoOwn. The catch block gets the IoOwn, which
+    //   ensures the object still exists at this point.
+    auto serialized = hackySerialize(js, result.value);
+    KJ_IF_SOME(expiration, result.expiration) {
+      JSG_REQUIRE(
+          !kj::isNaN(expiration), TypeError, "Expiration time must not be NaN.");
+    }
+    (*callback)(SharedMemoryCache::Use::FallbackResult{
+      kj::mv(serialized), result.expiration});
+    return kj::mv(result.value);
+  })
+      .catch_(js,
+          [callback = context.addObject(kj::mv(heapCallback)), negativeCacheTtl](jsg::Lock& js,
+              jsg::Value&& exception) mutable -> jsg::JsRef<jsg::JsValue> {
+    KJ_IF_SOME(ttl, negativeCacheTtl) {
+      // Cache the failure, so that reads within the TTL reject with the same
+      // error. If the error cannot be serialized, it is simply not cached.
+      jsg::JsRef<jsg::JsValue> error(js, jsg::JsValue(exception.getHandle(js)));
+      kj::Own<CacheValue> serialized;
+      auto serializeError = kj::runCatchingExceptions([&]() {
+        serialized = hackySerialize(js, error);
+      });
+      if (serializeError == kj::none) {
+        (*callback)(SharedMemoryCache::Use::FallbackResult{
+          kj::atomicRefcounted<CacheValue>(kj::mv(serialized->bytes), true), dateNow() + ttl});
+        js.throwException(kj::mv(exception));
+      }
+    }
+    (*callback)(kj::none);
+    js.throwException(kj::mv(exception));
+  });
+}
+
 jsg::Promise<jsg::JsRef<jsg::JsValue>> MemoryCache::read(jsg::Lock& js,
     jsg::NonCoercible<kj::String> key,
-    jsg::Optional<FallbackFunction> optionalFallback) {
+    jsg::Optional<FallbackFunction> optionalFallback,
+    jsg::Optional<MemoryCacheReadOptions> options) {
   if (key.value.size() > MAX_KEY_SIZE) {
     return js.rejectedPromise<jsg::JsRef<jsg::JsValue>>(js.rangeError("Key too large."_kj));
   }
 
+  double staleWhileRevalidate = 0;
+  kj::Maybe<double> negativeCacheTtl;
+  KJ_IF_SOME(o, options) {
+    KJ_IF_SOME(swr, o.staleWhileRevalidate) {
+      JSG_REQUIRE(!kj::isNaN(swr) && swr >= 0, RangeError,
+          "staleWhileRevalidate must be a non-negative number.");
+      staleWhileRevalidate = swr;
+    }
+    KJ_IF_SOME(ttl, o.negativeCacheTtl) {
+      JSG_REQUIRE(!kj::isNaN(ttl) && ttl >= 0, RangeError,
+          "negativeCacheTtl must be a non-negative number.");
+      if (ttl > 0) {
+        negativeCacheTtl = ttl;
+      }
+    }
+  }
+
   KJ_IF_SOME(fallback, optionalFallback) {
-    KJ_SWITCH_ONEOF(cacheUse.getWithFallback(key.value)) {
+    KJ_SWITCH_ONEOF(cacheUse.getWithFallback(key.value, staleWhileRevalidate)) {
       KJ_CASE_ONEOF(result, kj::Own<CacheValue>) {
         // Optimization: Don't even release the isolate lock if the value is aleady in cache.
-        jsg::Deserializer deserializer(js, result->bytes.asPtr());
-        return js.resolvedPromise(jsg::JsRef(js, deserializer.readValue(js)));
+        return deserializeResult(js, *result);
+      }
+      KJ_CASE_ONEOF(stale, SharedMemoryCache::Use::StaleValue) {
+        KJ_IF_SOME(refresh, stale.refresh) {
+          // Refresh the value in the background. Whether that succeeds or not,
+          // this read resolves to the stale value.
+          auto& context = IoContext::current();
+          auto promise = runFallback(js, fallback, kj::str(key.value), kj::mv(refresh), kj::none)
+              .then(js, [](jsg::Lock&, jsg::JsRef<jsg::JsValue>) {},
+                  [](jsg::Lock&, jsg::Value&&) {});
+          context.addWaitUntil(context.awaitJs(js, kj::mv(promise)));
+        }
+        return deserializeResult(js, *stale.value);
       }
       KJ_CASE_ONEOF(promise, kj::Promise<SharedMemoryCache::Use::GetWithFallbackOutcome>) {
         return IoContext::current().awaitIo(js, kj::mv(promise),
-            [fallback = kj::mv(fallback), key = kj::str(key.value)](
+            [fallback = kj::mv(fallback), key = kj::str(key.value), negativeCacheTtl](
                 jsg::Lock& js, SharedMemoryCache::Use::GetWithFallbackOutcome cacheResult) mutable
             -> jsg::Promise<jsg::JsRef<jsg::JsValue>> {
           KJ_SWITCH_ONEOF(cacheResult) {
             KJ_CASE_ONEOF(serialized, kj::Own<CacheValue>) {
-              jsg::Deserializer deserializer(js, serialized->bytes.asPtr());
-              return js.resolvedPromise(jsg::JsRef(js, deserializer.readValue(js)));
+              return deserializeResult(js, *serialized);
             }
             KJ_CASE_ONEOF(callback, SharedMemoryCache::Use::FallbackDoneCallback) {
-              auto& context = IoContext::current();
-              auto heapCallback = kj::heap(kj::mv(callback));
-
-              return js.evalNow([&]() { return fallback(js, kj::mv(key)); })
-                  .then(js,
-                      [callback = context.addObject(*heapCallback)](jsg::Lock& js,
-                          CacheValueProduceResult result) mutable -> jsg::JsRef<jsg::JsValue> {
-                // NOTE: `callback` is IoPtr, not IoOwn. The catch block gets the IoOwn, which
-                //   ensures the object still exists at this point.
-                auto serialized = hackySerialize(js, result.value);
-                KJ_IF_SOME(expiration, result.expiration) {
-                  JSG_REQUIRE(
-                      !kj::isNaN(expiration), TypeError, "Expiration time must not be NaN.");
-                }
-                (*callback)(SharedMemoryCache::Use::FallbackResult{
-                  kj::mv(serialized), result.expiration});
-                return kj::mv(result.value);
-              })
-                  .catch_(js,
-                      [callback = context.addObject(kj::mv(heapCallback))](jsg::Lock& js,
-                          jsg::Value&& exception) mutable -> jsg::JsRef<jsg::JsValue> {
-                (*callback)(kj::none);
-                js.throwException(kj::mv(exception));
-              });
+              return runFallback(js, fallback, kj::mv(key), kj::mv(callback), negativeCacheTtl);
             }
           }
           KJ_UNREACHABLE;
@@ -423,8 +595,7 @@ jsg::Promise<jsg::JsRef<jsg::JsValue>> MemoryCache::read(jsg::Lock& js,
     KJ_UNREACHABLE;
   } else {
     KJ_IF_SOME(cacheValue, cacheUse.getWithoutFallback(key.value)) {
-      jsg::Deserializer deserializer(js, cacheValue->bytes.asPtr());
-      return js.resolvedPromise(jsg::JsRef(js, deserializer.readValue(js)));
+      return deserializeResult(js, *cacheValue);
     }
     return js.resolvedPromise(jsg::JsRef(js, js.undefined()));
   }
@@ -7,6 +7,7 @@
 #include <kj/map.h>
 #include <kj/mutex.h>
 #include <kj/table.h>
+#include <atomic>
 #include <set>
 
 namespace workerd::api {
@@ -32,9 +33,15 @@ namespace workerd::api {
 // explicitly not supported.
 
 struct CacheValue: kj::AtomicRefcounted {
-  CacheValue(kj::Array<kj::byte>&& bytes): bytes(kj::mv(bytes)) {}
+  CacheValue(kj::Array<kj::byte>&& bytes, bool isFailure = false)
+      : bytes(kj::mv(bytes)), isFailure(isFailure) {}
 
   kj::Array<kj::byte> bytes;
+
+  // If true, this is a negatively cached fallback failure and `bytes` holds the
+  // serialized error, which reads with a fallback reject with. Reads without a
+  // fallback treat the key as absent.
+  bool isFailure;
 };
 
 struct MemoryCacheEntry {
@@ -42,7 +49,8 @@ struct MemoryCacheEntry {
   kj::String key;
 
   // Whenever an entry is created, updated, or retrieved, its liveliness is
-  // set to the value of a monotonically increasing counter.
+  // set to the value of a monotonically increasing counter. The counter is
+  // shared by all shards of the cache, so liveliness is unique cache-wide.
   uint64_t liveliness;
   // TODO(cleanup): The liveliness index accomplishes the same thing as
   //   kj::InsertionOrderIndex.
@@ -75,10 +83,32 @@ struct CacheValueProduceResult {
   JSG_STRUCT(value, expiration);
 };
 
+struct MemoryCacheReadOptions {
+  // For how many milliseconds past its expiration a value may still be returned.
+  // A read that finds such a stale value resolves to it immediately, and if no
+  // other fallback is running for the key, invokes the fallback in the
+  // background to refresh it.
+  jsg::Optional<double> staleWhileRevalidate;
+
+  // If set, a fallback that throws or rejects is cached as a failure for this
+  // many milliseconds: until then, reads with a fallback reject with the same
+  // error instead of invoking their fallback again. Failures of background
+  // refreshes are not cached, so that the stale value remains available.
+  jsg::Optional<double> negativeCacheTtl;
+
+  JSG_STRUCT(staleWhileRevalidate, negativeCacheTtl);
+};
+
 class MemoryCacheProvider;
 
 // An in-memory cache that can be accessed by any number of workers/isolates
 // within the same process.
+//
+// To keep isolates on different threads from serializing on a single lock, the
+// entries are split by key hash into a power-of-two number of shards, each
+// with its own lock, LRU order and share of the limits. Small caches use fewer
+// shards (down to one), since splitting a small budget would change which
+// entries get evicted too much.
 // TODO(soon): We plan to explore replacing this implementation with a memcached-based
 // implementation in the near future. The memcached-based impl would likely be
 // fairly different from this implementation so quite a few of the details here
@@ -86,6 +116,7 @@ class MemoryCacheProvider;
 class SharedMemoryCache : public kj::AtomicRefcounted {
 private:
   struct InProgress;
+  struct Shard;
 
 public:
   struct ThreadUnsafeData;
@@ -180,13 +211,23 @@ public:
     typedef kj::Function<void(kj::Maybe<FallbackResult>)> FallbackDoneCallback;
     using GetWithFallbackOutcome = kj::OneOf<kj::Own<CacheValue>, FallbackDoneCallback>;
 
+    // An expired value that is still within its stale-while-revalidate window.
+    // If `refresh` is set, this read is responsible for refreshing the value in
+    // the background, just like with any other FallbackDoneCallback.
+    struct StaleValue {
+      kj::Own<CacheValue> value;
+      kj::Maybe<FallbackDoneCallback> refresh;
+    };
+
     // Returns either:
     // 1. The immediate value, if already in cache.
-    // 2. A Promise that will eventually resolve either to the cached value
+    // 2. A stale value, if the value has expired less than staleWhileRevalidate
+    //    milliseconds ago.
+    // 3. A Promise that will eventually resolve either to the cached value
     //    or to a FallbackDoneCallback. In the latter case, the caller should
     //    invoke the fallback function.
-    kj::OneOf<kj::Own<CacheValue>, kj::Promise<GetWithFallbackOutcome>> getWithFallback(
-        const kj::String& key) const;
+    kj::OneOf<kj::Own<CacheValue>, StaleValue, kj::Promise<GetWithFallbackOutcome>>
+        getWithFallback(const kj::String& key, double staleWhileRevalidate = 0) const;
 
   private:
     // Creates a new FallbackDoneCallback associated with the given
@@ -254,30 +295,49 @@ private:
   // Used internally by suggest() and unsuggest() to dynamically resize the
   // cache as appropriate. This function also recomputed the effective cache
   // limits and thus must be called even when the cache size is increased (which
-  // does not change the cache contents).
+  // does not change the cache contents). Locks every shard, and may change the
+  // number of shards in use.
   void resize(ThreadUnsafeData& data) const;
 
-  // Returns a cached value while the cache's data is already locked by the
+  // Locks the shard that the given key belongs to.
+  kj::Locked<Shard> lockShard(kj::StringPtr key) const;
+
+  struct Lookup {
+    kj::Own<CacheValue> value;
+
+    // True if the value has expired but is within the requested
+    // stale-while-revalidate window.
+    bool isStale;
+  };
+
+  // Returns a cached value while the key's shard is already locked by the
   // calling thread. If such a cache entry exists, it will be marked as the
-  // most recently used entry.
-  kj::Maybe<kj::Own<CacheValue>> getWhileLocked(
-      ThreadUnsafeData& data, const kj::String& key) const;
+  // most recently used entry. Expired values are removed, unless they expired
+  // less than staleWhileRevalidate milliseconds ago (and are not failures).
+  kj::Maybe<Lookup> getWhileLocked(
+      Shard& shard, const kj::String& key, double staleWhileRevalidate = 0) const;
 
   // Stores a value in the cache, with an optional expiration timestamp. It is
   // marked as the most recently used entry.
-  void putWhileLocked(ThreadUnsafeData& data,
+  void putWhileLocked(Shard& shard,
       const kj::String& key,
       kj::Own<CacheValue>&& value,
       kj::Maybe<double> expiration) const;
 
-  // Evicts at least one cache entry. The cache's data must already be locked by
-  // the calling thread, and the cache must not be empty. Expiration timestamps
-  // are only considered if called from within an I/O context or if
-  // allowOutsideIoContext is true.
-  void evictNextWhileLocked(ThreadUnsafeData& data, bool allowOutsideIoContext = false) const;
+  // Evicts at least one cache entry. The shard must already be locked by the
+  // calling thread, and must not be empty. Expiration timestamps are only
+  // considered if called from within an I/O context or if allowOutsideIoContext
+  // is true.
+  void evictNextWhileLocked(Shard& shard, bool allowOutsideIoContext = false) const;
 
   // Removes the cache entry with the given key, if it exists.
-  void removeIfExistsWhileLocked(ThreadUnsafeData& data, const kj::String& key) const;
+  void removeIfExistsWhileLocked(Shard& shard, const kj::String& key) const;
+
+  // Returns the next liveliness and increments it so that the next call to
+  // this function will return a different value.
+  uint64_t stepLiveliness() const {
+    return nextLiveliness.fetch_add(1, std::memory_order_relaxed);
+  }
 
   // Callbacks for a HashIndex that allow locating cache entries based on the
   // cache key, which is a string. This is used for all key-based cache
@@ -390,17 +450,24 @@ public:
     // The computed effective limits. These are updated whenever new isolates
     // are attached to this cache.
     Limits effectiveLimits = Limits::min();
+  };
+
+  // The maximum number of shards, and the minimum number of keys each shard
+  // must be able to hold for the cache to be split further.
+  static constexpr uint MAX_SHARDS = 16;
+  static constexpr uint MIN_KEYS_PER_SHARD = 256;
+
+private:
+  struct Shard {
+    KJ_DISALLOW_COPY_AND_MOVE(Shard);
 
-    // Returns the next liveliness and increments it so that the next call to
-    // this function will return a different value.
-    inline uint64_t stepLiveliness() { return nextLiveliness++; }
+    Shard() {}
 
-    // We do not handle integer overflow, but a 64-bit counter should never wrap
-    // around, at least not in the foreseeable future. (Even at a billion cache
-    // operations per second, it would take almost 600 years.)
-    uint64_t nextLiveliness = 0;
+    // This shard's share of the effective limits. The maximum value size is
+    // not divided.
+    Limits limits = Limits::min();
 
-    // The sum of the sizes of all values that are currently stored in the cache.
+    // The sum of the sizes of all values that are currently stored in the shard.
     // This is technically redundant information, but more efficient than
     // iterating over all cache entries every time we need this information.
     size_t totalValueSize = 0;
@@ -423,12 +490,25 @@ public:
     kj::Table<kj::Own<InProgress>, kj::HashIndex<InProgress::KeyCallbacks>> inProgress;
   };
 
-private:
-
-  // To ensure thread-safety, all mutable data is guarded by a mutex. Each cache
-  // operation requires an exclusive lock. Even read-only operations need to
-  // update the liveliness of cache entries, which currently requires a lock.
+  // To ensure thread-safety, all mutable data is guarded by mutexes. `data`
+  // holds the limits, and is only locked when isolates attach or detach. Each
+  // cache operation requires an exclusive lock on the key's shard. Even
+  // read-only operations need to update the liveliness of cache entries, which
+  // currently requires a lock.
+  //
+  // When both are needed, `data` is locked first, then shards in index order.
   kj::MutexGuarded<ThreadUnsafeData> data;
+  kj::MutexGuarded<Shard> shards[MAX_SHARDS];
+
+  // The number of shards in use, always a power of two. Keys map to shards by
+  // the low bits of their hash. Only changes while every shard is locked, so
+  // it can be read reliably by anyone holding one shard's lock.
+  mutable std::atomic<uint> shardCount = 1;
+
+  // We do not handle integer overflow, but a 64-bit counter should never wrap
+  // around, at least not in the foreseeable future. (Even at a billion cache
+  // operations per second, it would take almost 600 years.)
+  mutable std::atomic<uint64_t> nextLiveliness = 0;
 
   // The MemoryCacheProvider instance needs to be guaranteed to outlive the SharedMemoryCache
   // instance. When the SharedMemoryCache is destroyed, it will remove itself from the provider.
@@ -458,15 +538,25 @@ public:
   using FallbackFunction = jsg::Function<jsg::Promise<CacheValueProduceResult>(kj::String)>;
 
   // Reads a value from the cache or invokes a fallback function to obtain the
-  // value, if a fallback function was given.
+  // value, if a fallback function was given. The options only apply to reads
+  // with a fallback.
   jsg::Promise<jsg::JsRef<jsg::JsValue>> read(jsg::Lock& js,
       jsg::NonCoercible<kj::String> key,
-      jsg::Optional<FallbackFunction> optionalFallback);
+      jsg::Optional<FallbackFunction> optionalFallback,
+      jsg::Optional<MemoryCacheReadOptions> options);
 
   JSG_RESOURCE_TYPE(MemoryCache) { JSG_METHOD(read); }
 
 private:
   SharedMemoryCache::Use cacheUse;
+
+  // Invokes the fallback and passes its result (or failure) to the callback.
+  // If negativeCacheTtl is set, failures are passed on as failure values.
+  static jsg::Promise<jsg::JsRef<jsg::JsValue>> runFallback(jsg::Lock& js,
+      FallbackFunction& fallback,
+      kj::String key,
+      SharedMemoryCache::Use::FallbackDoneCallback callback,
+      kj::Maybe<double> negativeCacheTtl);
 };
 
 // The MemoryCacheProvider provides the internal implementation of the MemoryCache mechanism.
@@ -504,7 +594,8 @@ private:
 // clang-format off
 #define EW_MEMORY_CACHE_ISOLATE_TYPES                                                   \
   api::MemoryCache,                                                                     \
-  api::CacheValueProduceResult
+  api::CacheValueProduceResult,                                                         \
+  api::MemoryCacheReadOptions
 // clang-format on
 
 }  // namespace workerd::api
@@ -711,6 +711,30 @@ async function test(storage) {
     const execIterator = sql.exec(`SELECT * FROM abc, cde`)
     assert.deepEqual(execIterator.columnNames, ['a', 'b', 'c', 'c', 'd', 'e'])
     assert.equal(Array.from(execIterator.raw())[0].length, 6)
+
+    // toArray() returns the same rows as iteration
+    assert.deepEqual(stmt().toArray(), objResults)
+    assert.deepEqual(sql.exec(`SELECT * FROM abc, cde`).toArray(), objResults)
+
+    // ...including only the ones not yet consumed, after which the cursor is done
+    const partial = stmt()
+    assert.deepEqual(partial[Symbol.iterator]().next().value, objResults[0])
+    assert.deepEqual(partial.toArray(), objResults.slice(1))
+    assert.deepEqual(partial.toArray(), [])
+    assert.deepEqual(partial.rowsRead, 4)
+    assert.throws(() => {
+      partial.columnNames
+    }, 'Error: Cannot call .getColumnNames after Cursor iterator has been consumed.')
+  }
+
+  // toArray() converts values like iteration does
+  {
+    const query = `SELECT 1 AS i, 2.5 AS d, 'text' AS t, x'0102' AS b, NULL AS n`
+    const rows = sql.exec(query).toArray()
+    assert.deepEqual(rows, [...sql.exec(query)])
+    assert.ok(rows[0].b instanceof ArrayBuffer)
+    assert.deepEqual(new Uint8Array(rows[0].b), new Uint8Array([1, 2]))
+    assert.strictEqual(rows[0].n, null)
   }
 
   await scheduler.wait(1)
@@ -949,6 +973,53 @@ async function testIoStats(storage) {
   }
 }
 
+async function testStatementCache(storage) {
+  const sql = storage.sql
+
+  sql.exec('CREATE TABLE cached (id INTEGER PRIMARY KEY, value TEXT)')
+
+  // The same SQL run repeatedly reuses one prepared statement. Writes report their stats even
+  // though the statement is reused before the cursor is looked at.
+  const inserts = []
+  for (let i = 0; i < 5; i++) {
+    inserts.push(sql.exec('INSERT INTO cached VALUES (?, ?)', i, `value ${i}`))
+  }
+  for (const cursor of inserts) {
+    assert.equal(cursor.rowsWritten, 1)
+    assert.deepEqual(cursor.columnNames, [])
+    assert.deepEqual([...cursor], [])
+  }
+
+  // A cursor that hasn't been consumed yet isn't disturbed by running the same SQL again.
+  const select = 'SELECT id FROM cached ORDER BY id'
+  const first = sql.exec(select)
+  const second = sql.exec(select)
+  assert.deepEqual(
+    [...second].map((row) => row.id),
+    [0, 1, 2, 3, 4]
+  )
+  assert.deepEqual(
+    [...first].map((row) => row.id),
+    [0, 1, 2, 3, 4]
+  )
+
+  // Cached statements follow schema changes.
+  const selectAll = 'SELECT * FROM cached WHERE id = ?'
+  assert.deepEqual([...sql.exec(selectAll, 1)], [{ id: 1, value: 'value 1' }])
+  sql.exec('ALTER TABLE cached ADD COLUMN extra INTEGER DEFAULT 7')
+  assert.deepEqual(
+    [...sql.exec(selectAll, 1)],
+    [{ id: 1, value: 'value 1', extra: 7 }]
+  )
+  sql.exec('DROP TABLE cached')
+  assert.throws(() => sql.exec(selectAll, 1), /no such table: cached/)
+
+  // Multiple statements still work, repeatedly.
+  for (let i = 0; i < 2; i++) {
+    assert.deepEqual([...sql.exec('SELECT 1; SELECT 2 AS two')], [{ two: 2 }])
+  }
+}
+
 async function testForeignKeys(storage) {
   const sql = storage.sql
 
@@ -1050,6 +1121,102 @@ async function testStreamingIngestion(request, storage) {
   )
 }
 
+async function testDump(storage) {
+  const sql = storage.sql
+
+  sql.exec(
+    `CREATE TABLE people (id INTEGER PRIMARY KEY, name TEXT, score REAL, avatar BLOB)`
+  )
+  sql.exec(`CREATE INDEX people_by_name ON people (name)`)
+  sql.exec(`CREATE VIEW high_scores AS SELECT name FROM people WHERE score > 50`)
+  sql.exec(
+    `CREATE TABLE "odd ""name""" (value, doubled AS (value || value) STORED)`
+  )
+  for (let i = 0; i < 1000; i++) {
+    sql.exec(
+      `INSERT INTO people VALUES (?, ?, ?, ?)`,
+      i,
+      `person '${i}'`,
+      i / 10,
+      new Uint8Array([i & 0xff, 0])
+    )
+  }
+  sql.exec(`INSERT INTO "odd ""name""" VALUES (1), (2.0), ('three'), (NULL)`)
+
+  // The AUTOINCREMENT counter is ahead of the rows that are left.
+  sql.exec(`CREATE TABLE tickets (id INTEGER PRIMARY KEY AUTOINCREMENT, what TEXT)`)
+  sql.exec(`INSERT INTO tickets (what) VALUES ('a'), ('b'), ('c')`)
+  sql.exec(`DELETE FROM tickets WHERE what != 'a'`)
+
+  // KV storage isn't part of the dump.
+  await storage.put('kv-key', 'not dumped')
+
+  return new Response(sql.dump())
+}
+
+async function testIngestStream(request, storage) {
+  const sql = storage.sql
+
+  await sql.ingestStream(request.body)
+
+  assert.deepEqual(
+    [...sql.exec(`SELECT count(*) AS n, sum(id) AS s FROM people`)],
+    [{ n: 1000, s: 499500 }]
+  )
+  const row = sql
+    .exec(
+      `SELECT * FROM people INDEXED BY people_by_name WHERE name = ?`,
+      `person '7'`
+    )
+    .toArray()[0]
+  assert.equal(row.id, 7)
+  assert.equal(row.score, 0.7)
+  assert.deepEqual(new Uint8Array(row.avatar), new Uint8Array([7, 0]))
+  assert.equal([...sql.exec(`SELECT * FROM high_scores`)].length, 499)
+  assert.deepEqual(
+    [
+      ...sql.exec(
+        `SELECT value, typeof(value) AS type, doubled FROM "odd ""name"""`
+      ),
+    ],
+    [
+      { value: 1, type: 'integer', doubled: '11' },
+      { value: 2, type: 'real', doubled: '2.02.0' },
+      { value: 'three', type: 'text', doubled: 'threethree' },
+      { value: null, type: 'null', doubled: null },
+    ]
+  )
+  assert.equal(await storage.get('kv-key'), undefined)
+
+  // New rows don't reuse the IDs of rows deleted before the dump.
+  sql.exec(`INSERT INTO tickets (what) VALUES ('d')`)
+  assert.deepEqual(
+    [...sql.exec(`SELECT id, what FROM tickets ORDER BY id`)],
+    [
+      { id: 1, what: 'a' },
+      { id: 4, what: 'd' },
+    ]
+  )
+
+  // A stream that stops mid-statement fails, after running the statements before it.
+  await assert.rejects(
+    sql.ingestStream(
+      new Blob([`CREATE TABLE partial (x); INSERT INTO partial VALUES (`]).stream()
+    ),
+    /SQL stream ended in the middle of a statement/
+  )
+  assert.deepEqual([...sql.exec(`SELECT count(*) AS n FROM partial`)], [{ n: 0 }])
+
+  // A dump that ends in a comment with no final newline is complete.
+  await sql.ingestStream(
+    new Blob([
+      `CREATE TABLE trailing (x); INSERT INTO trailing VALUES (1);\n`,
+      `/* block */ -- line comment`,
+    ]).stream()
+  )
+  assert.deepEqual([...sql.exec(`SELECT x FROM trailing`)], [{ x: 1 }])
+}
+
 export class DurableObjectExample {
   constructor(state, env) {
     this.state = state
@@ -1076,12 +1243,20 @@ export class DurableObjectExample {
 
       // abort() always throws.
       throw new Error("can't get here")
+    } else if (req.url.endsWith('/sql-test-statement-cache')) {
+      await testStatementCache(this.state.storage)
+      return Response.json({ ok: true })
     } else if (req.url.endsWith('/sql-test-io-stats')) {
       await testIoStats(this.state.storage)
       return Response.json({ ok: true })
     } else if (req.url.endsWith('/streaming-ingestion')) {
       await testStreamingIngestion(req, this.state.storage)
       return Response.json({ ok: true })
+    } else if (req.url.endsWith('/sql-test-dump')) {
+      return await testDump(this.state.storage)
+    } else if (req.url.endsWith('/sql-test-ingest-stream')) {
+      await testIngestStream(req, this.state.storage)
+      return Response.json({ ok: true })
     }
 
     throw new Error('unknown url: ' + req.url)
@@ -1105,6 +1280,9 @@ export default {
     // Test SQL IO stats
     assert.deepEqual(await doReq('sql-test-io-stats'), { ok: true })
 
+    // Test reuse of statements prepared by exec()
+    assert.deepEqual(await doReq('sql-test-statement-cache'), { ok: true })
+
     // Test SQL streaming ingestion
     assert.deepEqual(
       await doReq('streaming-ingestion', {
@@ -1134,6 +1312,18 @@ export default {
       { ok: true }
     )
 
+    // Test copying a database by streaming a dump of it into another one
+    {
+      const source = env.ns.get(env.ns.idFromName('dump-source'))
+      const destination = env.ns.get(env.ns.idFromName('dump-destination'))
+      const dump = await source.fetch('http://foo/sql-test-dump')
+      const resp = await destination.fetch('http://foo/sql-test-ingest-stream', {
+        method: 'POST',
+        body: dump.body,
+      })
+      assert.deepEqual(await resp.json(), { ok: true })
+    }
+
     // Test defer_foreign_keys (explodes the DO)
     await assert.rejects(async () => {
       await doReq('sql-test-foreign-keys')
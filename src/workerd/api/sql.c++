@@ -4,19 +4,125 @@
 
 #include "sql.h"
 #include "actor-state.h"
+#include "streams.h"
 #include "workerd/io/io-context.h"
+#include <kj/encoding.h>
+#include <workerd/util/use-perfetto-categories.h>
 
 namespace workerd::api {
 
+class SqlStorage::StatementCache {
+public:
+  struct Entry {
+    kj::String sql;
+
+    // Null if the SQL contains multiple statements, which can't be prepared.
+    kj::Maybe<kj::Own<kj::RefcountedWrapper<SqliteDatabase::Statement>>> statement;
+
+    kj::ListLink<Entry> link;
+  };
+
+  ~StatementCache() noexcept(false) {
+    while (!lru.empty()) {
+      lru.remove(*lru.begin());
+    }
+  }
+
+  // Returns the entry for `sql`, marking it most recently used.
+  kj::Maybe<Entry&> find(kj::StringPtr sql) {
+    KJ_IF_SOME(entry, entries.find(sql)) {
+      lru.remove(*entry);
+      lru.add(*entry);
+      return *entry;
+    }
+    return kj::none;
+  }
+
+  Entry& add(kj::String sql,
+             kj::Maybe<kj::Own<kj::RefcountedWrapper<SqliteDatabase::Statement>>> statement) {
+    if (entries.size() >= MAX_CACHED_STATEMENTS) {
+      // Evict the least recently used. Cursors still using its statement keep it alive.
+      auto& oldest = *lru.begin();
+      lru.remove(oldest);
+      entries.erase(oldest.sql);
+    }
+
+    auto entry = kj::heap<Entry>();
+    entry->sql = kj::mv(sql);
+    entry->statement = kj::mv(statement);
+    auto& result = *entry;
+    lru.add(result);
+    entries.insert(result.sql, kj::mv(entry));
+    return result;
+  }
+
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+
+private:
+  kj::HashMap<kj::StringPtr, kj::Own<Entry>> entries;
+
+  // Least recently used first.
+  kj::List<Entry, &Entry::link> lru;
+};
+
 SqlStorage::SqlStorage(SqliteDatabase& sqlite, jsg::Ref<DurableObjectStorage> storage)
     : sqlite(IoContext::current().addObject(sqlite)), storage(kj::mv(storage)) {}
 
 SqlStorage::~SqlStorage() {}
 
+SqlStorage::StatementCache& SqlStorage::getStatementCache() {
+  KJ_IF_SOME(c, statementCache) {
+    return *c;
+  } else {
+    return *statementCache.emplace(IoContext::current().addObject(kj::heap<StatementCache>()));
+  }
+}
+
 jsg::Ref<SqlStorage::Cursor> SqlStorage::exec(jsg::Lock& js, kj::String querySql,
                                               jsg::Arguments<BindingValue> bindings) {
   SqliteDatabase::Regulator& regulator = *this;
-  return jsg::alloc<Cursor>(*sqlite, regulator, querySql, kj::mv(bindings));
+
+  if (querySql.size() > MAX_CACHED_SQL_LENGTH) {
+    return jsg::alloc<Cursor>(*sqlite, regulator, querySql, kj::mv(bindings));
+  }
+
+  auto& cache = getStatementCache();
+  kj::Maybe<kj::RefcountedWrapper<SqliteDatabase::Statement>&> statement;
+  KJ_IF_SOME(entry, cache.find(querySql)) {
+    KJ_IF_SOME(s, entry.statement) {
+      // A statement can only run one query at a time. If a cursor that hasn't finished still
+      // holds it, run this one without the cache.
+      if (!s->isShared()) {
+        ++cache.hits;
+        statement = *s;
+      } else {
+        ++cache.misses;
+      }
+    } else {
+      // Multiple statements, not cacheable.
+      ++cache.misses;
+    }
+  } else {
+    ++cache.misses;
+    auto& entry = cache.add(kj::str(querySql),
+        sqlite->tryPrepare(regulator, querySql).map([](SqliteDatabase::Statement&& s) {
+      return kj::refcountedWrapper<SqliteDatabase::Statement>(kj::mv(s));
+    }));
+    KJ_IF_SOME(s, entry.statement) {
+      statement = *s;
+    }
+  }
+  TRACE_COUNTER("workerd", "SqlStorage statement cache hits", cache.hits);
+  TRACE_COUNTER("workerd", "SqlStorage statement cache misses", cache.misses);
+
+  KJ_IF_SOME(s, statement) {
+    auto result = jsg::alloc<Cursor>(s, kj::mv(bindings));
+    result->releaseIfDone(js);
+    return result;
+  } else {
+    return jsg::alloc<Cursor>(*sqlite, regulator, querySql, kj::mv(bindings));
+  }
 }
 
 kj::String SqlStorage::ingest(jsg::Lock& js, kj::String querySql) {
@@ -24,6 +130,297 @@ kj::String SqlStorage::ingest(jsg::Lock& js, kj::String querySql) {
   return kj::str(sqlite->ingestSql(regulator, querySql));
 }
 
+class SqlStorage::IngestSink final: public WritableStreamSink {
+public:
+  explicit IngestSink(jsg::Ref<SqlStorage> storage)
+      : db(*storage->sqlite), storage(kj::mv(storage)) {}
+
+  kj::Promise<void> write(const void* buffer, size_t size) override {
+    ingest(kj::arrayPtr(reinterpret_cast<const char*>(buffer), size));
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> write(kj::ArrayPtr<const kj::ArrayPtr<const byte>> pieces) override {
+    for (auto piece: pieces) {
+      ingest(piece.asChars());
+    }
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> end() override {
+    pending.add('\0');
+    SqliteDatabase::Regulator& regulator = *storage;
+    bool complete =
+        db.finishIngestSql(regulator, kj::StringPtr(pending.begin(), pending.size() - 1));
+    pending.clear();
+    JSG_REQUIRE(complete, Error, "SQL stream ended in the middle of a statement.");
+    return kj::READY_NOW;
+  }
+
+  void abort(kj::Exception reason) override {
+    pending.clear();
+  }
+
+private:
+  SqliteDatabase& db;
+  jsg::Ref<SqlStorage> storage;
+
+  // The incomplete statement left over from previous chunks.
+  kj::Vector<char> pending;
+
+  void ingest(kj::ArrayPtr<const char> chunk) {
+    pending.addAll(chunk);
+    pending.add('\0');
+
+    SqliteDatabase::Regulator& regulator = *storage;
+    auto rest = db.ingestSql(regulator, kj::StringPtr(pending.begin(), pending.size() - 1));
+
+    // Keep what's left for the next chunk.
+    size_t restSize = rest.size();
+    memmove(pending.begin(), rest.begin(), restSize);
+    pending.truncate(restSize);
+
+    JSG_REQUIRE(pending.size() <= MAX_INGEST_STATEMENT_SIZE, Error,
+        "SQL statement in stream is too large.");
+  }
+};
+
+jsg::Promise<void> SqlStorage::ingestStream(jsg::Lock& js, jsg::Ref<ReadableStream> stream) {
+  // The sink runs each chunk's statements as the stream is pumped, outside of the isolate lock.
+  // ActorSqlite commits the writes made by each chunk as one implicit transaction.
+  auto& context = IoContext::current();
+  return context.awaitIo(js, context.waitForDeferredProxy(
+      stream->pumpTo(js, kj::heap<IngestSink>(JSG_THIS), true)));
+}
+
+namespace {
+
+kj::String quoteSqlIdentifier(kj::StringPtr name) {
+  kj::Vector<char> result(name.size() + 3);
+  result.add('"');
+  for (char c: name) {
+    if (c == '"') result.add('"');
+    result.add(c);
+  }
+  result.add('"');
+  result.add('\0');
+  return kj::String(result.releaseAsArray());
+}
+
+// Appends `value` to `out` as an SQL literal which evaluates to the same value and type.
+void appendSqlLiteral(kj::Vector<char>& out, SqliteDatabase::Query::ValuePtr value) {
+  KJ_SWITCH_ONEOF(value) {
+    KJ_CASE_ONEOF(data, kj::ArrayPtr<const byte>) {
+      out.addAll("X'"_kj);
+      out.addAll(kj::encodeHex(data));
+      out.add('\'');
+    }
+    KJ_CASE_ONEOF(text, kj::StringPtr) {
+      out.add('\'');
+      for (char c: text) {
+        if (c == '\'') out.add('\'');
+        out.add(c);
+      }
+      out.add('\'');
+    }
+    KJ_CASE_ONEOF(i, int64_t) {
+      out.addAll(kj::str(i));
+    }
+    KJ_CASE_ONEOF(d, double) {
+      if (kj::isNaN(d)) {
+        // SQLite stores NaN as NULL, so this shouldn't happen.
+        out.addAll("NULL"_kj);
+      } else if (d == kj::inf()) {
+        out.addAll("1e999"_kj);
+      } else if (d == -kj::inf()) {
+        out.addAll("-1e999"_kj);
+      } else {
+        auto text = kj::str(d);
+        out.addAll(text);
+        // Make sure the literal is read back as a REAL, not an INTEGER.
+        if (text.findFirst('.') == kj::none && text.findFirst('e') == kj::none) {
+          out.addAll(".0"_kj);
+        }
+      }
+    }
+    KJ_CASE_ONEOF(_, decltype(nullptr)) {
+      out.addAll("NULL"_kj);
+    }
+  }
+}
+
+}  // namespace
+
+// Generates the dump one statement at a time, as the stream is read. Tables are created and
+// filled in the order they were created, and indexes, views, and triggers are created after all
+// the data has been inserted.
+class SqlStorage::DumpSource final: public ReadableStreamSource {
+public:
+  explicit DumpSource(jsg::Ref<SqlStorage> storage)
+      : db(*storage->sqlite), storage(kj::mv(storage)) {}
+
+  kj::Promise<size_t> tryRead(void* buffer, size_t minBytes, size_t maxBytes) override {
+    // Drop what the last read consumed.
+    size_t available = pending.size() - pendingOffset;
+    memmove(pending.begin(), pending.begin() + pendingOffset, available);
+    pending.truncate(available);
+    pendingOffset = 0;
+
+    // Only generate about as much as was asked for, so that memory use doesn't depend on the
+    // size of the database.
+    while (pending.size() < maxBytes && !done) {
+      generate();
+    }
+
+    size_t amount = kj::min(maxBytes, pending.size());
+    memcpy(buffer, pending.begin(), amount);
+    pendingOffset = amount;
+    return amount;
+  }
+
+  void cancel(kj::Exception reason) override {
+    currentTable = kj::none;
+    done = true;
+  }
+
+private:
+  SqliteDatabase& db;
+  jsg::Ref<SqlStorage> storage;
+
+  struct TableDump {
+    // Prefix of the INSERT statement for each row, up to the opening parenthesis of the values.
+    kj::String insertPrefix;
+
+    SqliteDatabase::Query query;
+
+    TableDump(SqliteDatabase& db, kj::StringPtr selectSql, kj::String insertPrefix)
+        : insertPrefix(kj::mv(insertPrefix)),
+          query(db.run(SqliteDatabase::TRUSTED, selectSql)) {}
+  };
+
+  struct Table {
+    kj::String name;
+    kj::String sql;
+  };
+
+  bool started = false;
+  bool done = false;
+
+  kj::Vector<Table> tables;
+  size_t nextTable = 0;
+  kj::Maybe<kj::Own<TableDump>> currentTable;
+
+  // Whether sqlite_sequence exists, and its rows are still to be dumped.
+  bool needSequence = false;
+
+  // CREATE statements for everything other than tables.
+  kj::Vector<kj::String> others;
+  size_t nextOther = 0;
+
+  // Text generated but not yet read.
+  kj::Vector<char> pending;
+  size_t pendingOffset = 0;
+
+  // Appends the next statement to `pending`.
+  void generate() {
+    if (!started) {
+      loadSchema();
+      started = true;
+      return;
+    }
+
+    KJ_IF_SOME(table, currentTable) {
+      auto& query = table->query;
+      if (query.isDone()) {
+        currentTable = kj::none;
+      } else {
+        pending.addAll(table->insertPrefix);
+        for (auto i: kj::zeroTo(query.columnCount())) {
+          if (i > 0) pending.add(',');
+          appendSqlLiteral(pending, query.getValue(i));
+        }
+        pending.addAll(");\n"_kj);
+        query.nextRow();
+      }
+    } else if (nextTable < tables.size()) {
+      auto& table = tables[nextTable++];
+      pending.addAll(table.sql);
+      pending.addAll(";\n"_kj);
+      currentTable = startTable(table.name);
+    } else if (needSequence) {
+      // The rows inserted above only bring AUTOINCREMENT counters up to the largest rowid
+      // present. Set them to where they were, which may be higher if rows have been deleted.
+      needSequence = false;
+      for (auto query = db.run("SELECT name, seq FROM sqlite_sequence");
+           !query.isDone(); query.nextRow()) {
+        if (!storage->isAllowedName(query.getText(0))) continue;
+        pending.addAll("DELETE FROM sqlite_sequence WHERE name = "_kj);
+        appendSqlLiteral(pending, query.getValue(0));
+        pending.addAll(";\nINSERT INTO sqlite_sequence VALUES("_kj);
+        appendSqlLiteral(pending, query.getValue(0));
+        pending.add(',');
+        appendSqlLiteral(pending, query.getValue(1));
+        pending.addAll(");\n"_kj);
+      }
+    } else if (nextOther < others.size()) {
+      pending.addAll(others[nextOther++]);
+      pending.addAll(";\n"_kj);
+    } else {
+      done = true;
+    }
+  }
+
+  void loadSchema() {
+    // Shadow tables are created, and filled, along with their virtual tables.
+    kj::HashSet<kj::String> shadowTables;
+    for (auto query = db.run(
+            "SELECT name FROM pragma_table_list WHERE schema = 'main' AND type = 'shadow'");
+         !query.isDone(); query.nextRow()) {
+      shadowTables.insert(kj::str(query.getText(0)));
+    }
+
+    for (auto query = db.run(
+            "SELECT type, tbl_name, sql FROM sqlite_master WHERE sql IS NOT NULL ORDER BY rowid");
+         !query.isDone(); query.nextRow()) {
+      auto tableName = query.getText(1);
+      if (tableName == "sqlite_sequence") {
+        // Created along with the first AUTOINCREMENT table. Its rows are dumped after the tables.
+        needSequence = true;
+        continue;
+      }
+      if (tableName.startsWith("sqlite_") || !storage->isAllowedName(tableName) ||
+          shadowTables.contains(tableName)) {
+        continue;
+      }
+
+      if (query.getText(0) == "table") {
+        tables.add(Table { .name = kj::str(tableName), .sql = kj::str(query.getText(2)) });
+      } else {
+        others.add(kj::str(query.getText(2)));
+      }
+    }
+  }
+
+  kj::Own<TableDump> startTable(kj::StringPtr name) {
+    // Generated columns can't be inserted into, so name the ones that can.
+    kj::Vector<kj::String> columns;
+    for (auto query = db.run("SELECT name FROM pragma_table_xinfo(?) WHERE hidden = 0", name);
+         !query.isDone(); query.nextRow()) {
+      columns.add(quoteSqlIdentifier(query.getText(0)));
+    }
+    auto columnList = kj::strArray(columns, ",");
+    auto quotedName = quoteSqlIdentifier(name);
+
+    return kj::heap<TableDump>(db,
+        kj::str("SELECT ", columnList, " FROM ", quotedName),
+        kj::str("INSERT INTO ", quotedName, "(", columnList, ") VALUES("));
+  }
+};
+
+jsg::Ref<ReadableStream> SqlStorage::dump(jsg::Lock& js) {
+  return jsg::alloc<ReadableStream>(IoContext::current(), kj::heap<DumpSource>(JSG_THIS));
+}
+
 jsg::Ref<SqlStorage::Statement> SqlStorage::prepare(jsg::Lock& js, kj::String query) {
   return jsg::alloc<Statement>(sqlite->prepare(*this, query));
 }
@@ -140,6 +537,18 @@ jsg::Ref<SqlStorage::Cursor::RawIterator> SqlStorage::Cursor::raw(jsg::Lock&) {
   return jsg::alloc<RawIterator>(JSG_THIS);
 }
 
+void SqlStorage::Cursor::releaseIfDone(jsg::Lock& js) {
+  KJ_IF_SOME(s, state) {
+    if (s->query.isDone()) {
+      cachedColumnNames.ensureInitialized(js, s->query);
+      rowsRead = s->query.getRowsRead();
+      rowsWritten = s->query.getRowsWritten();
+      state = kj::none;
+      released = true;
+    }
+  }
+}
+
 // Returns the set of column names for the current Cursor. An exception will be thrown if the
 // iterator has already been fully consumed. The resulting columns may contain duplicate entries,
 // for instance a `SELECT *` across a join of two tables that share a column name.
@@ -149,11 +558,98 @@ kj::Array<jsg::JsRef<jsg::JsString>> SqlStorage::Cursor::getColumnNames(jsg::Loc
     return KJ_MAP(name, this->cachedColumnNames.get()) {
       return name.addRef(js);
     };
+  } else if (released) {
+    return KJ_MAP(name, this->cachedColumnNames.get()) {
+      return name.addRef(js);
+    };
   } else {
     JSG_FAIL_REQUIRE(Error, "Cannot call .getColumnNames after Cursor iterator has been consumed.");
   }
 }
 
+namespace {
+
+// Converts a value returned from SQL the same way JSG would convert the equivalent
+// Cursor::Value.
+jsg::JsValue valueToJs(jsg::Lock& js, SqliteDatabase::Query::ValuePtr value) {
+  KJ_SWITCH_ONEOF(value) {
+    KJ_CASE_ONEOF(data, kj::ArrayPtr<const byte>) {
+      return jsg::JsValue(js.arrayBuffer(kj::heapArray(data)).getHandle(js));
+    }
+    KJ_CASE_ONEOF(text, kj::StringPtr) {
+      return js.str(text);
+    }
+    KJ_CASE_ONEOF(i, int64_t) {
+      // Coerced to double, as in iteratorImpl().
+      return js.num(static_cast<double>(i));
+    }
+    KJ_CASE_ONEOF(d, double) {
+      return js.num(d);
+    }
+    KJ_CASE_ONEOF(_, decltype(nullptr)) {
+      return js.null();
+    }
+  }
+  KJ_UNREACHABLE;
+}
+
+}  // namespace
+
+jsg::JsArray SqlStorage::Cursor::toArray(jsg::Lock& js) {
+  auto array = v8::Array::New(js.v8Isolate);
+
+  KJ_IF_SOME(st, getRunningState()) {
+    auto& query = st.query;
+    cachedColumnNames.ensureInitialized(js, query);
+    auto names = cachedColumnNames.get();
+
+    if (st.isFirst) {
+      st.isFirst = false;
+    } else {
+      query.nextRow();
+    }
+
+    // Every row gets its properties set in the same order, so V8 gives all of them the hidden
+    // class it built for the first one. Rows are built in batches, each in its own HandleScope,
+    // so that the number of live handles doesn't grow with the size of the result.
+    static constexpr uint ROWS_PER_HANDLE_SCOPE = 256;
+    uint32_t index = 0;
+    while (!query.isDone()) {
+      js.withinHandleScope([&]() {
+        for (uint n = 0; n < ROWS_PER_HANDLE_SCOPE && !query.isDone(); n++) {
+          auto row = js.obj();
+          for (auto i: kj::zeroTo(names.size())) {
+            row.set(js, names[i].getHandle(js), valueToJs(js, query.getValue(i)));
+          }
+          jsg::check(array->Set(js.v8Context(), index++, row));
+          query.nextRow();
+        }
+      });
+    }
+
+    // Save off row counts before the query goes away.
+    rowsRead = query.getRowsRead();
+    rowsWritten = query.getRowsWritten();
+    state = kj::none;
+  }
+
+  return jsg::JsArray(array);
+}
+
+kj::Maybe<SqlStorage::Cursor::State&> SqlStorage::Cursor::getRunningState() {
+  KJ_IF_SOME(s, state) {
+    return *s;
+  } else if (canceled) {
+    JSG_FAIL_REQUIRE(Error,
+        "SQL cursor was closed because the same statement was executed again. If you need to "
+        "run multiple copies of the same statement concurrently, you must create multiple "
+        "prepared statement objects.");
+  } else {
+    // Query already done.
+    return kj::none;
+  }
+}
+
 kj::Maybe<kj::Array<SqlStorage::Cursor::Value>> SqlStorage::Cursor::rawIteratorNext(
     jsg::Lock& js, jsg::Ref<Cursor>& obj) {
   return iteratorImpl(js, obj,
@@ -168,17 +664,7 @@ auto SqlStorage::Cursor::iteratorImpl(jsg::Lock& js, jsg::Ref<Cursor>& obj, Func
         decltype(func(kj::instance<State&>(), uint(), kj::instance<Value&&>()))>> {
   using Element = decltype(func(kj::instance<State&>(), uint(), kj::instance<Value&&>()));
 
-  auto& state = *KJ_UNWRAP_OR(obj->state, {
-    if (obj->canceled) {
-      JSG_FAIL_REQUIRE(Error,
-          "SQL cursor was closed because the same statement was executed again. If you need to "
-          "run multiple copies of the same statement concurrently, you must create multiple "
-          "prepared statement objects.");
-    } else {
-      // Query already done.
-      return kj::none;
-    }
-  });
+  auto& state = KJ_UNWRAP_OR(obj->getRunningState(), return kj::none);
 
   if (state.isFirst) {
     // Little hack: We don't want to call query.nextRow() at the end of this method because it
@@ -293,6 +779,9 @@ void SqlStorage::visitForMemoryInfo(jsg::MemoryTracker& tracker) const {
     tracker.trackFieldWithSize("IoPtr<SqllitDatabase::Statement>",
         sizeof(IoPtr<SqliteDatabase::Statement>));
   }
+  if (statementCache != kj::none) {
+    tracker.trackFieldWithSize("IoOwn<StatementCache>", sizeof(IoOwn<StatementCache>));
+  }
 }
 
 }  // namespace workerd::api
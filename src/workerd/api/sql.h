@@ -8,10 +8,12 @@
 #include <workerd/util/sqlite.h>
 #include <workerd/io/compatibility-date.capnp.h>
 #include <workerd/io/io-context.h>
+#include <kj/list.h>
 
 namespace workerd::api {
 
 class DurableObjectStorage;
+class ReadableStream;
 
 class SqlStorage final: public jsg::Object, private SqliteDatabase::Regulator {
 public:
@@ -26,6 +28,17 @@ public:
   jsg::Ref<Cursor> exec(jsg::Lock& js, kj::String query, jsg::Arguments<BindingValue> bindings);
   kj::String ingest(jsg::Lock& js, kj::String query);
 
+  // Like ingest(), but consumes a whole stream of SQL text. Statements are run as soon as they
+  // are complete, so only the last incomplete statement is ever buffered. The statements from
+  // each chunk of the stream are committed together, unless the caller wraps the whole call in
+  // a transaction.
+  jsg::Promise<void> ingestStream(jsg::Lock& js, jsg::Ref<ReadableStream> stream);
+
+  // Returns a stream of SQL text which, when ingested into an empty database, recreates this
+  // database's schema and contents. The text is generated as the stream is read. Writes made
+  // while the dump is being read may or may not be included.
+  jsg::Ref<ReadableStream> dump(jsg::Lock& js);
+
   jsg::Ref<Statement> prepare(jsg::Lock& js, kj::String query);
 
   double getDatabaseSize();
@@ -38,6 +51,8 @@ public:
     // the SQL API becomes publicly available.
     if (flags.getWorkerdExperimental()) {
       JSG_METHOD(ingest);
+      JSG_METHOD(ingestStream);
+      JSG_METHOD(dump);
     }
 
     JSG_READONLY_PROTOTYPE_PROPERTY(databaseSize, getDatabaseSize);
@@ -65,6 +80,28 @@ private:
   kj::Maybe<IoOwn<SqliteDatabase::Statement>> pragmaPageCount;
   kj::Maybe<IoOwn<SqliteDatabase::Statement>> pragmaGetMaxPageCount;
 
+  // Statements prepared by exec(), so that running the same SQL again skips preparing it. Bounded
+  // to the MAX_CACHED_STATEMENTS most recently used. Since the statements are prepared with this
+  // object as their Regulator, and SQLite re-prepares them by itself when the schema changes,
+  // reusing them is always equivalent to preparing the SQL afresh.
+  class StatementCache;
+  kj::Maybe<IoOwn<StatementCache>> statementCache;
+
+  static constexpr size_t MAX_CACHED_STATEMENTS = 64;
+
+  // SQL longer than this is not cached, as it is unlikely to be repeated verbatim.
+  static constexpr size_t MAX_CACHED_SQL_LENGTH = 4096;
+
+  StatementCache& getStatementCache();
+
+  class IngestSink;
+  class DumpSource;
+
+  // A statement that's still incomplete when this much SQL text has been buffered fails
+  // ingestStream(). This is well past SQLITE_LIMIT_SQL_LENGTH, which the statement would exceed
+  // anyway; the margin only lets the stream deliver the statement's end along with the next one.
+  static constexpr size_t MAX_INGEST_STATEMENT_SIZE = 1024 * 1024;
+
   template <size_t size, typename... Params>
   SqliteDatabase::Query execMemoized(
       kj::Maybe<IoOwn<SqliteDatabase::Statement>>& slot,
@@ -110,9 +147,17 @@ public:
   double getRowsWritten();
 
   kj::Array<jsg::JsRef<jsg::JsString>> getColumnNames(jsg::Lock& js);
+
+  // Runs the rest of the query to completion and returns its remaining rows as an array of
+  // objects, as the iterator would have produced them one at a time. The rows are stepped and
+  // built entirely in C++, rather than crossing into JavaScript once per row, which is much
+  // faster for queries returning many rows.
+  jsg::JsArray toArray(jsg::Lock& js);
+
   JSG_RESOURCE_TYPE(Cursor) {
     JSG_ITERABLE(rows);
     JSG_METHOD(raw);
+    JSG_METHOD(toArray);
     JSG_READONLY_PROTOTYPE_PROPERTY(columnNames, getColumnNames);
     JSG_READONLY_PROTOTYPE_PROPERTY(rowsRead, getRowsRead);
     JSG_READONLY_PROTOTYPE_PROPERTY(rowsWritten, getRowsWritten);
@@ -128,6 +173,11 @@ public:
   JSG_ITERATOR(RowIterator, rows, RowDict, jsg::Ref<Cursor>, rowIteratorNext);
   JSG_ITERATOR(RawIterator, raw, kj::Array<Value>, jsg::Ref<Cursor>, rawIteratorNext);
 
+  // If the query already finished on its first step, as writes typically do, keeps what's still
+  // needed of it (the column names and row counts) and releases it, so that its statement can be
+  // run again right away.
+  void releaseIfDone(jsg::Lock& js);
+
   void visitForMemoryInfo(jsg::MemoryTracker& tracker) const {
     if (state != kj::none) {
       tracker.trackFieldWithSize("IoOwn<State>", sizeof(IoOwn<State>));
@@ -184,6 +234,9 @@ private:
   // flag an error if the application tries to reuse the cursor.
   bool canceled = false;
 
+  // True if the query was released by releaseIfDone(), before being iterated.
+  bool released = false;
+
   // Reference to a weak reference that might point back to this object. If so, null it out at
   // destruction. Used by Statement to invalidate past cursors when the statement is
   // executed again.
@@ -209,6 +262,10 @@ private:
   static kj::Array<const SqliteDatabase::Query::ValuePtr> mapBindings(
       kj::ArrayPtr<BindingValue> values);
 
+  // Returns the state of the running query, or kj::none if it's done. Throws if the cursor was
+  // canceled.
+  kj::Maybe<State&> getRunningState();
+
   static kj::Maybe<RowDict> rowIteratorNext(jsg::Lock& js, jsg::Ref<Cursor>& obj);
   static kj::Maybe<kj::Array<Value>> rawIteratorNext(jsg::Lock& js, jsg::Ref<Cursor>& obj);
   template <typename Func>
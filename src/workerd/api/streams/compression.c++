@@ -5,9 +5,9 @@
 #include "compression.h"
 #include <workerd/io/features.h>
 #include <zlib.h>
+#include <brotli/decode.h>
+#include <brotli/encode.h>
 #include <deque>
-#include <vector>
-#include <iterator>
 
 namespace workerd::api {
 
@@ -27,11 +27,16 @@ public:
 
   struct Result {
     bool success = false;
-    kj::ArrayPtr<const byte> buffer;
+    size_t written = 0;
   };
 
   explicit Context(Mode mode, kj::StringPtr format, ContextFlags flags) :
       mode(mode), strictCompression(flags) {
+    if (format == "br") {
+      initBrotli();
+      return;
+    }
+
     int result = Z_OK;
     switch (mode) {
       case Mode::COMPRESS:
@@ -53,6 +58,18 @@ public:
   }
 
   ~Context() noexcept(false) {
+    if (brotli) {
+      switch (mode) {
+        case Mode::COMPRESS:
+          BrotliEncoderDestroyInstance(brotliEncoder);
+          break;
+        case Mode::DECOMPRESS:
+          BrotliDecoderDestroyInstance(brotliDecoder);
+          break;
+      }
+      return;
+    }
+
     switch (mode) {
       case Mode::COMPRESS:
         deflateEnd(&ctx);
@@ -66,13 +83,22 @@ public:
   KJ_DISALLOW_COPY_AND_MOVE(Context);
 
   void setInput(const void* in, size_t size) {
+    if (brotli) {
+      brotliNextIn = reinterpret_cast<const byte*>(in);
+      brotliAvailIn = size;
+      return;
+    }
     ctx.next_in = const_cast<byte*>(reinterpret_cast<const byte*>(in));
     ctx.avail_in = size;
   }
 
-  Result pumpOnce(int flush) {
-    ctx.next_out = buffer;
-    ctx.avail_out = sizeof(buffer);
+  // Processes input, writing as much output as fits directly into `dest`. `flush` takes zlib's
+  // flush values regardless of the format.
+  Result pumpOnce(int flush, kj::ArrayPtr<kj::byte> dest) {
+    if (brotli) return pumpBrotli(flush, dest);
+
+    ctx.next_out = dest.begin();
+    ctx.avail_out = dest.size();
 
     int result = Z_OK;
 
@@ -96,7 +122,7 @@ public:
               "Trailing bytes after end of compressed data");
           // Same applies to closing a stream before the complete decompressed data is available.
           JSG_REQUIRE(!(flush == Z_FINISH && result == Z_BUF_ERROR &&
-              ctx.avail_out == sizeof(buffer)), TypeError,
+              ctx.avail_out == dest.size()), TypeError,
               "Called close() on a decompression stream with incomplete data");
         }
         break;
@@ -106,11 +132,68 @@ public:
 
     return Result {
       .success = result == Z_OK,
-      .buffer = kj::arrayPtr(buffer, sizeof(buffer) - ctx.avail_out),
+      .written = dest.size() - ctx.avail_out,
     };
   }
 
 private:
+  void initBrotli() {
+    brotli = true;
+    switch (mode) {
+      case Mode::COMPRESS:
+        brotliEncoder = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+        JSG_REQUIRE(brotliEncoder != nullptr, Error, "Failed to initialize compression context.");
+        // The default quality of 11 is meant for compressing static assets ahead of time and is
+        // far too slow for streaming. 5 is in the same ballpark as zlib's default level for speed,
+        // while still compressing noticeably better.
+        BrotliEncoderSetParameter(brotliEncoder, BROTLI_PARAM_QUALITY, 5);
+        break;
+      case Mode::DECOMPRESS:
+        brotliDecoder = BrotliDecoderCreateInstance(nullptr, nullptr, nullptr);
+        JSG_REQUIRE(brotliDecoder != nullptr, Error, "Failed to initialize compression context.");
+        break;
+    }
+  }
+
+  Result pumpBrotli(int flush, kj::ArrayPtr<kj::byte> dest) {
+    kj::byte* nextOut = dest.begin();
+    size_t availOut = dest.size();
+    bool success = false;
+
+    switch (mode) {
+      case Mode::COMPRESS: {
+        auto op = flush == Z_FINISH ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS;
+        JSG_REQUIRE(BrotliEncoderCompressStream(brotliEncoder, op,
+            &brotliAvailIn, &brotliNextIn, &availOut, &nextOut, nullptr),
+            Error, "Compression failed.");
+        success = brotliAvailIn > 0 || BrotliEncoderHasMoreOutput(brotliEncoder) ||
+            (op == BROTLI_OPERATION_FINISH && !BrotliEncoderIsFinished(brotliEncoder));
+        break;
+      }
+      case Mode::DECOMPRESS: {
+        auto result = BrotliDecoderDecompressStream(brotliDecoder,
+            &brotliAvailIn, &brotliNextIn, &availOut, &nextOut, nullptr);
+        JSG_REQUIRE(result != BROTLI_DECODER_RESULT_ERROR, Error, "Decompression failed.");
+
+        if (strictCompression == ContextFlags::STRICT) {
+          JSG_REQUIRE(!(result == BROTLI_DECODER_RESULT_SUCCESS && brotliAvailIn > 0), TypeError,
+              "Trailing bytes after end of compressed data");
+          JSG_REQUIRE(!(flush == Z_FINISH && result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT),
+              TypeError, "Called close() on a decompression stream with incomplete data");
+        }
+        success = result == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT;
+        break;
+      }
+      default:
+        KJ_UNREACHABLE;
+    }
+
+    return Result {
+      .success = success,
+      .written = dest.size() - availOut,
+    };
+  }
+
   static int getWindowBits(kj::StringPtr format) {
     // We use a windowBits value of 15 combined with the magic value
     // for the compression format type. For gzip, the magic value is
@@ -129,7 +212,13 @@ private:
 
   Mode mode;
   z_stream ctx = {};
-  kj::byte buffer[4096];
+
+  // Used instead of `ctx` for the "br" format.
+  bool brotli = false;
+  BrotliEncoderState* brotliEncoder = nullptr;
+  BrotliDecoderState* brotliDecoder = nullptr;
+  const kj::byte* brotliNextIn = nullptr;
+  size_t brotliAvailIn = 0;
 
   // For the eponymous compatibility flag
   ContextFlags strictCompression;
@@ -173,11 +262,15 @@ public:
         kj::throwFatalException(kj::cp(exception));
       }
       KJ_CASE_ONEOF(open, Open) {
-        if (pieces.size() == 0) return kj::READY_NOW;
-        return write(pieces[0].begin(), pieces[0].size())
-            .then([this, pieces = pieces.slice(1)]() mutable {
-          return write(pieces);
-        });
+        // Feed every piece through the context before waking up any reader, rather than taking a
+        // trip through the event loop per piece.
+        for (auto piece: pieces) {
+          context.setInput(piece.begin(), piece.size());
+          KJ_IF_SOME(exception, pumpContext(Z_NO_FLUSH)) {
+            return kj::mv(exception);
+          }
+        }
+        return maybeFulfillRead();
       }
     }
     KJ_UNREACHABLE;
@@ -199,7 +292,7 @@ public:
     KJ_SWITCH_ONEOF(state) {
       KJ_CASE_ONEOF(ended, Ended) {
         // There might still be data in the output buffer remaining to read.
-        if (output.empty()) return size_t(0);
+        if (outputSize == 0) return size_t(0);
         return tryReadInternal(
             kj::ArrayPtr<kj::byte>(reinterpret_cast<kj::byte*>(buffer), maxBytes),
             minBytes);
@@ -230,6 +323,7 @@ private:
 
   void cancelInternal(kj::Exception reason) {
     output.clear();
+    outputSize = 0;
 
     while (!pendingReads.empty()) {
       auto pending = kj::mv(pendingReads.front());
@@ -243,22 +337,61 @@ private:
     state = kj::mv(reason);
   }
 
-  kj::Promise<size_t> tryReadInternal(kj::ArrayPtr<kj::byte> dest, size_t minBytes) {
-    const auto copyIntoBuffer = [this](kj::ArrayPtr<kj::byte> dest) {
-      auto maxBytesToCopy = kj::min(dest.size(), output.size());
-      auto src = &output[0];
-      memcpy(dest.begin(), src, maxBytesToCopy);
-      output.erase(output.begin(), output.begin() + maxBytesToCopy);
-      return maxBytesToCopy;
-    };
+  // Returns space at the end of the output queue for the context to write into, starting a new
+  // chunk if the last one is full.
+  kj::ArrayPtr<kj::byte> outputSpace() {
+    if (output.empty() || output.back().end == output.back().data.size()) {
+      kj::Array<kj::byte> data;
+      if (freeChunks.empty()) {
+        data = kj::heapArray<kj::byte>(CHUNK_SIZE);
+      } else {
+        data = kj::mv(freeChunks.back());
+        freeChunks.removeLast();
+      }
+      output.push_back(OutputChunk { .data = kj::mv(data) });
+    }
+    auto& chunk = output.back();
+    return chunk.data.slice(chunk.end, chunk.data.size());
+  }
+
+  void commitOutput(size_t size) {
+    output.back().end += size;
+    outputSize += size;
+  }
 
+  // Moves as much output as fits into `dest`, recycling the chunks that are used up.
+  size_t copyOutput(kj::ArrayPtr<kj::byte> dest) {
+    size_t copied = 0;
+    while (copied < dest.size() && !output.empty()) {
+      auto& chunk = output.front();
+      auto amount = kj::min(dest.size() - copied, chunk.end - chunk.begin);
+      memcpy(dest.begin() + copied, chunk.data.begin() + chunk.begin, amount);
+      chunk.begin += amount;
+      copied += amount;
+      if (chunk.begin < chunk.end) break;
+      if (output.size() == 1) {
+        // The context is still writing into the last chunk, so start it over from the top.
+        chunk.begin = 0;
+        chunk.end = 0;
+        break;
+      }
+      if (freeChunks.size() < MAX_FREE_CHUNKS) {
+        freeChunks.add(kj::mv(chunk.data));
+      }
+      output.pop_front();
+    }
+    outputSize -= copied;
+    return copied;
+  }
+
+  kj::Promise<size_t> tryReadInternal(kj::ArrayPtr<kj::byte> dest, size_t minBytes) {
     // If the output currently contains >= minBytes, then we'll fulfill
     // the read immediately, removing as many bytes as possible from the
     // output queue.
     // If we reached the end, resolve the read immediately as well, since no
     // new data is expected.
-    if (output.size() >= minBytes || state.template is<Ended>()) {
-      return copyIntoBuffer(dest);
+    if (outputSize >= minBytes || state.template is<Ended>()) {
+      return copyOutput(dest);
     }
 
     // Otherwise, create a pending read.
@@ -271,8 +404,8 @@ private:
     };
 
     // If there are any bytes queued, copy as much as possible into the buffer.
-    if (output.size() > 0) {
-      pendingRead.filled = copyIntoBuffer(dest);
+    if (outputSize > 0) {
+      pendingRead.filled = copyOutput(dest);
     }
 
     pendingReads.push_back(kj::mv(pendingRead));
@@ -281,38 +414,40 @@ private:
   }
 
   kj::Promise<void> writeInternal(int flush) {
-    // TODO(later): This does not yet implement any backpressure. A caller can keep calling
-    // write without reading, which will continue to fill the internal buffer.
-    KJ_ASSERT(flush == Z_FINISH || state.template is<Open>());
-    Context::Result result;
-    KJ_IF_SOME(exception, kj::runCatchingExceptions([this, flush, &result]() {
-      result = context.pumpOnce(flush);
-    })) {
-      cancelInternal(kj::cp(exception));
+    KJ_IF_SOME(exception, pumpContext(flush)) {
       return kj::mv(exception);
     }
+    return maybeFulfillRead();
+  }
 
-    if (result.buffer.size() == 0) {
-      if (result.success) {
-        return writeInternal(flush);
+  // Runs the context over its current input, appending whatever it produces to the output queue.
+  kj::Maybe<kj::Exception> pumpContext(int flush) {
+    // TODO(later): This does not yet implement any backpressure. A caller can keep calling
+    // write without reading, which will continue to fill the internal buffer.
+    KJ_ASSERT(flush == Z_FINISH || state.template is<Open>());
+    for (;;) {
+      // The context writes straight into the output queue's chunks, so there is no intermediate
+      // copy.
+      auto dest = outputSpace();
+      Context::Result result;
+      KJ_IF_SOME(exception, kj::runCatchingExceptions([this, flush, dest, &result]() {
+        result = context.pumpOnce(flush, dest);
+      })) {
+        cancelInternal(kj::cp(exception));
+        return kj::mv(exception);
       }
-      return maybeFulfillRead();
-    }
+      commitOutput(result.written);
 
-    if (result.buffer.size() > 0) {
-      std::copy(result.buffer.begin(), result.buffer.end(), std::back_inserter(output));
+      if (result.written == 0 && !result.success) break;
     }
-    return writeInternal(flush);
+    return kj::none;
   }
 
   // Fulfill as many pending reads as we can from the output buffer.
   kj::Promise<void> maybeFulfillRead() {
-    auto remaining = output.size();
-    auto source = output.begin();
-
     // If there are pending reads and data to be read, we'll loop through
     // the pending reads and fulfill them as much as possible.
-    while (!pendingReads.empty() && remaining > 0) {
+    while (!pendingReads.empty() && outputSize > 0) {
       auto& pending = pendingReads.front();
 
       if (!pending.promise->isWaiting()) {
@@ -334,13 +469,8 @@ private:
         return kj::mv(ex);
       }
 
-      // The pending read is still viable so determine how much we can copy in.
-      auto amountToCopy = kj::min(pending.buffer.size() - pending.filled, remaining);
-      std::copy(source, source + amountToCopy, pending.buffer.begin() + pending.filled);
-      source += amountToCopy;
-      pending.filled += amountToCopy;
-      remaining -= amountToCopy;
-      output.erase(output.begin(), source);
+      // The pending read is still viable so copy in as much as we can.
+      pending.filled += copyOutput(pending.buffer.slice(pending.filled, pending.buffer.size()));
 
       // If we've met the minimum bytes requirement for the pending read, fulfill
       // the read promise.
@@ -351,16 +481,16 @@ private:
         continue;
       }
 
-      // If we reached this point in the loop, remaining must be 0 so that we
+      // If we reached this point in the loop, the output must be empty so that we
       // don't keep iterating through on the same pending read.
-      KJ_ASSERT(remaining == 0);
+      KJ_ASSERT(outputSize == 0);
     }
 
     if (state.template is<Ended>() && !pendingReads.empty()) {
       // We are ended and we have pending reads. Because of the loop above,
       // one of either pendingReads or output must be empty, so if we got this
-      // far, output.empty() must be true. Let's check.
-      KJ_ASSERT(output.empty());
+      // far, outputSize must be 0. Let's check.
+      KJ_ASSERT(outputSize == 0);
       // We need to flush any remaining reads.
       while (!pendingReads.empty()) {
         auto pending = kj::mv(pendingReads.front());
@@ -381,15 +511,31 @@ private:
   kj::OneOf<Open, Ended, kj::Exception> state = Open();
   Context context;
 
+  // Output is queued in fixed-size chunks. Reads from the internal stream implementation are at
+  // most 16 KiB, so this lets most reads be served from a single chunk.
+  static constexpr size_t CHUNK_SIZE = 16384;
+  static constexpr size_t MAX_FREE_CHUNKS = 4;
+
+  struct OutputChunk {
+    kj::Array<kj::byte> data;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
   kj::Canceler canceler;
-  std::vector<kj::byte> output;
+  std::deque<OutputChunk> output;
+  size_t outputSize = 0;
+  // Chunks that have been fully read, kept for reuse so that a long stream doesn't allocate a new
+  // buffer for every chunk of output.
+  kj::Vector<kj::Array<kj::byte>> freeChunks;
   std::deque<PendingRead> pendingReads;
 };
 }  // namespace
 
 jsg::Ref<CompressionStream> CompressionStream::constructor(jsg::Lock& js, kj::String format) {
-  JSG_REQUIRE(format == "deflate" || format == "gzip" || format == "deflate-raw", TypeError,
-               "The compression format must be either 'deflate', 'deflate-raw' or 'gzip'.");
+  JSG_REQUIRE(format == "deflate" || format == "gzip" || format == "deflate-raw" || format == "br",
+               TypeError,
+               "The compression format must be either 'deflate', 'deflate-raw', 'gzip' or 'br'.");
 
   auto readableSide =
       kj::refcounted<CompressionStreamImpl<Context::Mode::COMPRESS>>(kj::mv(format),
@@ -404,8 +550,9 @@ jsg::Ref<CompressionStream> CompressionStream::constructor(jsg::Lock& js, kj::St
 }
 
 jsg::Ref<DecompressionStream> DecompressionStream::constructor(jsg::Lock& js, kj::String format) {
-  JSG_REQUIRE(format == "deflate" || format == "gzip" || format == "deflate-raw", TypeError,
-               "The compression format must be either 'deflate', 'deflate-raw' or 'gzip'.");
+  JSG_REQUIRE(format == "deflate" || format == "gzip" || format == "deflate-raw" || format == "br",
+               TypeError,
+               "The compression format must be either 'deflate', 'deflate-raw', 'gzip' or 'br'.");
 
   auto readableSide =
       kj::refcounted<CompressionStreamImpl<Context::Mode::DECOMPRESS>>(
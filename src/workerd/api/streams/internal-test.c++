@@ -186,6 +186,43 @@ KJ_TEST("honest small stream") {
   KJ_ASSERT(stream.maxMaxBytesSeen(), 100);
 }
 
+KJ_TEST("IdentityTransformStreamImpl piecewise write") {
+  kj::EventLoop loop;
+  kj::WaitScope waitScope(loop);
+
+  auto stream = kj::refcounted<IdentityTransformStreamImpl>();
+
+  // A read reaches across piece boundaries, skipping empty pieces, rather than stopping at the end
+  // of the first piece.
+  auto foo = "foo"_kj.asBytes();
+  auto barbaz = "barbaz"_kj.asBytes();
+  kj::ArrayPtr<const kj::byte> pieces[] = { foo, nullptr, barbaz };
+  auto write = stream->write(pieces);
+
+  char buffer[16];
+  KJ_ASSERT(stream->tryRead(buffer, 1, 5).wait(waitScope) == 5);
+  KJ_ASSERT(kj::heapString(buffer, 5) == "fooba");
+  KJ_ASSERT(!write.poll(waitScope));
+
+  KJ_ASSERT(stream->tryRead(buffer, 1, sizeof(buffer)).wait(waitScope) == 1);
+  KJ_ASSERT(buffer[0] == 'z');
+  write.wait(waitScope);
+
+  // A read that's already waiting takes as much of the write as fits.
+  auto read = stream->tryRead(buffer, 1, sizeof(buffer));
+  stream->write(pieces).wait(waitScope);
+  KJ_ASSERT(read.wait(waitScope) == 9);
+  KJ_ASSERT(kj::heapString(buffer, 9) == "foobarbaz");
+
+  // Writing only empty pieces is a no-op, not a close.
+  kj::ArrayPtr<const kj::byte> empty[] = { nullptr, nullptr };
+  stream->write(empty).wait(waitScope);
+  read = stream->tryRead(buffer, 1, sizeof(buffer));
+  KJ_ASSERT(!read.poll(waitScope));
+  stream->end().wait(waitScope);
+  KJ_ASSERT(read.wait(waitScope) == 0);
+}
+
 KJ_TEST("WritableStreamInternalController queue size assertion") {
 
   capnp::MallocMessageBuilder message;
@@ -29,11 +29,108 @@ namespace {
           kj::str(JSG_EXCEPTION(TypeError) ": ", message)));
 }
 
+// Hands out the buffers that pumpTo() reads into. Sizes are rounded up to a power of two, and a
+// few freed buffers of each size are kept around so that pumps, which come and go and change
+// their chunk size as they go, don't need to allocate every time. There is one pool per thread.
+class PumpBufferPool final {
+public:
+  static constexpr size_t MIN_SIZE = 4096;
+  static constexpr size_t MAX_SIZE = 256 * 1024;
+
+  static kj::Array<kj::byte> get(size_t size) {
+    return forThisThread().getImpl(size);
+  }
+
+private:
+  // One size class for each power of two from MIN_SIZE to MAX_SIZE.
+  static constexpr uint SIZE_CLASS_COUNT = 7;
+  static_assert(MIN_SIZE << (SIZE_CLASS_COUNT - 1) == MAX_SIZE);
+
+  // Freed buffers beyond this many bytes are returned to the allocator.
+  static constexpr size_t MAX_CACHED_BYTES = 1024 * 1024;
+
+  // Returns buffers to the pool of whichever thread frees them. It's a stateless static rather
+  // than the pool itself, since a buffer can be freed after the pool it came from is gone.
+  class Disposer final: public kj::ArrayDisposer {
+  public:
+    void disposeImpl(void* firstElement, size_t elementSize, size_t elementCount,
+                     size_t capacity, void (*destroyElement)(void*)) const override {
+      PumpBufferPool::put(static_cast<kj::byte*>(firstElement), elementCount);
+    }
+  };
+  static const Disposer disposer;
+
+  kj::Vector<kj::byte*> freeLists[SIZE_CLASS_COUNT];
+  size_t cachedBytes = 0;
+
+  // Set once this thread's pool has been destroyed, during thread exit. Buffers freed after that,
+  // by other thread_local destructors, go straight back to the allocator.
+  static thread_local bool destroyed;
+
+  ~PumpBufferPool() noexcept(false) {
+    destroyed = true;
+    for (auto& freeList: freeLists) {
+      for (auto buffer: freeList) delete[] buffer;
+    }
+  }
+
+  static PumpBufferPool& forThisThread() {
+    static thread_local PumpBufferPool pool;
+    return pool;
+  }
+
+  static uint sizeClass(size_t size) {
+    uint result = 0;
+    while ((MIN_SIZE << result) < size && result < SIZE_CLASS_COUNT - 1) ++result;
+    return result;
+  }
+
+  kj::Array<kj::byte> getImpl(size_t size) {
+    uint cls = sizeClass(size);
+    size_t bytes = MIN_SIZE << cls;
+    auto& freeList = freeLists[cls];
+    kj::byte* buffer;
+    if (freeList.empty()) {
+      buffer = new kj::byte[bytes];
+    } else {
+      buffer = freeList.back();
+      freeList.removeLast();
+      cachedBytes -= bytes;
+    }
+    return kj::Array<kj::byte>(buffer, bytes, disposer);
+  }
+
+  static void put(kj::byte* buffer, size_t size) {
+    if (destroyed) {
+      delete[] buffer;
+      return;
+    }
+    auto& pool = forThisThread();
+    if (pool.cachedBytes + size > MAX_CACHED_BYTES) {
+      delete[] buffer;
+      return;
+    }
+    pool.freeLists[sizeClass(size)].add(buffer);
+    pool.cachedBytes += size;
+  }
+};
+
+const PumpBufferPool::Disposer PumpBufferPool::disposer{};
+thread_local bool PumpBufferPool::destroyed = false;
+
 kj::Promise<void> pumpTo(ReadableStreamSource& input, WritableStreamSink& output, bool end) {
-  kj::byte buffer[4096];
+  // Reading 4k at a time takes a lot of trips through the event loop to pump a large body, so we
+  // adapt the chunk size as we go. If we know how big the body is, we start with a chunk big
+  // enough to hold it all (within limits). After that, we double the chunk size whenever a read
+  // fills the buffer, and halve it when reads use less than a quarter of it.
+  size_t chunkSize = PumpBufferPool::MIN_SIZE;
+  KJ_IF_SOME(length, input.tryGetLength(StreamEncoding::IDENTITY)) {
+    chunkSize = kj::max(kj::min(length, PumpBufferPool::MAX_SIZE), PumpBufferPool::MIN_SIZE);
+  }
+  auto buffer = PumpBufferPool::get(chunkSize);
 
   while (true) {
-    auto amount = co_await input.tryRead(buffer, 1, kj::size(buffer));
+    auto amount = co_await input.tryRead(buffer.begin(), 1, buffer.size());
 
     if (amount == 0) {
       if (end) {
@@ -42,7 +139,13 @@ kj::Promise<void> pumpTo(ReadableStreamSource& input, WritableStreamSink& output
       co_return;
     }
 
-    co_await output.write(buffer, amount);
+    co_await output.write(buffer.begin(), amount);
+
+    if (amount == buffer.size() && buffer.size() < PumpBufferPool::MAX_SIZE) {
+      buffer = PumpBufferPool::get(buffer.size() * 2);
+    } else if (amount < buffer.size() / 4 && buffer.size() > PumpBufferPool::MIN_SIZE) {
+      buffer = PumpBufferPool::get(buffer.size() / 2);
+    }
   }
 }
 
@@ -2209,9 +2312,17 @@ kj::Promise<void> IdentityTransformStreamImpl::write(const void* buffer, size_t
 
 kj::Promise<void> IdentityTransformStreamImpl::write(
     kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> pieces) {
-  KJ_UNIMPLEMENTED("IdentityTransformStreamImpl piecewise write() not currently supported");
-  // TODO(soon): This will be called by TeeBranch::pumpTo(). We disallow that anyway, since we
-  //   disallow inter-TransformStream pumping.
+  // Skip leading empty pieces, since an empty first buffer is how writeHelper() spells close.
+  while (pieces.size() > 0 && pieces.front().size() == 0) {
+    pieces = pieces.slice(1, pieces.size());
+  }
+  if (pieces.size() == 0) {
+    return kj::READY_NOW;
+  }
+
+  // The pieces stay pending as one write request, so that a single read can gather across them
+  // instead of seeing one piece per read.
+  return writeHelper(pieces.front(), pieces.slice(1, pieces.size()));
 }
 
 kj::Promise<void> IdentityTransformStreamImpl::end() {
@@ -2259,22 +2370,19 @@ kj::Promise<size_t> IdentityTransformStreamImpl::readHelper(kj::ArrayPtr<kj::byt
       KJ_FAIL_ASSERT("read operation already in flight");
     }
     KJ_CASE_ONEOF(request, WriteRequest) {
-      if (bytes.size() >= request.bytes.size()) {
-        // The write buffer will entirely fit into our read buffer; fulfill both requests.
-        memcpy(bytes.begin(), request.bytes.begin(), request.bytes.size());
-        auto result = request.bytes.size();
+      auto result = gather(bytes, request.bytes, request.morePieces);
+
+      if (request.bytes.size() == 0) {
+        // The write buffer entirely fit into our read buffer; fulfill both requests.
         request.fulfiller->fulfill();
 
         // Switch to idle state.
         state = Idle();
-
-        return result;
       }
 
-      // The write buffer won't quite fit into our read buffer; fulfill only the read request.
-      memcpy(bytes.begin(), request.bytes.begin(), bytes.size());
-      request.bytes = request.bytes.slice(bytes.size(), request.bytes.size());
-      return bytes.size();
+      // Otherwise, the write buffer didn't quite fit into our read buffer; fulfill only the read
+      // request.
+      return result;
     }
     KJ_CASE_ONEOF(exception, kj::Exception) {
       return kj::cp(exception);
@@ -2287,7 +2395,8 @@ kj::Promise<size_t> IdentityTransformStreamImpl::readHelper(kj::ArrayPtr<kj::byt
   KJ_UNREACHABLE;
 }
 
-kj::Promise<void> IdentityTransformStreamImpl::writeHelper(kj::ArrayPtr<const kj::byte> bytes) {
+kj::Promise<void> IdentityTransformStreamImpl::writeHelper(kj::ArrayPtr<const kj::byte> bytes,
+    kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> morePieces) {
   KJ_SWITCH_ONEOF(state) {
     KJ_CASE_ONEOF(idle, Idle) {
       if (bytes.size() == 0) {
@@ -2297,7 +2406,7 @@ kj::Promise<void> IdentityTransformStreamImpl::writeHelper(kj::ArrayPtr<const kj
       }
 
       auto paf = kj::newPromiseAndFulfiller<void>();
-      state = WriteRequest { bytes, kj::mv(paf.fulfiller) };
+      state = WriteRequest { bytes, morePieces, kj::mv(paf.fulfiller) };
       return kj::mv(paf.promise);
     }
     KJ_CASE_ONEOF(request, ReadRequest) {
@@ -2312,7 +2421,7 @@ kj::Promise<void> IdentityTransformStreamImpl::writeHelper(kj::ArrayPtr<const kj
         state = KJ_EXCEPTION(DISCONNECTED, "reader canceled");
 
         // I was going to use a `goto` but Harris choked on his bagel. Recursion it is.
-        return writeHelper(bytes);
+        return writeHelper(bytes, morePieces);
       }
 
       if (bytes.size() == 0) {
@@ -2324,21 +2433,18 @@ kj::Promise<void> IdentityTransformStreamImpl::writeHelper(kj::ArrayPtr<const kj
 
       KJ_ASSERT(request.bytes.size() > 0);
 
-      if (request.bytes.size() >= bytes.size()) {
-        // Our write buffer will entirely fit into the read buffer; fulfill both requests.
-        memcpy(request.bytes.begin(), bytes.begin(), bytes.size());
-        request.fulfiller->fulfill(bytes.size());
+      request.fulfiller->fulfill(gather(request.bytes, bytes, morePieces));
+
+      if (bytes.size() == 0) {
+        // Our write buffer entirely fit into the read buffer; both requests are fulfilled.
         state = Idle();
         return kj::READY_NOW;
       }
 
-      // Our write buffer won't quite fit into the read buffer; fulfill only the read request.
-      memcpy(request.bytes.begin(), bytes.begin(), request.bytes.size());
-      bytes = bytes.slice(request.bytes.size(), bytes.size());
-      request.fulfiller->fulfill(request.bytes.size());
-
+      // Our write buffer didn't quite fit into the read buffer; only the read request is
+      // fulfilled.
       auto paf = kj::newPromiseAndFulfiller<void>();
-      state = WriteRequest { bytes, kj::mv(paf.fulfiller) };
+      state = WriteRequest { bytes, morePieces, kj::mv(paf.fulfiller) };
       return kj::mv(paf.promise);
     }
     KJ_CASE_ONEOF(request, WriteRequest) {
@@ -2355,6 +2461,27 @@ kj::Promise<void> IdentityTransformStreamImpl::writeHelper(kj::ArrayPtr<const kj
   KJ_UNREACHABLE;
 }
 
+size_t IdentityTransformStreamImpl::gather(kj::ArrayPtr<kj::byte> dest,
+    kj::ArrayPtr<const kj::byte>& bytes,
+    kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>>& morePieces) {
+  size_t copied = 0;
+  for (;;) {
+    auto amount = kj::min(dest.size() - copied, bytes.size());
+    if (amount > 0) {
+      memcpy(dest.begin() + copied, bytes.begin(), amount);
+      copied += amount;
+    }
+    bytes = bytes.slice(amount, bytes.size());
+
+    // Stop once the destination is full, leaving `bytes` on the first piece not fully copied, or
+    // once there's nothing left to copy. Empty pieces are skipped along the way.
+    if (bytes.size() > 0 || morePieces.size() == 0) break;
+    bytes = morePieces.front();
+    morePieces = morePieces.slice(1, morePieces.size());
+  }
+  return copied;
+}
+
 kj::Own<ReadableStreamController> newReadableStreamInternalController(
     IoContext& ioContext,
     kj::Own<ReadableStreamSource> source) {
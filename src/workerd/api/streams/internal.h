@@ -406,7 +406,15 @@ public:
 private:
   kj::Promise<size_t> readHelper(kj::ArrayPtr<kj::byte> bytes);
 
-  kj::Promise<void> writeHelper(kj::ArrayPtr<const kj::byte> bytes);
+  // `morePieces` are written after `bytes`, as if they were one contiguous buffer. `bytes` is
+  // empty only for a close operation.
+  kj::Promise<void> writeHelper(kj::ArrayPtr<const kj::byte> bytes,
+      kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> morePieces = nullptr);
+
+  // Copies as much of `bytes`, then `morePieces`, into `dest` as fits, advancing both past what
+  // was copied. On return `bytes` is empty only if everything was copied.
+  static size_t gather(kj::ArrayPtr<kj::byte> dest, kj::ArrayPtr<const kj::byte>& bytes,
+      kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>>& morePieces);
 
   kj::Maybe<uint64_t> limit;
 
@@ -420,6 +428,9 @@ private:
 
   struct WriteRequest {
     kj::ArrayPtr<const kj::byte> bytes;
+    kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> morePieces;
+    // The rest of a piecewise write(), to be read after `bytes`.
+
     kj::Own<kj::PromiseFulfiller<void>> fulfiller;
   };
 
@@ -361,6 +361,49 @@ KJ_TEST("ValueQueue with multiple consumers with pending reads") {
   });
 }
 
+KJ_TEST("ValueQueue consumer drain") {
+  preamble([](jsg::Lock& js) {
+    ValueQueue queue(4);
+
+    ValueQueue::Consumer consumer(queue);
+
+    queue.push(js, getEntry(js, 1));
+    queue.push(js, getEntry(js, 2));
+    queue.push(js, getEntry(js, 3));
+    KJ_ASSERT(consumer.size() == 6);
+    KJ_ASSERT(queue.desiredSize() == -2);
+
+    // Entries stay in the buffer once the callback stops taking them.
+    uint taken = 0;
+    consumer.drain(js, [&](ValueQueue::QueueEntry& entry) {
+      if (taken == 2) return false;
+      KJ_ASSERT(entry.entry->getValue(js).getHandle(js)->IsTrue());
+      ++taken;
+      return true;
+    });
+    KJ_ASSERT(taken == 2);
+    KJ_ASSERT(consumer.size() == 3);
+    KJ_ASSERT(queue.size() == 3);
+    KJ_ASSERT(queue.desiredSize() == 1);
+
+    // Nothing is drained while a read is pending, but here the read just takes the last entry.
+    MustCall<ReadContinuation> readContinuation([&](jsg::Lock& js, auto&& result) -> auto {
+      KJ_ASSERT(!result.done);
+      return js.resolvedPromise(kj::mv(result));
+    });
+    read(js, consumer).then(js, readContinuation);
+    KJ_ASSERT(consumer.empty());
+
+    read(js, consumer);
+    KJ_ASSERT(consumer.hasReadRequests());
+    consumer.drain(js, [&](ValueQueue::QueueEntry& entry) -> bool {
+      KJ_FAIL_ASSERT("drain() should not take anything while a read is pending");
+    });
+
+    js.runMicrotasks();
+  });
+}
+
 #pragma endregion ValueQueue Tests
 
 #pragma region ByteQueue Tests
@@ -1214,6 +1257,46 @@ KJ_TEST("ByteQueue with multiple default consumers with atLeast (different rate)
   });
 }
 
+KJ_TEST("ByteQueue consumer drain closes the consumer") {
+  preamble([](jsg::Lock& js) {
+    ByteQueue queue(2);
+
+    ByteQueue::Consumer consumer(queue);
+
+    const auto push = [&](kj::StringPtr data) {
+      auto store = jsg::BackingStore::alloc(js, data.size());
+      memcpy(store.asArrayPtr().begin(), data.begin(), data.size());
+      queue.push(js, kj::heap<ByteQueue::Entry>(kj::mv(store)));
+    };
+
+    push("abc");
+    push("de");
+    queue.close(js);
+    KJ_ASSERT(consumer.size() == 5);
+
+    kj::Vector<kj::String> chunks;
+    consumer.drain(js, [&](ByteQueue::QueueEntry& entry) {
+      auto bytes = entry.entry->toArrayPtr().slice(entry.offset, entry.entry->getSize());
+      chunks.add(kj::heapString(bytes.asChars()));
+      return true;
+    });
+    KJ_ASSERT(chunks.size() == 2);
+    KJ_ASSERT(chunks[0] == "abc");
+    KJ_ASSERT(chunks[1] == "de");
+    KJ_ASSERT(consumer.size() == 0);
+    KJ_ASSERT(queue.size() == 0);
+
+    // The buffer was emptied up to the close, so the consumer is now closed.
+    MustCall<ReadContinuation> readContinuation([&](jsg::Lock& js, auto&& result) -> auto {
+      KJ_ASSERT(result.done);
+      return js.resolvedPromise(kj::mv(result));
+    });
+    byobRead(js, consumer, 4).then(js, readContinuation);
+
+    js.runMicrotasks();
+  });
+}
+
 #pragma endregion ByteQueue Tests
 
 }  // namespace
@@ -466,6 +466,34 @@ public:
     }
   }
 
+  // Removes entries from the front of the buffer, without waiting, for as long as `func` takes
+  // them. `func` is called with each QueueEntry and returns false to leave it, and everything
+  // after it, in the buffer. Does nothing while there are pending read requests, as those are owed
+  // the data first. If this empties the buffer of a closing consumer, the consumer closes, so it
+  // is not safe to use the consumer after calling this.
+  template <typename Func>
+  void drain(jsg::Lock& js, Func&& func) {
+    auto& ready = KJ_UNWRAP_OR(state.template tryGet<Ready>(), return);
+    if (!ready.readRequests.empty()) return;
+
+    {
+      UpdateBackpressureScope scope(queue);
+      while (!ready.buffer.empty()) {
+        KJ_IF_SOME(entry, ready.buffer.front().template tryGet<QueueEntry>()) {
+          auto size = entry.getSize();
+          if (!func(entry)) break;
+          ready.buffer.pop_front();
+          ready.queueTotalSize -= size;
+        } else {
+          // We've reached the close sentinel.
+          break;
+        }
+      }
+    }
+
+    maybeDrainAndSetState(js);
+  }
+
   bool hasReadRequests() const {
     KJ_SWITCH_ONEOF(state) {
       KJ_CASE_ONEOF(closed, Closed) { return false; }
@@ -652,6 +680,9 @@ public:
     kj::Own<Entry> entry;
     QueueEntry clone(jsg::Lock& js);
 
+    // The amount this entry counts toward the queue's total size.
+    size_t getSize() const { return entry->getSize(); }
+
     JSG_MEMORY_INFO(ValueQueue::QueueEntry) {
       tracker.trackField("entry", entry);
     }
@@ -688,6 +719,10 @@ public:
     bool hasReadRequests();
     void cancelPendingReads(jsg::Lock& js, jsg::JsValue reason);
 
+    // See ConsumerImpl::drain().
+    template <typename Func>
+    void drain(jsg::Lock& js, Func&& func) { impl.drain(js, kj::fwd<Func>(func)); }
+
     void visitForGc(jsg::GcVisitor& visitor);
 
     inline kj::StringPtr jsgGetMemoryName() const;
@@ -877,6 +912,9 @@ public:
 
     QueueEntry clone(jsg::Lock& js);
 
+    // The number of bytes of this entry that haven't been read yet.
+    size_t getSize() const { return entry->getSize() - offset; }
+
     JSG_MEMORY_INFO(ByteQueue::QueueEntry) {
       tracker.trackField("entry", entry);
     }
@@ -912,6 +950,10 @@ public:
     bool hasReadRequests();
     void cancelPendingReads(jsg::Lock& js, jsg::JsValue reason);
 
+    // See ConsumerImpl::drain().
+    template <typename Func>
+    void drain(jsg::Lock& js, Func&& func) { impl.drain(js, kj::fwd<Func>(func)); }
+
     void visitForGc(jsg::GcVisitor& visitor);
 
     inline kj::StringPtr jsgGetMemoryName() const;
@@ -717,6 +717,11 @@ public:
       jsg::Lock& js,
       kj::Maybe<ByobOptions> byobOptions) override;
 
+  // Takes the chunks that are already buffered in the queue, without waiting, so that pumpTo()
+  // can write them to its sink all at once. Returns nothing if the queue is empty or the stream
+  // isn't readable. Like read(), this may close the stream once the buffer is drained.
+  kj::Vector<kj::Array<kj::byte>> drainBuffered(jsg::Lock& js);
+
   // See the comment for releaseReader in common.h for details on the use of maybeJs
   void releaseReader(Reader& reader, kj::Maybe<jsg::Lock&> maybeJs) override;
 
@@ -1716,6 +1721,26 @@ struct ValueReadable final: private api::ValueQueue::ConsumerImpl::StateListener
     return js.resolvedPromise(ReadResult { .done = true });
   }
 
+  // Takes the chunks already buffered for this consumer, as long as they are bytes, without
+  // waiting. A chunk that isn't bytes is left for read() to report.
+  void drainBuffered(jsg::Lock& js, kj::Vector<kj::Array<kj::byte>>& chunks) {
+    KJ_IF_SOME(s, state) {
+      s.consumer->drain(js, [&](ValueQueue::QueueEntry& entry) {
+        auto handle = entry.entry->getValue(js).getHandle(js);
+        if (!handle->IsArrayBufferView() && !handle->IsArrayBuffer()) {
+          return false;
+        }
+        jsg::BufferSource bufferSource(js, handle);
+        if (bufferSource.size() > 0) {
+          // As in PumpToReader, we don't detach, since a value-oriented stream may have the
+          // same buffer queued more than once.
+          chunks.add(bufferSource.asArrayPtr().attach(kj::mv(bufferSource)));
+        }
+        return true;
+      });
+    }
+  }
+
   jsg::Promise<void> cancel(jsg::Lock& js, jsg::Optional<v8::Local<v8::Value>> maybeReason) {
     // When a ReadableStream is canceled, the expected behavior is that the underlying
     // controller is notified and the cancel algorithm on the underlying source is
@@ -1873,6 +1898,17 @@ struct ByteReadable final: private api::ByteQueue::ConsumerImpl::StateListener {
     }
   }
 
+  // Takes the bytes already buffered for this consumer without waiting.
+  void drainBuffered(jsg::Lock& js, kj::Vector<kj::Array<kj::byte>>& chunks) {
+    KJ_IF_SOME(s, state) {
+      s.consumer->drain(js, [&](ByteQueue::QueueEntry& entry) {
+        auto bytes = entry.entry->toArrayPtr().slice(entry.offset, entry.entry->getSize());
+        chunks.add(bytes.attach(kj::mv(entry.entry)));
+        return true;
+      });
+    }
+  }
+
   // When a ReadableStream is canceled, the expected behavior is that the underlying
   // controller is notified and the cancel algorithm on the underlying source is
   // called. When there are multiple ReadableStreams sharing consumption of a
@@ -2469,6 +2505,42 @@ kj::Maybe<jsg::Promise<ReadResult>> ReadableStreamJsController::read(
   KJ_UNREACHABLE;
 }
 
+kj::Vector<kj::Array<kj::byte>> ReadableStreamJsController::drainBuffered(jsg::Lock& js) {
+  kj::Vector<kj::Array<kj::byte>> chunks;
+  if (maybePendingState != kj::none) return chunks;
+
+  // As in deferControllerStateChange(), a close triggered by draining the queue must wait until
+  // we're done with the consumer.
+  pendingReadCount++;
+  KJ_SWITCH_ONEOF(state) {
+    KJ_CASE_ONEOF(closed, StreamStates::Closed) {}
+    KJ_CASE_ONEOF(errored, StreamStates::Errored) {}
+    KJ_CASE_ONEOF(consumer, kj::Own<ValueReadable>) {
+      consumer->drainBuffered(js, chunks);
+    }
+    KJ_CASE_ONEOF(consumer, kj::Own<ByteReadable>) {
+      consumer->drainBuffered(js, chunks);
+    }
+  }
+  --pendingReadCount;
+
+  if (!isReadPending()) {
+    KJ_IF_SOME(pendingState, maybePendingState) {
+      KJ_SWITCH_ONEOF(pendingState) {
+        KJ_CASE_ONEOF(closed, StreamStates::Closed) {
+          doClose(js);
+        }
+        KJ_CASE_ONEOF(errored, StreamStates::Errored) {
+          doError(js, errored.getHandle(js));
+        }
+      }
+      maybePendingState = kj::none;
+    }
+  }
+
+  return chunks;
+}
+
 void ReadableStreamJsController::releaseReader(
     Reader& reader,
     kj::Maybe<jsg::Lock&> maybeJs) {
@@ -2876,6 +2948,69 @@ private:
            state.template is<StreamStates::Closed>();
   }
 
+  ReadableStreamJsController& getController(ReadableStream& readable) {
+    // PumpToReader is only used by ReadableStreamJsController::pumpTo(), and the stream stays
+    // locked while we pump it.
+    return kj::downcast<ReadableStreamJsController>(readable.getController());
+  }
+
+  // Writes `chunks` to the sink, in a single write, then continues the pump loop.
+  jsg::Promise<void> writeChunks(
+      jsg::Lock& js,
+      IoContext& ioContext,
+      kj::Array<kj::Array<kj::byte>> chunks,
+      jsg::Ref<ReadableStream> readable,
+      IoOwn<WeakRef<PumpToReader>> pumpToReader) {
+    auto promise = [&]() -> kj::Promise<void> {
+      if (chunks.size() == 1) {
+        return sink->write(chunks[0].begin(), chunks[0].size()).attach(kj::mv(chunks));
+      }
+      auto pieces = KJ_MAP(chunk, chunks) -> kj::ArrayPtr<const kj::byte> { return chunk; };
+      return sink->write(pieces).attach(kj::mv(pieces), kj::mv(chunks));
+    }();
+
+    // Wrap the write promise in a canceler that will be triggered when the
+    // PumpToReader is dropped. While the write promise is pending, it is
+    // possible for the promise that is holding the PumpToReader to be
+    // dropped causing the hold on the sink to be released. If that is
+    // released while the write is still pending we can end up with an
+    // error further up the destruct chain.
+    return ioContext.awaitIo(js, canceler.wrap(kj::mv(promise))).then(js,
+        [](jsg::Lock& js) -> kj::Maybe<jsg::Value> {
+      // The write completed successfully.
+      return kj::Maybe<jsg::Value>(kj::none);
+    }, [](jsg::Lock& js, jsg::Value exception) mutable -> kj::Maybe<jsg::Value> {
+      // The write failed.
+      return kj::mv(exception);
+    }).then(js, ioContext.addFunctor(
+        JSG_VISITABLE_LAMBDA(
+          (readable=kj::mv(readable),pumpToReader=kj::mv(pumpToReader)),
+          (readable),
+          (jsg::Lock& js, kj::Maybe<jsg::Value> maybeException) mutable {
+      KJ_IF_SOME(reader, pumpToReader->tryGet()) {
+        auto& ioContext = reader.ioContext;
+        ioContext.requireCurrentOrThrowJs();
+        // Oh good, if we got here it means we're in the right IoContext and
+        // the PumpToReader is still alive.
+        KJ_IF_SOME(exception, maybeException) {
+          if (!reader.isErroredOrClosed()) {
+            reader.state.init<kj::Exception>(js.exceptionToKj(kj::mv(exception)));
+          }
+        } else {
+          // Else block to avert dangling else compiler warning.
+        }
+        return reader.pumpLoop(js, ioContext, readable.addRef(), kj::mv(pumpToReader));
+      } else {
+        // If we got here, we're in the right IoContext but the PumpToReader
+        // has been destroyed. Let's cancel the readable as the last step.
+        return readable->getController().cancel(js,
+            maybeException.map([&](jsg::Value& ex) {
+          return ex.getHandle(js);
+        }));
+      }
+    })));
+  }
+
   jsg::Promise<void> pumpLoop(
       jsg::Lock& js,
       IoContext& ioContext,
@@ -2899,6 +3034,14 @@ private:
         return js.rejectedPromise<void>(kj::cp(errored));
       }
       KJ_CASE_ONEOF(pumping, Pumping) {
+        // If the stream already has data buffered, we can write it right away, without waiting
+        // for a read promise (and the microtasks that resolve it).
+        auto buffered = getController(*readable).drainBuffered(js);
+        if (!buffered.empty()) {
+          return writeChunks(js, ioContext, buffered.releaseAsArray(),
+                             kj::mv(readable), kj::mv(pumpToReader));
+        }
+
         using Result = kj::OneOf<Pumping,              // Continue with next read.
                                  kj::Array<kj::byte>,  // Bytes to write were returned.
                                  StreamStates::Closed, // Readable indicated done.
@@ -2991,49 +3134,15 @@ private:
             auto& ioContext = IoContext::current();
             KJ_SWITCH_ONEOF(result) {
               KJ_CASE_ONEOF(bytes, kj::Array<kj::byte>) {
-                // We received bytes to write. Do so...
-                auto promise = reader.sink->write(bytes.begin(), bytes.size())
-                    .attach(kj::mv(bytes));
-                // Wrap the write promise in a canceler that will be triggered when the
-                // PumpToReader is dropped. While the write promise is pending, it is
-                // possible for the promise that is holding the PumpToReader to be
-                // dropped causing the hold on the sink to be released. If that is
-                // released while the write is still pending we can end up with an
-                // error further up the destruct chain.
-                return ioContext.awaitIo(js, reader.canceler.wrap(kj::mv(promise))).then(js,
-                    [](jsg::Lock& js) -> kj::Maybe<jsg::Value> {
-                  // The write completed successfully.
-                  return kj::Maybe<jsg::Value>(kj::none);
-                }, [](jsg::Lock& js, jsg::Value exception) mutable -> kj::Maybe<jsg::Value> {
-                  // The write failed.
-                  return kj::mv(exception);
-                }).then(js, ioContext.addFunctor(
-                    JSG_VISITABLE_LAMBDA(
-                      (readable=readable.addRef(),pumpToReader=kj::mv(pumpToReader)),
-                      (readable),
-                      (jsg::Lock& js, kj::Maybe<jsg::Value> maybeException) mutable {
-                  KJ_IF_SOME(reader, pumpToReader->tryGet()) {
-                    auto& ioContext = reader.ioContext;
-                    ioContext.requireCurrentOrThrowJs();
-                    // Oh good, if we got here it means we're in the right IoContext and
-                    // the PumpToReader is still alive.
-                    KJ_IF_SOME(exception, maybeException) {
-                      if (!reader.isErroredOrClosed()) {
-                        reader.state.init<kj::Exception>(js.exceptionToKj(kj::mv(exception)));
-                      }
-                    } else {
-                      // Else block to avert dangling else compiler warning.
-                    }
-                    return reader.pumpLoop(js, ioContext, readable.addRef(), kj::mv(pumpToReader));
-                  } else {
-                    // If we got here, we're in the right IoContext but the PumpToReader
-                    // has been destroyed. Let's cancel the readable as the last step.
-                    return readable->getController().cancel(js,
-                        maybeException.map([&](jsg::Value& ex) {
-                      return ex.getHandle(js);
-                    }));
-                  }
-                })));
+                // We received bytes to write. Write anything else that's already buffered
+                // along with them.
+                kj::Vector<kj::Array<kj::byte>> chunks;
+                chunks.add(kj::mv(bytes));
+                for (auto& chunk: reader.getController(*readable).drainBuffered(js)) {
+                  chunks.add(kj::mv(chunk));
+                }
+                return reader.writeChunks(js, ioContext, chunks.releaseAsArray(),
+                                          readable.addRef(), kj::mv(pumpToReader));
               }
               KJ_CASE_ONEOF(pumping, Pumping) {
                 // If we got here, a zero-length buffer was provided by the read and we're
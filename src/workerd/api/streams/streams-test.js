@@ -44,6 +44,32 @@ export const arrayBufferOfReadable = {
   }
 }
 
+export const brotliRoundTrip = {
+  async test() {
+    // Large enough to span several of the streams' internal output chunks.
+    const input = new TextEncoder().encode("0123456789".repeat(100_000));
+
+    const cs = new CompressionStream("br");
+    const cw = cs.writable.getWriter();
+    await cw.write(input);
+    await cw.close();
+    const compressed = await new Response(cs.readable).arrayBuffer();
+    assert.ok(compressed.byteLength < 1000);
+
+    const ds = new DecompressionStream("br");
+    const dw = ds.writable.getWriter();
+    await dw.write(compressed);
+    await dw.close();
+    const read = new Uint8Array(await new Response(ds.readable).arrayBuffer());
+    assert.deepStrictEqual(read, input);
+
+    assert.throws(() => new CompressionStream("zstd"), {
+      name: "TypeError",
+      message: "The compression format must be either 'deflate', 'deflate-raw', 'gzip' or 'br'.",
+    });
+  }
+}
+
 export const inspect = {
   async test() {
     const inspectOpts = { breakLength: Infinity };
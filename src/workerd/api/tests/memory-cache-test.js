@@ -224,3 +224,76 @@ export const fallbackNotLocked = {
     strictEqual(raced, 'bbb');
   }
 };
+
+export const staleWhileRevalidate = {
+  async test(ctrl, env) {
+    const options = { staleWhileRevalidate: 10000 };
+    strictEqual(await env.CACHE4.read('swr', async () => {
+      return { value: 'old', expiration: Date.now() + 100 };
+    }, options), 'old');
+    await scheduler.wait(200);
+
+    // The value has expired, but is within the window: it is returned right
+    // away, and exactly one fallback refreshes it in the background.
+    let refreshes = 0;
+    const { promise: refreshed, resolve } = Promise.withResolvers();
+    const refresh = async () => {
+      refreshes++;
+      await scheduler.wait(100);
+      resolve();
+      return { value: 'new' };
+    };
+    strictEqual(await env.CACHE4.read('swr', refresh, options), 'old');
+    strictEqual(await env.CACHE4.read('swr', refresh, options), 'old');
+    await refreshed;
+    await scheduler.wait(10);
+    strictEqual(refreshes, 1);
+    strictEqual(await env.CACHE4.read('swr', refresh, options), 'new');
+
+    // Without the option, an expired value is not returned.
+    strictEqual(await env.CACHE4.read('swr2', async () => {
+      return { value: 'old', expiration: Date.now() + 100 };
+    }), 'old');
+    await scheduler.wait(200);
+    strictEqual(await env.CACHE4.read('swr2', async () => {
+      return { value: 'new' };
+    }), 'new');
+  }
+};
+
+export const negativeCaching = {
+  async test(ctrl, env) {
+    const options = { negativeCacheTtl: 200 };
+    let calls = 0;
+    const failing = async () => {
+      calls++;
+      throw new Error('boom');
+    };
+    for (let n = 0; n < 3; n++) {
+      try {
+        await env.CACHE4.read('negative', failing, options);
+        throw new Error('should have thrown');
+      } catch (err) {
+        strictEqual(err.message, 'boom');
+      }
+    }
+    strictEqual(calls, 1);
+
+    // Reads without a fallback do not see the failure.
+    strictEqual(await env.CACHE4.read('negative'), undefined);
+
+    // Once the TTL has passed, the fallback is invoked again.
+    await scheduler.wait(300);
+    strictEqual(await env.CACHE4.read('negative', async () => {
+      return { value: 'ok' };
+    }, options), 'ok');
+
+    // Invalid options are rejected.
+    try {
+      await env.CACHE4.read('x', failing, { staleWhileRevalidate: -1 });
+      throw new Error('should have thrown');
+    } catch (err) {
+      ok(err instanceof RangeError);
+    }
+  }
+};
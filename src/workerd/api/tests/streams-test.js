@@ -2,6 +2,7 @@ import {
   strictEqual,
   ok,
   deepStrictEqual,
+  rejects,
 } from 'node:assert';
 
 const enc = new TextEncoder();
@@ -414,8 +415,89 @@ export const readableStreamFromNoopAsyncGen = {
   }
 };
 
+// Streams returned from the fetch() handler below, keyed by path. Pumping a response body from
+// JS writes all the chunks already queued in the stream at once, so each of these has several
+// queued up before the pump gets to them.
+const pumpChunkSizes = [1, 10, 4096, 3, 16384, 7, 65536, 100];
+function pumpChunk(size) {
+  return new Uint8Array(size).map((_, i) => (i * 7 + size) & 0xff);
+}
+function pumpExpected(repeat = 1) {
+  const chunks = [];
+  for (let n = 0; n < repeat; n++) {
+    chunks.push(...pumpChunkSizes.map(pumpChunk));
+  }
+  const result = new Uint8Array(chunks.reduce((total, chunk) => total + chunk.byteLength, 0));
+  let offset = 0;
+  for (const chunk of chunks) {
+    result.set(chunk, offset);
+    offset += chunk.byteLength;
+  }
+  return result;
+}
+
+const pumpStreams = {
+  // Everything, including the close, is queued before the response is returned.
+  '/pump-queued': () => new ReadableStream({
+    start(c) {
+      for (const size of pumpChunkSizes) c.enqueue(pumpChunk(size));
+      c.close();
+    }
+  }),
+
+  // The string can't be written, even though the bytes queued ahead of it can.
+  '/pump-non-bytes': () => new ReadableStream({
+    start(c) {
+      for (const size of pumpChunkSizes) c.enqueue(pumpChunk(size));
+      c.enqueue('not bytes');
+      c.close();
+    }
+  }),
+
+  // Each pull() hands its first chunk to the pump's pending read and queues the rest, so the last
+  // pull's close ends up queued behind chunks, and takes effect when the pump drains them.
+  '/pump-close-while-queued': () => {
+    let pulls = 0;
+    return new ReadableStream({
+      async pull(c) {
+        await scheduler.wait(1);
+        for (const size of pumpChunkSizes) c.enqueue(pumpChunk(size));
+        if (++pulls == 3) c.close();
+      }
+    });
+  },
+};
+
+export const pumpQueuedChunks = {
+  async test(ctrl, env) {
+    const resp = await env.subrequest.fetch('http://example.org/pump-queued');
+    deepStrictEqual(new Uint8Array(await resp.arrayBuffer()), pumpExpected());
+  }
+};
+
+export const pumpNonBytesAfterQueuedChunks = {
+  async test(ctrl, env) {
+    await rejects(async () => {
+      const resp = await env.subrequest.fetch('http://example.org/pump-non-bytes');
+      await resp.arrayBuffer();
+    });
+  }
+};
+
+export const pumpCloseWhileQueued = {
+  async test(ctrl, env) {
+    const resp = await env.subrequest.fetch('http://example.org/pump-close-while-queued');
+    deepStrictEqual(new Uint8Array(await resp.arrayBuffer()), pumpExpected(3));
+  }
+};
+
 export default {
   async fetch(request, env) {
+    const pumpStream = pumpStreams[new URL(request.url).pathname];
+    if (pumpStream) {
+      return new Response(pumpStream());
+    }
+
     strictEqual(request.headers.get('content-length'), '10');
     return new Response(request.body);
   }
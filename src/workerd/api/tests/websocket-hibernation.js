@@ -20,6 +20,8 @@ export class DurableObjectExample {
     let server = pair[0];
     if (request.url.endsWith("/hibernation")) {
       this.state.acceptWebSocket(server);
+    } else if (request.url.endsWith("/broadcast")) {
+      this.state.acceptWebSocket(server, ["room"]);
     } else {
       server.accept();
       server.addEventListener("message", () => {
@@ -36,7 +38,13 @@ export class DurableObjectExample {
     });
   }
 
-  webSocketMessage(ws) {
+  webSocketMessage(ws, message) {
+    if (typeof message === "string" && message.startsWith("broadcast:")) {
+      let count = this.state.broadcast(message.slice("broadcast:".length),
+                                       { tag: "room", except: [ws] });
+      ws.send(`broadcast to ${count}`);
+      return;
+    }
     ws.send(`Hibernatable message from DO.`)
   }
 
@@ -82,5 +90,47 @@ export default {
     await webSocketTest(obj, "http://example.com/", "regular close from DO");
     // Hibernatable Websocket.
     await webSocketTest(obj, "http://example.com/hibernation", "Hibernatable close from DO");
+
+    // Test that state.broadcast() reaches every websocket with the tag except the sender.
+    let connect = async () => {
+      let req = await obj.fetch("http://example.com/broadcast", {
+        headers: {
+          Upgrade: 'websocket',
+        },
+      });
+      let ws = req.webSocket;
+      if (!ws) {
+        throw new Error("Failed to get ws");
+      }
+      ws.accept();
+      let messages = [];
+      ws.addEventListener("message", (event) => messages.push(event.data));
+      return { ws, messages };
+    };
+    let sender = await connect();
+    let receiver = await connect();
+
+    let received = new Promise((resolve) => {
+      receiver.ws.addEventListener("message", (event) => resolve(event.data));
+    });
+    let acknowledged = new Promise((resolve) => {
+      sender.ws.addEventListener("message", (event) => resolve(event.data));
+    });
+    sender.ws.send("broadcast:hello everyone");
+
+    let ack = await acknowledged;
+    if (ack !== "broadcast to 1") {
+      throw new Error(`unexpected acknowledgement: ${ack}`);
+    }
+    let data = await received;
+    if (data !== "hello everyone") {
+      throw new Error(`unexpected broadcast: ${data}`);
+    }
+    if (sender.messages.length !== 1) {
+      throw new Error(`sender received its own broadcast: ${sender.messages}`);
+    }
+
+    sender.ws.close(1000, "bye from Worker!");
+    receiver.ws.close(1000, "bye from Worker!");
   }
 }
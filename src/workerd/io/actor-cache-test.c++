@@ -4132,6 +4132,69 @@ KJ_TEST("ActorCache exceed hard limit on write") {
       brokenPromise.wait(ws));
 }
 
+KJ_TEST("ActorCache exceed hard limit evicts from other threads' shards") {
+  ActorCacheTestOptions options;
+  ActorCache::SharedLru lru({2 * ENTRY_SIZE, 4 * ENTRY_SIZE,
+      options.staleTimeout, options.dirtyListByteLimit, options.maxKeysPerRpc});
+
+  // 0 = starting, 1 = the other thread has cached its entries, 2 = we're done with them.
+  kj::MutexGuarded<uint> stage(0);
+
+  kj::Thread thread([&]() {
+    kj::EventLoop loop;
+    kj::WaitScope ws(loop);
+    auto mockPair = MockServer::make<rpc::ActorStorage::Stage>();
+    auto& mockStorage = mockPair.mock;
+    OutputGate gate;
+    ActorCache cache(kj::mv(mockPair.client), lru, gate);
+    ActorCacheConvenienceWrappers ezCache(cache);
+
+    // Fill this thread's shard with clean entries, up to the soft limit.
+    {
+      auto promise = expectUncached(ezCache.get("bar"));
+      mockStorage->expectCall("get", ws)
+          .withParams(CAPNP(key = "bar"))
+          .thenReturn(CAPNP(value = "456"));
+      KJ_ASSERT(KJ_ASSERT_NONNULL(promise.wait(ws)) == "456");
+    }
+    {
+      auto promise = expectUncached(ezCache.get("baz"));
+      mockStorage->expectCall("get", ws)
+          .withParams(CAPNP(key = "baz"))
+          .thenReturn(CAPNP(value = "789"));
+      KJ_ASSERT(KJ_ASSERT_NONNULL(promise.wait(ws)) == "789");
+    }
+
+    // Go idle, without touching the cache, until the main thread is done.
+    *stage.lockExclusive() = 1;
+    stage.when([](const uint& s) { return s == 2; }, [](uint&) {});
+
+    cache.verifyConsistencyForTest();
+  });
+
+  {
+    KJ_DEFER(*stage.lockExclusive() = 2);
+    stage.when([](const uint& s) { return s == 1; }, [](uint&) {});
+    KJ_ASSERT(lru.currentSize() == 2 * ENTRY_SIZE);
+
+    kj::EventLoop loop;
+    kj::WaitScope ws(loop);
+    auto mockPair = MockServer::make<rpc::ActorStorage::Stage>();
+    OutputGate gate;
+    ActorCache cache(kj::mv(mockPair.client), lru, gate);
+    ActorCacheConvenienceWrappers ezCache(cache);
+
+    // Our own shard has no clean entries at all, so only evicting the other thread's can keep the
+    // third put under the hard limit.
+    ezCache.put("foo", "123");
+    ezCache.put("qux", "321");
+    ezCache.put("xyz", "654");
+
+    KJ_EXPECT(lru.currentSize() == 3 * ENTRY_SIZE);
+    cache.verifyConsistencyForTest();
+  }
+}
+
 // =======================================================================================
 
 KJ_TEST("ActorCache skip cache") {
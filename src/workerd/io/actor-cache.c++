@@ -42,12 +42,13 @@ auto recordStorageWrite(ActorCache::Hooks& hooks, const kj::MonotonicClock& cloc
 
 ActorCache::ActorCache(rpc::ActorStorage::Stage::Client storage, const SharedLru& lru,
                        OutputGate& gate, Hooks& hooks)
-    : storage(kj::mv(storage)), lru(lru), gate(gate), hooks(hooks), clock(kj::systemPreciseMonotonicClock()),
-      currentValues(lru.cleanList.lockExclusive()) {}
+    : storage(kj::mv(storage)), lru(lru), lruShard(lru.currentThreadShard()), gate(gate),
+      hooks(hooks), clock(kj::systemPreciseMonotonicClock()),
+      currentValues(lruShard.cleanList.lockExclusive()) {}
 
 ActorCache::~ActorCache() noexcept(false) {
   // Need to remove all entries from any lists they might be in.
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = lruShard.cleanList.lockExclusive();
   clear(lock);
 }
 
@@ -109,8 +110,10 @@ ActorCache::Entry::~Entry() noexcept(false) {
 ActorCache::SharedLru::SharedLru(Options options): options(options) {}
 
 ActorCache::SharedLru::~SharedLru() noexcept(false) {
-  KJ_REQUIRE(cleanList.getWithoutLock().empty(),
-      "ActorCache::SharedLru destroyed while an ActorCache still exists?");
+  for (auto& shard: shards) {
+    KJ_REQUIRE(shard.cleanList.getWithoutLock().empty(),
+        "ActorCache::SharedLru destroyed while an ActorCache still exists?");
+  }
   if (size.load(std::memory_order_relaxed) != 0) {
     KJ_LOG(ERROR, "SharedLru destroyed while cache entries still exist, "
         "this will lead to use-after-free");
@@ -119,12 +122,12 @@ ActorCache::SharedLru::~SharedLru() noexcept(false) {
 
 kj::Maybe<kj::Promise<void>> ActorCache::evictStale(kj::Date now) {
   int64_t nowNs = (now - kj::UNIX_EPOCH) / kj::NANOSECONDS;
-  int64_t oldValue = lru.nextStaleCheckNs.load(std::memory_order_relaxed);
+  int64_t oldValue = lruShard.nextStaleCheckNs.load(std::memory_order_relaxed);
 
   if (nowNs >= oldValue) {
     int64_t newValue = nowNs + lru.options.staleTimeout / kj::NANOSECONDS;
-    if (lru.nextStaleCheckNs.compare_exchange_strong(oldValue, newValue)) {
-      auto lock = lru.cleanList.lockExclusive();
+    if (lruShard.nextStaleCheckNs.compare_exchange_strong(oldValue, newValue)) {
+      auto lock = lruShard.cleanList.lockExclusive();
       for (auto& entry: *lock) {
         if (entry.isStale) {
           auto& cache = KJ_ASSERT_NONNULL(entry.maybeCache);
@@ -256,18 +259,48 @@ void ActorCache::evictOrOomIfNeeded(Lock& lock) {
   }
 }
 
+const ActorCache::LruShard& ActorCache::SharedLru::currentThreadShard() const {
+  static std::atomic<uint> threadCount = 0;
+  static thread_local uint threadIndex = threadCount.fetch_add(1, std::memory_order_relaxed);
+  return shards[threadIndex % SHARD_COUNT];
+}
+
 bool ActorCache::SharedLru::evictIfNeeded(Lock& lock) const {
-  for (;;) {
-    size_t current = size.load(std::memory_order_relaxed);
-    if (current <= options.softLimit) {
-      // All good.
+  if (!evictFromShard(lock)) {
+    return false;
+  }
+
+  // Our own shard has nothing left to evict, but other shards may still hold clean entries, e.g.
+  // because their threads have gone idle. We're already holding our own shard's lock, so we must
+  // not block on theirs: a thread doing the same thing the other way around would deadlock with
+  // us. So first we only take the locks that are free, and if that isn't enough to get under the
+  // hard limit, we make one more pass waiting briefly on each.
+  for (kj::Duration timeout: {0 * kj::NANOSECONDS, 1 * kj::MILLISECONDS}) {
+    for (auto& shard: shards) {
+      if (&shard.cleanList.getWithoutLock() == &*lock) continue;
+
+      auto maybeLock = shard.cleanList.lockExclusiveWithTimeout(timeout);
+      KJ_IF_SOME(otherLock, maybeLock) {
+        if (!evictFromShard(otherLock)) {
+          return false;
+        }
+      }
+    }
+
+    if (size.load(std::memory_order_relaxed) <= options.hardLimit) {
+      // Still over the soft limit, but not by enough to be worth waiting on anyone.
       return false;
     }
+  }
 
-    // We're over the limit, let's evict stuff.
+  return true;
+}
+
+bool ActorCache::SharedLru::evictFromShard(Lock& lock) const {
+  while (size.load(std::memory_order_relaxed) > options.softLimit) {
     if (lock->empty()) {
-      // Nothing to evict.
-      return current > options.hardLimit;
+      // Nothing (more) to evict here.
+      return true;
     }
 
     Entry& entry = lock->front();
@@ -275,6 +308,8 @@ bool ActorCache::SharedLru::evictIfNeeded(Lock& lock) const {
     cache.removeEntry(lock, entry);
     cache.evictEntry(lock, entry);
   }
+
+  return false;
 }
 
 void ActorCache::touchEntry(Lock& lock, Entry& entry, const ReadOptions& options) {
@@ -325,7 +360,7 @@ void ActorCache::evictEntry(Lock& lock, Entry& entry) {
 }
 
 void ActorCache::verifyConsistencyForTest() {
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = lruShard.cleanList.lockExclusive();
   currentValues.get(lock).verify();  // verify the table's BTreeIndex
   bool prevGapIsKnownEmpty = false;
   kj::Maybe<kj::StringPtr> prevKey = kj::none;
@@ -368,7 +403,7 @@ kj::OneOf<kj::Maybe<ActorCache::Value>, kj::Promise<kj::Maybe<ActorCache::Value>
   options.noCache = options.noCache || lru.options.noCache;
   requireNotTerminal();
 
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = lruShard.cleanList.lockExclusive();
   auto entry = findInCache(lock, kj::mv(key), options);
   switch (entry->valueStatus) {
     case EntryValueStatus::PRESENT:
@@ -395,7 +430,7 @@ auto ActorCache::getImpl(kj::Own<Entry> entry, ReadOptions options)
   if (response.hasValue()) {
     value = response.getValue();
   }
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = lruShard.cleanList.lockExclusive();
   auto newEntry = addReadResultToCache(lock, cloneKey(entry->key), value, options);
   evictOrOomIfNeeded(lock);
   co_return newEntry->getValue();
@@ -419,7 +454,7 @@ public:
       return KJ_EXCEPTION(DISCONNECTED, "canceled");
     }
 
-    auto lock = cache.lru.cleanList.lockExclusive();
+    auto lock = cache.lruShard.cleanList.lockExclusive();
     auto params = context.getParams();
     kj::String prevKey;
     for (auto kv: params.getList()) {
@@ -469,7 +504,7 @@ public:
 
     if (nextExpectedKey < keysToFetch.end()) {
       // Some trailing keys weren't seen, better mark them as not present.
-      auto lock = cache.lru.cleanList.lockExclusive();
+      auto lock = cache.lruShard.cleanList.lockExclusive();
       while (nextExpectedKey < keysToFetch.end()) {
         cache.addReadResultToCache(lock, kj::mv(*nextExpectedKey++), kj::none, options);
       }
@@ -540,7 +575,7 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>>
   capnp::MessageSize sizeHint { 4, 1 };
 
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = lruShard.cleanList.lockExclusive();
     for (auto& key: keys) {
       auto entry = findInCache(lock, key, options);
       switch(entry->valueStatus) {
@@ -724,7 +759,7 @@ public:
     }
 
     {
-      auto lock = cache.lru.cleanList.lockExclusive();
+      auto lock = cache.lruShard.cleanList.lockExclusive();
       auto list = context.getParams().getList();
 
       bool insertedAny = false;
@@ -782,7 +817,7 @@ public:
 
     // Mark the rest of the range as empty.
     {
-      auto lock = cache.lru.cleanList.lockExclusive();
+      auto lock = cache.lruShard.cleanList.lockExclusive();
 
       if (!beginKeyIsKnown) {
         // We received no results at all, so the start of the list is definitely not in storage.
@@ -890,7 +925,7 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>>
   // negative entries in the range, since each of those negative entries could potentially negate a
   // positive entry read from disk.
 
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = lruShard.cleanList.lockExclusive();
   auto& map = currentValues.get(lock);
   auto ordered = map.ordered();
 
@@ -1093,7 +1128,7 @@ public:
     }
 
     {
-      auto lock = cache.lru.cleanList.lockExclusive();
+      auto lock = cache.lruShard.cleanList.lockExclusive();
       auto list = context.getParams().getList();
 
       bool insertedAny = false;
@@ -1141,7 +1176,7 @@ public:
 
     // Mark the rest of the range as empty.
     {
-      auto lock = cache.lru.cleanList.lockExclusive();
+      auto lock = cache.lruShard.cleanList.lockExclusive();
 
       if (fetchedEntries.size() < adjustedLimit.orDefault(kj::maxValue)) {
         // We didn't reach the limit, so the rest of the range must be empty.
@@ -1229,7 +1264,7 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>>
   // negative entries in the range, since each of those negative entries could potentially negate a
   // positive entry read from disk.
 
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = lruShard.cleanList.lockExclusive();
   auto& map = currentValues.get(lock);
   auto ordered = map.ordered();
 
@@ -1796,7 +1831,7 @@ kj::Maybe<kj::Promise<void>> ActorCache::put(Key key, Value value, WriteOptions
   options.noCache = options.noCache || lru.options.noCache;
   requireNotTerminal();
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = lruShard.cleanList.lockExclusive();
     kj::Maybe<CountedDelete> maybeCountedDelete;
     auto entry = kj::atomicRefcounted<Entry>(*this, kj::mv(key), kj::mv(value));
     putImpl(lock, kj::mv(entry), options, maybeCountedDelete);
@@ -1809,7 +1844,7 @@ kj::Maybe<kj::Promise<void>> ActorCache::put(kj::Array<KeyValuePair> pairs, Writ
   options.noCache = options.noCache || lru.options.noCache;
   requireNotTerminal();
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = lruShard.cleanList.lockExclusive();
     for (auto& pair: pairs) {
       kj::Maybe<CountedDelete> maybeCountedDelete;
       auto entry = kj::atomicRefcounted<Entry>(*this, kj::mv(pair.key), kj::mv(pair.value));
@@ -1857,7 +1892,7 @@ kj::OneOf<bool, kj::Promise<bool>> ActorCache::delete_(Key key, WriteOptions opt
 
   auto countedDelete = kj::refcounted<CountedDelete>();
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = lruShard.cleanList.lockExclusive();
     auto entry = kj::atomicRefcounted<Entry>(*this, kj::mv(key), EntryValueStatus::ABSENT);
     putImpl(lock, kj::mv(entry), options, *countedDelete);
     evictOrOomIfNeeded(lock);
@@ -1895,7 +1930,7 @@ kj::OneOf<uint, kj::Promise<uint>> ActorCache::delete_(kj::Array<Key> keys, Writ
 
   auto countedDelete = kj::refcounted<CountedDelete>();
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = lruShard.cleanList.lockExclusive();
     for (auto& key: keys) {
       auto entry = kj::atomicRefcounted<Entry>(*this, kj::mv(key), EntryValueStatus::ABSENT);
       putImpl(lock, kj::mv(entry), options, *countedDelete);
@@ -1948,7 +1983,7 @@ ActorCache::DeleteAllResults ActorCache::deleteAll(WriteOptions options) {
   kj::Promise<uint> result { (uint)0 };
 
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = lruShard.cleanList.lockExclusive();
     auto& map = currentValues.get(lock);
 
     kj::Vector<kj::Own<Entry>> deletedDirty;
@@ -2262,7 +2297,7 @@ kj::Promise<void> ActorCache::flushImpl(uint retryCount) {
   // Perhaps this would be possible to fix by adding more complex logic. But, it doesn't seem
   // like a big deal to require all flushes to be complete flushes.
 
-  // We don't take a lock on `lru.cleanList` here, because we don't need it. We only access
+  // We don't take a lock on `lruShard.cleanList` here, because we don't need it. We only access
   // `dirtyList`, which is only ever accessed within the actor's thread, so it's safe. We know
   // that `SharedLru` will only ever mess with CLEAN entries, which we don't look at here.
 
@@ -2479,7 +2514,7 @@ kj::Promise<void> ActorCache::flushImpl(uint retryCount) {
       return flushImplDeleteAll();
     }
 
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = lruShard.cleanList.lockExclusive();
 
     KJ_IF_SOME(r, requestedDeleteAll) {
       // It would appear that all dirty entries were moved into `requestedDeleteAll` during the
@@ -2947,7 +2982,7 @@ kj::Promise<void> ActorCache::flushImplDeleteAll(uint retryCount) {
     requestedDeleteAll = kj::none;
 
     {
-      auto lock = lru.cleanList.lockExclusive();
+      auto lock = lruShard.cleanList.lockExclusive();
       evictOrOomIfNeeded(lock);
     }
 
@@ -2987,7 +3022,7 @@ ActorCache::Transaction::~Transaction() noexcept(false) {
 
 kj::Maybe<kj::Promise<void>> ActorCache::Transaction::commit() {
   {
-    auto lock = cache.lru.cleanList.lockExclusive();
+    auto lock = cache.lruShard.cleanList.lockExclusive();
     for (auto& change: entriesToWrite) {
       cache.putImpl(lock, kj::mv(change.entry), change.options, kj::none);
     }
@@ -3138,7 +3173,7 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>>
 kj::Maybe<kj::Promise<void>> ActorCache::Transaction::put(
     Key key, Value value, WriteOptions options) {
   options.noCache = options.noCache || cache.lru.options.noCache;
-  auto lock = cache.lru.cleanList.lockExclusive();
+  auto lock = cache.lruShard.cleanList.lockExclusive();
   auto entry = kj::atomicRefcounted<Entry>(cache, kj::mv(key), kj::mv(value));
   putImpl(lock, kj::mv(entry), options);
 
@@ -3149,7 +3184,7 @@ kj::Maybe<kj::Promise<void>> ActorCache::Transaction::put(
 kj::Maybe<kj::Promise<void>> ActorCache::Transaction::put(
     kj::Array<KeyValuePair> pairs, WriteOptions options) {
   options.noCache = options.noCache || cache.lru.options.noCache;
-  auto lock = cache.lru.cleanList.lockExclusive();
+  auto lock = cache.lruShard.cleanList.lockExclusive();
 
   for (auto& pair: pairs) {
     auto entry = kj::atomicRefcounted<Entry>(cache, kj::mv(pair.key), kj::mv(pair.value));
@@ -3176,7 +3211,7 @@ kj::OneOf<bool, kj::Promise<bool>> ActorCache::Transaction::delete_(
   kj::Maybe<KeyPtr> keyToCount;
 
   {
-    auto lock = cache.lru.cleanList.lockExclusive();
+    auto lock = cache.lruShard.cleanList.lockExclusive();
     auto entry = kj::atomicRefcounted<Entry>(cache, kj::mv(key), EntryValueStatus::ABSENT);
     keyToCount = putImpl(lock, kj::mv(entry), options, count);
   }
@@ -3215,7 +3250,7 @@ kj::OneOf<uint, kj::Promise<uint>> ActorCache::Transaction::delete_(
   auto currentBatch = startNewBatch();
 
   {
-    auto lock = cache.lru.cleanList.lockExclusive();
+    auto lock = cache.lruShard.cleanList.lockExclusive();
     for (auto& key: keys) {
       auto entry = kj::atomicRefcounted<Entry>(cache, kj::mv(key), EntryValueStatus::ABSENT);
       KJ_IF_SOME(keyToCount, putImpl(lock, kj::mv(entry), options, count)) {
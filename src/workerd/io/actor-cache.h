@@ -382,7 +382,7 @@ private:
     // the read operation still has the original value from when it was called.
     //
     // The mutable content of an `Entry` is protected by the same mutex that protects
-    // `lru.cleanList`. `key` and `value` are declared `const` so that they can safely be used
+    // `lruShard.cleanList`. `key` and `value` are declared `const` so that they can safely be used
     // without a lock.
 
     Entry(ActorCache& cache, Key key, Value value);
@@ -467,7 +467,7 @@ private:
     // to the replacement entry, so that it can be retried.)
     kj::Maybe<kj::Own<CountedDelete>> countedDelete;
 
-    // If CLEAN, the entry will be in the SharedLru's `cleanList`.
+    // If CLEAN, the entry will be in the `cleanList` of this cache's SharedLru shard.
     //
     // If DIRTY or FLUSHING, the entry will be in `dirtyList`.
     kj::ListLink<Entry> link;
@@ -513,6 +513,12 @@ private:
 
   rpc::ActorStorage::Stage::Client storage;
   const SharedLru& lru;
+
+  // The part of `lru` that this cache's clean entries live in. Its lock also protects
+  // `currentValues`.
+  struct LruShard;
+  const LruShard& lruShard;
+
   OutputGate& gate;
   Hooks& hooks;
   const kj::MonotonicClock& clock;
@@ -548,8 +554,8 @@ private:
 
   // Map of current known values for keys. Searchable by key, including ordered iteration.
   //
-  // This map is protected by the same lock as lru.cleanList. ExternalMutexGuarded helps enforce
-  // this.
+  // This map is protected by the same lock as lruShard.cleanList. ExternalMutexGuarded helps
+  // enforce this.
   kj::ExternalMutexGuarded<kj::Table<kj::Own<Entry>, kj::TreeIndex<EntryTableCallbacks>>>
       currentValues;
 
@@ -623,7 +629,7 @@ private:
   // Will be canceled if and when `oomException` becomes non-null.
   kj::Canceler oomCanceler;
 
-  // Type of a lock on `SharedLru::cleanList`. We use the same lock to protect `currentValues`.
+  // Type of a lock on `lruShard.cleanList`. We use the same lock to protect `currentValues`.
   typedef kj::Locked<kj::List<Entry, &Entry::link>> Lock;
 
   // Indicate that an entry was observed by a read operation and so should be moved to the end of
@@ -801,6 +807,18 @@ private:
   friend class ActorCache;
 };
 
+// One shard of an ActorCache::SharedLru. See SharedLru::shards. Aligned so that shards used by
+// different threads don't share cache lines.
+struct alignas(64) ActorCache::LruShard {
+  // List of clean values, across all caches in this shard, ordered from least-recently-used to
+  // most-recently-used.
+  kj::MutexGuarded<kj::List<Entry, &Entry::link>> cleanList;
+
+  // TimePoint when we should next evict stale entries from this shard. Represented as an int64_t
+  // of nanoseconds instead of kj::TimePoint to allow for atomic operations.
+  mutable std::atomic<int64_t> nextStaleCheckNs = 0;
+};
+
 // Options to ActorCache::SharedLru's constructor. Declared at top level so that it can be
 // forward-declared elsewhere.
 struct ActorCacheSharedLruOptions {
@@ -849,23 +867,39 @@ public:
 private:
   Options options;
 
-  // List of clean values, across all caches, ordered from least-recently-used to
-  // most-recently-used.
-  kj::MutexGuarded<kj::List<Entry, &Entry::link>> cleanList;
+  // Every cache operation, including each read (to bump the entry's recency), takes its shard's
+  // lock. With a single lock, caches on different threads would all contend for it, so instead
+  // each thread's caches get a shard of their own. Each shard is an LRU of its own, and evicts
+  // its own entries first whenever the total `size` is over the soft limit. Only once its own
+  // shard is empty does a thread go on to evict from the other shards, so that a shard that's gone
+  // idle can't hold on to clean entries while another thread fails at the hard limit.
+  //
+  // Caches created on the same thread always share a shard, so a single-threaded process sees
+  // exactly one global LRU, as before.
+  static constexpr uint SHARD_COUNT = 16;
+  LruShard shards[SHARD_COUNT];
 
-  // Total byte size of everything that is cached, including dirty values that are not in `list`.
+  // Total byte size of everything that is cached, including dirty values that are not in any
+  // `cleanList`.
   mutable std::atomic<size_t> size = 0;
 
-  // TimePoint when we should next evict stale entries. Represented as an int64_t of nanoseconds
-  // instead of kj::TimePoint to allow for atomic operations.
-  mutable std::atomic<int64_t> nextStaleCheckNs = 0;
+  // Returns the shard for caches created on the current thread.
+  const LruShard& currentThreadShard() const;
 
-  // Evict cache entries as needed according to the cache limits. Returns true if the hard limit
-  // is exceeded and nothing can be evicted, in which case the caller should fail out in the
-  // appropriate way for the kind of operation being performed.
+  // Evict cache entries as needed according to the cache limits, starting with the locked shard.
+  // Returns true if the hard limit is exceeded and nothing can be evicted, in which case the
+  // caller should fail out in the appropriate way for the kind of operation being performed.
   bool evictIfNeeded(Lock& lock) const KJ_WARN_UNUSED_RESULT;
 
+  // Evict entries from the locked shard until `size` is under the soft limit. Returns true if the
+  // shard ran out of entries first.
+  bool evictFromShard(Lock& lock) const;
+
   friend class ActorCache;
+
+  // ActorSqlite's read cache counts toward `size` and honors `options`, but keeps its entries
+  // out of the shards' `cleanList`s, evicting them itself.
+  friend class ActorSqlite;
 };
 
 // A transaction represents a set of writes that haven't been committed. The transaction can be
@@ -0,0 +1,136 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "actor-sqlite.h"
+#include "io-gate.h"
+#include <kj/test.h>
+
+namespace workerd {
+namespace {
+
+struct ActorSqliteTestOptions {
+  size_t softLimit = 512 * 1024;
+  size_t hardLimit = 1024 * 1024;
+};
+
+struct ActorSqliteTest {
+  kj::EventLoop loop;
+  kj::WaitScope ws{loop};
+
+  kj::Own<const kj::Directory> dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs{*dir};
+
+  ActorCache::SharedLru lru;
+  OutputGate gate;
+  ActorSqlite actor;
+
+  explicit ActorSqliteTest(ActorSqliteTestOptions options = {})
+      : lru({
+          .softLimit = options.softLimit,
+          .hardLimit = options.hardLimit,
+          .staleTimeout = 1 * kj::SECONDS,
+          .dirtyListByteLimit = 0,
+          .maxKeysPerRpc = 128,
+        }),
+        actor(kj::heap<SqliteDatabase>(vfs, kj::Path({"foo"}),
+                                       kj::WriteMode::CREATE | kj::WriteMode::MODIFY),
+              gate, []() -> kj::Promise<void> { return kj::READY_NOW; },
+              ActorSqlite::Hooks::DEFAULT, lru) {}
+
+  SqliteDatabase& db() { return KJ_ASSERT_NONNULL(actor.getSqliteDatabase()); }
+
+  kj::Maybe<kj::String> get(ActorCacheOps& ops, kj::StringPtr key) {
+    auto result = kj::mv(KJ_ASSERT_NONNULL(
+        ops.get(kj::str(key), {}).tryGet<kj::Maybe<ActorCacheOps::Value>>()));
+    return result.map([](ActorCacheOps::Value& value) { return kj::str(value.asChars()); });
+  }
+  kj::Maybe<kj::String> get(kj::StringPtr key) { return get(actor, key); }
+
+  void put(ActorCacheOps& ops, kj::StringPtr key, kj::StringPtr value) {
+    KJ_EXPECT(ops.put(kj::str(key), kj::heapArray(value.asBytes()), {}) == kj::none);
+  }
+  void put(kj::StringPtr key, kj::StringPtr value) { put(actor, key, value); }
+};
+
+KJ_TEST("ActorSqlite serves repeated reads from its read cache") {
+  ActorSqliteTest test;
+
+  test.put("foo", "bar");
+  KJ_EXPECT(test.get("baz") == kj::none);
+  test.ws.poll();
+
+  // Change the database behind the cache's back, to see where reads are served from.
+  test.db().run("UPDATE _cf_KV SET value = x'00'");
+  test.db().run("INSERT INTO _cf_KV VALUES ('baz', x'00')");
+  KJ_EXPECT(KJ_ASSERT_NONNULL(test.get("foo")) == "bar");
+  KJ_EXPECT(test.get("baz") == kj::none);
+
+  // Keys that haven't been read yet come from the database.
+  test.db().run("INSERT INTO _cf_KV VALUES ('qux', x'717578')");
+  KJ_EXPECT(KJ_ASSERT_NONNULL(test.get("qux")) == "qux");
+}
+
+KJ_TEST("ActorSqlite read cache follows writes and rollbacks") {
+  ActorSqliteTest test;
+
+  test.put("foo", "a");
+  KJ_EXPECT(KJ_ASSERT_NONNULL(test.get("foo")) == "a");
+  test.ws.poll();
+
+  {
+    auto txn = test.actor.startTransaction();
+    test.put(*txn, "foo", "b");
+    test.put(*txn, "bar", "b");
+    KJ_EXPECT(KJ_ASSERT_NONNULL(test.get(*txn, "foo")) == "b");
+    txn->rollback().wait(test.ws);
+  }
+  KJ_EXPECT(KJ_ASSERT_NONNULL(test.get("foo")) == "a");
+  KJ_EXPECT(test.get("bar") == kj::none);
+
+  {
+    auto txn = test.actor.startTransaction();
+    test.put(*txn, "foo", "c");
+    KJ_EXPECT(txn->commit() == kj::none);
+  }
+  KJ_EXPECT(KJ_ASSERT_NONNULL(test.get("foo")) == "c");
+
+  KJ_EXPECT(test.actor.delete_(kj::str("foo"), {}).get<bool>());
+  KJ_EXPECT(test.get("foo") == kj::none);
+
+  test.put("foo", "d");
+  test.actor.deleteAll({});
+  KJ_EXPECT(test.get("foo") == kj::none);
+  test.ws.poll();
+}
+
+KJ_TEST("ActorSqlite read cache counts toward the shared LRU's limits") {
+  ActorSqliteTest test({ .softLimit = 1000, .hardLimit = 1500 });
+
+  auto value = kj::str(kj::repeat('x', 200));
+  for (auto i: kj::zeroTo(10)) {
+    test.put(kj::str("key", i), value);
+    KJ_EXPECT(test.lru.currentSize() > 0);
+    KJ_EXPECT(test.lru.currentSize() <= 1000);
+  }
+  test.ws.poll();
+
+  // A value too big to fit under the hard limit isn't cached at all.
+  test.put("big", kj::str(kj::repeat('x', 2000)));
+  KJ_EXPECT(test.lru.currentSize() == 0);
+  KJ_EXPECT(KJ_ASSERT_NONNULL(test.get("big")).size() == 2000);
+  KJ_EXPECT(test.lru.currentSize() == 0);
+
+  // Entries that go unread for a whole stale timeout are evicted.
+  KJ_EXPECT(test.get("key9") != kj::none);
+  KJ_EXPECT(test.lru.currentSize() > 0);
+  auto now = kj::UNIX_EPOCH + 1000 * kj::SECONDS;
+  KJ_EXPECT(test.actor.evictStale(now) == kj::none);
+  KJ_EXPECT(test.lru.currentSize() > 0);
+  KJ_EXPECT(test.actor.evictStale(now + 2 * kj::SECONDS) == kj::none);
+  KJ_EXPECT(test.lru.currentSize() == 0);
+  test.ws.poll();
+}
+
+}  // namespace
+}  // namespace workerd
@@ -9,14 +9,158 @@
 
 namespace workerd {
 
+// Values read from or written to `kv`, kept in memory. Writes go through to SQLite as usual and
+// replace the cached value, so the cache always matches the database as it's seen from inside
+// the current transaction. Since a rollback can discard writes the cache has already seen, the
+// whole cache is dropped whenever anything is rolled back; that's rare enough not to matter.
+class ActorSqlite::ReadCache {
+public:
+  explicit ReadCache(const ActorCache::SharedLru& lru): lru(lru) {}
+
+  ~ReadCache() noexcept(false) {
+    clear();
+  }
+
+  KJ_DISALLOW_COPY_AND_MOVE(ReadCache);
+
+  // Returns kj::none if `key` isn't cached. Otherwise returns its value, or kj::none inside if
+  // the key is known not to exist.
+  kj::Maybe<kj::Maybe<Value>> get(KeyPtr key) {
+    auto& entry = *KJ_UNWRAP_OR(entries.find(key), return kj::none);
+    entry.isStale = false;
+    lruList.remove(entry);
+    lruList.add(entry);
+    return entry.getValue();
+  }
+
+  // Caches `value` for `key`, replacing any value already cached, and returns it. The returned
+  // value shares the cached copy.
+  kj::Maybe<Value> put(KeyPtr key, kj::Maybe<Value> value) {
+    remove(key);
+
+    auto entry = kj::refcounted<Entry>(lru, key, kj::mv(value));
+    auto result = entry->getValue();
+    if (makeRoom()) {
+      lruList.add(*entry);
+      KeyPtr entryKey = entry->key;
+      entries.insert(entryKey, kj::mv(entry));
+    }
+    return result;
+  }
+
+  void remove(KeyPtr key) {
+    KJ_IF_SOME(entry, entries.find(key)) {
+      lruList.remove(*entry);
+      entries.erase(key);
+    }
+  }
+
+  void clear() {
+    while (!lruList.empty()) {
+      lruList.remove(lruList.front());
+    }
+    entries.clear();
+  }
+
+  // Evicts entries that haven't been read since the previous call, if it was at least
+  // `staleTimeout` ago.
+  void evictStale(kj::Date now) {
+    if (now < nextStaleCheck) return;
+    nextStaleCheck = now + lru.options.staleTimeout;
+
+    kj::Vector<KeyPtr> stale;
+    for (auto& entry: lruList) {
+      if (entry.isStale) {
+        stale.add(entry.key);
+      } else {
+        entry.isStale = true;
+      }
+    }
+    for (auto key: stale) {
+      remove(key);
+    }
+  }
+
+private:
+  struct Entry: public kj::Refcounted {
+    Entry(const ActorCache::SharedLru& lru, KeyPtr key, kj::Maybe<Value> value)
+        : lru(lru), key(cloneKey(key)), value(kj::mv(value)) {
+      lru.size.fetch_add(size(), std::memory_order_relaxed);
+    }
+    ~Entry() noexcept(false) {
+      lru.size.fetch_sub(size(), std::memory_order_relaxed);
+    }
+    KJ_DISALLOW_COPY_AND_MOVE(Entry);
+
+    const ActorCache::SharedLru& lru;
+    const Key key;
+    const kj::Maybe<Value> value;
+    bool isStale = false;
+    kj::ListLink<Entry> link;
+
+    size_t size() const {
+      size_t result = sizeof(*this) + key.size();
+      KJ_IF_SOME(v, value) {
+        result += v.size();
+      }
+      return result;
+    }
+
+    kj::Maybe<Value> getValue() {
+      KJ_IF_SOME(v, value) {
+        return v.asPtr().attach(kj::addRef(*this));
+      } else {
+        return kj::none;
+      }
+    }
+  };
+
+  const ActorCache::SharedLru& lru;
+
+  // Keyed by pointers to each entry's own key.
+  kj::HashMap<KeyPtr, kj::Own<Entry>> entries;
+
+  // Least recently used first.
+  kj::List<Entry, &Entry::link> lruList;
+
+  kj::Date nextStaleCheck = kj::UNIX_EPOCH;
+
+  // Evicts our least recently used entries while the shared size is over the soft limit. Other
+  // actors' entries are theirs to evict. Returns false if a new entry would push the shared size
+  // past the hard limit, in which case it shouldn't be cached: unlike ActorCache, which has to
+  // hold dirty values somewhere, we can always just read from the database instead.
+  bool makeRoom() {
+    while (lru.size.load(std::memory_order_relaxed) > lru.options.softLimit &&
+           !lruList.empty()) {
+      Entry& entry = lruList.front();
+      lruList.remove(entry);
+      entries.erase(entry.key);
+    }
+    return lru.size.load(std::memory_order_relaxed) <= lru.options.hardLimit;
+  }
+};
+
 ActorSqlite::ActorSqlite(kj::Own<SqliteDatabase> dbParam, OutputGate& outputGate,
                          kj::Function<kj::Promise<void>()> commitCallback,
-                         Hooks& hooks)
+                         Hooks& hooks, kj::Maybe<const ActorCache::SharedLru&> sharedLru)
     : db(kj::mv(dbParam)), outputGate(outputGate), commitCallback(kj::mv(commitCallback)),
       hooks(hooks), kv(*db), commitTasks(*this) {
   db->onWrite(KJ_BIND_METHOD(*this, onWrite));
+
+  KJ_IF_SOME(lru, sharedLru) {
+    if (!lru.options.noCache) {
+      readCache = kj::heap<ReadCache>(lru);
+      db->onRollback([this]() {
+        KJ_IF_SOME(c, readCache) {
+          c->clear();
+        }
+      });
+    }
+  }
 }
 
+ActorSqlite::~ActorSqlite() noexcept(false) {}
+
 ActorSqlite::ImplicitTxn::ImplicitTxn(ActorSqlite& parent)
     : parent(parent) {
   KJ_REQUIRE(parent.currentTxn.is<NoTxn>());
@@ -129,6 +273,7 @@ void ActorSqlite::ExplicitTxn::rollbackImpl() noexcept(false) {
       kj::str("ROLLBACK TO _cf_savepoint_", depth));
   actorSqlite.db->run(SqliteDatabase::TRUSTED,
       kj::str("RELEASE _cf_savepoint_", depth));
+  actorSqlite.db->notifyRollback();
 }
 
 void ActorSqlite::onWrite() {
@@ -177,6 +322,26 @@ void ActorSqlite::requireNotBroken() {
   }
 }
 
+kj::Maybe<ActorCacheOps::Value> ActorSqlite::cacheRead(
+    KeyPtr key, kj::Maybe<Value> value, const ReadOptions& options) {
+  KJ_IF_SOME(c, readCache) {
+    if (!options.noCache) {
+      return c->put(key, kj::mv(value));
+    }
+  }
+  return value;
+}
+
+void ActorSqlite::cacheWrite(KeyPtr key, kj::Maybe<Value> value, const WriteOptions& options) {
+  KJ_IF_SOME(c, readCache) {
+    if (options.noCache) {
+      c->remove(key);
+    } else {
+      c->put(key, kj::mv(value));
+    }
+  }
+}
+
 // =======================================================================================
 // ActorCacheInterface implementation
 
@@ -185,11 +350,17 @@ kj::OneOf<kj::Maybe<ActorCacheOps::Value>,
     ActorSqlite::get(Key key, ReadOptions options) {
   requireNotBroken();
 
+  KJ_IF_SOME(c, readCache) {
+    KJ_IF_SOME(cached, c->get(key)) {
+      return kj::mv(cached);
+    }
+  }
+
   kj::Maybe<ActorCacheOps::Value> result;
   kv.get(key, [&](ValuePtr value) {
     result = kj::heapArray(value);
   });
-  return result;
+  return cacheRead(key, kj::mv(result), options);
 }
 
 kj::OneOf<ActorCacheOps::GetResultList, kj::Promise<ActorCacheOps::GetResultList>>
@@ -197,11 +368,39 @@ kj::OneOf<ActorCacheOps::GetResultList, kj::Promise<ActorCacheOps::GetResultList
   requireNotBroken();
 
   kj::Vector<KeyValuePair> results;
+  kj::Vector<KeyPtr> toRead(keys.size());
   for (auto& key: keys) {
-    kv.get(key, [&](ValuePtr value) {
-      results.add(KeyValuePair { kj::mv(key), kj::heapArray(value) });
+    KJ_IF_SOME(c, readCache) {
+      KJ_IF_SOME(cached, c->get(key)) {
+        KJ_IF_SOME(value, cached) {
+          results.add(KeyValuePair { kj::mv(key), kj::mv(value) });
+        }
+        continue;
+      }
+    }
+    toRead.add(key);
+  }
+
+  size_t cachedCount = results.size();
+  uint found = kv.get(toRead, [&](KeyPtr key, ValuePtr value) {
+    results.add(KeyValuePair {
+      kj::str(key), KJ_ASSERT_NONNULL(cacheRead(key, kj::heapArray(value), options))
     });
+  });
+
+  // Also remember which keys turned out not to exist.
+  if (readCache != kj::none && found < toRead.size()) {
+    kj::HashSet<KeyPtr> foundKeys;
+    for (auto& result: results.asPtr().slice(cachedCount, results.size())) {
+      foundKeys.upsert(result.key, [](KeyPtr&, KeyPtr&&) {});
+    }
+    for (auto key: toRead) {
+      if (!foundKeys.contains(key)) {
+        cacheRead(key, kj::none, options);
+      }
+    }
   }
+
   std::sort(results.begin(), results.end(),
       [](auto& a, auto& b) { return a.key < b.key; });
   return GetResultList(kj::mv(results));
@@ -220,7 +419,9 @@ kj::OneOf<ActorCacheOps::GetResultList, kj::Promise<ActorCacheOps::GetResultList
 
   kj::Vector<KeyValuePair> results;
   kv.list(begin, end, limit, SqliteKv::FORWARD, [&](KeyPtr key, ValuePtr value) {
-    results.add(KeyValuePair { kj::str(key), kj::heapArray(value) });
+    results.add(KeyValuePair {
+      kj::str(key), KJ_ASSERT_NONNULL(cacheRead(key, kj::heapArray(value), options))
+    });
   });
 
   // Already guaranteed sorted.
@@ -234,7 +435,9 @@ kj::OneOf<ActorCacheOps::GetResultList, kj::Promise<ActorCacheOps::GetResultList
 
   kj::Vector<KeyValuePair> results;
   kv.list(begin, end, limit, SqliteKv::REVERSE, [&](KeyPtr key, ValuePtr value) {
-    results.add(KeyValuePair { kj::str(key), kj::heapArray(value) });
+    results.add(KeyValuePair {
+      kj::str(key), KJ_ASSERT_NONNULL(cacheRead(key, kj::heapArray(value), options))
+    });
   });
 
   // Already guaranteed sorted (reversed).
@@ -245,6 +448,7 @@ kj::Maybe<kj::Promise<void>> ActorSqlite::put(Key key, Value value, WriteOptions
   requireNotBroken();
 
   kv.put(key, value);
+  cacheWrite(key, kj::mv(value), options);
   return kj::none;
 }
 
@@ -252,8 +456,13 @@ kj::Maybe<kj::Promise<void>> ActorSqlite::put(
     kj::Array<KeyValuePair> pairs, WriteOptions options) {
   requireNotBroken();
 
+  auto ptrs = KJ_MAP(pair, pairs) {
+    return SqliteKv::KeyValuePtrPair { pair.key, pair.value };
+  };
+  kv.put(ptrs);
+
   for (auto& pair: pairs) {
-    kv.put(pair.key, pair.value);
+    cacheWrite(pair.key, kj::mv(pair.value), options);
   }
   return kj::none;
 }
@@ -261,7 +470,9 @@ kj::Maybe<kj::Promise<void>> ActorSqlite::put(
 kj::OneOf<bool, kj::Promise<bool>> ActorSqlite::delete_(Key key, WriteOptions options) {
   requireNotBroken();
 
-  return kv.delete_(key);
+  bool deleted = kv.delete_(key);
+  cacheWrite(key, kj::none, options);
+  return deleted;
 }
 
 kj::OneOf<uint, kj::Promise<uint>> ActorSqlite::delete_(
@@ -271,6 +482,7 @@ kj::OneOf<uint, kj::Promise<uint>> ActorSqlite::delete_(
   uint count = 0;
   for (auto& key: keys) {
     count += kv.delete_(key);
+    cacheWrite(key, kj::none, options);
   }
   return count;
 }
@@ -292,6 +504,9 @@ ActorCacheInterface::DeleteAllResults ActorSqlite::deleteAll(WriteOptions option
   requireNotBroken();
 
   uint count = kv.deleteAll();
+  KJ_IF_SOME(c, readCache) {
+    c->clear();
+  }
   return {
     .backpressure = kj::none,
     .count = count,
@@ -299,6 +514,10 @@ ActorCacheInterface::DeleteAllResults ActorSqlite::deleteAll(WriteOptions option
 }
 
 kj::Maybe<kj::Promise<void>> ActorSqlite::evictStale(kj::Date now) {
+  KJ_IF_SOME(c, readCache) {
+    c->evictStale(now);
+  }
+
   // This implementation never needs to apply backpressure.
   return kj::none;
 }
@@ -357,6 +576,19 @@ kj::Maybe<kj::Promise<void>> ActorSqlite::onNoPendingFlush() {
   return outputGate.wait();
 }
 
+kj::Promise<kj::String> ActorSqlite::getCurrentBookmark() {
+  // A bookmark names a committed state, so wait for writes made so far to be committed.
+  return outputGate.wait().then([this]() { return hooks.getCurrentBookmark(); });
+}
+
+kj::Promise<kj::String> ActorSqlite::getBookmarkForTime(kj::Date timestamp) {
+  return hooks.getBookmarkForTime(timestamp);
+}
+
+kj::Promise<kj::String> ActorSqlite::onNextSessionRestoreBookmark(kj::StringPtr bookmark) {
+  return hooks.onNextSessionRestoreBookmark(bookmark);
+}
+
 ActorSqlite::Hooks ActorSqlite::Hooks::DEFAULT = ActorSqlite::Hooks{};
 
 kj::Maybe<kj::Own<void>> ActorSqlite::Hooks::armAlarmHandler(kj::Date scheduledTime, bool noCache) {
@@ -375,6 +607,21 @@ kj::Promise<void> ActorSqlite::Hooks::setAlarm(kj::Maybe<kj::Date>) {
   JSG_FAIL_REQUIRE(Error, "setAlarm() is not yet implemented for SQLite-backed Durable Objects");
 }
 
+kj::Promise<kj::String> ActorSqlite::Hooks::getCurrentBookmark() {
+  JSG_FAIL_REQUIRE(Error,
+      "This Durable Object's storage back-end does not implement point-in-time recovery.");
+}
+
+kj::Promise<kj::String> ActorSqlite::Hooks::getBookmarkForTime(kj::Date timestamp) {
+  JSG_FAIL_REQUIRE(Error,
+      "This Durable Object's storage back-end does not implement point-in-time recovery.");
+}
+
+kj::Promise<kj::String> ActorSqlite::Hooks::onNextSessionRestoreBookmark(kj::StringPtr bookmark) {
+  JSG_FAIL_REQUIRE(Error,
+      "This Durable Object's storage back-end does not implement point-in-time recovery.");
+}
+
 kj::OneOf<kj::Maybe<ActorCacheOps::Value>, kj::Promise<kj::Maybe<ActorCacheOps::Value>>>
     ActorSqlite::ExplicitTxn::get(Key key, ReadOptions options) {
   return actorSqlite.get(kj::mv(key), options);
@@ -27,6 +27,11 @@ public:
     virtual kj::Maybe<kj::Own<void>> armAlarmHandler(kj::Date scheduledTime, bool noCache);
     virtual void cancelDeferredAlarmDeletion();
 
+    // Point-in-time recovery. See ActorCacheInterface.
+    virtual kj::Promise<kj::String> getCurrentBookmark();
+    virtual kj::Promise<kj::String> getBookmarkForTime(kj::Date timestamp);
+    virtual kj::Promise<kj::String> onNextSessionRestoreBookmark(kj::StringPtr bookmark);
+
     static Hooks DEFAULT;
   };
 
@@ -39,9 +44,15 @@ public:
   // `commitCallback` will be invoked after committing a transaction. The output gate will block on
   // the returned promise. This can be used e.g. when the database needs to be replicated to other
   // machines before being considered durable.
+  //
+  // If `sharedLru` is given, values read and written through the KV interface are also kept in
+  // memory, so that reading them again doesn't query SQLite. The cached values count toward
+  // `sharedLru`'s size, and are evicted to keep it under its soft limit.
   explicit ActorSqlite(kj::Own<SqliteDatabase> dbParam, OutputGate& outputGate,
                        kj::Function<kj::Promise<void>()> commitCallback,
-                       Hooks& hooks = Hooks::DEFAULT);
+                       Hooks& hooks = Hooks::DEFAULT,
+                       kj::Maybe<const ActorCache::SharedLru&> sharedLru = kj::none);
+  ~ActorSqlite() noexcept(false);
 
   bool isCommitScheduled() { return !currentTxn.is<NoTxn>(); }
 
@@ -71,6 +82,9 @@ public:
   kj::Maybe<kj::Own<void>> armAlarmHandler(kj::Date scheduledTime, bool noCache = false) override;
   void cancelDeferredAlarmDeletion() override;
   kj::Maybe<kj::Promise<void>> onNoPendingFlush() override;
+  kj::Promise<kj::String> getCurrentBookmark() override;
+  kj::Promise<kj::String> getBookmarkForTime(kj::Date timestamp) override;
+  kj::Promise<kj::String> onNextSessionRestoreBookmark(kj::StringPtr bookmark) override;
   // See ActorCacheInterface
 
 private:
@@ -80,6 +94,9 @@ private:
   Hooks& hooks;
   SqliteKv kv;
 
+  class ReadCache;
+  kj::Maybe<kj::Own<ReadCache>> readCache;
+
   SqliteDatabase::Statement beginTxn = db->prepare("BEGIN TRANSACTION");
   SqliteDatabase::Statement commitTxn = db->prepare("COMMIT TRANSACTION");
 
@@ -153,6 +170,13 @@ private:
 
   void onWrite();
 
+  // Adds a value just read from `kv`, or kj::none if the key doesn't exist, to the read cache
+  // (if any), returning the value to hand back to the caller.
+  kj::Maybe<Value> cacheRead(KeyPtr key, kj::Maybe<Value> value, const ReadOptions& options);
+
+  // Updates the read cache (if any) after a write to `kv`. `value` is kj::none for a delete.
+  void cacheWrite(KeyPtr key, kj::Maybe<Value> value, const WriteOptions& options);
+
   void taskFailed(kj::Exception&& exception) override;
 
   void requireNotBroken();
@@ -8,6 +8,75 @@
 
 namespace workerd {
 
+// A message passed to broadcast(). Every websocket it's sent to shares the same copy.
+class HibernationManagerImpl::BroadcastMessage final: public kj::Refcounted {
+public:
+  BroadcastMessage(kj::OneOf<kj::Array<kj::byte>, kj::String> content,
+                   HibernationManagerImpl& manager)
+      : content(kj::mv(content)), manager(manager) {}
+
+  size_t size() {
+    KJ_SWITCH_ONEOF(content) {
+      KJ_CASE_ONEOF(data, kj::Array<kj::byte>) {
+        return data.size();
+      }
+      KJ_CASE_ONEOF(text, kj::String) {
+        return text.size();
+      }
+    }
+    KJ_UNREACHABLE;
+  }
+
+  // Returns the message in the form api::WebSocket::send() takes, without copying it.
+  kj::OneOf<kj::Array<kj::byte>, kj::String> share() {
+    KJ_SWITCH_ONEOF(content) {
+      KJ_CASE_ONEOF(data, kj::Array<kj::byte>) {
+        return data.asPtr().attach(kj::addRef(*this));
+      }
+      KJ_CASE_ONEOF(text, kj::String) {
+        if (text.size() == 0) return kj::String();
+        // Include the NUL terminator, which kj::String requires.
+        return kj::String(kj::arrayPtr(text.begin(), text.size() + 1).attach(kj::addRef(*this)));
+      }
+    }
+    KJ_UNREACHABLE;
+  }
+
+  // Sends the message on a hibernating websocket.
+  kj::Promise<void> send(kj::WebSocket& ws, kj::Maybe<kj::Promise<void>> outputLock) {
+    KJ_IF_SOME(promise, outputLock) {
+      co_await promise;
+    }
+    KJ_SWITCH_ONEOF(content) {
+      KJ_CASE_ONEOF(data, kj::Array<kj::byte>) {
+        co_await ws.send(data);
+      }
+      KJ_CASE_ONEOF(text, kj::String) {
+        co_await ws.send(text);
+      }
+    }
+  }
+
+  // Called when the message is queued on, and when it's done being sent to or dropped by, a
+  // hibernating websocket. The message counts towards the manager's `queuedBroadcastBytes` for
+  // as long as it's queued on any.
+  void addQueued() {
+    if (queuedCount++ == 0) {
+      manager.queuedBroadcastBytes += size();
+    }
+  }
+  void removeQueued() {
+    if (--queuedCount == 0) {
+      manager.queuedBroadcastBytes -= size();
+    }
+  }
+
+private:
+  kj::OneOf<kj::Array<kj::byte>, kj::String> content;
+  HibernationManagerImpl& manager;
+  uint queuedCount = 0;
+};
+
 HibernationManagerImpl::HibernatableWebSocket::HibernatableWebSocket(
     jsg::Ref<api::WebSocket> websocket,
     kj::ArrayPtr<kj::String> tags,
@@ -21,6 +90,8 @@ HibernationManagerImpl::HibernatableWebSocket::HibernatableWebSocket(
       manager(manager) {}
 
 HibernationManagerImpl::HibernatableWebSocket::~HibernatableWebSocket() noexcept(false) {
+  dropQueuedSends();
+
   // We expect this dtor to be called when we're removing a HibernatableWebSocket
   // from our `allWs` collection in the HibernationManager.
 
@@ -64,16 +135,80 @@ jsg::Ref<api::WebSocket> HibernationManagerImpl::HibernatableWebSocket::getActiv
     package.maybeTags = getTags();
 
     // Now that we unhibernated the WebSocket, we can set the last received autoResponse timestamp
-    // that was stored in the corresponding HibernatableWebSocket. We also move autoResponsePromise
-    // from the hibernation manager to api::websocket to prevent possible ws.send races.
+    // that was stored in the corresponding HibernatableWebSocket. We also hand our pending sends
+    // over to api::websocket to prevent possible ws.send races.
     activeOrPackage.init<jsg::Ref<api::WebSocket>>(
         api::WebSocket::hibernatableFromNative(js, *KJ_REQUIRE_NONNULL(ws), kj::mv(package))
-    )->setAutoResponseStatus(autoResponseTimestamp, kj::mv(autoResponsePromise));
-    autoResponsePromise = kj::READY_NOW;
+    )->setAutoResponseStatus(autoResponseTimestamp, pendingSends.addBranch());
   }
   return activeOrPackage.get<jsg::Ref<api::WebSocket>>().addRef();
 }
 
+bool HibernationManagerImpl::HibernatableWebSocket::queueBroadcast(
+    kj::Own<BroadcastMessage> message, kj::Maybe<kj::Promise<void>> outputLock) {
+  auto size = message->size();
+  if (queuedBroadcastBytes + size > MAX_QUEUED_BROADCAST_BYTES_PER_WEBSOCKET) {
+    return false;
+  }
+  queuedBroadcastBytes += size;
+  message->addQueued();
+  queuedBroadcasts.push_back({kj::mv(message), kj::mv(outputLock)});
+  startSending();
+  return true;
+}
+
+kj::Promise<void> HibernationManagerImpl::HibernatableWebSocket::sendAutoResponse(
+    kj::String response) {
+  auto paf = kj::newPromiseAndFulfiller<void>();
+  queuedAutoResponses.push_back({kj::mv(response), kj::mv(paf.fulfiller)});
+  startSending();
+  return paf.promise.catch_([](kj::Exception&&) {
+    // If the connection is broken, the read loop will find out too, and clean up.
+  });
+}
+
+void HibernationManagerImpl::HibernatableWebSocket::startSending() {
+  if (sending) return;
+  sending = true;
+  pendingSends = sendLoop().catch_([this](kj::Exception&&) {
+    // If the connection is broken, the read loop will find out too, and clean up.
+    sending = false;
+    dropQueuedSends();
+  }).fork();
+}
+
+kj::Promise<void> HibernationManagerImpl::HibernatableWebSocket::sendLoop() {
+  auto& socket = *KJ_REQUIRE_NONNULL(ws);
+  for (;;) {
+    if (!queuedAutoResponses.empty()) {
+      auto autoResponse = kj::mv(queuedAutoResponses.front());
+      queuedAutoResponses.pop_front();
+      co_await socket.send(autoResponse.response.asArray());
+      autoResponse.fulfiller->fulfill();
+    } else if (!queuedBroadcasts.empty()) {
+      auto broadcast = kj::mv(queuedBroadcasts.front());
+      queuedBroadcasts.pop_front();
+      KJ_DEFER({
+        queuedBroadcastBytes -= broadcast.message->size();
+        broadcast.message->removeQueued();
+      });
+      co_await broadcast.message->send(socket, kj::mv(broadcast.outputLock));
+    } else {
+      sending = false;
+      co_return;
+    }
+  }
+}
+
+void HibernationManagerImpl::HibernatableWebSocket::dropQueuedSends() {
+  for (auto& broadcast: queuedBroadcasts) {
+    queuedBroadcastBytes -= broadcast.message->size();
+    broadcast.message->removeQueued();
+  }
+  queuedBroadcasts.clear();
+  queuedAutoResponses.clear();
+}
+
 HibernationManagerImpl::HibernationManagerImpl(
     kj::Own<Worker::Actor::Loopback> loopback,
     uint16_t hibernationEventType)
@@ -181,6 +316,68 @@ kj::Vector<jsg::Ref<api::WebSocket>> HibernationManagerImpl::getWebSockets(
   return kj::mv(matches);
 }
 
+uint HibernationManagerImpl::broadcast(
+    jsg::Lock& js,
+    kj::OneOf<kj::Array<kj::byte>, kj::String> message,
+    kj::Maybe<kj::StringPtr> maybeTag,
+    kj::ArrayPtr<jsg::Ref<api::WebSocket>> except) {
+  auto& context = IoContext::current();
+  auto shared = kj::refcounted<BroadcastMessage>(kj::mv(message), *this);
+  auto size = shared->size();
+
+  JSG_REQUIRE(queuedBroadcastBytes + size <= MAX_QUEUED_BROADCAST_BYTES, Error,
+      "Too much data is waiting to be sent to hibernating WebSockets to broadcast more. A "
+      "WebSocket's queue only drains as fast as its peer reads from it.");
+
+  // Like api::WebSocket::send(), hold the message back until any pending storage writes are
+  // confirmed. One wait covers all the hibernating websockets.
+  auto outputLock = context.waitForOutputLocksIfNecessary().map([](kj::Promise<void>& promise) {
+    return promise.fork();
+  });
+
+  uint count = 0;
+  auto sendTo = [&](HibernatableWebSocket& hib) {
+    KJ_SWITCH_ONEOF(hib.activeOrPackage) {
+      KJ_CASE_ONEOF(active, jsg::Ref<api::WebSocket>) {
+        for (auto& excluded: except) {
+          if (excluded.get() == active.get()) return;
+        }
+        if (active->getReadyState() != api::WebSocket::READY_STATE_OPEN) return;
+        // Goes through the websocket's own outgoing queue, so it's ordered with the app's sends.
+        active->send(js, shared->share());
+      }
+      KJ_CASE_ONEOF(package, api::WebSocket::HibernationPackage) {
+        // The app can't be holding a hibernating websocket, so `except` can't contain it.
+        if (package.closedOutgoingConnection || hib.ws == kj::none) return;
+        if (!hib.queueBroadcast(kj::addRef(*shared),
+                                outputLock.map([](kj::ForkedPromise<void>& fork) {
+                                  return fork.addBranch();
+                                }))) {
+          // Its peer is too far behind; it misses this message.
+          return;
+        }
+        KJ_IF_SOME(a, context.getActor()) {
+          a.getMetrics().sentWebSocketMessage(size);
+        }
+      }
+    }
+    ++count;
+  };
+
+  KJ_IF_SOME(tag, maybeTag) {
+    KJ_IF_SOME(item, tagToWs.find(tag)) {
+      for (auto& entry: *item->list) {
+        sendTo(KJ_REQUIRE_NONNULL(entry.hibWS));
+      }
+    }
+  } else {
+    for (auto& hibWS : allWs) {
+      sendTo(*hibWS);
+    }
+  }
+  return count;
+}
+
 void HibernationManagerImpl::setWebSocketAutoResponse(
     kj::Maybe<kj::StringPtr> request, kj::Maybe<kj::StringPtr> response) {
   KJ_IF_SOME(req, request) {
@@ -313,15 +510,13 @@ kj::Promise<void> HibernationManagerImpl::readLoop(HibernatableWebSocket& hib) {
               }
               KJ_CASE_ONEOF(package, api::WebSocket::HibernationPackage) {
                 if (!package.closedOutgoingConnection) {
-                  // We need to store the autoResponsePromise because we may instantiate an api::websocket
-                  // If we do that, we have to provide it with the promise to avoid races. This can
+                  // The send is queued on the HibernatableWebSocket because we may instantiate an
+                  // api::websocket, which then has to wait for it to avoid races. This can
                   // happen if we have a websocket hibernating, that unhibernates and sends a
-                  // message while ws.send() for auto-response is also sending.
-                  auto p = ws.send(
-                      KJ_REQUIRE_NONNULL(autoResponsePair->response).asArray()).fork();
-                  hib.autoResponsePromise = p.addBranch();
-                  co_await p;
-                  hib.autoResponsePromise = kj::READY_NOW;
+                  // message while ws.send() for auto-response is also sending. It also keeps
+                  // the auto-response from being sent in the middle of a broadcast.
+                  co_await hib.sendAutoResponse(
+                      kj::str(KJ_REQUIRE_NONNULL(autoResponsePair->response)));
                 }
               }
             }
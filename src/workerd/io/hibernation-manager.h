@@ -10,6 +10,7 @@
 #include <workerd/api/actor-state.h>
 #include <workerd/jsg/jsg.h>
 
+#include <deque>
 #include <list>
 
 namespace workerd {
@@ -31,6 +32,16 @@ public:
       jsg::Lock& js,
       kj::Maybe<kj::StringPtr> tag) override;
 
+  // Sends `message` to every websocket associated with the given tag (or to all accepted
+  // websockets if no tag is provided), except those in `except`. Unlike sending to each of the
+  // websockets returned by getWebSockets(), hibernating websockets are not woken up: the message
+  // is written to their kj::WebSocket directly. Returns the number of websockets sent to.
+  uint broadcast(
+      jsg::Lock& js,
+      kj::OneOf<kj::Array<kj::byte>, kj::String> message,
+      kj::Maybe<kj::StringPtr> tag,
+      kj::ArrayPtr<jsg::Ref<api::WebSocket>> except) override;
+
   // Hibernates all the websockets held by the HibernationManager.
   // This converts our activeOrPackage from an api::WebSocket to a HibernationPackage.
   void hibernateWebSockets(Worker::Lock& lock) override;
@@ -53,6 +64,7 @@ public:
 
 private:
   class HibernatableWebSocket;
+  class BroadcastMessage;
 
   kj::Promise<void> handleReadLoop(HibernatableWebSocket& refToHibernatable);
 
@@ -98,6 +110,17 @@ private:
     // to the api::WebSocket.
     jsg::Ref<api::WebSocket> getActiveOrUnhibernate(jsg::Lock& js);
 
+    // Queues a broadcast message to be sent directly on `ws` while hibernating, after any queued
+    // before it. The message is held back until `outputLock`, if any, resolves. Returns false,
+    // queuing nothing, if that would put more than MAX_QUEUED_BROADCAST_BYTES_PER_WEBSOCKET in
+    // the queue.
+    bool queueBroadcast(kj::Own<BroadcastMessage> message, kj::Maybe<kj::Promise<void>> outputLock);
+
+    // Sends an auto-response directly on `ws` while hibernating. It goes ahead of any queued
+    // broadcasts that haven't started sending yet, so that a peer's heartbeats aren't held up by
+    // a backlog of broadcasts. Completes once the auto-response is sent, or fails to be.
+    kj::Promise<void> sendAutoResponse(kj::String response);
+
     kj::ListLink<HibernatableWebSocket> link;
 
     // An array of all the items/nodes that refer to this HibernatableWebSocket.
@@ -132,9 +155,38 @@ private:
     // Stores the last received autoResponseRequest timestamp.
     kj::Maybe<kj::Date> autoResponseTimestamp;
 
-    // Keeps track of the currently ongoing websocket auto-response send promise. This promise may
-    // be moved to api::websocket if an hibernating websocket unhibernates.
-    kj::Promise<void> autoResponsePromise = kj::READY_NOW;
+    struct QueuedBroadcast {
+      kj::Own<BroadcastMessage> message;
+      kj::Maybe<kj::Promise<void>> outputLock;
+    };
+    struct QueuedAutoResponse {
+      kj::String response;
+      kj::Own<kj::PromiseFulfiller<void>> fulfiller;
+    };
+
+    // Sends queued while hibernating, not yet started. Auto-responses are sent first.
+    std::deque<QueuedAutoResponse> queuedAutoResponses;
+    std::deque<QueuedBroadcast> queuedBroadcasts;
+
+    // Total size of the broadcasts in `queuedBroadcasts`, plus the one being sent, if any.
+    size_t queuedBroadcastBytes = 0;
+
+    // True while sendLoop() is running.
+    bool sending = false;
+
+    // Completes once everything queued so far with queueBroadcast() and sendAutoResponse() is
+    // sent. If a hibernating websocket unhibernates, a branch is handed to the api::WebSocket,
+    // which waits for it before sending anything itself, to prevent ws.send() races.
+    kj::ForkedPromise<void> pendingSends = kj::Promise<void>(kj::READY_NOW).fork();
+
+    // Starts sendLoop() if it isn't running already.
+    void startSending();
+
+    // Sends the queued auto-responses and broadcasts until there are none left.
+    kj::Promise<void> sendLoop();
+
+    // Drops everything that's queued but not yet being sent.
+    void dropQueuedSends();
 
     friend HibernationManagerImpl;
   };
@@ -181,6 +233,10 @@ private:
   // move the underlying data (thereby keeping any references intact).
   kj::HashMap<kj::StringPtr, kj::Own<TagCollection>> tagToWs;
 
+  // Total size of the distinct broadcast messages queued on hibernating websockets. Each
+  // message is counted once, however many websockets it's queued on.
+  size_t queuedBroadcastBytes = 0;
+
   // We store all of our HibernatableWebSockets in a doubly linked-list.
   std::list<kj::Own<HibernatableWebSocket>> allWs;
 
@@ -203,6 +259,14 @@ private:
   // instance can manage.
   const size_t ACTIVE_CONNECTION_LIMIT = 1024 * 32;
 
+  // Broadcasts to a hibernating websocket are held in memory until its peer reads them. A peer
+  // that falls this far behind misses further broadcasts until it catches up.
+  static constexpr size_t MAX_QUEUED_BROADCAST_BYTES_PER_WEBSOCKET = 1024 * 1024;
+
+  // Once the actor has this much queued for its hibernating websockets altogether, broadcast()
+  // throws rather than queue more.
+  static constexpr size_t MAX_QUEUED_BROADCAST_BYTES = 16 * 1024 * 1024;
+
   class DisconnectHandler: public kj::TaskSet::ErrorHandler {
   public:
     // We don't need to do anything here; we already handle disconnects in the callee of readLoop().
@@ -1172,7 +1172,8 @@ Worker::Script::Script(kj::Own<const Isolate> isolateParam, kj::StringPtr id,
                   // limit just to be safe. Don't add it to the rollover bank, though.
                   auto limitScope = isolate->getLimitEnforcer().enterStartupJs(lock, maybeLimitError);
                   impl->unboundScriptOrMainModule =
-                      jsg::NonModuleScript::compile(script.mainScript, lock, script.mainScriptName);
+                      jsg::NonModuleScript::compileBundleScript(
+                          script.mainScript, lock, script.mainScriptName);
                 }
 
                 break;
@@ -1357,6 +1358,10 @@ Worker::Worker(kj::Own<const Script> scriptParam,
         v8::TryCatch catcher(lock.v8Isolate);
         kj::Maybe<kj::Exception> maybeLimitError;
 
+        // If top-level code throws, storeDeferredCodeCache() is never reached. Drop the scripts it
+        // would have cached rather than keeping them alive for the life of the isolate.
+        KJ_DEFER(jsg::IsolateBase::from(lock.v8Isolate).endCodeCacheDeferral());
+
         try {
           try {
             currentSpan = maybeMakeSpan("lw:globals_instantiation"_kjc);
@@ -1477,6 +1482,10 @@ Worker::Worker(kj::Own<const Script> scriptParam,
               }
             }
 
+            // Now that top-level code has run, create any code cache data that was waiting for
+            // it, so that the data covers the functions compiled during startup.
+            jsg::storeDeferredCodeCache(lock);
+
             startupMetrics->done();
           } catch (const kj::Exception& e) {
             lock.throwException(kj::cp(e));
@@ -649,6 +649,11 @@ public:
     virtual kj::Vector<jsg::Ref<api::WebSocket>> getWebSockets(
         jsg::Lock& js,
         kj::Maybe<kj::StringPtr> tag) = 0;
+    virtual uint broadcast(
+        jsg::Lock& js,
+        kj::OneOf<kj::Array<kj::byte>, kj::String> message,
+        kj::Maybe<kj::StringPtr> tag,
+        kj::ArrayPtr<jsg::Ref<api::WebSocket>> except) = 0;
     virtual void hibernateWebSockets(Worker::Lock& lock) = 0;
     virtual void setWebSocketAutoResponse(kj::Maybe<kj::StringPtr> request,
         kj::Maybe<kj::StringPtr> response) = 0;
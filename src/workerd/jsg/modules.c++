@@ -42,6 +42,34 @@ private:
   kj::MutexGuarded<kj::HashMap<const void*, std::unique_ptr<v8::ScriptCompiler::CachedData>>> cache;
 };
 
+template <typename Script>
+void putCodeCache(const CodeCache& codeCache, kj::StringPtr key, v8::Local<Script> script) {
+  auto cachedData = std::unique_ptr<v8::ScriptCompiler::CachedData>(
+      v8::ScriptCompiler::CreateCodeCache(script));
+  if (cachedData != nullptr) {
+    codeCache.put(key, kj::arrayPtr(cachedData->data, cachedData->length));
+  }
+}
+
+// Creates code cache data for a freshly compiled bundle script or module and stores it, either
+// right away or, if the cache wants it and the Worker is still starting up, once the Worker's
+// top-level code has run.
+template <typename Script>
+void storeCodeCache(jsg::Lock& js, const CodeCache& codeCache, kj::String key,
+                    v8::Local<Script> script) {
+  if (codeCache.isCreatedAfterStartup()) {
+    KJ_IF_SOME(deferred, IsolateBase::from(js.v8Isolate).getDeferredCodeCache()) {
+      deferred.add(IsolateBase::DeferredCodeCache {
+        .key = kj::mv(key),
+        .script = v8::Global<Script>(js.v8Isolate, script),
+      });
+      return;
+    }
+  }
+
+  putCodeCache(codeCache, key, script);
+}
+
 // Implementation of `v8::Module::ResolveCallback`.
 v8::MaybeLocal<v8::Module> resolveCallback(v8::Local<v8::Context> context,
                                            v8::Local<v8::String> specifier,
@@ -327,6 +355,54 @@ NonModuleScript NonModuleScript::compile(kj::StringPtr code, jsg::Lock& js, kj::
       check(v8::ScriptCompiler::CompileUnboundScript(isolate, &source)));
 }
 
+NonModuleScript NonModuleScript::compileBundleScript(
+    kj::StringPtr code, jsg::Lock& js, kj::StringPtr name) {
+  auto isolate = js.v8Isolate;
+  auto& codeCache = KJ_UNWRAP_OR(IsolateBase::from(isolate).getObserver().getCodeCache(), {
+    return compile(code, js, name);
+  });
+
+  v8::ScriptOrigin origin(v8StrIntern(isolate, name));
+  auto key = codeCache.keyFor(code);
+  KJ_IF_SOME(data, codeCache.get(key)) {
+    // The Source takes ownership of the CachedData, but not of the buffer it points to.
+    v8::ScriptCompiler::Source source(v8Str(isolate, code), origin,
+        new v8::ScriptCompiler::CachedData(data.begin(), data.size()));
+    auto script = check(v8::ScriptCompiler::CompileUnboundScript(
+        isolate, &source, v8::ScriptCompiler::kConsumeCodeCache));
+    if (source.GetCachedData()->rejected) {
+      codeCache.reject(key);
+      storeCodeCache(js, codeCache, kj::mv(key), script);
+    }
+    return NonModuleScript(js, script);
+  }
+
+  v8::ScriptCompiler::Source source(v8Str(isolate, code), origin);
+  auto script = check(v8::ScriptCompiler::CompileUnboundScript(isolate, &source));
+  storeCodeCache(js, codeCache, kj::mv(key), script);
+  return NonModuleScript(js, script);
+}
+
+void storeDeferredCodeCache(jsg::Lock& js) {
+  auto& isolateBase = IsolateBase::from(js.v8Isolate);
+  auto deferred = isolateBase.endCodeCacheDeferral();
+  if (deferred.empty()) return;
+
+  auto& codeCache = KJ_ASSERT_NONNULL(isolateBase.getObserver().getCodeCache());
+  js.withinHandleScope([&] {
+    for (auto& entry: deferred) {
+      KJ_SWITCH_ONEOF(entry.script) {
+        KJ_CASE_ONEOF(script, v8::Global<v8::UnboundScript>) {
+          putCodeCache(codeCache, entry.key, script.Get(js.v8Isolate));
+        }
+        KJ_CASE_ONEOF(script, v8::Global<v8::UnboundModuleScript>) {
+          putCodeCache(codeCache, entry.key, script.Get(js.v8Isolate));
+        }
+      }
+    }
+  });
+}
+
 void instantiateModule(jsg::Lock& js, v8::Local<v8::Module>& module) {
   KJ_ASSERT(!module.IsEmpty());
   auto isolate = js.v8Isolate;
@@ -430,6 +506,28 @@ v8::Local<v8::Module> compileEsmModule(
 
   contentStr = jsg::v8Str(js.v8Isolate, content);
 
+  KJ_IF_SOME(codeCache, observer.getCodeCache()) {
+    auto key = codeCache.keyFor(content);
+    KJ_IF_SOME(data, codeCache.get(key)) {
+      // The Source takes ownership of the CachedData, but not of the buffer it points to.
+      v8::ScriptCompiler::Source source(contentStr, origin,
+          new v8::ScriptCompiler::CachedData(data.begin(), data.size()));
+      auto module = jsg::check(v8::ScriptCompiler::CompileModule(
+          js.v8Isolate, &source, v8::ScriptCompiler::kConsumeCodeCache));
+      if (source.GetCachedData()->rejected) {
+        // V8 compiled from source instead. Replace the stale entry.
+        codeCache.reject(key);
+        storeCodeCache(js, codeCache, kj::mv(key), module->GetUnboundModuleScript());
+      }
+      return module;
+    }
+
+    v8::ScriptCompiler::Source source(contentStr, origin);
+    auto module = jsg::check(v8::ScriptCompiler::CompileModule(js.v8Isolate, &source));
+    storeCodeCache(js, codeCache, kj::mv(key), module->GetUnboundModuleScript());
+    return module;
+  }
+
   v8::ScriptCompiler::Source source(contentStr, origin);
   auto module = jsg::check(v8::ScriptCompiler::CompileModule(js.v8Isolate, &source));
 
@@ -176,12 +176,22 @@ public:
 
   static jsg::NonModuleScript compile(kj::StringPtr code, jsg::Lock& js, kj::StringPtr name = "worker.js");
 
+  // Like compile(), for the main script of a worker bundle, which may make use of the isolate's
+  // CodeCache (see CompilationObserver::getCodeCache()).
+  static jsg::NonModuleScript compileBundleScript(
+      kj::StringPtr code, jsg::Lock& js, kj::StringPtr name);
+
 private:
   v8::Global<v8::UnboundScript> unboundScript;
 };
 
 void instantiateModule(jsg::Lock& js, v8::Local<v8::Module>& module);
 
+// Creates the code cache data that was put off while the Worker started up (see
+// CodeCache::isCreatedAfterStartup()). Call once the Worker's top-level code has run. Code
+// compiled after this call has its data created right away.
+void storeDeferredCodeCache(jsg::Lock& js);
+
 enum class ModuleInfoCompileOption {
   // The BUNDLE options tells the compile operation to treat the content as coming
   // from a worker bundle.
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <kj/array.h>
 #include <kj/common.h>
 #include <kj/string.h>
 #include <kj/exception.h>
@@ -16,6 +17,32 @@ namespace v8 {
 
 namespace workerd::jsg {
 
+// Storage for V8 code cache data produced when compiling worker bundle code (ES modules and
+// service worker scripts). Implementations must be thread-safe.
+class CodeCache {
+public:
+  virtual ~CodeCache() noexcept(false) { }
+
+  // Returns the key under which the cached data for `source` is stored.
+  virtual kj::String keyFor(kj::ArrayPtr<const char> source) const = 0;
+
+  // Returns the cached data previously stored under `key`, if any.
+  virtual kj::Maybe<kj::Array<const kj::byte>> get(kj::StringPtr key) const = 0;
+
+  // Stores cached data under `key`. Failures should be logged, not thrown.
+  virtual void put(kj::StringPtr key, kj::ArrayPtr<const kj::byte> data) const = 0;
+
+  // Called when V8 rejected the data returned by get(), e.g. because it was produced by a
+  // different V8 version. The entry will be replaced by a subsequent put().
+  virtual void reject(kj::StringPtr key) const = 0;
+
+  // If true, data for code compiled while a Worker starts up is only created once the Worker's
+  // top-level code has run (see jsg::storeDeferredCodeCache()), so that it also covers the
+  // functions that startup compiled lazily. Consuming such data lets later startups skip
+  // compiling most of their initialization code.
+  virtual bool isCreatedAfterStartup() const { return false; }
+};
+
 struct CompilationObserver {
   virtual ~CompilationObserver() noexcept(false) { }
 
@@ -36,6 +63,9 @@ struct CompilationObserver {
   virtual kj::Own<void> onWasmCompilationStart(v8::Isolate* isolate, size_t codeSize) const {
     return kj::Own<void>();
   }
+
+  // Returns the cache to consult when compiling worker bundle code, if any.
+  virtual kj::Maybe<const CodeCache&> getCodeCache() const { return kj::none; }
 };
 
 struct InternalExceptionObserver {
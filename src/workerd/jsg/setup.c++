@@ -408,6 +408,7 @@ void IsolateBase::dropWrappers(kj::Own<void> typeWrapperInstance) {
     KJ_DEFER(symbolAsyncDispose.Reset());
     KJ_DEFER(symbolDispose.Reset());
     KJ_DEFER(opaqueTemplate.Reset());
+    KJ_DEFER(deferredCodeCache = kj::none);
 
     // Make sure the TypeWrapper is destroyed under lock by declaring a new copy of the variable
     // that is destroyed before the lock is released.
@@ -132,6 +132,26 @@ public:
 
   IsolateObserver& getObserver() { return *observer; }
 
+  // Code cache data to create once the Worker's top-level code has run; see
+  // CodeCache::isCreatedAfterStartup().
+  struct DeferredCodeCache {
+    kj::String key;
+    kj::OneOf<v8::Global<v8::UnboundScript>, v8::Global<v8::UnboundModuleScript>> script;
+  };
+
+  // Returns null once endCodeCacheDeferral() has been called.
+  kj::Maybe<kj::Vector<DeferredCodeCache>&> getDeferredCodeCache() {
+    return deferredCodeCache;
+  }
+  kj::Vector<DeferredCodeCache> endCodeCacheDeferral() {
+    KJ_IF_SOME(d, deferredCodeCache) {
+      auto result = kj::mv(d);
+      deferredCodeCache = kj::none;
+      return result;
+    }
+    return {};
+  }
+
   // Implementation of MemoryRetainer
   void jsgGetMemoryInfo(MemoryTracker& tracker) const;
   kj::StringPtr jsgGetMemoryName() const { return "IsolateBase"_kjc; }
@@ -192,6 +212,8 @@ private:
   kj::Maybe<kj::Function<Logger>> maybeLogger;
   kj::Maybe<kj::Function<ModuleFallbackCallback>> maybeModuleFallbackCallback;
 
+  kj::Maybe<kj::Vector<DeferredCodeCache>> deferredCodeCache = kj::Vector<DeferredCodeCache>();
+
   // FunctionTemplate used by Wrappable::attachOpaqueWrapper(). Just a constructor for an empty
   // object with 2 internal fields.
   v8::Global<v8::FunctionTemplate> opaqueTemplate;
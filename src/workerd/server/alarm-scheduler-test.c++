@@ -0,0 +1,308 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "alarm-scheduler.h"
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+constexpr kj::Date START = kj::UNIX_EPOCH + 1'700'000'000 * kj::SECONDS;
+
+class AlarmSchedulerTest final: private kj::Clock {
+public:
+  AlarmSchedulerTest(): ws(loop), timer(kj::origin<kj::TimePoint>()) {}
+
+  kj::Own<AlarmScheduler> makeScheduler(AlarmScheduler::Options options = {}) {
+    auto scheduler = kj::heap<AlarmScheduler>(
+        *this, timer, vfs, kj::Path({"alarms.sqlite"}), options);
+    scheduler->registerNamespace("ns", [this](kj::String actorId) -> kj::Own<WorkerInterface> {
+      return kj::heap<MockWorker>(*this, kj::mv(actorId));
+    });
+    return scheduler;
+  }
+
+  ActorKey key(kj::StringPtr actorId) {
+    return { .uniqueKey = "ns"_kj, .actorId = actorId };
+  }
+
+  kj::Date now() const override {
+    return START + (timer.now() - kj::origin<kj::TimePoint>());
+  }
+
+  // Runs the event loop, advancing the timer through every event up to `delay` from now.
+  void advance(kj::Duration delay) {
+    auto target = timer.now() + delay;
+    for (;;) {
+      ws.poll();
+      KJ_IF_SOME(next, timer.nextEvent()) {
+        if (next <= target) {
+          timer.advanceTo(kj::max(next, timer.now()));
+          continue;
+        }
+      }
+      break;
+    }
+    timer.advanceTo(target);
+    ws.poll();
+  }
+
+  struct Run {
+    kj::String actorId;
+    kj::Date scheduledTime;
+    kj::Date time;
+    uint32_t retryCount;
+  };
+  kj::Vector<Run> runs;
+
+  // If set, alarms don't finish until their fulfiller in `pending` is fulfilled.
+  bool hold = false;
+  kj::Vector<kj::Own<kj::PromiseFulfiller<WorkerInterface::AlarmResult>>> pending;
+
+  // Results to return from the alarms run, in turn, before reverting to success.
+  kj::Vector<WorkerInterface::AlarmResult> results;
+  size_t nextResult = 0;
+
+private:
+  kj::EventLoop loop;
+  kj::WaitScope ws;
+  kj::TimerImpl timer;
+  kj::Own<const kj::Directory> dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs{*dir};
+
+  class MockWorker final: public WorkerInterface {
+  public:
+    MockWorker(AlarmSchedulerTest& test, kj::String actorId)
+        : test(test), actorId(kj::mv(actorId)) {}
+
+    kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime, uint32_t retryCount) override {
+      test.runs.add(Run {
+        .actorId = kj::str(actorId),
+        .scheduledTime = scheduledTime,
+        .time = test.now(),
+        .retryCount = retryCount
+      });
+      if (test.hold) {
+        auto paf = kj::newPromiseAndFulfiller<AlarmResult>();
+        test.pending.add(kj::mv(paf.fulfiller));
+        return kj::mv(paf.promise);
+      }
+      if (test.nextResult < test.results.size()) {
+        return test.results[test.nextResult++];
+      }
+      return AlarmResult { .retry = false, .outcome = EventOutcome::OK };
+    }
+
+    kj::Promise<void> request(
+        kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+        kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+      KJ_UNIMPLEMENTED("not used");
+    }
+    kj::Promise<void> connect(kj::StringPtr host, const kj::HttpHeaders& headers,
+                              kj::AsyncIoStream& connection, ConnectResponse& response,
+                              kj::HttpConnectSettings settings) override {
+      KJ_UNIMPLEMENTED("not used");
+    }
+    void prewarm(kj::StringPtr url) override {}
+    kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime, kj::StringPtr cron) override {
+      KJ_UNIMPLEMENTED("not used");
+    }
+    kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+      KJ_UNIMPLEMENTED("not used");
+    }
+
+  private:
+    AlarmSchedulerTest& test;
+    kj::String actorId;
+  };
+};
+
+KJ_TEST("AlarmScheduler: runs alarms in order at their scheduled times") {
+  AlarmSchedulerTest test;
+  auto scheduler = test.makeScheduler();
+
+  auto t0 = test.now();
+  scheduler->setAlarm(test.key("a"), t0 + 3 * kj::SECONDS);
+  scheduler->setAlarm(test.key("b"), t0 + 1 * kj::SECONDS);
+  scheduler->setAlarm(test.key("c"), t0 + 2 * kj::SECONDS + 500 * kj::MICROSECONDS);
+  KJ_EXPECT(KJ_ASSERT_NONNULL(scheduler->getAlarm(test.key("c"))) ==
+            t0 + 2 * kj::SECONDS + 500 * kj::MICROSECONDS);
+
+  test.advance(5 * kj::SECONDS);
+
+  KJ_ASSERT(test.runs.size() == 3);
+  KJ_EXPECT(test.runs[0].actorId == "b");
+  KJ_EXPECT(test.runs[1].actorId == "c");
+  KJ_EXPECT(test.runs[2].actorId == "a");
+  for (auto& run: test.runs) {
+    // Never early, even when scheduled between ticks.
+    KJ_EXPECT(run.time >= run.scheduledTime);
+    KJ_EXPECT(run.time - run.scheduledTime < 1 * kj::MILLISECONDS);
+  }
+
+  KJ_EXPECT(scheduler->getAlarm(test.key("a")) == kj::none);
+  KJ_EXPECT(scheduler->getAlarm(test.key("b")) == kj::none);
+  KJ_EXPECT(scheduler->getAlarm(test.key("c")) == kj::none);
+}
+
+KJ_TEST("AlarmScheduler: set and delete alarms before they run") {
+  AlarmSchedulerTest test;
+  auto scheduler = test.makeScheduler();
+
+  auto t0 = test.now();
+  scheduler->setAlarm(test.key("a"), t0 + 1 * kj::SECONDS);
+  scheduler->setAlarm(test.key("b"), t0 + 2 * kj::SECONDS);
+  scheduler->setAlarm(test.key("a"), t0 + 3 * kj::SECONDS);
+  KJ_EXPECT(scheduler->deleteAlarm(test.key("b")));
+  KJ_EXPECT(!scheduler->deleteAlarm(test.key("b")));
+
+  test.advance(5 * kj::SECONDS);
+
+  KJ_ASSERT(test.runs.size() == 1);
+  KJ_EXPECT(test.runs[0].actorId == "a");
+  KJ_EXPECT(test.runs[0].scheduledTime == t0 + 3 * kj::SECONDS);
+}
+
+KJ_TEST("AlarmScheduler: pages alarms in from the database") {
+  AlarmSchedulerTest test;
+  AlarmScheduler::Options options { .window = 1 * kj::MINUTES, .pageSize = 2 };
+  auto t0 = test.now();
+
+  {
+    auto scheduler = test.makeScheduler(options);
+    for (auto i: kj::range(0, 5)) {
+      scheduler->setAlarm(test.key(kj::str("a", i)), t0 + (10 + 10 * i) * kj::SECONDS);
+    }
+    scheduler->setAlarm(test.key("late"), t0 + 1 * kj::HOURS);
+    scheduler->setAlarm(test.key("tie1"), t0 + 20 * kj::SECONDS);
+    scheduler->setAlarm(test.key("tie2"), t0 + 20 * kj::SECONDS);
+  }
+
+  // Starting over loads only the first page (and the alarms due at the same time as its last).
+  auto scheduler = test.makeScheduler(options);
+  KJ_EXPECT(KJ_ASSERT_NONNULL(scheduler->getAlarm(test.key("late"))) == t0 + 1 * kj::HOURS);
+  KJ_EXPECT(KJ_ASSERT_NONNULL(scheduler->getAlarm(test.key("a4"))) == t0 + 50 * kj::SECONDS);
+
+  test.advance(2 * kj::HOURS);
+
+  auto ids = KJ_MAP(run, test.runs) { return kj::str(run.actorId); };
+  KJ_ASSERT(ids.size() == 8, kj::strArray(ids, ", "));
+  KJ_EXPECT(ids[0] == "a0");
+  KJ_EXPECT(ids[4] == "a2");
+  KJ_EXPECT(ids[5] == "a3");
+  KJ_EXPECT(ids[6] == "a4");
+  KJ_EXPECT(ids[7] == "late");
+  for (auto& run: test.runs) {
+    KJ_EXPECT(run.time >= run.scheduledTime);
+    KJ_EXPECT(run.time - run.scheduledTime < 1 * kj::MILLISECONDS);
+  }
+  KJ_EXPECT(scheduler->getAlarm(test.key("late")) == kj::none);
+}
+
+KJ_TEST("AlarmScheduler: deleting a full page of alarms pages in the next") {
+  AlarmSchedulerTest test;
+  AlarmScheduler::Options options { .window = 1 * kj::MINUTES, .pageSize = 2 };
+  auto t0 = test.now();
+
+  {
+    auto scheduler = test.makeScheduler(options);
+    for (auto i: kj::range(0, 4)) {
+      scheduler->setAlarm(test.key(kj::str("a", i)), t0 + (10 + 10 * i) * kj::SECONDS);
+    }
+  }
+
+  // Only a0 and a1 are in memory. Once they're gone, nothing in memory is left to finish and
+  // trigger a refill, so removing them has to.
+  auto scheduler = test.makeScheduler(options);
+  KJ_EXPECT(scheduler->deleteAlarm(test.key("a0")));
+  KJ_EXPECT(scheduler->deleteAlarm(test.key("a1")));
+
+  test.advance(1 * kj::MINUTES);
+
+  auto ids = KJ_MAP(run, test.runs) { return kj::str(run.actorId); };
+  KJ_ASSERT(ids.size() == 2, kj::strArray(ids, ", "));
+  KJ_EXPECT(ids[0] == "a2");
+  KJ_EXPECT(ids[1] == "a3");
+  for (auto& run: test.runs) {
+    KJ_EXPECT(run.time - run.scheduledTime < 1 * kj::MILLISECONDS);
+  }
+}
+
+KJ_TEST("AlarmScheduler: rescheduling a full page of alarms pages in the next") {
+  AlarmSchedulerTest test;
+  AlarmScheduler::Options options { .window = 1 * kj::MINUTES, .pageSize = 2 };
+  auto t0 = test.now();
+
+  {
+    auto scheduler = test.makeScheduler(options);
+    for (auto i: kj::range(0, 4)) {
+      scheduler->setAlarm(test.key(kj::str("a", i)), t0 + (10 + 10 * i) * kj::SECONDS);
+    }
+  }
+
+  // Moving a0 and a1 beyond the window evicts them from memory, just like deleting them.
+  auto scheduler = test.makeScheduler(options);
+  scheduler->setAlarm(test.key("a0"), t0 + 2 * kj::HOURS);
+  scheduler->setAlarm(test.key("a1"), t0 + 2 * kj::HOURS);
+
+  test.advance(1 * kj::MINUTES);
+
+  auto ids = KJ_MAP(run, test.runs) { return kj::str(run.actorId); };
+  KJ_ASSERT(ids.size() == 2, kj::strArray(ids, ", "));
+  KJ_EXPECT(ids[0] == "a2");
+  KJ_EXPECT(ids[1] == "a3");
+
+  test.advance(2 * kj::HOURS);
+
+  ids = KJ_MAP(run, test.runs) { return kj::str(run.actorId); };
+  KJ_ASSERT(ids.size() == 4, kj::strArray(ids, ", "));
+  KJ_EXPECT(test.runs[2].scheduledTime == t0 + 2 * kj::HOURS);
+  KJ_EXPECT(test.runs[3].scheduledTime == t0 + 2 * kj::HOURS);
+}
+
+KJ_TEST("AlarmScheduler: limits concurrent alarms per namespace") {
+  AlarmSchedulerTest test;
+  auto scheduler = test.makeScheduler({ .maxConcurrentAlarms = 2 });
+  test.hold = true;
+
+  auto t0 = test.now();
+  for (auto i: kj::range(0, 5)) {
+    scheduler->setAlarm(test.key(kj::str("a", i)), t0 + 1 * kj::SECONDS);
+  }
+
+  test.advance(2 * kj::SECONDS);
+  KJ_EXPECT(test.runs.size() == 2);
+
+  // Each alarm that finishes lets the next one start.
+  for (auto i: kj::range<size_t>(0, 3)) {
+    test.pending[i]->fulfill({ .retry = false, .outcome = EventOutcome::OK });
+    test.advance(0 * kj::SECONDS);
+    KJ_EXPECT(test.runs.size() == i + 3);
+  }
+}
+
+KJ_TEST("AlarmScheduler: retries failed alarms with backoff") {
+  AlarmSchedulerTest test;
+  auto scheduler = test.makeScheduler();
+
+  test.results.add(WorkerInterface::AlarmResult {
+    .retry = true, .retryCountsAgainstLimit = true, .outcome = EventOutcome::EXCEPTION });
+  auto t0 = test.now();
+  scheduler->setAlarm(test.key("a"), t0 + 1 * kj::SECONDS);
+
+  test.advance(2 * kj::SECONDS);
+  KJ_ASSERT(test.runs.size() == 1);
+  KJ_EXPECT(KJ_ASSERT_NONNULL(scheduler->getAlarm(test.key("a"))) == t0 + 1 * kj::SECONDS);
+
+  test.advance(5 * kj::SECONDS);
+  KJ_ASSERT(test.runs.size() == 2);
+  KJ_EXPECT(test.runs[1].scheduledTime == t0 + 1 * kj::SECONDS);
+  KJ_EXPECT(test.runs[1].retryCount == 1);
+  KJ_EXPECT(test.runs[1].time - test.runs[0].time >=
+            AlarmScheduler::RETRY_START_SECONDS * kj::SECONDS);
+  KJ_EXPECT(scheduler->getAlarm(test.key("a")) == kj::none);
+}
+
+}  // namespace
+}  // namespace workerd::server
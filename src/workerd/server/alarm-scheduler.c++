@@ -22,23 +22,159 @@ std::default_random_engine makeSeededRandomEngine() {
   return engine;
 }
 
+int64_t toNanoseconds(kj::Date date) {
+  return (date - kj::UNIX_EPOCH) / kj::NANOSECONDS;
+}
+
+kj::Date fromNanoseconds(int64_t ns) {
+  return kj::UNIX_EPOCH + ns * kj::NANOSECONDS;
+}
+
+// Timer wheel ticks are milliseconds since the epoch.
+constexpr int64_t NANOSECONDS_PER_TICK = 1'000'000;
+
+// The tick that `date` falls in, i.e. the last tick that has started by then.
+int64_t floorTick(kj::Date date) {
+  int64_t ns = toNanoseconds(date);
+  return ns / NANOSECONDS_PER_TICK - (ns % NANOSECONDS_PER_TICK < 0);
+}
+
+// The first tick that starts at or after `date`. Alarms are due at this tick, so that they never
+// run before their scheduled time.
+int64_t ceilTick(kj::Date date) {
+  int64_t ns = toNanoseconds(date);
+  return ns / NANOSECONDS_PER_TICK + (ns % NANOSECONDS_PER_TICK > 0);
+}
+
+kj::Date tickToDate(int64_t tick) {
+  return kj::UNIX_EPOCH + tick * kj::MILLISECONDS;
+}
+
 } // namespace
 
+void AlarmScheduler::TimerWheel::add(AlarmList& list, ScheduledAlarm& alarm) {
+  KJ_DASSERT(alarm.list == nullptr);
+  list.add(alarm);
+  alarm.list = &list;
+}
+
+void AlarmScheduler::TimerWheel::insert(ScheduledAlarm& alarm, AlarmList& expired) {
+  if (alarm.dueTick <= currentTick) {
+    add(expired, alarm);
+    return;
+  }
+
+  uint64_t delta = alarm.dueTick - currentTick;
+  for (uint level = 0; level < LEVELS; level++) {
+    uint shift = level * SLOT_BITS;
+    uint64_t range = uint64_t(1) << (shift + SLOT_BITS);
+    if (delta < range) {
+      // Each slot of level `level` covers 2^shift ticks, and is cascaded down when the wheel
+      // reaches its first tick. Since `delta` is at least 2^shift (or the alarm would have gone in
+      // a lower level), that tick is after the current one and no later than the due tick.
+      add(slots[level][(alarm.dueTick >> shift) & (SLOTS - 1)], alarm);
+      return;
+    } else if (level == LEVELS - 1) {
+      // Beyond the wheel's range. Park the alarm in the furthest slot of the top level; it will be
+      // re-inserted from there when that slot is cascaded.
+      add(slots[level][((currentTick + range - 1) >> shift) & (SLOTS - 1)], alarm);
+      return;
+    }
+  }
+}
+
+void AlarmScheduler::TimerWheel::advance(int64_t tick, AlarmList& expired) {
+  // Rather than stepping through every tick, jump straight to each tick at which something happens.
+  while (true) {
+    KJ_IF_SOME(next, nextEventTick()) {
+      if (next > tick) break;
+      currentTick = next;
+    } else {
+      break;
+    }
+
+    // Cascade the slots of higher levels whose first tick this is. Their alarms all land in lower
+    // levels (or on `expired`), never back in a slot being cascaded.
+    for (uint level = 1; level < LEVELS; level++) {
+      uint shift = level * SLOT_BITS;
+      if (currentTick & ((int64_t(1) << shift) - 1)) break;
+
+      auto& slot = slots[level][(currentTick >> shift) & (SLOTS - 1)];
+      while (!slot.empty()) {
+        auto& alarm = slot.front();
+        slot.remove(alarm);
+        alarm.list = nullptr;
+        insert(alarm, expired);
+      }
+    }
+
+    auto& slot = slots[0][currentTick & (SLOTS - 1)];
+    while (!slot.empty()) {
+      auto& alarm = slot.front();
+      slot.remove(alarm);
+      alarm.list = nullptr;
+      add(expired, alarm);
+    }
+  }
+
+  currentTick = kj::max(currentTick, tick);
+}
+
+kj::Maybe<int64_t> AlarmScheduler::TimerWheel::nextEventTick() {
+  kj::Maybe<int64_t> result;
+  for (uint level = 0; level < LEVELS; level++) {
+    uint shift = level * SLOT_BITS;
+    int64_t base = currentTick >> shift;
+    // Looking one full turn ahead covers the slot the wheel is in at this level, which (above
+    // level 0) may hold alarms due on the wheel's next turn.
+    for (int64_t i = 1; i <= SLOTS; i++) {
+      if (!slots[level][(base + i) & (SLOTS - 1)].empty()) {
+        int64_t next = (base + i) << shift;
+        KJ_IF_SOME(r, result) {
+          result = kj::min(r, next);
+        } else {
+          result = next;
+        }
+        break;
+      }
+    }
+  }
+  return result;
+}
+
 AlarmScheduler::AlarmScheduler(
     const kj::Clock& clock,
     kj::Timer& timer,
     const SqliteDatabase::Vfs& vfs,
-    kj::PathPtr path)
-    : clock(clock), timer(timer), random(makeSeededRandomEngine()),
+    kj::PathPtr path,
+    Options options)
+    : clock(clock), timer(timer), options(options), random(makeSeededRandomEngine()),
       db([&]{
         auto db = kj::heap<SqliteDatabase>(vfs, path,
             kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT);
         ensureInitialized(*db);
         return kj::mv(db);
       }()),
-      tasks(*this) {
-    loadAlarmsFromDb();
+      tasks(*this),
+      wheel(floorTick(clock.now())) {
+  // Alarms that are already overdue go on `due`, to be dispatched on the first wake, by which
+  // time their namespaces will have been registered.
+  refillWindow(clock.now());
+  updateWakeTime();
+}
+
+AlarmScheduler::~AlarmScheduler() noexcept(false) {
+  wakeTask = kj::none;
+
+  // Alarms must be unlinked before they are destroyed.
+  for (auto& entry: alarms) {
+    auto& alarm = *entry.value;
+    if (alarm.list != nullptr) {
+      alarm.list->remove(alarm);
+      alarm.list = nullptr;
+    }
   }
+}
 
 void AlarmScheduler::ensureInitialized(SqliteDatabase& db) {
   // TODO(sqlite): Do this automatically at a lower layer?
@@ -52,108 +188,228 @@ void AlarmScheduler::ensureInitialized(SqliteDatabase& db) {
       PRIMARY KEY (actor_unique_key, actor_id)
     ) WITHOUT ROWID;
   )");
+
+  db.run(R"(
+    CREATE INDEX IF NOT EXISTS _cf_ALARM_scheduled_time ON _cf_ALARM (scheduled_time);
+  )");
 }
 
-void AlarmScheduler::loadAlarmsFromDb() {
-  auto now = clock.now();
+void AlarmScheduler::refillWindow(kj::Date now) {
+  int64_t nowNs = toNanoseconds(now);
+  int64_t windowNs = options.window / kj::NANOSECONDS;
+  int64_t target = nowNs + windowNs;
 
-  // TODO(someday): don't maintain the entire alarm set in memory -- right now for the usecase of
-  // local development, doing so is sufficent.
-  auto query = db->run(R"(
-    SELECT actor_unique_key, actor_id, scheduled_time FROM _cf_ALARM;
-  )");
+  // Load more once half of the window has gone by, or, if the window was cut short by a full page,
+  // once fewer than half of that page's alarms are still waiting. Alarms that are running or
+  // awaiting a retry don't count, as they may hang around for a long time.
+  bool windowLow = !lastPageFull && windowEnd <= nowNs + windowNs / 2;
+  bool pageLow = lastPageFull && waitingAlarms * 2 < options.pageSize;
+  if (windowEnd >= target || !(windowLow || pageLow)) return;
+
+  uint count = 0;
+  int64_t last = windowEnd;
+  {
+    auto query = stmtLoadPage.run(windowEnd, target, int64_t(options.pageSize));
+    while (!query.isDone()) {
+      ActorKey actor { .uniqueKey = query.getText(0), .actorId = query.getText(1) };
+      last = query.getInt64(2);
+      // Alarms already in memory are running or retrying, and will pick up their stored time
+      // when done.
+      if (alarms.find(actor) == kj::none) {
+        addAlarm(actor, fromNanoseconds(last));
+      }
+      ++count;
+      query.nextRow();
+    }
+  }
+
+  if (count < options.pageSize) {
+    windowEnd = target;
+    lastPageFull = false;
+  } else {
+    // The page ended partway through the window. Load the rest of the alarms due at the same time
+    // as the last one too, so that the window can end right after it.
+    auto query = stmtLoadTies.run(last);
+    while (!query.isDone()) {
+      ActorKey actor { .uniqueKey = query.getText(0), .actorId = query.getText(1) };
+      if (alarms.find(actor) == kj::none) {
+        addAlarm(actor, fromNanoseconds(last));
+      }
+      query.nextRow();
+    }
+    windowEnd = last + 1;
+    lastPageFull = true;
+  }
+}
 
-  while (!query.isDone()) {
-    auto date = kj::UNIX_EPOCH + (kj::NANOSECONDS * query.getInt64(2));
+void AlarmScheduler::updateWakeTime() {
+  kj::Maybe<kj::Date> maybeNext;
+  if (!due.empty()) {
+    maybeNext = clock.now();
+  } else {
+    if (!lastPageFull) {
+      maybeNext = fromNanoseconds(windowEnd) - options.window / 2;
+    } else if (windowEnd > toNanoseconds(clock.now())) {
+      // The window is refilled as the alarms in the last page finish or are removed, but look
+      // again once the window has run out, in case none of them are left to do it.
+      maybeNext = fromNanoseconds(windowEnd);
+    }
+    KJ_IF_SOME(tick, wheel.nextEventTick()) {
+      KJ_IF_SOME(n, maybeNext) {
+        maybeNext = kj::min(n, tickToDate(tick));
+      } else {
+        maybeNext = tickToDate(tick);
+      }
+    }
+  }
+  auto next = KJ_UNWRAP_OR(maybeNext, return);
 
-    auto ownUniqueKey = kj::str(query.getText(0));
-    auto ownActorId = kj::str(query.getText(1));
-    auto actor = kj::attachVal(ActorKey { .uniqueKey = ownUniqueKey, .actorId = ownActorId },
-        kj::mv(ownUniqueKey), kj::mv(ownActorId));
+  KJ_IF_SOME(current, wakeTime) {
+    // An earlier wake will set the timer again.
+    if (current <= next) return;
+  }
+
+  wakeTime = next;
+  wakeTask = timer.afterDelay(next - clock.now()).then([this]() {
+    onWake();
+  }).eagerlyEvaluate([](kj::Exception&& e) {
+    KJ_LOG(ERROR, "alarm scheduler failed to dispatch alarms", e);
+  });
+}
+
+void AlarmScheduler::onWake() {
+  // We're running as part of `wakeTask`, which must not be destroyed until we return.
+  KJ_IF_SOME(task, wakeTask) {
+    tasks.add(kj::mv(task));
+  }
+  wakeTask = kj::none;
+  wakeTime = kj::none;
+
+  // Since we are waiting on timer.afterDelay, it's possible that timer.now() was behind the real
+  // time by a few ms. The wheel only turns as far as the clock says, so alarms never run before
+  // their scheduled time; if nothing is due yet, we'll just wait a while longer.
+  auto now = clock.now();
+  wheel.advance(floorTick(now), due);
+  refillWindow(now);
+  dispatch();
+  updateWakeTime();
+}
+
+void AlarmScheduler::dispatch() {
+  while (!due.empty()) {
+    auto& alarm = due.front();
+    due.remove(alarm);
+    alarm.list = nullptr;
+
+    KJ_IF_SOME(ns, namespaces.find(alarm.actor->uniqueKey)) {
+      if (ns->running >= options.maxConcurrentAlarms) {
+        ns->queue.add(alarm);
+        alarm.list = &ns->queue;
+        continue;
+      }
+    }
+    // If the namespace isn't registered, runAlarm() fails, and the alarm is retried.
+    startAlarm(alarm);
+  }
+}
 
-    alarms.insert(*actor, scheduleAlarm(now, kj::mv(actor), date));
+void AlarmScheduler::startAlarm(ScheduledAlarm& alarm) {
+  KJ_IF_SOME(ns, namespaces.find(alarm.actor->uniqueKey)) {
+    ++ns->running;
+  }
+  setStatus(alarm, AlarmStatus::STARTED);
+  alarm.task = makeAlarmTask(*alarm.actor, alarm.scheduledTime, alarm.countedRetry);
+}
 
-    query.nextRow();
+void AlarmScheduler::releaseSlot(kj::StringPtr uniqueKey) {
+  KJ_IF_SOME(ns, namespaces.find(uniqueKey)) {
+    if (ns->running > 0) --ns->running;
+    if (!ns->queue.empty() && ns->running < options.maxConcurrentAlarms) {
+      auto& next = ns->queue.front();
+      ns->queue.remove(next);
+      next.list = nullptr;
+      startAlarm(next);
+    }
   }
 }
 
 void AlarmScheduler::registerNamespace(kj::StringPtr uniqueKey, GetActorFn getActor) {
-  namespaces.insert(uniqueKey, Namespace{
-    .getActor = kj::mv(getActor)
-  });
+  namespaces.insert(uniqueKey, kj::heap<Namespace>(kj::mv(getActor)));
 }
 
 kj::Maybe<kj::Date> AlarmScheduler::getAlarm(ActorKey actor) {
   KJ_IF_SOME(alarm, alarms.find(actor)) {
-    if (alarm.status == AlarmStatus::STARTED) {
+    if (alarm->status == AlarmStatus::STARTED) {
       // getAlarm() when the alarm handler is running should return null,
       // unless an alarm is queued;
-      return alarm.queuedAlarm;
+      return alarm->queuedAlarm;
     } else {
-      return alarm.scheduledTime;
+      return alarm->scheduledTime;
     }
-  } else {
-    // We currently retain the entire set of queued alarms in memory, no need to hit sqlite
-    return kj::none;
   }
+
+  // Alarms due beyond the window are only in the database.
+  auto query = stmtGetAlarm.run(actor.uniqueKey, actor.actorId);
+  if (query.isDone()) return kj::none;
+  return fromNanoseconds(query.getInt64(0));
 }
 
 bool AlarmScheduler::setAlarm(ActorKey actor, kj::Date scheduledTime) {
-  int64_t scheduledTimeNs = (scheduledTime - kj::UNIX_EPOCH) / kj::NANOSECONDS;
-  auto query = stmtSetAlarm.run(actor.uniqueKey, actor.actorId, scheduledTimeNs);
-
-  bool existing = true;
-  auto& entry = alarms.findOrCreate(actor, [&]() {
-    existing = false;
-
-    auto ownUniqueKey = kj::str(actor.uniqueKey);
-    auto ownActorId = kj::str(actor.actorId);
-    auto ownActor = kj::attachVal(ActorKey { .uniqueKey = ownUniqueKey, .actorId = ownActorId },
-    kj::mv(ownUniqueKey), kj::mv(ownActorId));
+  int64_t scheduledTimeNs = toNanoseconds(scheduledTime);
+  bool changed = stmtSetAlarm.run(actor.uniqueKey, actor.actorId, scheduledTimeNs)
+      .changeCount() > 0;
 
-    return decltype(alarms)::Entry {
-        *ownActor, scheduleAlarm(clock.now(), kj::mv(ownActor), scheduledTime) };
-  });
-
-  if (existing) {
-    if (entry.status != AlarmStatus::WAITING) {
+  KJ_IF_SOME(entry, alarms.find(actor)) {
+    if (entry->status != AlarmStatus::WAITING) {
       // We queue any new alarm after the existing alarm even if the new alarm has the same scheduled
       // time, as receiving a notification directly maps to a write for that time in the actor.
-      entry.queuedAlarm = scheduledTime;
+      entry->queuedAlarm = scheduledTime;
     } else {
-      entry = scheduleAlarm(clock.now(), kj::mv(entry.actor), scheduledTime);
+      rescheduleAlarm(*entry, scheduledTime);
     }
+  } else if (scheduledTimeNs < windowEnd) {
+    addAlarm(actor, scheduledTime);
   }
+  // Rescheduling may have moved the alarm out of the window.
+  refillWindow(clock.now());
+  updateWakeTime();
 
-  return query.changeCount() > 0;
+  return changed;
 }
 
 bool AlarmScheduler::deleteAlarm(ActorKey actor) {
-  auto query = stmtDeleteAlarm.run(actor.uniqueKey, actor.actorId);
+  bool changed = stmtDeleteAlarm.run(actor.uniqueKey, actor.actorId).changeCount() > 0;
 
-  KJ_IF_SOME(entry, alarms.findEntry(actor)) {
-    KJ_IF_SOME(queued, entry.value.queuedAlarm) {
-      if (entry.value.status == AlarmStatus::STARTED) {
+  KJ_IF_SOME(entry, alarms.find(actor)) {
+    auto& alarm = *entry;
+    KJ_IF_SOME(queued, alarm.queuedAlarm) {
+      if (alarm.status == AlarmStatus::STARTED) {
         // If we are currently running an alarm, we want to delete the queued instead of current.
-        entry.value.queuedAlarm = kj::none;
+        alarm.queuedAlarm = kj::none;
       } else {
-        entry.value = scheduleAlarm(clock.now(), kj::mv(entry.value.actor), queued);
+        // The queued alarm is no longer in the database, so keep it in memory even if it is
+        // beyond the window.
+        resetAlarm(alarm, queued);
+        scheduleAlarm(alarm, queued);
+        updateWakeTime();
       }
     } else {
-      if (entry.value.status != AlarmStatus::STARTED) {
+      if (alarm.status != AlarmStatus::STARTED) {
         // We can't remove running alarms.
-        alarms.erase(entry);
+        evictAlarm(alarm);
+        refillWindow(clock.now());
+        updateWakeTime();
       }
     }
   }
 
-  return query.changeCount() > 0;
+  return changed;
 }
 
 kj::Promise<AlarmScheduler::RetryInfo> AlarmScheduler::runAlarm(
     const ActorKey& actor, kj::Date scheduledTime, uint32_t retryCount) {
   KJ_IF_SOME(ns, namespaces.find(actor.uniqueKey)) {
-    auto result = co_await ns.getActor(kj::str(actor.actorId))->runAlarm(scheduledTime, retryCount);
+    auto result = co_await ns->getActor(kj::str(actor.actorId))->runAlarm(scheduledTime, retryCount);
 
     co_return RetryInfo {
       .retry = result.outcome != EventOutcome::OK && result.retry,
@@ -164,38 +420,67 @@ kj::Promise<AlarmScheduler::RetryInfo> AlarmScheduler::runAlarm(
   }
 }
 
-AlarmScheduler::ScheduledAlarm AlarmScheduler::scheduleAlarm(
-    kj::Date now, kj::Own<ActorKey> actor, kj::Date scheduledTime) {
-  auto task = makeAlarmTask(scheduledTime - now, *actor, scheduledTime);
-
-  return ScheduledAlarm { kj::mv(actor), scheduledTime, kj::mv(task) };
+void AlarmScheduler::scheduleAlarm(ScheduledAlarm& alarm, kj::Date time) {
+  // Bring the wheel up to date first, so that the alarm is placed relative to the current time.
+  wheel.advance(floorTick(clock.now()), due);
+  alarm.dueTick = ceilTick(time);
+  wheel.insert(alarm, due);
 }
 
-kj::Promise<void> AlarmScheduler::checkTimestamp(kj::Duration delay, kj::Date scheduledTime) {
-  co_await timer.afterDelay(delay);
+void AlarmScheduler::resetAlarm(ScheduledAlarm& alarm, kj::Date scheduledTime) {
+  if (alarm.list != nullptr) {
+    alarm.list->remove(alarm);
+    alarm.list = nullptr;
+  }
+  alarm.scheduledTime = scheduledTime;
+  alarm.queuedAlarm = kj::none;
+  setStatus(alarm, AlarmStatus::WAITING);
+  alarm.previousRetryCountedAgainstLimit = false;
+  alarm.backoff = 0;
+  alarm.retry = 0;
+  alarm.countedRetry = 0;
+}
 
-  // Since we are waiting on timer.afterDelay, it's possible that timer.now() was behind
-  // the real time by a few ms, leading to premature alarm() execution. This checks it the current
-  // time is >= than scheduledTime to ensure we run alarms only on or after their scheduled time.
-  auto now = clock.now();
-  if (now < scheduledTime) {
-    // If it's not yet time to trigger the alarm, we shall wait a while longer until we can
-    // trigger it. This repeats until it's time for the alarm to run.
-    co_await checkTimestamp(scheduledTime - now, scheduledTime);
+void AlarmScheduler::rescheduleAlarm(ScheduledAlarm& alarm, kj::Date scheduledTime) {
+  resetAlarm(alarm, scheduledTime);
+  if (toNanoseconds(scheduledTime) < windowEnd) {
+    scheduleAlarm(alarm, scheduledTime);
+  } else {
+    // It'll be loaded again when the window reaches it.
+    evictAlarm(alarm);
   }
 }
 
-kj::Promise<void> AlarmScheduler::makeAlarmTask(kj::Duration delay,
-                                                const ActorKey& actorRef,
-                                                kj::Date scheduledTime) {
-  co_await checkTimestamp(delay, scheduledTime);
-  uint32_t retryCount = 0;
-  {
-    auto& entry = KJ_ASSERT_NONNULL(alarms.findEntry(actorRef));
-    entry.value.status = AlarmStatus::STARTED;
-    retryCount = entry.value.countedRetry;
+void AlarmScheduler::evictAlarm(ScheduledAlarm& alarm) {
+  KJ_ASSERT(alarm.status != AlarmStatus::STARTED);
+  if (alarm.list != nullptr) {
+    alarm.list->remove(alarm);
+    alarm.list = nullptr;
   }
+  if (alarm.status == AlarmStatus::WAITING) --waitingAlarms;
+  auto& entry = KJ_ASSERT_NONNULL(alarms.findEntry(*alarm.actor));
+  alarms.erase(entry);
+}
 
+void AlarmScheduler::setStatus(ScheduledAlarm& alarm, AlarmStatus status) {
+  if (alarm.status == AlarmStatus::WAITING) --waitingAlarms;
+  if (status == AlarmStatus::WAITING) ++waitingAlarms;
+  alarm.status = status;
+}
+
+void AlarmScheduler::addAlarm(ActorKey actor, kj::Date scheduledTime) {
+  auto alarm = kj::heap<ScheduledAlarm>();
+  alarm->actor = actor.clone();
+  alarm->scheduledTime = scheduledTime;
+  auto& ref = *alarm;
+  alarms.insert(*ref.actor, kj::mv(alarm));
+  ++waitingAlarms;
+  scheduleAlarm(ref, scheduledTime);
+}
+
+kj::Promise<void> AlarmScheduler::makeAlarmTask(const ActorKey& actorRef,
+                                                kj::Date scheduledTime,
+                                                uint32_t retryCount) {
   auto retryInfo = co_await ([&]() -> kj::Promise<RetryInfo> {
     try {
       co_return co_await runAlarm(actorRef, scheduledTime, retryCount);
@@ -215,62 +500,72 @@ kj::Promise<void> AlarmScheduler::makeAlarmTask(kj::Duration delay,
   })();
 
   try {
-    auto& entry = KJ_ASSERT_NONNULL(alarms.findEntry(actorRef));
+    auto& entry = *KJ_ASSERT_NONNULL(alarms.find(actorRef));
 
     // We can't overwrite our entry before moving ourselves out of it, as a promise cannot
     // delete itself.
-    tasks.add(kj::mv(entry.value.task));
+    KJ_IF_SOME(task, entry.task) {
+      tasks.add(kj::mv(task));
+    }
+    entry.task = kj::none;
+
+    releaseSlot(entry.actor->uniqueKey);
 
     // If an alarm is queued, there's no point in retrying the current one -- proceed
     // to running the queued alarm instead.
-    KJ_IF_SOME(a, entry.value.queuedAlarm) {
-      // creating a new alarm and overwriting the old one will reset
-      // `status` to WAITING and `queuedAlarm` to null
-      entry.value = scheduleAlarm(clock.now(), kj::mv(entry.value.actor), a);
+    KJ_IF_SOME(a, entry.queuedAlarm) {
+      // rescheduling resets `status` to WAITING and `queuedAlarm` to null
+      rescheduleAlarm(entry, a);
+      refillWindow(clock.now());
+      updateWakeTime();
       co_return;
     }
 
     // When we reach this block of code and alarm has either successed or failed and may (or may
     // not) retry. Setting the status of an alarm as FINISHED here, will allow deletion of alarms
-    // between retries. If there's a retry, `makeAlarmTask` is called, setting status as RUNNING
-    // again.
-    entry.value.status = AlarmStatus::FINISHED;
+    // between retries. If there's a retry, the alarm is dispatched again when due, setting status
+    // as STARTED again.
+    setStatus(entry, AlarmStatus::FINISHED);
 
     if (retryInfo.retry) {
-      // recreate the task, running after a delay determined using the retry factor
-      if (entry.value.countedRetry >= AlarmScheduler::RETRY_MAX_TRIES) {
-        deleteAlarm(*entry.value.actor);
+      // put the alarm back in the wheel, due after a delay determined using the retry factor
+      if (entry.countedRetry >= AlarmScheduler::RETRY_MAX_TRIES) {
+        deleteAlarm(*entry.actor);
+        refillWindow(clock.now());
+        updateWakeTime();
         co_return;
       }
       if (retryInfo.retryCountsAgainstLimit) {
-        entry.value.countedRetry++;
+        entry.countedRetry++;
 
-        if (!entry.value.previousRetryCountedAgainstLimit) {
+        if (!entry.previousRetryCountedAgainstLimit) {
           // The last retry didn't count against the limit, indicating it was due to some internal
           // error. However, this retry does, meaning it's due to an error in user code,
           // most likely a different error. We should reset the retry counter used for
           // calculating backoff, so user-caused retries don't have an unnecessarily high backoff
           // time if they come after internal-caused retries.
 
-          entry.value.backoff = 0;
+          entry.backoff = 0;
         }
       }
-      entry.value.previousRetryCountedAgainstLimit = retryInfo.retryCountsAgainstLimit;
+      entry.previousRetryCountedAgainstLimit = retryInfo.retryCountsAgainstLimit;
 
-      entry.value.backoff = kj::min(AlarmScheduler::RETRY_BACKOFF_MAX, entry.value.backoff);
-      auto delay = (AlarmScheduler::RETRY_START_SECONDS << entry.value.backoff) * kj::SECONDS;
+      entry.backoff = kj::min(AlarmScheduler::RETRY_BACKOFF_MAX, entry.backoff);
+      auto delay = (AlarmScheduler::RETRY_START_SECONDS << entry.backoff) * kj::SECONDS;
 
       std::uniform_int_distribution<> distribution(0, maxJitterMsForDelay(delay));
       delay += distribution(random) * kj::MILLISECONDS;
 
-      entry.value.backoff++;
-      entry.value.retry++;
+      entry.backoff++;
+      entry.retry++;
 
-      entry.value.task = makeAlarmTask(delay, actorRef, scheduledTime);
+      scheduleAlarm(entry, clock.now() + delay);
     } else {
-      KJ_ASSERT(entry.value.queuedAlarm == kj::none);
+      KJ_ASSERT(entry.queuedAlarm == kj::none);
       deleteAlarm(actorRef);
+      refillWindow(clock.now());
     }
+    updateWakeTime();
   } catch (...) {
     auto exception = kj::getCaughtExceptionAsKj();
     KJ_LOG(ERROR, "Failed to run alarm and was unable to schedule a retry", exception);
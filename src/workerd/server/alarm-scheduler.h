@@ -10,6 +10,7 @@
 #include <kj/time.h>
 #include <kj/timer.h>
 #include <kj/map.h>
+#include <kj/list.h>
 
 #include <random>
 
@@ -42,6 +43,13 @@ inline uint KJ_HASHCODE(const ActorKey& k) { return kj::hashCode(k.uniqueKey, k.
 
 // Allows scheduling alarm executions at specific times, returning a promise representing
 // the completion of the alarm event.
+//
+// Alarms are stored in sqlite, but only those due within a sliding window (`Options::window`) are
+// kept in memory, at most about `Options::pageSize` at a time; the rest are paged in from an index
+// on `scheduled_time` as the window advances. Alarms in memory sit in a hierarchical timer wheel,
+// so that a single timer drives all of them, and alarms that come due together are dispatched as
+// a batch. At most `Options::maxConcurrentAlarms` alarms per namespace run at once; due alarms
+// beyond that wait their turn.
 class AlarmScheduler final : kj::TaskSet::ErrorHandler {
 public:
   static constexpr auto RETRY_START_SECONDS = WorkerInterface::ALARM_RETRY_START_SECONDS;
@@ -60,11 +68,31 @@ public:
 
   using GetActorFn = kj::Function<kj::Own<WorkerInterface>(kj::String)>;
 
+  struct Options {
+    // Alarms due within this long from now are kept in memory (unless there are more than
+    // `pageSize` of them). Must be well below the timer wheel's range of about 4.6 hours.
+    kj::Duration window = 10 * kj::MINUTES;
+
+    // The number of alarms loaded from the database at a time.
+    uint pageSize = 1024;
+
+    // The maximum number of alarms running at once in each namespace.
+    uint maxConcurrentAlarms = 32;
+  };
+
+  AlarmScheduler(
+    const kj::Clock& clock,
+    kj::Timer& timer,
+    const SqliteDatabase::Vfs& vfs,
+    kj::PathPtr path,
+    Options options);
   AlarmScheduler(
     const kj::Clock& clock,
     kj::Timer& timer,
     const SqliteDatabase::Vfs& vfs,
-    kj::PathPtr path);
+    kj::PathPtr path)
+    : AlarmScheduler(clock, timer, vfs, path, Options()) {}
+  ~AlarmScheduler() noexcept(false);
 
   kj::Maybe<kj::Date> getAlarm(ActorKey actor);
   bool setAlarm(ActorKey actor, kj::Date scheduledTime);
@@ -76,23 +104,28 @@ private:
   enum class AlarmStatus {WAITING, STARTED, FINISHED};
   const kj::Clock& clock;
   kj::Timer& timer;
+  Options options;
   std::default_random_engine random;
 
-  struct Namespace {
-    GetActorFn getActor;
-  };
-  kj::HashMap<kj::StringPtr, Namespace> namespaces;
-  kj::Own<SqliteDatabase> db;
-  kj::TaskSet tasks;
-
   struct ScheduledAlarm {
     kj::Own<ActorKey> actor;
     kj::Date scheduledTime;
-    kj::Promise<void> task;
+
+    // Set while the alarm is running.
+    kj::Maybe<kj::Promise<void>> task;
+
     kj::Maybe<kj::Date> queuedAlarm = kj::none;
     // Once started, an alarm can have a single alarm queued behind it.
     AlarmStatus status = AlarmStatus::WAITING;
 
+    // The tick (see TimerWheel) at which the alarm, or its next retry, is due.
+    int64_t dueTick = 0;
+
+    // Links the alarm into a timer wheel slot while waiting to be due, or into a list of due
+    // alarms while waiting to be dispatched. `list` points to whichever list that is.
+    kj::ListLink<ScheduledAlarm> link;
+    kj::List<ScheduledAlarm, &ScheduledAlarm::link>* list = nullptr;
+
     bool previousRetryCountedAgainstLimit = false;
 
     // Counter for calculating backoff -- separate from retry, so we can reset backoff without losing
@@ -105,8 +138,77 @@ private:
     // Counter for retry attempts that apply to the retry limit.
     uint32_t countedRetry = 0;
   };
+  using AlarmList = kj::List<ScheduledAlarm, &ScheduledAlarm::link>;
+
+  // A hierarchical timer wheel (Varghese & Lauck) with millisecond ticks. Each of the LEVELS
+  // levels has SLOTS slots, each covering SLOTS times as many ticks as a slot of the level below.
+  // An alarm is placed in the lowest level whose range covers its due tick, and is cascaded down
+  // as the wheel turns, so inserting and removing are O(1) and no per-alarm timers are needed.
+  class TimerWheel {
+  public:
+    static constexpr uint SLOT_BITS = 6;
+    static constexpr uint SLOTS = 1 << SLOT_BITS;
+    static constexpr uint LEVELS = 4;
+
+    explicit TimerWheel(int64_t currentTick): currentTick(currentTick) {}
+    KJ_DISALLOW_COPY_AND_MOVE(TimerWheel);
+
+    int64_t getCurrentTick() const { return currentTick; }
 
-  kj::HashMap<ActorKey, ScheduledAlarm> alarms;
+    // Adds the alarm, due at `alarm.dueTick`. An alarm that is already due goes on `expired`.
+    void insert(ScheduledAlarm& alarm, AlarmList& expired);
+
+    // Turns the wheel to `tick`, moving alarms that are due by then onto `expired`.
+    void advance(int64_t tick, AlarmList& expired);
+
+    // Returns the next tick at which the wheel has something to do: either an alarm comes due or
+    // a slot of a higher level needs to be cascaded. Returns null if the wheel is empty.
+    kj::Maybe<int64_t> nextEventTick();
+
+  private:
+    int64_t currentTick;
+    AlarmList slots[LEVELS][SLOTS];
+
+    void add(AlarmList& list, ScheduledAlarm& alarm);
+  };
+
+  struct Namespace {
+    explicit Namespace(GetActorFn getActor): getActor(kj::mv(getActor)) {}
+
+    GetActorFn getActor;
+
+    // Number of alarms running.
+    uint running = 0;
+
+    // Due alarms waiting for fewer than `maxConcurrentAlarms` to be running.
+    AlarmList queue;
+  };
+  kj::HashMap<kj::StringPtr, kj::Own<Namespace>> namespaces;
+  kj::Own<SqliteDatabase> db;
+  kj::TaskSet tasks;
+
+  // Alarms in memory: those due before `windowEnd`, plus those running or awaiting a retry.
+  kj::HashMap<ActorKey, kj::Own<ScheduledAlarm>> alarms;
+
+  // The number of `alarms` with status WAITING, i.e. not running or awaiting a retry.
+  uint waitingAlarms = 0;
+
+  // All alarms in the database due before this time (in nanoseconds since the epoch) are in
+  // memory. Alarms due later are only in the database.
+  int64_t windowEnd = kj::minValue;
+
+  // Whether the last page loaded was full, i.e. windowEnd is limited by `pageSize` rather than
+  // `window`.
+  bool lastPageFull = false;
+
+  TimerWheel wheel;
+
+  // Alarms that have come due, waiting to be dispatched on the next wake.
+  AlarmList due;
+
+  // The time the wheel's timer is set for, and the promise that waits for it.
+  kj::Maybe<kj::Date> wakeTime;
+  kj::Maybe<kj::Promise<void>> wakeTask;
 
   struct RetryInfo {
     bool retry;
@@ -114,13 +216,43 @@ private:
   };
   kj::Promise<RetryInfo> runAlarm(const ActorKey& actor, kj::Date scheduledTime, uint32_t retryCount);
 
-  void setAlarmInMemory(kj::Own<ActorKey> actor, kj::Date scheduledTime);
+  // Puts the alarm in the timer wheel, due at `time`, or on `due` if it already is.
+  void scheduleAlarm(ScheduledAlarm& alarm, kj::Date time);
+
+  // Resets the alarm to run at `scheduledTime`, taking it out of whatever list it is in.
+  void resetAlarm(ScheduledAlarm& alarm, kj::Date scheduledTime);
+
+  // Resets the alarm to run at `scheduledTime`, evicting it from memory if that is beyond the
+  // window.
+  void rescheduleAlarm(ScheduledAlarm& alarm, kj::Date scheduledTime);
+
+  // Removes the alarm from memory. It must not be running.
+  void evictAlarm(ScheduledAlarm& alarm);
+
+  // Sets `alarm.status`, keeping `waitingAlarms` up to date.
+  void setStatus(ScheduledAlarm& alarm, AlarmStatus status);
+
+  // Adds an alarm loaded from the database, or set within the window, to memory.
+  void addAlarm(ActorKey actor, kj::Date scheduledTime);
 
-  ScheduledAlarm scheduleAlarm(kj::Date now, kj::Own<ActorKey> actor, kj::Date scheduledTime);
+  // Starts the alarms in `due`, or queues them behind their namespace's concurrency limit.
+  void dispatch();
+  void startAlarm(ScheduledAlarm& alarm);
 
-  kj::Promise<void> makeAlarmTask(kj::Duration delay, const ActorKey& actor, kj::Date scheduledTime);
+  // Called when an alarm in the namespace has finished running, to start the next queued one.
+  void releaseSlot(kj::StringPtr uniqueKey);
 
-  kj::Promise<void> checkTimestamp(kj::Duration delay, kj::Date scheduledTime);
+  kj::Promise<void> makeAlarmTask(const ActorKey& actor, kj::Date scheduledTime,
+                                  uint32_t retryCount);
+
+  // Called when the wheel's timer fires.
+  void onWake();
+
+  // Sets the wheel's timer for when it next has something to do.
+  void updateWakeTime();
+
+  // Loads the next page of alarms from the database, if the window calls for it.
+  void refillWindow(kj::Date now);
 
   SqliteDatabase::Statement stmtSetAlarm = db->prepare(R"(
     INSERT INTO _cf_ALARM VALUES(?, ?, ?)
@@ -129,13 +261,24 @@ private:
   SqliteDatabase::Statement stmtDeleteAlarm = db->prepare(R"(
     DELETE FROM _cf_ALARM WHERE actor_unique_key = ? AND actor_id = ?
   )");
+  SqliteDatabase::Statement stmtGetAlarm = db->prepare(R"(
+    SELECT scheduled_time FROM _cf_ALARM WHERE actor_unique_key = ? AND actor_id = ?
+  )");
+  SqliteDatabase::Statement stmtLoadPage = db->prepare(R"(
+    SELECT actor_unique_key, actor_id, scheduled_time FROM _cf_ALARM
+      WHERE scheduled_time >= ? AND scheduled_time < ?
+      ORDER BY scheduled_time LIMIT ?
+  )");
+  SqliteDatabase::Statement stmtLoadTies = db->prepare(R"(
+    SELECT actor_unique_key, actor_id, scheduled_time FROM _cf_ALARM
+      WHERE scheduled_time = ?
+  )");
 
   void taskFailed(kj::Exception&& exception) override;
 
   int maxJitterMsForDelay(kj::Duration delay);
 
   static void ensureInitialized(SqliteDatabase& db);
-  void loadAlarmsFromDb();
 };
 
 } // namespace workerd::server
@@ -0,0 +1,85 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "group-commit.h"
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+struct GroupCommitTest {
+  kj::EventLoop loop;
+  kj::WaitScope ws{loop};
+  kj::TimerImpl timer{kj::origin<kj::TimePoint>()};
+  kj::Own<const kj::Directory> dir = kj::newInMemoryDirectory(kj::nullClock());
+
+  kj::Own<const kj::ReadableFile> file(kj::StringPtr name) {
+    dir->openFile(kj::Path(name), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+    return dir->openFile(kj::Path(name));
+  }
+
+  void advance(kj::Duration delay) {
+    timer.advanceTo(timer.now() + delay);
+    ws.poll();
+  }
+};
+
+KJ_TEST("GroupCommitScheduler: commits within the latency window share a batch") {
+  GroupCommitTest test;
+  GroupCommitScheduler scheduler(test.timer, { .maxLatency = 2 * kj::MILLISECONDS });
+
+  auto a = scheduler.sync(test.file("a"));
+  test.advance(1 * kj::MILLISECONDS);
+  auto b = scheduler.sync(test.file("b"));
+  KJ_EXPECT(!a.poll(test.ws));
+  KJ_EXPECT(!b.poll(test.ws));
+
+  // The batch is flushed once its first commit has waited `maxLatency`.
+  test.advance(1 * kj::MILLISECONDS);
+  KJ_EXPECT(a.poll(test.ws));
+  KJ_EXPECT(b.poll(test.ws));
+  a.wait(test.ws);
+  b.wait(test.ws);
+
+  auto c = scheduler.sync(test.file("c"));
+  test.advance(2 * kj::MILLISECONDS);
+  c.wait(test.ws);
+
+  auto& stats = scheduler.getStats();
+  KJ_EXPECT(stats.commits == 3);
+  KJ_EXPECT(stats.batches == 2);
+  KJ_EXPECT(stats.batchSizes[0] == 1);
+  KJ_EXPECT(stats.batchSizes[1] == 1);
+}
+
+KJ_TEST("GroupCommitScheduler: full batches are flushed right away") {
+  GroupCommitTest test;
+  GroupCommitScheduler scheduler(test.timer,
+      { .maxLatency = 1 * kj::SECONDS, .maxBatchSize = 4 });
+
+  kj::Vector<kj::Promise<void>> promises;
+  for (auto i: kj::zeroTo(4)) {
+    promises.add(scheduler.sync(test.file(kj::str("f", i))));
+  }
+  for (auto& promise: promises) {
+    KJ_EXPECT(promise.poll(test.ws));
+  }
+
+  test.advance(500 * kj::MILLISECONDS);
+  auto late = scheduler.sync(test.file("late"));
+
+  // The full batch's timer doesn't cut the next batch's wait short.
+  test.advance(999 * kj::MILLISECONDS);
+  KJ_EXPECT(!late.poll(test.ws));
+  test.advance(1 * kj::MILLISECONDS);
+  late.wait(test.ws);
+
+  auto& stats = scheduler.getStats();
+  KJ_EXPECT(stats.commits == 5);
+  KJ_EXPECT(stats.batches == 2);
+  KJ_EXPECT(stats.batchSizes[2] == 1);
+}
+
+}  // namespace
+}  // namespace workerd::server
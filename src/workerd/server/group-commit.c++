@@ -0,0 +1,88 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "group-commit.h"
+#include <kj/debug.h>
+
+#if __linux__
+#include <unistd.h>
+#endif
+
+namespace workerd::server {
+
+GroupCommitScheduler::GroupCommitScheduler(kj::Timer& timer, Options options)
+    : timer(timer), options(options), tasks(*this) {}
+
+GroupCommitScheduler::~GroupCommitScheduler() noexcept(false) {
+  if (stats.commits > 0) {
+    KJ_LOG(INFO, "Durable Object group commit", stats.commits, stats.batches, stats.failures,
+           kj::arrayPtr(stats.batchSizes, HISTOGRAM_BUCKETS));
+  }
+
+  // Anything still waiting belongs to objects that are being torn down along with us.
+  for (auto& commit: batch) {
+    commit.fulfiller->reject(KJ_EXCEPTION(DISCONNECTED, "group commit scheduler destroyed"));
+  }
+}
+
+kj::Promise<void> GroupCommitScheduler::sync(kj::Own<const kj::ReadableFile> file) {
+  auto paf = kj::newPromiseAndFulfiller<void>();
+  batch.add(Commit { .file = kj::mv(file), .fulfiller = kj::mv(paf.fulfiller) });
+
+  if (batch.size() >= options.maxBatchSize) {
+    flush();
+  } else if (batch.size() == 1) {
+    tasks.add(timer.afterDelay(options.maxLatency).then([this, gen = generation]() {
+      if (gen == generation) flush();
+    }));
+  }
+
+  return kj::mv(paf.promise);
+}
+
+void GroupCommitScheduler::flush() {
+  auto commits = kj::mv(batch);
+  ++generation;
+
+  ++stats.batches;
+  stats.commits += commits.size();
+  uint bucket = 0;
+  while (bucket + 1 < HISTOGRAM_BUCKETS && (size_t(2) << bucket) <= commits.size()) {
+    ++bucket;
+  }
+  ++stats.batchSizes[bucket];
+
+  KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() {
+    bool synced = false;
+#if __linux__
+    if (commits.size() > 1) {
+      KJ_IF_SOME(fd, commits[0].file->getFd()) {
+        KJ_SYSCALL(syncfs(fd));
+        synced = true;
+      }
+    }
+#endif
+    if (!synced) {
+      for (auto& commit: commits) {
+        commit.file->datasync();
+      }
+    }
+  })) {
+    ++stats.failures;
+    for (auto& commit: commits) {
+      commit.fulfiller->reject(kj::cp(exception));
+    }
+    return;
+  }
+
+  for (auto& commit: commits) {
+    commit.fulfiller->fulfill();
+  }
+}
+
+void GroupCommitScheduler::taskFailed(kj::Exception&& exception) {
+  KJ_LOG(ERROR, "group commit task failed", exception);
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,87 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/async.h>
+#include <kj/filesystem.h>
+#include <kj/timer.h>
+#include <kj/vector.h>
+
+namespace workerd::server {
+
+// Makes writes to files durable in batches ("group commit"), so that many SQLite-backed Durable
+// Objects committing at around the same time share one durability barrier rather than each
+// syncing its own write-ahead log.
+//
+// Databases using this run with `PRAGMA synchronous=NORMAL`, so that SQLite doesn't sync the WAL
+// on commit, and pass their WAL to sync() from ActorSqlite's commit callback. The object's output
+// gate then stays locked until the batch the commit joined is durable. A batch is made durable
+// once it has been open for `Options::maxLatency`, or as soon as it has `Options::maxBatchSize`
+// commits, whichever comes first.
+//
+// All files passed to one scheduler must be on the same filesystem. On Linux, a batch of more
+// than one file is made durable with a single syncfs(); elsewhere each file is synced in turn.
+class GroupCommitScheduler final: private kj::TaskSet::ErrorHandler {
+public:
+  struct Options {
+    // The longest a commit waits for others to join its batch.
+    kj::Duration maxLatency = 1 * kj::MILLISECONDS;
+
+    // A batch is made durable as soon as it has this many commits.
+    uint maxBatchSize = 256;
+  };
+
+  static constexpr uint HISTOGRAM_BUCKETS = 16;
+
+  struct Stats {
+    // Total number of commits, and of batches they were made durable in.
+    uint64_t commits = 0;
+    uint64_t batches = 0;
+
+    // Number of batches by size. Bucket `i` counts batches of size 2^i up to 2^(i+1) - 1, with
+    // the last bucket counting all batches beyond that.
+    uint64_t batchSizes[HISTOGRAM_BUCKETS] = {};
+
+    // Number of barriers that failed. Every commit in such a batch fails, breaking its object.
+    uint64_t failures = 0;
+  };
+
+  GroupCommitScheduler(kj::Timer& timer, Options options);
+  explicit GroupCommitScheduler(kj::Timer& timer)
+      : GroupCommitScheduler(timer, Options()) {}
+  ~GroupCommitScheduler() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(GroupCommitScheduler);
+
+  // Returns a promise that resolves once everything written to `file` so far is durable.
+  kj::Promise<void> sync(kj::Own<const kj::ReadableFile> file);
+
+  const Stats& getStats() const { return stats; }
+
+private:
+  kj::Timer& timer;
+  Options options;
+  Stats stats;
+
+  struct Commit {
+    kj::Own<const kj::ReadableFile> file;
+    kj::Own<kj::PromiseFulfiller<void>> fulfiller;
+  };
+
+  // Commits waiting for the current batch to be made durable.
+  kj::Vector<Commit> batch;
+
+  // Incremented whenever a batch is flushed, so that the timer of a batch that was flushed for
+  // being full doesn't flush the next one early.
+  uint64_t generation = 0;
+
+  kj::TaskSet tasks;
+
+  // Makes the current batch durable and resolves its commits.
+  void flush();
+
+  void taskFailed(kj::Exception&& exception) override;
+};
+
+}  // namespace workerd::server
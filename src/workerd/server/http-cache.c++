@@ -0,0 +1,755 @@
+// Copyright (c) 2017-2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "http-cache.h"
+
+#include <workerd/util/strings.h>
+#include <kj/debug.h>
+#include <algorithm>
+
+namespace workerd::server {
+
+namespace {
+
+// Upper bound for delta-seconds values, as suggested by RFC 9111 section 1.2.2.
+constexpr uint64_t MAX_DELTA_SECONDS = 2147483648;
+
+// First line of every stored entry, identifying the format.
+constexpr kj::StringPtr CONTENT_SIGNATURE = "workerd-cache 1"_kj;
+
+kj::String toLower(kj::ArrayPtr<const char> text) {
+  auto result = kj::heapString(text);
+  for (char& c: result) {
+    if ('A' <= c && c <= 'Z') c += 'a' - 'A';
+  }
+  return result;
+}
+
+kj::ArrayPtr<const char> trim(kj::ArrayPtr<const char> text) {
+  while (text.size() > 0 && (text.front() == ' ' || text.front() == '\t')) {
+    text = text.slice(1, text.size());
+  }
+  while (text.size() > 0 && (text.back() == ' ' || text.back() == '\t')) {
+    text = text.first(text.size() - 1);
+  }
+  return text;
+}
+
+// Splits a comma-separated header value into its trimmed, non-empty elements.
+kj::Vector<kj::String> splitList(kj::StringPtr value) {
+  kj::Vector<kj::String> result;
+  kj::ArrayPtr<const char> rest = value;
+  while (rest.size() > 0) {
+    size_t end = 0;
+    while (end < rest.size() && rest[end] != ',') ++end;
+    auto element = trim(rest.first(end));
+    if (element.size() > 0) result.add(kj::heapString(element));
+    rest = rest.slice(kj::min(end + 1, rest.size()), rest.size());
+  }
+  return result;
+}
+
+// Parses delta-seconds (RFC 9111 section 1.2.2), capped at MAX_DELTA_SECONDS.
+kj::Maybe<kj::Duration> parseDeltaSeconds(kj::ArrayPtr<const char> text) {
+  if (text.size() == 0) return kj::none;
+  uint64_t value = 0;
+  for (char c: text) {
+    if (c < '0' || c > '9') return kj::none;
+    value = kj::min(value * 10 + (c - '0'), MAX_DELTA_SECONDS);
+  }
+  return value * kj::SECONDS;
+}
+
+// Returns the number of days between 1970-01-01 and the given date of the proleptic Gregorian
+// calendar (Howard Hinnant's days_from_civil).
+int64_t daysFromCivil(int64_t y, uint m, uint d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  uint yoe = static_cast<uint>(y - era * 400);
+  uint doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  uint doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+// Parses an HTTP date in the IMF-fixdate format, e.g. "Sun, 06 Nov 1994 08:49:37 GMT". That is
+// the format all senders must generate (RFC 9110 section 5.6.7). The obsolete formats are not
+// supported; like invalid dates, they are treated as being in the past where that matters.
+kj::Maybe<kj::Date> parseHttpDate(kj::StringPtr text) {
+  static constexpr kj::StringPtr MONTHS[] = {
+    "Jan"_kj, "Feb"_kj, "Mar"_kj, "Apr"_kj, "May"_kj, "Jun"_kj,
+    "Jul"_kj, "Aug"_kj, "Sep"_kj, "Oct"_kj, "Nov"_kj, "Dec"_kj,
+  };
+
+  auto digits = [&](size_t start, size_t count) -> kj::Maybe<uint> {
+    uint value = 0;
+    for (size_t i = start; i < start + count; i++) {
+      if (text[i] < '0' || text[i] > '9') return kj::none;
+      value = value * 10 + (text[i] - '0');
+    }
+    return value;
+  };
+
+  if (text.size() != 29 || text[3] != ',' || text[4] != ' ' || text[7] != ' ' ||
+      text[11] != ' ' || text[16] != ' ' || text[19] != ':' || text[22] != ':' ||
+      text.slice(25) != " GMT"_kj) {
+    return kj::none;
+  }
+
+  uint month = 0;
+  for (auto i: kj::indices(MONTHS)) {
+    if (text.slice(8).startsWith(MONTHS[i])) month = i + 1;
+  }
+  if (month == 0) return kj::none;
+
+  uint day = KJ_UNWRAP_OR_RETURN(digits(5, 2), kj::none);
+  uint year = KJ_UNWRAP_OR_RETURN(digits(12, 4), kj::none);
+  uint hour = KJ_UNWRAP_OR_RETURN(digits(17, 2), kj::none);
+  uint minute = KJ_UNWRAP_OR_RETURN(digits(20, 2), kj::none);
+  uint second = KJ_UNWRAP_OR_RETURN(digits(23, 2), kj::none);
+  if (day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) return kj::none;
+
+  int64_t seconds = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+  return kj::UNIX_EPOCH + seconds * kj::SECONDS;
+}
+
+struct CacheControl {
+  bool noStore = false;
+  bool noCache = false;
+  bool isPrivate = false;
+  bool isPublic = false;
+  bool mustRevalidate = false;
+  kj::Maybe<kj::Duration> maxAge;
+  kj::Maybe<kj::Duration> sMaxAge;
+};
+
+CacheControl parseCacheControl(kj::Maybe<kj::StringPtr> header) {
+  CacheControl result;
+  KJ_IF_SOME(h, header) {
+    for (auto& directive: splitList(h)) {
+      kj::ArrayPtr<const char> name = directive;
+      kj::ArrayPtr<const char> value = nullptr;
+      KJ_IF_SOME(eq, directive.findFirst('=')) {
+        name = trim(directive.first(eq));
+        value = trim(directive.slice(eq + 1));
+        if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+          value = value.slice(1, value.size() - 1);
+        }
+      }
+
+      // The qualified forms of no-cache and private (which list header fields) allow storing the
+      // response without those fields. We don't bother and treat them like the unqualified forms.
+      if (equalsIgnoreCase(name, "no-store"_kj)) {
+        result.noStore = true;
+      } else if (equalsIgnoreCase(name, "no-cache"_kj)) {
+        result.noCache = true;
+      } else if (equalsIgnoreCase(name, "private"_kj)) {
+        result.isPrivate = true;
+      } else if (equalsIgnoreCase(name, "public"_kj)) {
+        result.isPublic = true;
+      } else if (equalsIgnoreCase(name, "must-revalidate"_kj) ||
+                 equalsIgnoreCase(name, "proxy-revalidate"_kj)) {
+        result.mustRevalidate = true;
+      } else if (equalsIgnoreCase(name, "max-age"_kj)) {
+        result.maxAge = parseDeltaSeconds(value);
+      } else if (equalsIgnoreCase(name, "s-maxage"_kj)) {
+        result.sMaxAge = parseDeltaSeconds(value);
+      }
+    }
+  }
+  return result;
+}
+
+// Returns the value of the header with the given name, with multiple occurrences combined. Used
+// for headers named by `Vary`, which need not be in the header table.
+kj::String getHeaderByName(const kj::HttpHeaders& headers, kj::StringPtr name) {
+  kj::Vector<kj::String> values;
+  headers.forEach([&](kj::StringPtr n, kj::StringPtr v) {
+    if (equalsIgnoreCase(n, name)) values.add(kj::heapString(trim(v)));
+  });
+  return kj::strArray(values, ", ");
+}
+
+// Returns true for status codes that are "heuristically cacheable" (RFC 9110 section 15.1).
+bool isHeuristicallyCacheable(uint statusCode) {
+  switch (statusCode) {
+    case 200: case 203: case 204: case 300: case 301: case 308:
+    case 404: case 405: case 410: case 414: case 501:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Weak comparison of an entity tag against an If-None-Match list (RFC 9110 section 13.1.2).
+bool etagMatches(kj::StringPtr ifNoneMatch, kj::StringPtr etag) {
+  auto opaque = [](kj::StringPtr tag) { return tag.startsWith("W/") ? tag.slice(2) : tag; };
+  auto ours = kj::heapString(trim(etag));
+  for (auto& candidate: splitList(ifNoneMatch)) {
+    if (candidate == "*" || opaque(candidate) == opaque(ours)) return true;
+  }
+  return false;
+}
+
+// Parses a space-separated list of unsigned integers. Returns an empty array if any is invalid.
+kj::Array<uint64_t> splitTimes(kj::StringPtr text) {
+  kj::Vector<uint64_t> result;
+  kj::ArrayPtr<const char> rest = text;
+  while (rest.size() > 0) {
+    size_t end = 0;
+    while (end < rest.size() && rest[end] != ' ') ++end;
+    KJ_IF_SOME(value, kj::str(rest.first(end)).tryParseAs<uint64_t>()) {
+      result.add(value);
+    } else {
+      return nullptr;
+    }
+    rest = rest.slice(kj::min(end + 1, rest.size()), rest.size());
+  }
+  return result.releaseAsArray();
+}
+
+// Returns the offset just past the first blank line in `bytes`. Like kj's HTTP parser, accepts
+// lines ending with a bare "\n" as well as "\r\n".
+kj::Maybe<size_t> findBlankLine(kj::ArrayPtr<const kj::byte> bytes) {
+  for (size_t i = 1; i < bytes.size(); i++) {
+    if (bytes[i] != '\n') continue;
+    if (bytes[i - 1] == '\n' || (i >= 2 && bytes[i - 1] == '\r' && bytes[i - 2] == '\n')) {
+      return i + 1;
+    }
+  }
+  return kj::none;
+}
+
+}  // namespace
+
+HttpCache::HeaderIds::HeaderIds(kj::HttpHeaderTable::Builder& builder)
+    : cfCacheStatus(builder.add("CF-Cache-Status")),
+      cfCacheNamespace(builder.add("CF-Cache-Namespace")),
+      cacheControl(builder.add("Cache-Control")),
+      vary(builder.add("Vary")),
+      age(builder.add("Age")),
+      date(builder.add("Date")),
+      expires(builder.add("Expires")),
+      lastModified(builder.add("Last-Modified")),
+      etag(builder.add("ETag")),
+      ifNoneMatch(builder.add("If-None-Match")),
+      ifModifiedSince(builder.add("If-Modified-Since")),
+      setCookie(builder.add("Set-Cookie")),
+      authorization(builder.add("Authorization")) {}
+
+HttpCache::HttpCache(kj::Maybe<kj::Own<const kj::Directory>> dirParam, const kj::Clock& clock,
+                     Limits limits)
+    : dir(kj::mv(dirParam)), clock(clock), limits(limits) {
+  KJ_IF_SOME(d, dir) {
+    load(*state.lockExclusive(), *d);
+  }
+}
+
+HttpCache::~HttpCache() noexcept(false) {
+  auto lock = state.lockExclusive();
+  while (!lock->lru.empty()) {
+    lock->lru.remove(lock->lru.front());
+  }
+}
+
+kj::Promise<void> HttpCache::request(
+    const kj::HttpHeaderTable& headerTable, const HeaderIds& ids,
+    kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+    kj::AsyncInputStream& requestBody, Response& response) const {
+  auto key = kj::str(headers.get(ids.cfCacheNamespace).orDefault(""_kj), ' ', url);
+
+  switch (method) {
+    case kj::HttpMethod::GET:
+      co_return co_await match(headerTable, ids, key, headers, response);
+    case kj::HttpMethod::PUT:
+      co_return co_await put(headerTable, ids, key, headers, requestBody, response);
+    case kj::HttpMethod::PURGE:
+      co_return co_await purge(headerTable, key, response);
+    default:
+      co_return co_await response.sendError(405, "Method Not Allowed", headerTable);
+  }
+}
+
+kj::Promise<void> HttpCache::match(const kj::HttpHeaderTable& headerTable, const HeaderIds& ids,
+    kj::StringPtr key, const kj::HttpHeaders& headers, Response& response) const {
+  auto sendMiss = [&]() {
+    kj::HttpHeaders responseHeaders(headerTable);
+    responseHeaders.set(ids.cfCacheStatus, "MISS");
+    return response.sendError(504, "Gateway Timeout", responseHeaders);
+  };
+
+  // The lock is only held for the lookup; `hit.content` keeps the bytes alive while we send them.
+  auto maybeHit = lookup(*state.lockExclusive(), key, headers);
+  auto& hit = KJ_UNWRAP_OR(maybeHit, co_return co_await sendMiss());
+  auto& content = hit.content;
+
+  // Parsing the head modifies it in place, so parse a copy.
+  auto headText = kj::heapArray<char>(
+      content.slice(hit.headOffset, hit.bodyOffset).asChars());
+  kj::HttpHeaders responseHeaders(headerTable);
+  auto parseResult = responseHeaders.tryParseResponse(headText);
+  auto& parsed = KJ_UNWRAP_OR(parseResult.tryGet<kj::HttpHeaders::Response>(), {
+    KJ_LOG(ERROR, "unparseable response head in HTTP cache entry", key);
+    removeIfPresent(*state.lockExclusive(), key, hit.entry);
+    co_return co_await sendMiss();
+  });
+  auto body = content.slice(hit.bodyOffset, content.size());
+
+  responseHeaders.set(ids.age, kj::str(hit.age / kj::SECONDS));
+  responseHeaders.set(ids.cfCacheStatus, "HIT");
+
+  // Conditional requests (RFC 9110 section 13.2.2). If-None-Match takes precedence.
+  bool notModified = false;
+  KJ_IF_SOME(ifNoneMatch, headers.get(ids.ifNoneMatch)) {
+    KJ_IF_SOME(etag, responseHeaders.get(ids.etag)) {
+      notModified = etagMatches(ifNoneMatch, etag);
+    }
+  } else KJ_IF_SOME(ifModifiedSince, headers.get(ids.ifModifiedSince)) {
+    KJ_IF_SOME(lastModified, responseHeaders.get(ids.lastModified)) {
+      KJ_IF_SOME(since, parseHttpDate(ifModifiedSince)) {
+        KJ_IF_SOME(modified, parseHttpDate(lastModified)) {
+          notModified = modified <= since;
+        }
+      }
+    }
+  }
+  if (notModified) {
+    response.send(304, "Not Modified", responseHeaders, uint64_t(0));
+    co_return;
+  }
+
+  // Serve a single satisfiable range as partial content. Multiple ranges get the full body.
+  KJ_IF_SOME(rangeHeader, headers.get(kj::HttpHeaderId::RANGE)) {
+    KJ_SWITCH_ONEOF(kj::tryParseHttpRangeHeader(rangeHeader.asArray(), body.size())) {
+      KJ_CASE_ONEOF(ranges, kj::Array<kj::HttpByteRange>) {
+        KJ_ASSERT(ranges.size() > 0);
+        if (ranges.size() == 1) {
+          auto& r = ranges[0];
+          auto slice = body.slice(r.start, r.end + 1);
+          responseHeaders.set(kj::HttpHeaderId::CONTENT_RANGE,
+              kj::str("bytes ", r.start, "-", r.end, "/", body.size()));
+          auto out = response.send(206, "Partial Content", responseHeaders, slice.size());
+          co_return co_await out->write(slice.begin(), slice.size());
+        }
+      }
+      KJ_CASE_ONEOF(_, kj::HttpEverythingRange) {}
+      KJ_CASE_ONEOF(_, kj::HttpUnsatisfiableRange) {
+        kj::HttpHeaders errorHeaders(headerTable);
+        errorHeaders.set(ids.cfCacheStatus, "HIT");
+        errorHeaders.set(kj::HttpHeaderId::CONTENT_RANGE, kj::str("bytes */", body.size()));
+        co_return co_await response.sendError(416, "Range Not Satisfiable", errorHeaders);
+      }
+    }
+  }
+
+  auto out = response.send(parsed.statusCode, parsed.statusText, responseHeaders, body.size());
+  co_await out->write(body.begin(), body.size());
+}
+
+kj::Maybe<HttpCache::Hit> HttpCache::lookup(
+    State& s, kj::StringPtr key, const kj::HttpHeaders& headers) const {
+  auto& variants = KJ_UNWRAP_OR_RETURN(s.entries.find(key), kj::none);
+
+  // Select the stored response whose `Vary` headers match this request (RFC 9111 section 4.1).
+  kj::Maybe<Entry&> selected;
+  for (auto& candidate: variants) {
+    bool matches = true;
+    for (auto& vary: candidate->vary) {
+      auto colon = KJ_ASSERT_NONNULL(vary.findFirst(':'));
+      if (getHeaderByName(headers, kj::str(vary.first(colon))) != vary.slice(colon + 1)) {
+        matches = false;
+        break;
+      }
+    }
+    if (matches) {
+      selected = *candidate;
+      break;
+    }
+  }
+  auto& entry = KJ_UNWRAP_OR_RETURN(selected, kj::none);
+
+  // We cannot revalidate, so a stale response is as good as gone.
+  auto age = entry.initialAge + (clock.now() - entry.responseTime);
+  if (age >= entry.lifetime) {
+    remove(s, entry);
+    return kj::none;
+  }
+
+  auto content = KJ_UNWRAP_OR(readContent(entry), {
+    remove(s, entry);
+    return kj::none;
+  });
+
+  s.lru.remove(entry);
+  s.lru.add(entry);
+
+  return Hit {
+    .content = kj::mv(content),
+    .headOffset = entry.headOffset,
+    .bodyOffset = entry.bodyOffset,
+    .age = age,
+    .entry = &entry,
+  };
+}
+
+kj::Promise<void> HttpCache::put(const kj::HttpHeaderTable& headerTable, const HeaderIds& ids,
+                                 kj::StringPtr key, const kj::HttpHeaders& headers,
+                                 kj::AsyncInputStream& requestBody, Response& response) const {
+  auto sendTooLarge = [&]() {
+    return response.sendError(413, "Payload Too Large", headerTable);
+  };
+  auto sendNotStored = [&]() {
+    // The Cache API doesn't promise to store anything, so there is no status for "not stored".
+    kj::HttpHeaders responseHeaders(headerTable);
+    response.send(204, "No Content", responseHeaders);
+  };
+
+  KJ_IF_SOME(length, requestBody.tryGetLength()) {
+    if (length > limits.maxEntrySize) {
+      co_return co_await sendTooLarge();
+    }
+  }
+
+  // Read the whole payload: a serialized HTTP response, head and body, without chunked encoding.
+  kj::Vector<kj::byte> payload;
+  auto buffer = kj::heapArray<kj::byte>(65536);
+  for (;;) {
+    size_t n = co_await requestBody.tryRead(buffer.begin(), 1, buffer.size());
+    if (n == 0) break;
+    if (payload.size() + n > limits.maxEntrySize) {
+      co_return co_await sendTooLarge();
+    }
+    payload.addAll(buffer.first(n));
+  }
+
+  size_t headEnd = KJ_UNWRAP_OR(findBlankLine(payload.asPtr()), {
+    co_return co_await response.sendError(400, "Bad Request", headerTable);
+  });
+  auto headText = kj::heapArray<char>(payload.asPtr().first(headEnd).asChars());
+  kj::HttpHeaders responseHeaders(headerTable);
+  auto parseResult = responseHeaders.tryParseResponse(headText);
+  auto& parsed = KJ_UNWRAP_OR(parseResult.tryGet<kj::HttpHeaders::Response>(), {
+    co_return co_await response.sendError(400, "Bad Request", headerTable);
+  });
+  auto body = payload.asPtr().slice(headEnd, payload.size());
+
+  // Decide whether a shared cache may store the response (RFC 9111 section 3).
+  auto cacheControl = parseCacheControl(responseHeaders.get(ids.cacheControl));
+  if (parsed.statusCode < 200 || parsed.statusCode == 206 || parsed.statusCode == 304 ||
+      cacheControl.noStore || cacheControl.isPrivate || cacheControl.noCache) {
+    co_return sendNotStored();
+  }
+  if (headers.get(ids.authorization) != kj::none &&
+      !(cacheControl.isPublic || cacheControl.mustRevalidate || cacheControl.sMaxAge != kj::none)) {
+    co_return sendNotStored();
+  }
+  // Handing one client's cookies to others would be a disaster, so never store those.
+  if (responseHeaders.get(ids.setCookie) != kj::none) {
+    co_return sendNotStored();
+  }
+
+  // Remember what the request had for each header the response varies by.
+  kj::Vector<kj::String> vary;
+  KJ_IF_SOME(varyHeader, responseHeaders.get(ids.vary)) {
+    for (auto& name: splitList(varyHeader)) {
+      if (name == "*") {
+        co_return sendNotStored();
+      }
+      auto lowerName = toLower(name);
+      auto value = getHeaderByName(headers, lowerName);
+      vary.add(kj::str(lowerName, ':', value));
+    }
+  }
+
+  // Freshness lifetime and age (RFC 9111 sections 4.2.1 and 4.2.3).
+  auto now = clock.now();
+  kj::Date dateValue = now;
+  KJ_IF_SOME(date, responseHeaders.get(ids.date)) {
+    KJ_IF_SOME(parsedDate, parseHttpDate(date)) {
+      dateValue = parsedDate;
+    }
+  }
+
+  kj::Duration lifetime = 0 * kj::SECONDS;
+  KJ_IF_SOME(sMaxAge, cacheControl.sMaxAge) {
+    lifetime = sMaxAge;
+  } else KJ_IF_SOME(maxAge, cacheControl.maxAge) {
+    lifetime = maxAge;
+  } else KJ_IF_SOME(expires, responseHeaders.get(ids.expires)) {
+    // An invalid Expires means "already expired".
+    KJ_IF_SOME(expiresDate, parseHttpDate(expires)) {
+      if (expiresDate > dateValue) lifetime = expiresDate - dateValue;
+    }
+  } else if (isHeuristicallyCacheable(parsed.statusCode)) {
+    // Use 10% of the time since the last modification, as suggested by RFC 9111 section 4.2.2.
+    KJ_IF_SOME(lastModified, responseHeaders.get(ids.lastModified)) {
+      KJ_IF_SOME(modified, parseHttpDate(lastModified)) {
+        if (modified < dateValue) lifetime = (dateValue - modified) / 10;
+      }
+    }
+  }
+
+  auto apparentAge = now > dateValue ? now - dateValue : 0 * kj::SECONDS;
+  auto initialAge = apparentAge;
+  KJ_IF_SOME(age, responseHeaders.get(ids.age)) {
+    KJ_IF_SOME(ageValue, parseDeltaSeconds(age)) {
+      initialAge = kj::max(initialAge, ageValue);
+    }
+  }
+
+  // A response that is already stale would never be served, since we cannot revalidate it.
+  if (lifetime <= initialAge) {
+    co_return sendNotStored();
+  }
+
+  // Re-serialize the head, which drops connection headers. The body is stored without any transfer
+  // coding, so it gets a Content-Length instead.
+  auto contentLength = kj::str(body.size());
+  kj::StringPtr connectionHeaders[kj::HttpHeaders::CONNECTION_HEADERS_COUNT];
+  connectionHeaders[kj::HttpHeaders::BuiltinIndices::CONTENT_LENGTH] = contentLength;
+  auto head = responseHeaders.serializeResponse(
+      parsed.statusCode, parsed.statusText, connectionHeaders);
+
+  // The stored content is our metadata (lines of text, ending with a blank line), followed by
+  // the response head and the body. load() parses the metadata back.
+  kj::Vector<kj::String> metaLines;
+  metaLines.add(kj::str(CONTENT_SIGNATURE));
+  metaLines.add(kj::str("key: ", key));
+  for (auto& v: vary) {
+    metaLines.add(kj::str("vary: ", v));
+  }
+  metaLines.add(kj::str("time: ", (now - kj::UNIX_EPOCH) / kj::MILLISECONDS, ' ',
+      initialAge / kj::SECONDS, ' ', lifetime / kj::SECONDS));
+  auto meta = kj::str(kj::strArray(metaLines, "\r\n"), "\r\n\r\n");
+
+  uint64_t size = meta.size() + head.size() + body.size();
+  if (size > limits.maxEntrySize) {
+    co_return co_await sendTooLarge();
+  }
+  auto content = kj::heapArray<kj::byte>(size);
+  auto pos = content.begin();
+  for (kj::ArrayPtr<const kj::byte> part: {meta.asBytes(), head.asBytes(), body.asConst()}) {
+    memcpy(pos, part.begin(), part.size());
+    pos += part.size();
+  }
+
+  auto entry = kj::heap<Entry>();
+  entry->key = kj::str(key);
+  entry->vary = vary.releaseAsArray();
+  entry->responseTime = now;
+  entry->initialAge = initialAge;
+  entry->lifetime = lifetime;
+  entry->size = size;
+  entry->headOffset = meta.size();
+  entry->bodyOffset = meta.size() + head.size();
+
+  KJ_IF_SOME(d, dir) {
+    auto name = kj::str(kj::hex((now - kj::UNIX_EPOCH) / kj::NANOSECONDS), '-',
+                        kj::hex(state.lockExclusive()->nextId++));
+    KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() {
+      auto replacer = d->replaceFile(kj::Path(name), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+      replacer->get().write(0, content);
+      replacer->commit();
+    })) {
+      KJ_LOG(ERROR, "failed to write HTTP cache entry", key, exception);
+      co_return sendNotStored();
+    }
+    entry->storage = kj::mv(name);
+  } else {
+    entry->storage = kj::atomicRefcounted<Content>(kj::mv(content));
+  }
+
+  {
+    auto lock = state.lockExclusive();
+
+    // Storing replaces whatever response this request would have been served before.
+    KJ_IF_SOME(existing, lock->entries.find(key)) {
+      kj::Vector<Entry*> replaced;
+      for (auto& candidate: existing) {
+        if (candidate->vary.size() == entry->vary.size() &&
+            std::equal(entry->vary.begin(), entry->vary.end(), candidate->vary.begin())) {
+          replaced.add(candidate.get());
+        }
+      }
+      for (auto e: replaced) {
+        remove(*lock, *e);
+      }
+    }
+
+    add(*lock, kj::mv(entry));
+    evictAsNeeded(*lock);
+  }
+
+  kj::HttpHeaders responseHeadersOut(headerTable);
+  response.send(204, "No Content", responseHeadersOut);
+}
+
+kj::Promise<void> HttpCache::purge(const kj::HttpHeaderTable& headerTable, kj::StringPtr key,
+                                   Response& response) const {
+  bool found = false;
+  {
+    auto lock = state.lockExclusive();
+    // remove() erases the map entry along with the last variant.
+    for (;;) {
+      auto& variants = KJ_UNWRAP_OR(lock->entries.find(key), break);
+      remove(*lock, *variants.back());
+      found = true;
+    }
+  }
+  if (!found) {
+    return response.sendError(404, "Not Found", headerTable);
+  }
+
+  kj::HttpHeaders responseHeaders(headerTable);
+  response.send(200, "OK", responseHeaders, uint64_t(0));
+  return kj::READY_NOW;
+}
+
+kj::Maybe<kj::Array<const kj::byte>> HttpCache::readContent(Entry& entry) const {
+  KJ_SWITCH_ONEOF(entry.storage) {
+    KJ_CASE_ONEOF(content, kj::Own<const Content>) {
+      return content->bytes.asPtr().attach(kj::atomicAddRef(*content));
+    }
+    KJ_CASE_ONEOF(name, kj::String) {
+      auto& d = KJ_ASSERT_NONNULL(dir);
+      auto file = KJ_UNWRAP_OR_RETURN(d->tryOpenFile(kj::Path(name), kj::WriteMode::MODIFY),
+                                      kj::none);
+      if (file->stat().size != entry.size) {
+        return kj::none;
+      }
+      return file->mmap(0, entry.size);
+    }
+  }
+  KJ_UNREACHABLE;
+}
+
+void HttpCache::add(State& s, kj::Own<Entry> entry) const {
+  s.totalSize += entry->size;
+  s.lru.add(*entry);
+  auto& variants = s.entries.findOrCreate(entry->key, [&]() {
+    return decltype(s.entries)::Entry { kj::str(entry->key), {} };
+  });
+  variants.add(kj::mv(entry));
+}
+
+void HttpCache::remove(State& s, Entry& entry) const {
+  s.totalSize -= entry.size;
+  s.lru.remove(entry);
+  KJ_IF_SOME(name, entry.storage.tryGet<kj::String>()) {
+    KJ_ASSERT_NONNULL(dir)->tryRemove(kj::Path(name));
+  }
+
+  auto& mapEntry = KJ_ASSERT_NONNULL(s.entries.findEntry(entry.key));
+  auto& variants = mapEntry.value;
+  for (auto i: kj::indices(variants)) {
+    if (variants[i].get() == &entry) {
+      // This destroys `entry`.
+      if (i + 1 < variants.size()) {
+        variants[i] = kj::mv(variants.back());
+      }
+      variants.removeLast();
+      break;
+    }
+  }
+  if (variants.empty()) {
+    s.entries.erase(mapEntry);
+  }
+}
+
+void HttpCache::evictAsNeeded(State& s) const {
+  while (s.totalSize > limits.maxTotalSize && !s.lru.empty()) {
+    remove(s, s.lru.front());
+  }
+}
+
+void HttpCache::removeIfPresent(State& s, kj::StringPtr key, const Entry* entry) const {
+  auto& variants = KJ_UNWRAP_OR(s.entries.find(key), return);
+  for (auto& candidate: variants) {
+    if (candidate.get() == entry) {
+      remove(s, *candidate);
+      return;
+    }
+  }
+}
+
+void HttpCache::load(State& s, const kj::Directory& d) const {
+  struct Loaded {
+    kj::Date lastModified;
+    kj::Own<Entry> entry;
+  };
+  kj::Vector<Loaded> loaded;
+
+  for (auto& name: d.listNames()) {
+    auto path = kj::Path(name);
+    auto file = KJ_UNWRAP_OR(d.tryOpenFile(path, kj::WriteMode::MODIFY), continue);
+    auto metadata = file->stat();
+    if (metadata.type != kj::FsNode::Type::FILE) continue;
+
+    auto content = file->mmap(0, metadata.size);
+    KJ_IF_SOME(entry, parseContent(content)) {
+      entry->storage = kj::str(name);
+      loaded.add(Loaded { metadata.lastModified, kj::mv(entry) });
+    } else {
+      KJ_LOG(WARNING, "removing unreadable HTTP cache entry", name);
+      d.tryRemove(path);
+    }
+  }
+
+  // Files are rewritten whenever their entry is, so the modification time approximates the LRU
+  // order well enough.
+  std::sort(loaded.begin(), loaded.end(), [](const Loaded& a, const Loaded& b) {
+    return a.lastModified < b.lastModified;
+  });
+  for (auto& l: loaded) {
+    add(s, kj::mv(l.entry));
+  }
+  evictAsNeeded(s);
+}
+
+kj::Maybe<kj::Own<HttpCache::Entry>> HttpCache::parseContent(kj::ArrayPtr<const kj::byte> content) {
+  size_t metaEnd = KJ_UNWRAP_OR_RETURN(findBlankLine(content), kj::none);
+  size_t headEnd = metaEnd + KJ_UNWRAP_OR_RETURN(
+      findBlankLine(content.slice(metaEnd, content.size())), kj::none);
+
+  auto entry = kj::heap<Entry>();
+  entry->size = content.size();
+  entry->headOffset = metaEnd;
+  entry->bodyOffset = headEnd;
+
+  // The metadata is a sequence of lines, each ending with "\r\n".
+  kj::ArrayPtr<const char> meta = content.first(metaEnd - 2).asChars();
+  kj::Vector<kj::String> vary;
+  bool hasSignature = false;
+  bool hasKey = false;
+  bool hasTime = false;
+  while (meta.size() > 0) {
+    size_t end = 0;
+    while (end + 1 < meta.size() && !(meta[end] == '\r' && meta[end + 1] == '\n')) ++end;
+    auto line = kj::heapString(meta.first(end));
+    meta = meta.slice(kj::min(end + 2, meta.size()), meta.size());
+
+    if (!hasSignature) {
+      if (line != CONTENT_SIGNATURE) return kj::none;
+      hasSignature = true;
+    } else if (line.startsWith("key: ")) {
+      entry->key = kj::str(line.slice(5));
+      hasKey = true;
+    } else if (line.startsWith("vary: ")) {
+      vary.add(kj::str(line.slice(6)));
+    } else if (line.startsWith("time: ")) {
+      // Response time in milliseconds since the epoch, initial age and lifetime in seconds.
+      auto parts = splitTimes(line.slice(6));
+      if (parts.size() != 3) return kj::none;
+      entry->responseTime = kj::UNIX_EPOCH + parts[0] * kj::MILLISECONDS;
+      entry->initialAge = parts[1] * kj::SECONDS;
+      entry->lifetime = parts[2] * kj::SECONDS;
+      hasTime = true;
+    }
+  }
+  if (!hasKey || !hasTime) return kj::none;
+
+  entry->vary = vary.releaseAsArray();
+  return kj::mv(entry);
+}
+
+}  // namespace workerd::server
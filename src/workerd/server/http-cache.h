@@ -0,0 +1,190 @@
+// Copyright (c) 2017-2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/compat/http.h>
+#include <kj/filesystem.h>
+#include <kj/list.h>
+#include <kj/map.h>
+#include <kj/mutex.h>
+#include <kj/one-of.h>
+#include <kj/refcount.h>
+#include <kj/time.h>
+
+namespace workerd::server {
+
+// A shared HTTP cache that gives the Cache API (`caches.default`, `caches.open()`) real storage
+// when configured as a Worker's `cacheApiOutbound` (see `CacheService` in workerd.capnp). It
+// speaks the same protocol that api::Cache speaks to the cache in production:
+//
+// - GET looks up a stored response for the URL, as if sent with `Cache-Control: only-if-cached`.
+//   A hit is returned with `CF-Cache-Status: HIT` (honoring `Range` and conditional request
+//   headers). A miss is a 504 with `CF-Cache-Status: MISS`.
+// - PUT stores the HTTP response contained in the request body. The request's own headers are
+//   those of the original request, which `Vary` is evaluated against. Replies 204, or 413 if the
+//   response is larger than `Limits::maxEntrySize`.
+// - PURGE removes all stored responses for the URL, replying 200, or 404 if there were none.
+//
+// The `CF-Cache-Namespace` header names the cache opened with `caches.open()`; without it, the
+// request goes to the default cache.
+//
+// Whether and for how long a response is stored follows the rules RFC 9111 sets for shared
+// caches. Since the Cache API cannot revalidate, responses that would need revalidation before
+// being served (`no-cache`, or no freshness lifetime at all) are not stored, and stale responses
+// are dropped on lookup.
+//
+// Entries are kept either in memory or as one file each in a directory. On disk, each file holds
+// the entry's metadata, the response head and the body, so entries survive restarts; hits are
+// served straight from a memory mapping of the file.
+//
+// An HttpCache is thread-safe, so that all threads of a server can share one. Since HTTP headers
+// are tied to a thread's header table, each request names the table it uses.
+class HttpCache final {
+public:
+  struct Limits {
+    // The maximum sum of the sizes of all stored entries (response heads and bodies). Least
+    // recently used entries are evicted to stay within it.
+    uint64_t maxTotalSize;
+
+    // The maximum size of a single stored entry.
+    uint64_t maxEntrySize;
+  };
+
+  // IDs of the headers the cache needs, which must be registered before the header table is
+  // built. Each thread needs its own, from the table it passes to request().
+  struct HeaderIds {
+    explicit HeaderIds(kj::HttpHeaderTable::Builder& builder);
+
+    kj::HttpHeaderId cfCacheStatus;
+    kj::HttpHeaderId cfCacheNamespace;
+    kj::HttpHeaderId cacheControl;
+    kj::HttpHeaderId vary;
+    kj::HttpHeaderId age;
+    kj::HttpHeaderId date;
+    kj::HttpHeaderId expires;
+    kj::HttpHeaderId lastModified;
+    kj::HttpHeaderId etag;
+    kj::HttpHeaderId ifNoneMatch;
+    kj::HttpHeaderId ifModifiedSince;
+    kj::HttpHeaderId setCookie;
+    kj::HttpHeaderId authorization;
+  };
+
+  // If `dir` is null, entries are kept in memory. Otherwise, they are stored in `dir`, and any
+  // entries already in it are loaded (and evicted as needed to fit `limits`).
+  HttpCache(kj::Maybe<kj::Own<const kj::Directory>> dir, const kj::Clock& clock, Limits limits);
+  ~HttpCache() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(HttpCache);
+
+  // Handles a request like kj::HttpService::request(). `headers` and the response use
+  // `headerTable`, which `headerIds` must have been registered with.
+  kj::Promise<void> request(
+      const kj::HttpHeaderTable& headerTable, const HeaderIds& headerIds,
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) const;
+
+  // The sum of the sizes of all stored entries.
+  uint64_t getTotalSize() const { return state.lockShared()->totalSize; }
+
+private:
+  using Response = kj::HttpService::Response;
+
+  // The stored form of an entry: metadata, response head and body (see put()). Refcounted so
+  // that a response being served, possibly on another thread, can outlive the entry's eviction.
+  struct Content: public kj::AtomicRefcounted {
+    kj::Array<const kj::byte> bytes;
+
+    explicit Content(kj::Array<const kj::byte> bytes): bytes(kj::mv(bytes)) {}
+  };
+
+  struct Entry {
+    // Namespace and URL, separated by a space.
+    kj::String key;
+
+    // For each header named by the response's `Vary`, the header name in lower case, a colon, and
+    // the value the request that produced the response had for it.
+    kj::Array<kj::String> vary;
+
+    // The time the response was stored, and its age and freshness lifetime at that point
+    // (RFC 9111 section 4.2).
+    kj::Date responseTime = kj::UNIX_EPOCH;
+    kj::Duration initialAge = 0 * kj::SECONDS;
+    kj::Duration lifetime = 0 * kj::SECONDS;
+
+    // Size of the stored content.
+    uint64_t size = 0;
+
+    // Offsets of the response head and the body within the stored content.
+    uint64_t headOffset = 0;
+    uint64_t bodyOffset = 0;
+
+    // Name of the entry's file, if stored on disk; otherwise the content itself.
+    kj::OneOf<kj::String, kj::Own<const Content>> storage;
+
+    kj::ListLink<Entry> link;
+  };
+
+  // A fresh entry found by lookup(), with its content.
+  struct Hit {
+    kj::Array<const kj::byte> content;
+    uint64_t headOffset;
+    uint64_t bodyOffset;
+    kj::Duration age;
+
+    // Only for identifying the entry later; it may be evicted as soon as the lock is released.
+    const Entry* entry;
+  };
+
+  struct State {
+    // Stored responses by cache key (namespace and URL). There is more than one if the responses
+    // vary by request headers.
+    kj::HashMap<kj::String, kj::Vector<kj::Own<Entry>>> entries;
+
+    // All entries, least recently used first.
+    kj::List<Entry, &Entry::link> lru;
+
+    uint64_t totalSize = 0;
+
+    // Used to make up unique file names.
+    uint64_t nextId = 0;
+  };
+
+  kj::Maybe<kj::Own<const kj::Directory>> dir;
+  const kj::Clock& clock;
+  Limits limits;
+  kj::MutexGuarded<State> state;
+
+  kj::Promise<void> match(const kj::HttpHeaderTable& headerTable, const HeaderIds& ids,
+                          kj::StringPtr key, const kj::HttpHeaders& headers,
+                          Response& response) const;
+  kj::Promise<void> put(const kj::HttpHeaderTable& headerTable, const HeaderIds& ids,
+                        kj::StringPtr key, const kj::HttpHeaders& headers,
+                        kj::AsyncInputStream& requestBody, Response& response) const;
+  kj::Promise<void> purge(const kj::HttpHeaderTable& headerTable, kj::StringPtr key,
+                          Response& response) const;
+
+  // Finds the stored response to serve for the request, if any, and marks it as recently used.
+  // Removes stale or unreadable entries along the way.
+  kj::Maybe<Hit> lookup(State& s, kj::StringPtr key, const kj::HttpHeaders& headers) const;
+
+  // Returns the stored content of the entry. Returns null if the entry's file has disappeared.
+  kj::Maybe<kj::Array<const kj::byte>> readContent(Entry& entry) const;
+
+  void add(State& s, kj::Own<Entry> entry) const;
+  void remove(State& s, Entry& entry) const;
+  void evictAsNeeded(State& s) const;
+
+  // Removes `entry` if it is still stored under `key`.
+  void removeIfPresent(State& s, kj::StringPtr key, const Entry* entry) const;
+
+  // Reads the entries already stored in `dir`.
+  void load(State& s, const kj::Directory& dir) const;
+
+  // Parses the metadata at the start of stored content. The returned entry has no storage set.
+  // Returns null if the content is not in the expected format.
+  static kj::Maybe<kj::Own<Entry>> parseContent(kj::ArrayPtr<const kj::byte> content);
+};
+
+}  // namespace workerd::server
@@ -7,6 +7,11 @@
 #include <workerd/util/capnp-mock.h>
 #include <workerd/jsg/setup.h>
 #include <kj/async-queue.h>
+#include <kj/compat/brotli.h>
+#include <kj/compat/gzip.h>
+#include <kj/compat/http.h>
+#include <kj/compat/url.h>
+#include <atomic>
 #include <regex>
 #include <stdlib.h>
 
@@ -89,6 +94,10 @@ public:
   void send(kj::StringPtr data, kj::SourceLocation loc = {}) {
     stream->write(data.begin(), data.size()).wait(ws);
   }
+
+  // For talking to the server with kj's HTTP client instead, e.g. when the response is binary
+  // and can't go through recv().
+  kj::AsyncIoStream& getStream() { return *stream; }
   void recv(kj::StringPtr expected, kj::SourceLocation loc = {}) {
     auto actual = readAllAvailable();
     if (actual == nullptr) {
@@ -761,6 +770,264 @@ KJ_TEST("Server: compatibility dates are required") {
   )"_blockquote);
 }
 
+#if !_WIN32
+KJ_TEST("Server: workerThreads requires a low-level I/O provider") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request) { return new Response("ok"); }
+                `}
+            )
+          ]
+        )
+      )
+    ],
+    sockets = [ ( name = "main", address = "test-addr", service = "hello" ) ],
+    workerThreads = 2
+  ))"_kj);
+
+  test.expectErrors(R"(
+    `workerThreads` is not supported in this environment. Serving on a single thread.
+  )"_blockquote);
+}
+
+// Needs real threads and real sockets, so it can't use TestServer's in-memory network.
+// Distinct on every call from every thread, so that each isolate picks a distinct ID in the
+// workerThreads tests.
+class CountingEntropySource final: public kj::EntropySource {
+public:
+  void generate(kj::ArrayPtr<kj::byte> buffer) override {
+    uint64_t n = counter.fetch_add(1, std::memory_order_relaxed) + 1;
+    memset(buffer.begin(), 0, buffer.size());
+    memcpy(buffer.begin(), &n, kj::min(sizeof(n), buffer.size()));
+  }
+
+private:
+  std::atomic<uint64_t> counter = 0;
+};
+
+KJ_TEST("Server: workerThreads serves on every thread and routes Durable Objects") {
+  auto config = parseConfig(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `let thread;
+                `export default {
+                `  async fetch(request, env) {
+                `    thread ??= crypto.randomUUID();
+                `    if (new URL(request.url).pathname == "/do") {
+                `      let actor = env.ns.get(env.ns.idFromName("foo"));
+                `      let response = await actor.fetch("http://foo/", {cf: {hello: "world"}});
+                `      return new Response(thread + " " + await response.text());
+                `    }
+                `    return new Response(thread);
+                `  }
+                `}
+                `export class MyActorClass {
+                `  async fetch(request) {
+                `    thread ??= crypto.randomUUID();
+                `    return new Response(thread + " " + JSON.stringify(request.cf));
+                `  }
+                `}
+            )
+          ],
+          bindings = [(name = "ns", durableObjectNamespace = "MyActorClass")],
+          durableObjectNamespaces = [
+            ( className = "MyActorClass",
+              uniqueKey = "mykey",
+            )
+          ],
+          durableObjectStorage = (inMemory = void)
+        )
+      )
+    ],
+    sockets = [ ( name = "main", address = "test-addr", service = "hello" ) ],
+    workerThreads = 2
+  ))"_kj, {});
+
+  auto io = kj::setupAsyncIo();
+  auto& network = io.provider->getNetwork();
+  auto fs = kj::newDiskFilesystem();
+  CountingEntropySource entropySource;
+
+  Server server(*fs, io.provider->getTimer(), network, entropySource,
+                Worker::ConsoleMode::INSPECTOR_ONLY, [](kj::String error) {
+    KJ_FAIL_EXPECT(error);
+  });
+  server.enableWorkerThreads(*io.lowLevelProvider);
+
+  auto listener = network.parseAddress("127.0.0.1", 0).wait(io.waitScope)->listen();
+  uint port = listener->getPort();
+  server.overrideSocket(kj::str("main"), kj::mv(listener));
+
+  auto [drainPromise, drainFulfiller] = kj::newPromiseAndFulfiller<void>();
+  auto runTask = server.run(v8System, *config, kj::mv(drainPromise))
+      .eagerlyEvaluate([](kj::Exception&& e) { KJ_FAIL_EXPECT(e); });
+
+  kj::HttpHeaderTable headerTable;
+  auto addr = network.parseAddress("127.0.0.1", port).wait(io.waitScope);
+
+  // Uses a new connection each time, since connections are what get spread over the threads.
+  auto get = [&](kj::StringPtr path) {
+    auto stream = addr->connect().wait(io.waitScope);
+    auto client = kj::newHttpClient(headerTable, *stream);
+    kj::HttpHeaders headers(headerTable);
+    headers.set(kj::HttpHeaderId::HOST, "foo");
+    auto response = client->request(kj::HttpMethod::GET, path, headers)
+        .response.wait(io.waitScope);
+    KJ_EXPECT(response.statusCode == 200);
+    return response.body->readAllText().wait(io.waitScope);
+  };
+
+  // Connections alternate between the two threads, each with its own isolate.
+  kj::HashSet<kj::String> threads;
+  for (auto i KJ_UNUSED: kj::zeroTo(4)) {
+    auto thread = get("/");
+    if (!threads.contains(thread)) {
+      threads.insert(kj::mv(thread));
+    }
+  }
+  KJ_EXPECT(threads.size() == 2);
+
+  // Whichever thread takes the request, the Durable Object runs on the one thread that owns it,
+  // and still sees the `cf` blob.
+  kj::Maybe<kj::String> owner;
+  bool sawForwarded = false;
+  for (auto i KJ_UNUSED: kj::zeroTo(4)) {
+    auto text = get("/do");
+    auto space1 = KJ_ASSERT_NONNULL(text.findFirst(' '));
+    auto thread = kj::str(text.slice(0, space1));
+    auto rest = text.slice(space1 + 1);
+    auto space2 = KJ_ASSERT_NONNULL(rest.findFirst(' '));
+    auto actorThread = kj::str(rest.slice(0, space2));
+
+    KJ_EXPECT(threads.contains(thread), text);
+    KJ_EXPECT(threads.contains(actorThread), text);
+    KJ_EXPECT(rest.slice(space2 + 1) == "{\"hello\":\"world\"}"_kj, text);
+    KJ_IF_SOME(o, owner) {
+      KJ_EXPECT(o == actorThread, text);
+    } else {
+      owner = kj::str(actorThread);
+    }
+    if (thread != actorThread) sawForwarded = true;
+  }
+  KJ_EXPECT(sawForwarded);
+
+  drainFulfiller->fulfill();
+  runTask.wait(io.waitScope);
+}
+
+KJ_TEST("Server: workerThreads share cache services") {
+  auto config = parseConfig(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          cacheApiOutbound = "cache",
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `let thread;
+                `export default {
+                `  async fetch(request) {
+                `    thread ??= crypto.randomUUID();
+                `    const url = new URL(request.url);
+                `    const key = "http://example.com/" + url.searchParams.get("key");
+                `    let result;
+                `    if (url.pathname == "/put") {
+                `      await caches.default.put(key, new Response(url.searchParams.get("value"), {
+                `        headers: { "Cache-Control": "max-age=3600" }
+                `      }));
+                `      result = "stored";
+                `    } else if (url.pathname == "/delete") {
+                `      result = String(await caches.default.delete(key));
+                `    } else {
+                `      const response = await caches.default.match(key);
+                `      result = response ? await response.text() : "miss";
+                `    }
+                `    return new Response(thread + " " + result);
+                `  }
+                `}
+            )
+          ]
+        )
+      ),
+      ( name = "cache", cache = () ),
+    ],
+    sockets = [ ( name = "main", address = "test-addr", service = "hello" ) ],
+    workerThreads = 2
+  ))"_kj, {});
+
+  auto io = kj::setupAsyncIo();
+  auto& network = io.provider->getNetwork();
+  auto fs = kj::newDiskFilesystem();
+  CountingEntropySource entropySource;
+
+  Server server(*fs, io.provider->getTimer(), network, entropySource,
+                Worker::ConsoleMode::INSPECTOR_ONLY, [](kj::String error) {
+    KJ_FAIL_EXPECT(error);
+  });
+  server.enableWorkerThreads(*io.lowLevelProvider);
+
+  auto listener = network.parseAddress("127.0.0.1", 0).wait(io.waitScope)->listen();
+  uint port = listener->getPort();
+  server.overrideSocket(kj::str("main"), kj::mv(listener));
+
+  auto [drainPromise, drainFulfiller] = kj::newPromiseAndFulfiller<void>();
+  auto runTask = server.run(v8System, *config, kj::mv(drainPromise))
+      .eagerlyEvaluate([](kj::Exception&& e) { KJ_FAIL_EXPECT(e); });
+
+  kj::HttpHeaderTable headerTable;
+  auto addr = network.parseAddress("127.0.0.1", port).wait(io.waitScope);
+
+  // Connections alternate between the two threads, so consecutive calls run on different
+  // threads.
+  struct Result {
+    kj::String thread;
+    kj::String text;
+  };
+  auto get = [&](kj::StringPtr path) {
+    auto stream = addr->connect().wait(io.waitScope);
+    auto client = kj::newHttpClient(headerTable, *stream);
+    kj::HttpHeaders headers(headerTable);
+    headers.set(kj::HttpHeaderId::HOST, "foo");
+    auto response = client->request(kj::HttpMethod::GET, path, headers)
+        .response.wait(io.waitScope);
+    KJ_EXPECT(response.statusCode == 200);
+    auto text = response.body->readAllText().wait(io.waitScope);
+    auto space = KJ_ASSERT_NONNULL(text.findFirst(' '));
+    return Result { kj::str(text.first(space)), kj::str(text.slice(space + 1)) };
+  };
+
+  auto expectOnOtherThread = [&](kj::StringPtr writePath, kj::StringPtr writeResult,
+                                 kj::StringPtr readPath, kj::StringPtr readResult) {
+    auto write = get(writePath);
+    auto read = get(readPath);
+    KJ_EXPECT(write.thread != read.thread);
+    KJ_EXPECT(write.text == writeResult, write.text);
+    KJ_EXPECT(read.text == readResult, read.text);
+  };
+
+  // What one thread stores, replaces or deletes, the other sees.
+  expectOnOtherThread("/put?key=foo&value=hello", "stored", "/get?key=foo", "hello");
+  expectOnOtherThread("/put?key=foo&value=goodbye", "stored", "/get?key=foo", "goodbye");
+  expectOnOtherThread("/delete?key=foo", "true", "/get?key=foo", "miss");
+
+  drainFulfiller->fulfill();
+  runTask.wait(io.waitScope);
+}
+#endif
+
 KJ_TEST("Server: value bindings") {
 #if _WIN32
   _putenv("TEST_ENVIRONMENT_VAR=Hello from environment variable");
@@ -1625,12 +1892,13 @@ KJ_TEST("Server: Durable Objects (on disk)") {
     conn.httpGet200("/bar",
         "02b496f65dd35cbac90e3e72dc5a398ee93926ea4a3821e26677082d2e6f9b79: http://foo/bar 2");
 
-    // The storage directory contains .sqlite and .sqlite-wal files for both objects. Note that
-    // the `-shm` files are missing because SQLite doesn't actually tell the VFS to create these
-    // as separate files, it leaves it up to the VFS to decide how shared memory works, and our
-    // KJ-wrapping VFS currently doesn't put this in SHM files. If we were using a real disk
-    // directory, though, they would be there.
-    KJ_EXPECT(dir->openSubdir(kj::Path({"mykey"}))->listNames().size() == 4);
+    // The storage directory contains .sqlite and .sqlite-wal files for both objects, plus the
+    // `-pitr` directories holding their point-in-time recovery logs. Note that the `-shm` files
+    // are missing because SQLite doesn't actually tell the VFS to create these as separate files,
+    // it leaves it up to the VFS to decide how shared memory works, and our KJ-wrapping VFS
+    // currently doesn't put this in SHM files. If we were using a real disk directory, though,
+    // they would be there.
+    KJ_EXPECT(dir->openSubdir(kj::Path({"mykey"}))->listNames().size() == 6);
     KJ_EXPECT(dir->exists(kj::Path({"mykey",
       "02b496f65dd35cbac90e3e72dc5a398ee93926ea4a3821e26677082d2e6f9b79.sqlite"})));
     KJ_EXPECT(dir->exists(kj::Path({"mykey",
@@ -1639,14 +1907,30 @@ KJ_TEST("Server: Durable Objects (on disk)") {
       "59002eb8cf872e541722977a258a12d6a93bbe8192b502e1c0cb250aa91af234.sqlite"})));
     KJ_EXPECT(dir->exists(kj::Path({"mykey",
       "59002eb8cf872e541722977a258a12d6a93bbe8192b502e1c0cb250aa91af234.sqlite-wal"})));
+    KJ_EXPECT(dir->openSubdir(kj::Path({"mykey",
+      "02b496f65dd35cbac90e3e72dc5a398ee93926ea4a3821e26677082d2e6f9b79.sqlite-pitr"}))
+        ->exists(kj::Path({"0000000000000001.idx"})));
+    KJ_EXPECT(dir->openSubdir(kj::Path({"mykey",
+      "59002eb8cf872e541722977a258a12d6a93bbe8192b502e1c0cb250aa91af234.sqlite-pitr"}))
+        ->exists(kj::Path({"0000000000000001.idx"})));
   }
 
-  // Having torn everything down, the WAL files should be gone.
-  KJ_EXPECT(dir->openSubdir(kj::Path({"mykey"}))->listNames().size() == 2);
+  // Having torn everything down, the WAL files are still there: the recovery log needs every
+  // frame to pass through it, so the WAL isn't checkpointed on close, but is recovered when the
+  // object is next opened.
+  KJ_EXPECT(dir->openSubdir(kj::Path({"mykey"}))->listNames().size() == 6);
   KJ_EXPECT(dir->exists(kj::Path({"mykey",
     "02b496f65dd35cbac90e3e72dc5a398ee93926ea4a3821e26677082d2e6f9b79.sqlite"})));
+  KJ_EXPECT(dir->exists(kj::Path({"mykey",
+    "02b496f65dd35cbac90e3e72dc5a398ee93926ea4a3821e26677082d2e6f9b79.sqlite-wal"})));
+  KJ_EXPECT(dir->exists(kj::Path({"mykey",
+    "02b496f65dd35cbac90e3e72dc5a398ee93926ea4a3821e26677082d2e6f9b79.sqlite-pitr"})));
   KJ_EXPECT(dir->exists(kj::Path({"mykey",
     "59002eb8cf872e541722977a258a12d6a93bbe8192b502e1c0cb250aa91af234.sqlite"})));
+  KJ_EXPECT(dir->exists(kj::Path({"mykey",
+    "59002eb8cf872e541722977a258a12d6a93bbe8192b502e1c0cb250aa91af234.sqlite-wal"})));
+  KJ_EXPECT(dir->exists(kj::Path({"mykey",
+    "59002eb8cf872e541722977a258a12d6a93bbe8192b502e1c0cb250aa91af234.sqlite-pitr"})));
 
   // Let's start a new server and verify it can load the files from disk.
   {
@@ -1668,6 +1952,81 @@ KJ_TEST("Server: Durable Objects (on disk)") {
   }
 }
 
+KJ_TEST("Server: Durable Objects (on disk) without point-in-time recovery") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env) {
+                `    let id = env.ns.idFromName(request.url)
+                `    let actor = env.ns.get(id)
+                `    return await actor.fetch(request)
+                `  }
+                `}
+                `export class MyActorClass {
+                `  constructor(state, env) {
+                `    this.storage = state.storage;
+                `  }
+                `  async fetch(request) {
+                `    this.storage.put("foo", 123);
+                `    try {
+                `      await this.storage.getCurrentBookmark();
+                `      return new Response("unexpected bookmark");
+                `    } catch (err) {
+                `      return new Response(err.message);
+                `    }
+                `  }
+                `}
+            )
+          ],
+          bindings = [(name = "ns", durableObjectNamespace = "MyActorClass")],
+          durableObjectNamespaces = [
+            ( className = "MyActorClass",
+              uniqueKey = "mykey",
+            )
+          ],
+          compatibilityFlags = ["experimental"],
+          durableObjectStorage = (localDisk = "my-disk"),
+          durableObjectPointInTimeRecovery = (enabled = false),
+        )
+      ),
+      ( name = "my-disk",
+        disk = (
+          path = "../../var/do-storage",
+          writable = true,
+        )
+      ),
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello"
+      )
+    ]
+  ))"_kj);
+
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+  test.root->transfer(
+      kj::Path({"var"_kj, "do-storage"_kj}), kj::WriteMode::CREATE | kj::WriteMode::CREATE_PARENT,
+      *dir, nullptr, kj::TransferMode::LINK);
+
+  test.server.allowExperimental();
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/",
+      "This Durable Object's storage back-end does not implement point-in-time recovery.");
+
+  // No recovery log is kept.
+  KJ_EXPECT(dir->openSubdir(kj::Path({"mykey"}))->listNames().size() == 2);
+  KJ_EXPECT(!dir->exists(kj::Path({"mykey",
+    "59002eb8cf872e541722977a258a12d6a93bbe8192b502e1c0cb250aa91af234.sqlite-pitr"})));
+}
+
 KJ_TEST("Server: Ephemeral Objects") {
   TestServer test(R"((
     services = [
@@ -1895,6 +2254,69 @@ KJ_TEST("Server: Durable Objects (ephemeral) prevent eviction") {
   connTwo.httpGet200("/assertNotEvicted", "OK");
 }
 
+KJ_TEST("Server: Durable Object idleTimeoutMs") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2023-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env) {
+                `    let id = env.ns.idFromName("59002eb8cf872e541722977a258a12d6a93bbe8192b502e1c0cb250aa91af234");
+                `    return await env.ns.get(id).fetch(request.url);
+                `  }
+                `}
+                `export class MyActorClass {
+                `  constructor(state, env) {
+                `    this.live = false;
+                `  }
+                `  async fetch(request) {
+                `    if (request.url.endsWith("/setup")) {
+                `      this.live = true;
+                `      return new Response("OK");
+                `    } else {
+                `      return new Response(this.live ? "live" : "evicted");
+                `    }
+                `  }
+                `}
+            )
+          ],
+          bindings = [(name = "ns", durableObjectNamespace = "MyActorClass")],
+          durableObjectNamespaces = [
+            ( className = "MyActorClass",
+              uniqueKey = "mykey",
+              idleTimeoutMs = 30000,
+            )
+          ],
+          durableObjectStorage = (inMemory = void)
+        )
+      ),
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello"
+      )
+    ]
+  ))"_kj);
+
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/setup", "OK");
+
+  // The default 10 second timeout would have evicted the object by now.
+  test.wait(20);
+  auto connTwo = test.connect("test-addr");
+  connTwo.httpGet200("/check", "live");
+
+  test.wait(35);
+  auto connThree = test.connect("test-addr");
+  connThree.httpGet200("/check", "evicted");
+}
+
 KJ_TEST("Server: Durable Object evictions when callback scheduled") {
   kj::StringPtr config = R"((
     services = [
@@ -2266,29 +2688,157 @@ KJ_TEST("Server: Durable Objects websocket hibernation") {
   wsConn.send(kj::str("\x81\x1a", confirmEviction));
   wsConn.recvWebSocket(evicted);
 }
-// =======================================================================================
-// Test HttpOptions on receive
 
-KJ_TEST("Server: serve proxy requests") {
+KJ_TEST("Server: actor memory budget evicts idle Durable Objects") {
   TestServer test(R"((
     services = [
       ( name = "hello",
         worker = (
-          compatibilityDate = "2022-08-17",
-          serviceWorkerScript =
-              `addEventListener("fetch", event => {
-              `  event.respondWith(new Response("Hello: " + event.request.url + "\n"));
-              `})
+          compatibilityDate = "2023-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `// Keeps the heap well over the 1 MB budget, so that every check evicts something.
+                `const ballast = new Array(1 << 20).fill(1);
+                `
+                `export default {
+                `  async fetch(request, env) {
+                `    let path = new URL(request.url).pathname;
+                `    let ns = path == "/pinned" ? env.pinned : env.ns;
+                `    return await ns.get(ns.idFromName(path)).fetch(request);
+                `  }
+                `}
+                `
+                `// Reports how many requests it has handled since it was constructed, so a count of 1
+                `// after the first request means it was evicted in between.
+                `export class MyActorClass {
+                `  constructor(state) {
+                `    this.state = state;
+                `    this.requests = 0;
+                `  }
+                `  async fetch(request) {
+                `    ++this.requests;
+                `    if (request.headers.get("Upgrade") == "websocket") {
+                `      let pair = new WebSocketPair();
+                `      this.state.acceptWebSocket(pair[1]);
+                `      return new Response(null, {status: 101, webSocket: pair[0]});
+                `    }
+                `    return new Response(String(this.requests));
+                `  }
+                `  async webSocketMessage(ws, message) {
+                `    ws.send(String(this.requests));
+                `  }
+                `}
+                `
+                `export class Pinned extends MyActorClass {}
+            )
+          ],
+          bindings = [
+            (name = "ns", durableObjectNamespace = "MyActorClass"),
+            (name = "pinned", durableObjectNamespace = "Pinned"),
+          ],
+          durableObjectNamespaces = [
+            ( className = "MyActorClass",
+              uniqueKey = "mykey",
+              idleTimeoutMs = 3600000,
+            ),
+            ( className = "Pinned",
+              uniqueKey = "pinnedkey",
+              preventEviction = true,
+            ),
+          ],
+          durableObjectStorage = (inMemory = void)
         )
-      )
+      ),
     ],
     sockets = [
       ( name = "main",
         address = "test-addr",
-        service = "hello",
-        http = (style = proxy)
+        service = "hello"
       )
-    ]
+    ],
+    actorMemoryBudgetMb = 1
+  ))"_kj);
+
+  // Advances time without reaching the next budget check, which happens every whole second, so
+  // that the objects below are used in a well-defined order.
+  auto advance = [&]() {
+    test.timer.advanceTo(test.timer.now() + 100 * kj::MILLISECONDS);
+  };
+
+  test.start();
+  {
+    auto conn = test.connect("test-addr");
+    conn.httpGet200("/pinned", "1");
+    advance();
+    conn.httpGet200("/a", "1");
+    advance();
+    conn.httpGet200("/b", "1");
+    advance();
+    conn.httpGet200("/c", "1");
+    advance();
+  }
+
+  // The object handling `/` accepts a hibernatable WebSocket.
+  auto wsConn = test.connect("test-addr");
+  wsConn.upgradeToWebSocket();
+  wsConn.send(kj::str("\x81\x02", "hi"));
+  wsConn.recvWebSocket("1");
+
+  // The first check evicts the least recently used evictable object, `a`. `pinned` was used
+  // earlier, but its namespace prevents eviction.
+  test.wait(1);
+  {
+    auto conn = test.connect("test-addr");
+    conn.httpGet200("/b", "2");
+    advance();
+    conn.httpGet200("/a", "1");
+    advance();
+  }
+
+  // Using `a` and `b` made `c` the least recently used.
+  test.wait(1);
+  {
+    auto conn = test.connect("test-addr");
+    conn.httpGet200("/c", "1");
+    advance();
+  }
+
+  // Next is the WebSocket's object. Its WebSocket is hibernated rather than disconnected, and
+  // wakes up a new instance.
+  test.wait(1);
+  wsConn.send(kj::str("\x81\x02", "hi"));
+  wsConn.recvWebSocket("0");
+
+  {
+    auto conn = test.connect("test-addr");
+    conn.httpGet200("/b", "3");
+    conn.httpGet200("/pinned", "2");
+  }
+}
+// =======================================================================================
+// Test HttpOptions on receive
+
+KJ_TEST("Server: serve proxy requests") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          serviceWorkerScript =
+              `addEventListener("fetch", event => {
+              `  event.respondWith(new Response("Hello: " + event.request.url + "\n"));
+              `})
+        )
+      )
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello",
+        http = (style = proxy)
+      )
+    ]
   ))"_kj);
 
   test.start();
@@ -2481,6 +3031,111 @@ KJ_TEST("Server: inject headers on incoming request/response") {
   )"_blockquote);
 }
 
+KJ_TEST("Server: compress responses") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          serviceWorkerScript =
+              `addEventListener("fetch", event => {
+              `  let size = event.request.url.endsWith("/small") ? 1 : 1000;
+              `  event.respondWith(new Response("hello ".repeat(size)));
+              `})
+        )
+      )
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello",
+        http = (
+          compressResponses = (minimumSize = 100)
+        )
+      )
+    ]
+  ))"_kj);
+
+  test.start();
+
+  kj::Vector<kj::StringPtr> pieces;
+  for (auto i KJ_UNUSED: kj::zeroTo(1000)) pieces.add("hello "_kj);
+  auto payload = kj::strArray(pieces, "");
+
+  kj::HttpHeaderTable::Builder tableBuilder;
+  auto acceptEncoding = tableBuilder.add("Accept-Encoding");
+  auto contentEncoding = tableBuilder.add("Content-Encoding");
+  auto vary = tableBuilder.add("Vary");
+  auto headerTable = tableBuilder.build();
+
+  // Returns the compressed body, checking that it was compressed with `expectedEncoding`.
+  auto getCompressed = [&](kj::StringPtr acceptEncodingValue, kj::StringPtr expectedEncoding) {
+    auto conn = test.connect("test-addr");
+    auto client = kj::newHttpClient(*headerTable, conn.getStream());
+    kj::HttpHeaders headers(*headerTable);
+    headers.set(kj::HttpHeaderId::HOST, "example.com");
+    headers.set(acceptEncoding, acceptEncodingValue);
+    auto response = client->request(kj::HttpMethod::GET, "/", headers).response.wait(test.ws);
+    KJ_EXPECT(response.statusCode == 200);
+    KJ_EXPECT(response.headers->get(contentEncoding) == expectedEncoding);
+    KJ_EXPECT(response.headers->get(vary) == "Accept-Encoding"_kj);
+    auto body = response.body->readAllBytes().wait(test.ws);
+    KJ_EXPECT(body.size() < payload.size());
+    return body;
+  };
+
+  {
+    auto body = getCompressed("gzip;q=0.5, br", "br");
+    kj::ArrayInputStream compressed(body);
+    kj::BrotliInputStream decompressed(compressed);
+    KJ_EXPECT(decompressed.readAllText() == payload);
+  }
+
+  {
+    auto body = getCompressed("gzip, br;q=0", "gzip");
+    kj::ArrayInputStream compressed(body);
+    kj::GzipInputStream decompressed(compressed);
+    KJ_EXPECT(decompressed.readAllText() == payload);
+  }
+
+  // Too small to be worth compressing.
+  auto conn3 = test.connect("test-addr");
+  conn3.send(R"(
+    GET /small HTTP/1.1
+    Host: example.com
+    Accept-Encoding: gzip
+
+  )"_blockquote);
+  conn3.recvHttp200("hello ");
+
+  // Client doesn't accept any encoding we support. The response still says that it depends on
+  // Accept-Encoding, since other clients get it compressed.
+  auto uncompressed = kj::str(
+      "HTTP/1.1 200 OK\n"
+      "Content-Length: 6000\n"
+      "Content-Type: text/plain;charset=UTF-8\n"
+      "Vary: Accept-Encoding\n"
+      "\n",
+      payload);
+
+  auto conn4 = test.connect("test-addr");
+  conn4.send(R"(
+    GET / HTTP/1.1
+    Host: example.com
+    Accept-Encoding: zstd
+
+  )"_blockquote);
+  conn4.recv(uncompressed);
+
+  auto conn5 = test.connect("test-addr");
+  conn5.send(R"(
+    GET / HTTP/1.1
+    Host: example.com
+
+  )"_blockquote);
+  conn5.recv(uncompressed);
+}
+
 KJ_TEST("Server: drain incoming HTTP connections") {
   TestServer test(singleWorker(R"((
     compatibilityDate = "2022-08-17",
@@ -3004,6 +3659,152 @@ KJ_TEST("Server: disk service") {
     Not Found)"_blockquote);
 }
 
+KJ_TEST("Server: V8 code cache") {
+  auto makeConfig = [](kj::StringPtr greeting) {
+    return kj::str(R"((
+      services = [
+        ( name = "hello",
+          worker = (
+            compatibilityDate = "2022-08-17",
+            modules = [
+              ( name = "main.js",
+                esModule =
+                  `export default {
+                  `  async fetch(request) { return new Response(")", greeting, R"("); }
+                  `}
+              )
+            ]
+          )
+        ),
+        (name = "code-cache", disk = (path = "../../code-cache", writable = true))
+      ],
+      sockets = [ ( name = "main", address = "test-addr", service = "hello" ) ],
+      v8CodeCache = "code-cache"
+    ))");
+  };
+  auto config = makeConfig("cached");
+
+  // Lets us tell from an entry's modification time which run wrote it.
+  struct FakeClock final: public kj::Clock {
+    kj::Date date = kj::UNIX_EPOCH;
+    kj::Date now() const override { return date; }
+  };
+  FakeClock clock;
+
+  // Create a directory outside of the test scope which we can use across multiple TestServers.
+  auto dir = kj::newInMemoryDirectory(clock);
+  auto run = [&](kj::StringPtr config, kj::StringPtr expectedResponse) {
+    TestServer test(config);
+    test.root->transfer(kj::Path({"code-cache"_kj}), kj::WriteMode::CREATE, *dir, nullptr,
+                        kj::TransferMode::LINK);
+    test.start();
+    auto conn = test.connect("test-addr");
+    conn.httpGet200("/", expectedResponse);
+  };
+
+  // A miss: compiling main.js should have produced exactly one entry.
+  clock.date = kj::UNIX_EPOCH + 1 * kj::SECONDS;
+  run(config, "cached");
+  auto names = dir->listNames();
+  KJ_ASSERT(names.size() == 1, names);
+  auto name = kj::mv(names[0]);
+  KJ_EXPECT(name.endsWith(".v8cache"), name);
+  auto entryPath = kj::Path({name});
+  auto entry = dir->openFile(entryPath)->readAllBytes();
+  KJ_EXPECT(entry.size() > 0);
+  KJ_EXPECT(dir->openFile(entryPath)->stat().lastModified == clock.date);
+
+  // A hit: the entry is used as is, not written again.
+  clock.date = kj::UNIX_EPOCH + 2 * kj::SECONDS;
+  run(config, "cached");
+  KJ_EXPECT(dir->listNames().size() == 1);
+  KJ_EXPECT(dir->openFile(entryPath)->stat().lastModified == kj::UNIX_EPOCH + 1 * kj::SECONDS);
+  KJ_EXPECT(dir->openFile(entryPath)->readAllBytes().asPtr() == entry.asPtr());
+
+  // A corrupt entry is rejected by V8, which compiles from source instead, and is replaced.
+  dir->openFile(entryPath, kj::WriteMode::MODIFY)->writeAll("garbage"_kj);
+  clock.date = kj::UNIX_EPOCH + 3 * kj::SECONDS;
+  run(config, "cached");
+  KJ_EXPECT(dir->listNames().size() == 1);
+  KJ_EXPECT(dir->openFile(entryPath)->stat().lastModified == clock.date);
+  KJ_EXPECT(dir->openFile(entryPath)->readAllText() != "garbage");
+
+  // Changing the source misses, adding a second entry and leaving the first alone.
+  clock.date = kj::UNIX_EPOCH + 4 * kj::SECONDS;
+  run(makeConfig("changed"), "changed");
+  KJ_EXPECT(dir->listNames().size() == 2);
+  KJ_EXPECT(dir->openFile(entryPath)->stat().lastModified == kj::UNIX_EPOCH + 3 * kj::SECONDS);
+}
+
+KJ_TEST("Server: V8 code cache created after startup") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          serviceWorkerScript =
+              `function greet() { return "warm"; }
+              `const greeting = greet();
+              `addEventListener("fetch", event => {
+              `  event.respondWith(new Response(greeting));
+              `})
+        )
+      ),
+      (name = "code-cache", disk = (path = "../../code-cache", writable = true))
+    ],
+    sockets = [ ( name = "main", address = "test-addr", service = "hello" ) ],
+    v8CodeCache = "code-cache",
+    v8CodeCacheAfterStartup = true
+  ))"_kj);
+
+  auto mode = kj::WriteMode::CREATE | kj::WriteMode::CREATE_PARENT;
+  auto dir = test.root->openSubdir(kj::Path({"code-cache"_kj}), mode);
+
+  test.start();
+
+  // The entry is written once the script's top-level code has run.
+  auto names = dir->listNames();
+  KJ_ASSERT(names.size() == 1, names);
+  KJ_EXPECT(names[0].endsWith(".v8cache"), names[0]);
+
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/", "warm");
+}
+
+KJ_TEST("Server: V8 code cache created after startup, startup fails") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `throw new Error("boom");
+            )
+          ]
+        )
+      ),
+      (name = "code-cache", disk = (path = "../../code-cache", writable = true))
+    ],
+    sockets = [ ( name = "main", address = "test-addr", service = "hello" ) ],
+    v8CodeCache = "code-cache",
+    v8CodeCacheAfterStartup = true
+  ))"_kj);
+
+  auto mode = kj::WriteMode::CREATE | kj::WriteMode::CREATE_PARENT;
+  auto dir = test.root->openSubdir(kj::Path({"code-cache"_kj}), mode);
+
+  test.expectErrors(R"(
+    service hello: Uncaught Error: boom
+      at main.js:1:7
+  )"_blockquote);
+
+  // Top-level code never finished, so nothing was written. The scripts that were waiting on it
+  // must also have been released before the isolate goes away with the TestServer.
+  KJ_EXPECT(dir->listNames().size() == 0);
+}
+
 KJ_TEST("Server: disk service writable") {
   TestServer test(R"((
     services = [
@@ -3275,6 +4076,106 @@ KJ_TEST("Server: disk service allow dotfiles") {
   KJ_EXPECT(test.root->openFile(kj::Path({"secret"}))->readAllText() == "this is super-secret");
 }
 
+#if !_WIN32
+// Needs a real directory and real sockets, so that the file can be sent with sendfile().
+KJ_TEST("Server: disk service on real disk") {
+  class ZeroEntropySource final: public kj::EntropySource {
+  public:
+    void generate(kj::ArrayPtr<kj::byte> buffer) override {
+      memset(buffer.begin(), 0, buffer.size());
+    }
+  };
+
+  auto io = kj::setupAsyncIo();
+  auto& network = io.provider->getNetwork();
+  auto fs = kj::newDiskFilesystem();
+
+  const char* tmpDir = getenv("TEST_TMPDIR");
+  auto pathStr = kj::str(tmpDir != nullptr ? tmpDir : "/var/tmp", "/workerd-server-test.XXXXXX");
+  if (mkdtemp(pathStr.begin()) == nullptr) {
+    KJ_FAIL_SYSCALL("mkdtemp", errno, pathStr);
+  }
+  auto path = fs->getCurrentPath().evalNative(pathStr);
+  KJ_DEFER(fs->getRoot().remove(path));
+
+  // Several times the size of one sendfile() call, and big enough to fill the socket's buffer
+  // while the client isn't reading.
+  auto content = kj::heapArray<kj::byte>(8 * 1024 * 1024 + 123);
+  for (auto i: kj::indices(content)) {
+    content[i] = (i * 7 + i / 251) & 0xff;
+  }
+  fs->getRoot().openFile(path.append("big.bin"), kj::WriteMode::CREATE)->writeAll(content);
+
+  auto config = parseConfig(kj::str(R"((
+    services = [
+      (name = "hello", disk = ")", pathStr, R"(")
+    ],
+    sockets = [
+      (name = "main", address = "test-addr", service = "hello")
+    ]
+  ))"), {});
+
+  ZeroEntropySource entropySource;
+  Server server(*fs, io.provider->getTimer(), network, entropySource,
+                Worker::ConsoleMode::INSPECTOR_ONLY, [](kj::String error) {
+    KJ_FAIL_EXPECT(error);
+  });
+
+  auto listener = network.parseAddress("127.0.0.1", 0).wait(io.waitScope)->listen();
+  uint port = listener->getPort();
+  server.overrideSocket(kj::str("main"), kj::mv(listener));
+
+  auto [drainPromise, drainFulfiller] = kj::newPromiseAndFulfiller<void>();
+  auto runTask = server.run(v8System, *config, kj::mv(drainPromise))
+      .eagerlyEvaluate([](kj::Exception&& e) { KJ_FAIL_EXPECT(e); });
+
+  kj::HttpHeaderTable headerTable;
+  auto stream = network.parseAddress("127.0.0.1", port).wait(io.waitScope)
+      ->connect().wait(io.waitScope);
+  auto client = kj::newHttpClient(headerTable, *stream);
+
+  auto get = [&](kj::Maybe<kj::StringPtr> range, uint expectedStatus) {
+    kj::HttpHeaders headers(headerTable);
+    headers.set(kj::HttpHeaderId::HOST, "foo");
+    KJ_IF_SOME(r, range) {
+      headers.addPtrPtr("Range", r);
+    }
+    auto response = client->request(kj::HttpMethod::GET, "/big.bin", headers)
+        .response.wait(io.waitScope);
+    KJ_EXPECT(response.statusCode == expectedStatus);
+
+    // Don't read for a bit, so that the server fills the socket's buffer and has to wait for it
+    // to drain partway through.
+    io.provider->getTimer().afterDelay(100 * kj::MILLISECONDS).wait(io.waitScope);
+
+    return response.body->readAllBytes().wait(io.waitScope);
+  };
+
+  {
+    auto body = get(kj::none, 200);
+    KJ_EXPECT(body.size() == content.size());
+    KJ_EXPECT(body.asPtr() == content.asPtr());
+  }
+
+  {
+    auto body = get("bytes=1000-5000000"_kj, 206);
+    KJ_EXPECT(body.size() == 5000000 - 1000 + 1);
+    KJ_EXPECT(body.asPtr() == content.slice(1000, 5000001));
+  }
+
+  // A range reaching the end of the file.
+  {
+    auto body = get("bytes=-300"_kj, 206);
+    KJ_EXPECT(body.asPtr() == content.slice(content.size() - 300, content.size()));
+  }
+
+  client = nullptr;
+  stream = nullptr;
+  drainFulfiller->fulfill();
+  runTask.wait(io.waitScope);
+}
+#endif
+
 // =======================================================================================
 // Test Cache API
 
@@ -3424,6 +4325,345 @@ KJ_TEST("Server: cache name is passed through to service") {
     cached)"_blockquote);
 }
 
+KJ_TEST("Server: cache service") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          cacheApiOutbound = "cache",
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env, ctx) {
+                `    const url = new URL(request.url);
+                `    const cache = url.searchParams.has("ns")
+                `        ? await caches.open(url.searchParams.get("ns")) : caches.default;
+                `    const key = "http://example.com/" + url.searchParams.get("key");
+                `    if (url.pathname == "/put") {
+                `      await cache.put(key, new Response(url.searchParams.get("value"), {
+                `        headers: { "Cache-Control": url.searchParams.get("cc") ?? "max-age=3600" }
+                `      }));
+                `      return new Response("stored");
+                `    } else if (url.pathname == "/delete") {
+                `      return new Response(String(await cache.delete(key)));
+                `    } else {
+                `      const headers = {};
+                `      if (url.searchParams.has("range")) headers.Range = url.searchParams.get("range");
+                `      const response = await cache.match(new Request(key, { headers }));
+                `      if (!response) return new Response("miss");
+                `      return new Response(response.status + " " + await response.text());
+                `    }
+                `  }
+                `}
+            )
+          ]
+        )
+      ),
+      ( name = "cache", cache = () ),
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello"
+      )
+    ]
+  ))"_kj);
+
+  test.start();
+  auto conn = test.connect("test-addr");
+
+  conn.httpGet200("/get?key=foo", "miss");
+  conn.httpGet200("/put?key=foo&value=hello", "stored");
+  conn.httpGet200("/get?key=foo", "200 hello");
+  conn.httpGet200("/get?key=foo&range=bytes%3D1-3", "206 ell");
+
+  // Namespaces opened with `caches.open()` are separate from the default cache.
+  conn.httpGet200("/get?key=foo&ns=other", "miss");
+  conn.httpGet200("/put?key=foo&ns=other&value=world", "stored");
+  conn.httpGet200("/get?key=foo&ns=other", "200 world");
+  conn.httpGet200("/get?key=foo", "200 hello");
+
+  // Responses that a shared cache mustn't store are not stored.
+  conn.httpGet200("/put?key=bar&value=secret&cc=private", "stored");
+  conn.httpGet200("/get?key=bar", "miss");
+  conn.httpGet200("/put?key=bar&value=uncacheable&cc=no-store", "stored");
+  conn.httpGet200("/get?key=bar", "miss");
+  conn.httpGet200("/put?key=bar&value=expired&cc=max-age%3D0", "stored");
+  conn.httpGet200("/get?key=bar", "miss");
+
+  conn.httpGet200("/delete?key=foo", "true");
+  conn.httpGet200("/delete?key=foo", "false");
+  conn.httpGet200("/get?key=foo", "miss");
+  conn.httpGet200("/get?key=foo&ns=other", "200 world");
+}
+
+KJ_TEST("Server: cache service Vary") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          cacheApiOutbound = "cache",
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env, ctx) {
+                `    const url = new URL(request.url);
+                `    const key = "http://example.com/" + url.searchParams.get("key");
+                `    const headers = {};
+                `    if (url.searchParams.has("lang")) {
+                `      headers["Accept-Language"] = url.searchParams.get("lang");
+                `    }
+                `    if (url.pathname == "/put") {
+                `      const responseHeaders = { "Cache-Control": "max-age=3600" };
+                `      if (url.searchParams.has("vary")) {
+                `        responseHeaders.Vary = url.searchParams.get("vary");
+                `      }
+                `      // Padded with spaces to `size` bytes.
+                `      const value = url.searchParams.get("value")
+                `          .padEnd(Number(url.searchParams.get("size") ?? 0));
+                `      await caches.default.put(new Request(key, { headers }),
+                `          new Response(value, { headers: responseHeaders }));
+                `      return new Response("stored");
+                `    } else {
+                `      const response = await caches.default.match(new Request(key, { headers }));
+                `      if (!response) return new Response("miss");
+                `      return new Response((await response.text()).trimEnd());
+                `    }
+                `  }
+                `}
+            )
+          ]
+        )
+      ),
+      ( name = "cache", cache = () ),
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello"
+      )
+    ]
+  ))"_kj);
+
+  test.start();
+  auto conn = test.connect("test-addr");
+
+  // Each language gets its own stored response.
+  conn.httpGet200("/put?key=foo&vary=Accept-Language&lang=en&value=hello", "stored");
+  conn.httpGet200("/put?key=foo&vary=Accept-Language&lang=fr&value=bonjour", "stored");
+  conn.httpGet200("/get?key=foo&lang=en", "hello");
+  conn.httpGet200("/get?key=foo&lang=fr", "bonjour");
+  conn.httpGet200("/get?key=foo&lang=de", "miss");
+  conn.httpGet200("/get?key=foo", "miss");
+
+  // Header names in `Vary` are case-insensitive.
+  conn.httpGet200("/put?key=bar&vary=accept-LANGUAGE&lang=en&value=hi", "stored");
+  conn.httpGet200("/get?key=bar&lang=en", "hi");
+  conn.httpGet200("/get?key=bar&lang=fr", "miss");
+
+  // Storing again only replaces the response for the same language.
+  conn.httpGet200("/put?key=foo&vary=Accept-Language&lang=en&value=howdy", "stored");
+  conn.httpGet200("/get?key=foo&lang=en", "howdy");
+  conn.httpGet200("/get?key=foo&lang=fr", "bonjour");
+
+  // A response without `Vary` is served regardless of the request's headers.
+  conn.httpGet200("/put?key=baz&value=anything", "stored");
+  conn.httpGet200("/get?key=baz&lang=en", "anything");
+  conn.httpGet200("/get?key=baz", "anything");
+}
+
+KJ_TEST("Server: cache service evicts least recently used entries") {
+  // Each entry below takes a bit over 1000 bytes, so two fit but three don't.
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          cacheApiOutbound = "cache",
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env, ctx) {
+                `    const url = new URL(request.url);
+                `    const key = "http://example.com/" + url.searchParams.get("key");
+                `    const headers = {};
+                `    if (url.searchParams.has("lang")) {
+                `      headers["Accept-Language"] = url.searchParams.get("lang");
+                `    }
+                `    if (url.pathname == "/put") {
+                `      const responseHeaders = { "Cache-Control": "max-age=3600" };
+                `      if (url.searchParams.has("vary")) {
+                `        responseHeaders.Vary = url.searchParams.get("vary");
+                `      }
+                `      // Padded with spaces to `size` bytes.
+                `      const value = url.searchParams.get("value")
+                `          .padEnd(Number(url.searchParams.get("size") ?? 0));
+                `      await caches.default.put(new Request(key, { headers }),
+                `          new Response(value, { headers: responseHeaders }));
+                `      return new Response("stored");
+                `    } else {
+                `      const response = await caches.default.match(new Request(key, { headers }));
+                `      if (!response) return new Response("miss");
+                `      return new Response((await response.text()).trimEnd());
+                `    }
+                `  }
+                `}
+            )
+          ]
+        )
+      ),
+      ( name = "cache", cache = ( maxTotalSize = 3000 ) ),
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello"
+      )
+    ]
+  ))"_kj);
+
+  test.start();
+  auto conn = test.connect("test-addr");
+
+  conn.httpGet200("/put?key=a&value=first&size=1000", "stored");
+  conn.httpGet200("/put?key=b&value=second&size=1000", "stored");
+  conn.httpGet200("/get?key=a", "first");
+
+  // `a` was used more recently than `b`, so `b` goes.
+  conn.httpGet200("/put?key=c&value=third&size=1000", "stored");
+  conn.httpGet200("/get?key=b", "miss");
+  conn.httpGet200("/get?key=a", "first");
+  conn.httpGet200("/get?key=c", "third");
+
+  // Now `a` is older than `c`.
+  conn.httpGet200("/get?key=c", "third");
+  conn.httpGet200("/put?key=d&value=fourth&size=1000", "stored");
+  conn.httpGet200("/get?key=a", "miss");
+  conn.httpGet200("/get?key=c", "third");
+  conn.httpGet200("/get?key=d", "fourth");
+}
+
+KJ_TEST("Server: cache service on disk") {
+  kj::StringPtr config = R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          cacheApiOutbound = "cache",
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env, ctx) {
+                `    const url = new URL(request.url);
+                `    const cache = url.searchParams.has("ns")
+                `        ? await caches.open(url.searchParams.get("ns")) : caches.default;
+                `    const key = "http://example.com/" + url.searchParams.get("key");
+                `    if (url.pathname == "/put") {
+                `      await cache.put(key, new Response(url.searchParams.get("value"), {
+                `        headers: { "Cache-Control": url.searchParams.get("cc") ?? "max-age=3600" }
+                `      }));
+                `      return new Response("stored");
+                `    } else if (url.pathname == "/delete") {
+                `      return new Response(String(await cache.delete(key)));
+                `    } else {
+                `      const headers = {};
+                `      if (url.searchParams.has("range")) headers.Range = url.searchParams.get("range");
+                `      const response = await cache.match(new Request(key, { headers }));
+                `      if (!response) return new Response("miss");
+                `      return new Response(response.status + " " + await response.text());
+                `    }
+                `  }
+                `}
+            )
+          ]
+        )
+      ),
+      ( name = "cache", cache = ( storage = ( localDisk = "cache-dir" ) ) ),
+      ( name = "cache-dir", disk = ( path = "../../cache-dir", writable = true ) ),
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello"
+      )
+    ]
+  ))"_kj;
+
+  // Create a directory outside of the test scope which we can use across multiple TestServers.
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+
+  {
+    TestServer test(config);
+    test.root->transfer(kj::Path({"cache-dir"_kj}), kj::WriteMode::CREATE, *dir, nullptr,
+                        kj::TransferMode::LINK);
+
+    test.start();
+    auto conn = test.connect("test-addr");
+
+    conn.httpGet200("/put?key=foo&value=hello", "stored");
+    KJ_EXPECT(dir->listNames().size() == 1);
+    conn.httpGet200("/get?key=foo", "200 hello");
+
+    // Storing again replaces the file.
+    conn.httpGet200("/put?key=foo&value=goodbye", "stored");
+    KJ_EXPECT(dir->listNames().size() == 1);
+    conn.httpGet200("/get?key=foo", "200 goodbye");
+
+    conn.httpGet200("/delete?key=foo", "true");
+    KJ_EXPECT(dir->listNames().size() == 0);
+    conn.httpGet200("/get?key=foo", "miss");
+
+    conn.httpGet200("/put?key=foo&value=persistent", "stored");
+    conn.httpGet200("/put?key=foo&ns=other&value=namespaced", "stored");
+    conn.httpGet200("/put?key=bar&value=deleted", "stored");
+    conn.httpGet200("/delete?key=bar", "true");
+    KJ_EXPECT(dir->listNames().size() == 2);
+  }
+
+  // A new server loads the entries stored by the previous one.
+  {
+    TestServer test(config);
+    test.root->transfer(kj::Path({"cache-dir"_kj}), kj::WriteMode::CREATE, *dir, nullptr,
+                        kj::TransferMode::LINK);
+
+    test.start();
+    auto conn = test.connect("test-addr");
+
+    conn.httpGet200("/get?key=foo", "200 persistent");
+    conn.httpGet200("/get?key=foo&range=bytes%3D0-3", "206 pers");
+    conn.httpGet200("/get?key=foo&ns=other", "200 namespaced");
+    conn.httpGet200("/get?key=bar", "miss");
+
+    // Loaded entries can be replaced and deleted like any other.
+    conn.httpGet200("/put?key=foo&value=replaced", "stored");
+    conn.httpGet200("/get?key=foo", "200 replaced");
+    KJ_EXPECT(dir->listNames().size() == 2);
+    conn.httpGet200("/delete?key=foo", "true");
+    KJ_EXPECT(dir->listNames().size() == 1);
+  }
+
+  // Files that aren't cache entries are removed when loading.
+  dir->openFile(kj::Path({"garbage"}), kj::WriteMode::CREATE)->writeAll("not a cache entry");
+  {
+    TestServer test(config);
+    test.root->transfer(kj::Path({"cache-dir"_kj}), kj::WriteMode::CREATE, *dir, nullptr,
+                        kj::TransferMode::LINK);
+
+    test.start();
+    auto conn = test.connect("test-addr");
+
+    conn.httpGet200("/get?key=foo&ns=other", "200 namespaced");
+    KJ_EXPECT(dir->listNames().size() == 1);
+    KJ_EXPECT(!dir->exists(kj::Path({"garbage"})));
+  }
+}
+
 // =======================================================================================
 // Test the test command
 
@@ -3577,6 +4817,185 @@ KJ_TEST("Server: JS RPC over HTTP connections") {
 
 // =======================================================================================
 
+// A module fallback service (see `Worker.moduleFallback`) listening on a real loopback port. It
+// runs on its own thread, since the isolate's thread blocks while its modules are fetched.
+class FakeModuleFallbackService final: private kj::HttpService {
+public:
+  FakeModuleFallbackService(): thread(kj::heap<kj::Thread>([this]() { run(); })) {
+    port = state.when([](const State& s) { return s.port != 0; },
+                      [](const State& s) { return s.port; });
+  }
+
+  ~FakeModuleFallbackService() noexcept(false) {
+    KJ_ASSERT_NONNULL(state.lockExclusive()->shutdown)->fulfill();
+  }
+
+  kj::String getAddress() {
+    return kj::str("127.0.0.1:", port);
+  }
+
+  // Serves a module with the given JSON-encoded config::Worker::Module for `specifier`.
+  void addModule(kj::StringPtr specifier, kj::StringPtr json) {
+    state.lockExclusive()->modules.insert(kj::str(specifier), kj::str(json));
+  }
+
+  // While down, every request gets a 503.
+  void setDown(bool down) {
+    state.lockExclusive()->down = down;
+  }
+
+  // Returns the requests received so far, as "<specifier> from <referrer>".
+  kj::Array<kj::String> getRequests() {
+    auto lock = state.lockExclusive();
+    return KJ_MAP(r, lock->requests) { return kj::str(r); };
+  }
+
+private:
+  struct State {
+    uint port = 0;
+    kj::Maybe<kj::Own<kj::CrossThreadPromiseFulfiller<void>>> shutdown;
+    bool down = false;
+    kj::HashMap<kj::String, kj::String> modules;
+    kj::Vector<kj::String> requests;
+  };
+  kj::MutexGuarded<State> state;
+  uint port;
+  kj::HttpHeaderTable headerTable;
+
+  // Declared last, so that the thread is joined before anything it uses is destroyed.
+  kj::Own<kj::Thread> thread;
+
+  void run() {
+    auto io = kj::setupAsyncIo();
+    auto listener = io.provider->getNetwork().parseAddress("127.0.0.1", 0)
+        .wait(io.waitScope)->listen();
+    kj::HttpServer server(io.provider->getTimer(), headerTable, *this);
+    auto listenTask = server.listenHttp(*listener).eagerlyEvaluate(nullptr);
+
+    auto paf = kj::newPromiseAndCrossThreadFulfiller<void>();
+    {
+      auto lock = state.lockExclusive();
+      lock->port = listener->getPort();
+      lock->shutdown = kj::mv(paf.fulfiller);
+    }
+    paf.promise.wait(io.waitScope);
+  }
+
+  kj::Promise<void> request(kj::HttpMethod method, kj::StringPtr url,
+                            const kj::HttpHeaders& headers, kj::AsyncInputStream& requestBody,
+                            kj::HttpService::Response& response) override {
+    auto parsed = kj::Url::parse(url, kj::Url::HTTP_REQUEST);
+    kj::StringPtr specifier;
+    kj::StringPtr referrer = "(none)";
+    for (auto& param: parsed.query) {
+      if (param.name == "specifier") {
+        specifier = param.value;
+      } else if (param.name == "referrer") {
+        referrer = param.value;
+      }
+    }
+
+    kj::Maybe<kj::String> body;
+    bool down;
+    {
+      auto lock = state.lockExclusive();
+      lock->requests.add(kj::str(specifier, " from ", referrer));
+      down = lock->down;
+      if (!down) {
+        KJ_IF_SOME(module, lock->modules.find(specifier)) {
+          body = kj::str(module);
+        }
+      }
+    }
+
+    kj::HttpHeaders responseHeaders(headerTable);
+    KJ_IF_SOME(b, body) {
+      auto out = response.send(200, "OK", responseHeaders, b.size());
+      co_await out->write(b.begin(), b.size());
+    } else if (down) {
+      co_await response.sendError(503, "Service Unavailable", responseHeaders);
+    } else {
+      co_await response.sendError(404, "Not Found", responseHeaders);
+    }
+  }
+};
+
+kj::String moduleFallbackConfig(kj::StringPtr address) {
+  return kj::str(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request) {
+                `    let path = new URL(request.url).pathname;
+                `    try {
+                `      return new Response((await import("/fallback" + path)).default);
+                `    } catch (e) {
+                `      return new Response("failed");
+                `    }
+                `  }
+                `}
+            )
+          ],
+          moduleFallback = ")", address, R"("
+        )
+      )
+    ],
+    sockets = [ ( name = "main", address = "test-addr", service = "hello" ) ]
+  ))");
+}
+
+KJ_TEST("Server: module fallback service that is down, then comes back") {
+  FakeModuleFallbackService fallback;
+  fallback.addModule("/fallback/a.js", R"({"esModule": "export default \"a\";"})");
+  fallback.setDown(true);
+
+  TestServer test(moduleFallbackConfig(fallback.getAddress()));
+  test.server.allowExperimental();
+  test.start();
+
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/a.js", "failed");
+
+  // The failure isn't cached, so the module is found once the service is back.
+  fallback.setDown(false);
+  conn.httpGet200("/a.js", "a");
+
+  // A module that didn't exist at first is found once it does.
+  conn.httpGet200("/b.js", "failed");
+  fallback.addModule("/fallback/b.js", R"({"esModule": "export default \"b\";"})");
+  conn.httpGet200("/b.js", "b");
+}
+
+KJ_TEST("Server: module fallback prefetches static imports") {
+  FakeModuleFallbackService fallback;
+  fallback.addModule("/fallback/a.js",
+      R"({"esModule": "import b from \"./b.js\"; export default \"a\" + b;"})");
+  fallback.addModule("/fallback/b.js", R"({"esModule": "export default \"b\";"})");
+
+  TestServer test(moduleFallbackConfig(fallback.getAddress()));
+  test.server.allowExperimental();
+  test.start();
+
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/a.js", "ab");
+
+  // The isolate's own request for b.js was served by the prefetch rather than a second fetch.
+  kj::Vector<kj::StringPtr> forB;
+  auto requests = fallback.getRequests();
+  for (auto& r: requests) {
+    if (r.startsWith("/fallback/b.js ")) forB.add(r);
+  }
+  KJ_EXPECT(forB.size() == 1, requests);
+  KJ_EXPECT(forB[0] == "/fallback/b.js from /fallback/a.js", requests);
+}
+
+// =======================================================================================
+
 // TODO(beta): Test TLS (send and receive)
 // TODO(beta): Test CLI overrides
 
@@ -8,6 +8,8 @@
 #include <kj/compat/http.h>
 #include <kj/compat/tls.h>
 #include <kj/compat/url.h>
+#include <kj/compat/gzip.h>
+#include <kj/compat/brotli.h>
 #include <kj/encoding.h>
 #include <kj/map.h>
 #include <capnp/message.h>
@@ -23,18 +25,34 @@
 #include <time.h>
 #include <openssl/bio.h>
 #include <openssl/pem.h>
+#include <openssl/sha.h>
 #include <workerd/io/actor-cache.h>
 #include <workerd/io/actor-sqlite.h>
 #include <workerd/io/request-tracker.h>
 #include <workerd/util/http-util.h>
 #include <workerd/api/actor-state.h>
 #include <workerd/util/mimetype.h>
+#include <workerd/util/strings.h>
 #include <workerd/util/uuid.h>
+#include <workerd/util/sqlite-pitr.h>
 #include <workerd/util/use-perfetto-categories.h>
 #include <workerd/api/worker-rpc.h>
 #include "workerd-api.h"
+#include "http-cache.h"
 #include "workerd/io/hibernation-manager.h"
 #include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+
+#if !_WIN32
+#include <fcntl.h>
+#include <sys/socket.h>
+#endif
+
+#if __linux__
+#include <sys/sendfile.h>
+#endif
 
 namespace workerd::server {
 
@@ -121,16 +139,191 @@ static kj::Vector<char> escapeJsonString(kj::StringPtr text) {
   return escaped;
 }
 
+static kj::ArrayPtr<const char> trimWhitespace(kj::ArrayPtr<const char> text) {
+  while (text.size() > 0 && (text[0] == ' ' || text[0] == '\t')) {
+    text = text.slice(1, text.size());
+  }
+  while (text.size() > 0 && (text.back() == ' ' || text.back() == '\t')) {
+    text = text.first(text.size() - 1);
+  }
+  return text;
+}
+
+// Returns the quality value that the `Accept-Encoding` header value `header` gives to `coding`,
+// or 0 if the coding is not acceptable.
+static double acceptEncodingQuality(kj::StringPtr header, kj::StringPtr coding) {
+  kj::Maybe<double> exact;
+  kj::Maybe<double> wildcard;
+
+  size_t pos = 0;
+  while (pos < header.size()) {
+    size_t end = pos;
+    while (end < header.size() && header[end] != ',') ++end;
+    auto item = header.slice(pos, end);
+    pos = end + 1;
+
+    // Split off the parameters, of which only `q` means anything.
+    size_t paramsStart = 0;
+    while (paramsStart < item.size() && item[paramsStart] != ';') ++paramsStart;
+    auto name = trimWhitespace(item.first(paramsStart));
+    double quality = 1;
+    while (paramsStart < item.size()) {
+      size_t paramEnd = paramsStart + 1;
+      while (paramEnd < item.size() && item[paramEnd] != ';') ++paramEnd;
+      auto param = trimWhitespace(item.slice(paramsStart + 1, paramEnd));
+      if (param.size() >= 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+        quality = kj::str(param.slice(2, param.size())).tryParseAs<double>().orDefault(0);
+      }
+      paramsStart = paramEnd;
+    }
+
+    if (equalsIgnoreCase(name, coding)) {
+      exact = quality;
+    } else if (equalsIgnoreCase(name, "*"_kj)) {
+      wildcard = quality;
+    }
+  }
+
+  // Codings that the header doesn't mention are only acceptable through a wildcard.
+  return exact.orDefault(wildcard.orDefault(0));
+}
+
+// Passes writes through to another stream, counting the bytes.
+class ByteCountingOutputStream final: public kj::AsyncOutputStream {
+public:
+  ByteCountingOutputStream(kj::AsyncOutputStream& inner, uint64_t& count)
+      : inner(inner), count(count) {}
+
+  kj::Promise<void> write(const void* buffer, size_t size) override {
+    count += size;
+    return inner.write(buffer, size);
+  }
+
+  kj::Promise<void> write(kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> pieces) override {
+    for (auto& piece: pieces) count += piece.size();
+    return inner.write(pieces);
+  }
+
+  kj::Promise<void> whenWriteDisconnected() override {
+    return inner.whenWriteDisconnected();
+  }
+
+private:
+  kj::AsyncOutputStream& inner;
+  uint64_t& count;
+};
+
+// Reads `size` bytes of a file starting at `offset`.
+//
+// kj::HttpServer pumps fixed-length response bodies straight into the connection. When that
+// connection is a plain socket and the file is on disk, we use sendfile() so the file's contents
+// go from the page cache to the socket without being copied through userspace. Otherwise (TLS,
+// an in-memory directory, a response consumed by another worker, ...) we fall back to a regular
+// buffered pump.
+class FileRangeInputStream final: public kj::AsyncInputStream {
+public:
+  FileRangeInputStream(kj::Own<const kj::ReadableFile> file, uint64_t offset, uint64_t size)
+      : file(kj::mv(file)), offset(offset), remaining(size) {}
+
+  kj::Promise<size_t> tryRead(void* buffer, size_t minBytes, size_t maxBytes) override {
+    auto n = file->read(offset, kj::arrayPtr(reinterpret_cast<kj::byte*>(buffer),
+                                             kj::min(maxBytes, remaining)));
+    offset += n;
+    remaining -= n;
+    return n;
+  }
+
+  kj::Maybe<uint64_t> tryGetLength() override {
+    return remaining;
+  }
+
+  kj::Promise<uint64_t> pumpTo(kj::AsyncOutputStream& output, uint64_t amount) override {
+#if __linux__
+    KJ_IF_SOME(inFd, file->getFd()) {
+      KJ_IF_SOME(stream, kj::dynamicDowncastIfAvailable<kj::AsyncIoStream>(output)) {
+        KJ_IF_SOME(outFd, stream.getFd()) {
+          return sendfileTo(output, inFd, outFd, kj::min(amount, remaining));
+        }
+      }
+    }
+#endif
+
+    // This gives an HTTP entity writer the chance to call us back with its underlying connection.
+    KJ_IF_SOME(promise, output.tryPumpFrom(*this, amount)) {
+      return kj::mv(promise);
+    }
+    return kj::unoptimizedPumpTo(*this, output, amount);
+  }
+
+private:
+  kj::Own<const kj::ReadableFile> file;
+  uint64_t offset;
+  uint64_t remaining;
+
+#if __linux__
+  // Largest amount passed to a single sendfile() call, so that one big file can't monopolize the
+  // thread.
+  static constexpr size_t MAX_SENDFILE_CHUNK = 1 << 20;
+
+  kj::Promise<uint64_t> sendfileTo(
+      kj::AsyncOutputStream& output, int inFd, int outFd, uint64_t amount) {
+    uint64_t sent = 0;
+    while (sent < amount) {
+      off_t pos = offset;
+      ssize_t n;
+      KJ_SYSCALL_HANDLE_ERRORS(
+          n = ::sendfile(outFd, inFd, &pos, kj::min(amount - sent, MAX_SENDFILE_CHUNK))) {
+        case EAGAIN:
+          // The socket's buffer is full. We have no way to wait for it to drain other than
+          // through the stream itself, so send the next chunk with a regular write, which waits
+          // as long as needed, then go back to sendfile().
+          n = -1;
+          break;
+        case EINVAL:
+        case ENOSYS:
+          // This file or socket doesn't support sendfile(). Do the rest the slow way.
+          co_return sent + co_await kj::unoptimizedPumpTo(*this, output, amount - sent);
+        default:
+          KJ_FAIL_SYSCALL("sendfile()", error);
+      }
+
+      if (n < 0) {
+        auto buffer = kj::heapArray<kj::byte>(kj::min(amount - sent, 16384));
+        auto m = co_await tryRead(buffer.begin(), 1, buffer.size());
+        if (m == 0) break;
+        co_await output.write(buffer.begin(), m);
+        sent += m;
+      } else if (n == 0) {
+        // The file was truncated.
+        break;
+      } else {
+        offset += n;
+        remaining -= n;
+        sent += n;
+        // Yield so other connections get a turn.
+        co_await kj::yield();
+      }
+    }
+    co_return sent;
+  }
+#endif
+};
+
 }  // namespace
 
 // =======================================================================================
 
+struct Server::HttpCaches {
+  kj::MutexGuarded<kj::HashMap<kj::String, kj::Own<const HttpCache>>> byName;
+};
+
 Server::Server(kj::Filesystem& fs, kj::Timer& timer, kj::Network& network,
                kj::EntropySource& entropySource, Worker::ConsoleMode consoleMode,
                kj::Function<void(kj::String)> reportConfigError)
     : fs(fs), timer(timer), network(network), entropySource(entropySource),
       reportConfigError(kj::mv(reportConfigError)), consoleMode(consoleMode),
-      memoryCacheProvider(kj::heap<api::MemoryCacheProvider>()), tasks(*this) {}
+      memoryCacheProvider(kj::heap<api::MemoryCacheProvider>()),
+      httpCaches(kj::heap<HttpCaches>()), tasks(*this) {}
 
 Server::~Server() noexcept(false) {}
 
@@ -167,6 +360,45 @@ public:
   virtual bool hasHandler(kj::StringPtr handlerName) = 0;
 };
 
+// Maps `key` to a bucket in [0, buckets), such that growing the number of buckets moves as few
+// keys as possible. This is the "jump consistent hash" of Lamping & Veach.
+static uint jumpConsistentHash(uint64_t key, uint buckets) {
+  int64_t b = -1;
+  int64_t j = 0;
+  while (j < int64_t(buckets)) {
+    b = j;
+    key = key * 2862933555777941757ULL + 1;
+    j = (b + 1) * (double(1ll << 31) / double((key >> 33) + 1));
+  }
+  return b;
+}
+
+// Every thread's view of the other threads, when running with `Config.workerThreads` > 1.
+struct Server::ThreadShard {
+  // This thread's index. The primary is 0.
+  uint index;
+
+  struct Peer {
+    kj::Own<kj::AsyncIoStream> stream;
+    capnp::TwoPartyClient rpcSystem;
+    rpc::WorkerdActorRouter::Client router;
+
+    Peer(kj::Own<kj::AsyncIoStream> streamParam, capnp::Capability::Client bootstrap,
+         capnp::rpc::twoparty::Side side)
+        : stream(kj::mv(streamParam)),
+          rpcSystem(*stream, kj::mv(bootstrap), side),
+          router(rpcSystem.bootstrap().castAs<rpc::WorkerdActorRouter>()) {}
+  };
+
+  // Connections to every thread, indexed by thread number. The entry for this thread is null.
+  kj::Array<kj::Maybe<kj::Own<Peer>>> peers;
+
+  // Returns the index of the thread which owns the given actor.
+  uint ownerOf(kj::StringPtr className, kj::StringPtr actorId) {
+    return jumpConsistentHash(kj::hashCode(className, actorId), peers.size());
+  }
+};
+
 // =======================================================================================
 
 kj::Own<kj::TlsContext> Server::makeTlsContext(config::TlsOptions::Reader conf) {
@@ -267,6 +499,20 @@ public:
     if (httpOptions.hasCapnpConnectHost()) {
       capnpConnectHost = httpOptions.getCapnpConnectHost();
     }
+    if (httpOptions.hasCompressResponses()) {
+      auto conf = httpOptions.getCompressResponses();
+      compression = ResponseCompression {
+        .contentTypes = KJ_MAP(t, conf.getContentTypes()) { return kj::str(t); },
+        .minimumSize = conf.getMinimumSize(),
+        .gzipLevel = kj::max(1, kj::min(conf.getGzipLevel(), 9)),
+        .brotliQuality = kj::max(0, kj::min(conf.getBrotliQuality(), 11)),
+        .acceptEncoding = headerTableBuilder.add("Accept-Encoding"),
+        .cacheControl = headerTableBuilder.add("Cache-Control"),
+        .contentEncoding = headerTableBuilder.add("Content-Encoding"),
+        .etag = headerTableBuilder.add("ETag"),
+        .vary = headerTableBuilder.add("Vary"),
+      };
+    }
   }
 
   bool hasCfBlobHeader() {
@@ -359,12 +605,106 @@ public:
     return capnpConnectHost;
   }
 
+  enum class ResponseEncoding { GZIP, BROTLI };
+
+  // Picks the encoding to compress the response to a request with the given headers in, if
+  // `compressResponses` is configured and the client accepts one we support. Brotli is preferred
+  // unless the client ranks gzip higher.
+  kj::Maybe<ResponseEncoding> negotiateResponseEncoding(kj::HttpMethod method,
+                                                        const kj::HttpHeaders& headers) {
+    auto& c = KJ_UNWRAP_OR_RETURN(compression, kj::none);
+    if (method == kj::HttpMethod::HEAD) return kj::none;
+    auto accept = KJ_UNWRAP_OR_RETURN(headers.get(c.acceptEncoding), kj::none);
+
+    double br = acceptEncodingQuality(accept, "br");
+    double gzip = acceptEncodingQuality(accept, "gzip");
+    if (br > 0 && br >= gzip) return ResponseEncoding::BROTLI;
+    if (gzip > 0) return ResponseEncoding::GZIP;
+    return kj::none;
+  }
+
+  bool compressesResponses() {
+    return compression != kj::none;
+  }
+
+  // Decides whether to compress a response to a client that accepts `encoding`, if any. If so,
+  // updates the headers to describe the compressed body, whose size is no longer known in advance.
+  //
+  // A response that we would compress for some client gets `Vary: Accept-Encoding` whether or not
+  // this client gets it compressed, so that caches don't hand one client's variant to another.
+  bool rewriteCompressedResponse(uint statusCode, kj::HttpHeaders& headers,
+                                 kj::Maybe<uint64_t> expectedBodySize,
+                                 kj::Maybe<ResponseEncoding> encoding) {
+    auto& c = KJ_UNWRAP_OR_RETURN(compression, false);
+
+    // Partial content and responses without a body must be left alone.
+    if (statusCode < 200 || statusCode == 204 || statusCode == 206 || statusCode == 304) {
+      return false;
+    }
+    KJ_IF_SOME(size, expectedBodySize) {
+      if (size == 0 || size < c.minimumSize) return false;
+    }
+    if (headers.get(c.contentEncoding) != kj::none) return false;
+    KJ_IF_SOME(cacheControl, headers.get(c.cacheControl)) {
+      if (strstr(cacheControl.cStr(), "no-transform") != nullptr) return false;
+    }
+
+    auto contentType = KJ_UNWRAP_OR(headers.get(kj::HttpHeaderId::CONTENT_TYPE), return false);
+    auto maybeMimeType = MimeType::tryParse(contentType, MimeType::IGNORE_PARAMS);
+    auto& mimeType = KJ_UNWRAP_OR(maybeMimeType, return false);
+    auto essence = mimeType.essence();
+    bool eligible = false;
+    for (auto& type: c.contentTypes) {
+      if (type.endsWith("/") ? essence.startsWith(type) : essence == type) {
+        eligible = true;
+        break;
+      }
+    }
+    if (!eligible) return false;
+
+    KJ_IF_SOME(vary, headers.get(c.vary)) {
+      headers.set(c.vary, kj::str(vary, ", Accept-Encoding"));
+    } else {
+      headers.set(c.vary, "Accept-Encoding"_kj);
+    }
+
+    auto& e = KJ_UNWRAP_OR_RETURN(encoding, false);
+    headers.set(c.contentEncoding, e == ResponseEncoding::BROTLI ? "br"_kj : "gzip"_kj);
+    headers.unset(kj::HttpHeaderId::CONTENT_LENGTH);
+    // The compressed body is no longer byte-for-byte identical to what a strong ETag promises.
+    KJ_IF_SOME(etag, headers.get(c.etag)) {
+      if (etag.startsWith("\"")) {
+        headers.set(c.etag, kj::str("W/", etag));
+      }
+    }
+    return true;
+  }
+
+  int getCompressionLevel(ResponseEncoding encoding) {
+    auto& c = KJ_ASSERT_NONNULL(compression);
+    return encoding == ResponseEncoding::BROTLI ? c.brotliQuality : c.gzipLevel;
+  }
+
 private:
   config::HttpOptions::Style style;
   kj::Maybe<kj::HttpHeaderId> forwardedProtoHeader;
   kj::Maybe<kj::HttpHeaderId> cfBlobHeader;
   kj::Maybe<kj::StringPtr> capnpConnectHost;
 
+  struct ResponseCompression {
+    kj::Array<kj::String> contentTypes;
+    uint64_t minimumSize;
+    int gzipLevel;
+    int brotliQuality;
+
+    kj::HttpHeaderId acceptEncoding;
+    kj::HttpHeaderId cacheControl;
+    kj::HttpHeaderId contentEncoding;
+    kj::HttpHeaderId etag;
+    kj::HttpHeaderId vary;
+  };
+  kj::Maybe<ResponseCompression> compression;
+
   class HeaderInjector {
   public:
     HeaderInjector(capnp::List<config::HttpOptions::Header>::Reader headers,
@@ -864,6 +1204,16 @@ public:
 
   kj::Maybe<const kj::Directory&> getWritable() { return writable; }
 
+  // Returns the scheduler that batches the commits of Durable Objects stored in this directory,
+  // creating it on first use.
+  GroupCommitScheduler& getGroupCommitScheduler(
+      kj::Timer& timer, GroupCommitScheduler::Options options) {
+    KJ_IF_SOME(scheduler, groupCommit) {
+      return *scheduler;
+    }
+    return *groupCommit.emplace(kj::heap<GroupCommitScheduler>(timer, options));
+  }
+
   bool hasHandler(kj::StringPtr handlerName) override {
     return handlerName == "fetch"_kj;
   }
@@ -871,6 +1221,7 @@ public:
 private:
   kj::Maybe<const kj::Directory&> writable;
   kj::Own<const kj::ReadableDirectory> readable;
+  kj::Maybe<kj::Own<GroupCommitScheduler>> groupCommit;
   kj::HttpHeaderTable& headerTable;
   kj::HttpHeaderId hLastModified;
   bool allowDotfiles;
@@ -959,13 +1310,13 @@ private:
               kj::str("bytes ", r.start, "-", r.end, "/", meta.size));
             auto out = response.send(206, "Partial Content", headers, rangeSize);
 
-            auto in = kj::heap<kj::FileInputStream>(*file, r.start);
+            auto in = kj::heap<FileRangeInputStream>(kj::mv(file), r.start, rangeSize);
             co_return co_await in->pumpTo(*out, rangeSize).ignoreResult();
           } else {
             headers.set(kj::HttpHeaderId::CONTENT_LENGTH, kj::str(meta.size));
             auto out = response.send(200, "OK", headers, meta.size);
 
-            auto in = kj::heap<kj::FileInputStream>(*file);
+            auto in = kj::heap<FileRangeInputStream>(kj::mv(file), 0, meta.size);
             co_return co_await in->pumpTo(*out, meta.size).ignoreResult();
           }
         }
@@ -1122,6 +1473,181 @@ kj::Own<Server::Service> Server::makeDiskDirectoryService(
 
 // =======================================================================================
 
+// Serves the Cache API protocol from an HttpCache. The cache is created in link(), since the
+// disk service it stores in, if any, may be defined after it. With multiple threads, whichever
+// thread links first creates the cache, and the others share it.
+class Server::CacheService final: public Service, private WorkerInterface {
+public:
+  CacheService(Server& server, kj::StringPtr name, config::CacheService::Reader conf,
+               kj::HttpHeaderTable::Builder& headerTableBuilder)
+      : server(server), name(name), conf(conf),
+        headerTable(headerTableBuilder.getFutureTable()), headerIds(headerTableBuilder) {}
+
+  void link() override {
+    kj::Maybe<kj::Own<const kj::Directory>> dir;
+
+    auto storage = conf.getStorage();
+    if (storage.isLocalDisk()) {
+      kj::StringPtr diskName = storage.getLocalDisk();
+      KJ_IF_SOME(svc, server.services.find(diskName)) {
+        auto diskSvc = dynamic_cast<DiskDirectoryService*>(svc.get());
+        if (diskSvc == nullptr) {
+          server.reportConfigError(kj::str("service ", name, ": cache storage config refers "
+              "to the service \"", diskName, "\", but that service is not a local disk service."));
+        } else KJ_IF_SOME(d, diskSvc->getWritable()) {
+          // The cache may outlive this thread's disk service.
+          dir = d.clone();
+        } else {
+          server.reportConfigError(kj::str("service ", name, ": cache storage config refers "
+              "to the disk service \"", diskName, "\", but that service is defined read-only."));
+        }
+      } else {
+        server.reportConfigError(kj::str("service ", name, ": cache storage config refers "
+            "to a service \"", diskName, "\", but no such service is defined."));
+      }
+    }
+
+    auto lock = server.httpCaches->byName.lockExclusive();
+    cache = *lock->findOrCreate(name, [&]() {
+      return kj::HashMap<kj::String, kj::Own<const HttpCache>>::Entry {
+        kj::str(name),
+        kj::heap<HttpCache>(kj::mv(dir), kj::systemPreciseCalendarClock(), HttpCache::Limits {
+          .maxTotalSize = conf.getMaxTotalSize(),
+          .maxEntrySize = conf.getMaxEntrySize(),
+        })
+      };
+    });
+  }
+
+  kj::Own<WorkerInterface> startRequest(IoChannelFactory::SubrequestMetadata metadata) override {
+    return { this, kj::NullDisposer::instance };
+  }
+
+  bool hasHandler(kj::StringPtr handlerName) override {
+    return handlerName == "fetch"_kj;
+  }
+
+private:
+  Server& server;
+  kj::StringPtr name;
+  config::CacheService::Reader conf;
+  kj::HttpHeaderTable& headerTable;
+  HttpCache::HeaderIds headerIds;
+  kj::Maybe<const HttpCache&> cache;
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+    TRACE_EVENT("workerd", "CacheService::request()", "url", url.cStr());
+    return KJ_ASSERT_NONNULL(cache, "link() has not been called")
+        .request(headerTable, headerIds, method, url, headers, requestBody, response);
+  }
+
+  kj::Promise<void> connect(kj::StringPtr host, const kj::HttpHeaders& headers,
+      kj::AsyncIoStream& connection, kj::HttpService::ConnectResponse& response,
+      kj::HttpConnectSettings settings) override {
+    throwUnsupported();
+  }
+  void prewarm(kj::StringPtr url) override {}
+  kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime, kj::StringPtr cron) override {
+    throwUnsupported();
+  }
+  kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime, uint32_t retryCount) override {
+    throwUnsupported();
+  }
+  kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+    throwUnsupported();
+  }
+
+  [[noreturn]] void throwUnsupported() {
+    JSG_FAIL_REQUIRE(Error, "Cache services don't support this event type.");
+  }
+};
+
+// =======================================================================================
+
+// Keeps V8 code cache data for Worker code in a disk directory (see `Config.v8CodeCache`). Each
+// entry is a file named after a hash of the source text plus V8's cached data version tag.
+class Server::CodeCache final: public jsg::CodeCache {
+public:
+  CodeCache(const kj::Directory& dir, bool createdAfterStartup)
+      : dir(dir), createdAfterStartup(createdAfterStartup) {}
+
+  kj::String keyFor(kj::ArrayPtr<const char> source) const override {
+    kj::byte hash[SHA256_DIGEST_LENGTH];
+    SHA256(source.asBytes().begin(), source.size(), hash);
+    return kj::str(kj::encodeHex(kj::arrayPtr(hash, sizeof(hash))), '-',
+        v8::ScriptCompiler::CachedDataVersionTag(), ".v8cache");
+  }
+
+  kj::Maybe<kj::Array<const kj::byte>> get(kj::StringPtr key) const override {
+    KJ_IF_SOME(file, dir.tryOpenFile(kj::Path(key))) {
+      found.fetch_add(1, std::memory_order_relaxed);
+      return file->readAllBytes();
+    } else {
+      misses.fetch_add(1, std::memory_order_relaxed);
+      return kj::none;
+    }
+  }
+
+  void put(kj::StringPtr key, kj::ArrayPtr<const kj::byte> data) const override {
+    KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() {
+      // Replace atomically, so that a concurrent reader never sees a partial entry.
+      auto replacer = dir.replaceFile(kj::Path(key),
+          kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT);
+      replacer->get().writeAll(data);
+      replacer->commit();
+    })) {
+      KJ_LOG(WARNING, "failed to write V8 code cache entry", exception);
+    }
+  }
+
+  void reject(kj::StringPtr key) const override {
+    rejected.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  bool isCreatedAfterStartup() const override {
+    return createdAfterStartup;
+  }
+
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t rejected;
+  };
+
+  Stats getStats() const {
+    auto rejectedCount = rejected.load(std::memory_order_relaxed);
+    return {
+      .hits = found.load(std::memory_order_relaxed) - rejectedCount,
+      .misses = misses.load(std::memory_order_relaxed),
+      .rejected = rejectedCount,
+    };
+  }
+
+private:
+  const kj::Directory& dir;
+  bool createdAfterStartup;
+
+  // An entry that was found but then rejected by V8 counts in both `found` and `rejected`.
+  mutable std::atomic<uint64_t> found = 0;
+  mutable std::atomic<uint64_t> misses = 0;
+  mutable std::atomic<uint64_t> rejected = 0;
+};
+
+// IsolateObserver which makes compilation consult a CodeCache.
+class CodeCachingIsolateObserver final: public IsolateObserver {
+public:
+  CodeCachingIsolateObserver(const jsg::CodeCache& codeCache): codeCache(codeCache) {}
+
+  kj::Maybe<const jsg::CodeCache&> getCodeCache() const override {
+    return codeCache;
+  }
+
+private:
+  const jsg::CodeCache& codeCache;
+};
+
 // This class exists to update the InspectorService's table of isolates when a config
 // has multiple services. The InspectorService exists on the stack of it's own thread and
 // initializes state that is bound to the thread, e.g. a http server and an event loop.
@@ -1366,75 +1892,461 @@ void Server::InspectorServiceIsolateRegistrar::registerIsolate(kj::StringPtr nam
 
 // =======================================================================================
 
-class Server::WorkerService final: public Service, private kj::TaskSet::ErrorHandler,
-                                   private IoChannelFactory, private TimerChannel,
-                                   private LimitEnforcer {
+// Fetches modules from a module fallback service (see `Worker.moduleFallback`) on behalf of the
+// isolates that use it. Module resolution is synchronous, so an isolate must block on each fetch,
+// but the fetches themselves all happen on one long-lived thread with one HTTP client. That way
+// connections to the service are kept alive and reused, rather than each module paying for a new
+// thread and a new connection.
+//
+// Modules are cached for the lifetime of the loader. Anything else -- "not found", an error status,
+// a failure to reach the service -- is only shared with requests made while it was in flight, so
+// that a service that comes up late or gains modules is picked up. Whenever an ES module is
+// fetched, the modules its static imports resolve to are fetched in the background, so that they
+// are usually cached by the time the isolate gets around to asking for them.
+class Server::ModuleFallbackLoader final: public kj::AtomicRefcounted {
 public:
-  class ActorNamespace;
-
-  // I/O channels, delivered when link() is called.
-  struct LinkedIoChannels {
-    kj::Array<Service*> subrequest;
-    kj::Array<kj::Maybe<ActorNamespace&>> actor;  // null = configuration error
-    kj::Maybe<Service&> cache;
-    kj::Maybe<kj::Own<SqliteDatabase::Vfs>> actorStorage;
-    AlarmScheduler& alarmScheduler;
+  // A successful response from the fallback service: either a JSON-encoded config::Worker::Module,
+  // or, if `redirect` is true, the specifier of the module to load instead.
+  struct Response {
+    kj::String payload;
+    bool redirect;
   };
-  using LinkCallback = kj::Function<LinkedIoChannels(WorkerService&)>;
-  using AbortActorsCallback = kj::Function<void()>;
-
-  WorkerService(ThreadContext& threadContext, kj::Own<const Worker> worker,
-                kj::Maybe<kj::HashSet<kj::String>> defaultEntrypointHandlers,
-                kj::HashMap<kj::String, kj::HashSet<kj::String>> namedEntrypointsParam,
-                const kj::HashMap<kj::String, ActorConfig>& actorClasses,
-                LinkCallback linkCallback, AbortActorsCallback abortActorsCallback)
-      : threadContext(threadContext),
-        ioChannels(kj::mv(linkCallback)),
-        worker(kj::mv(worker)),
-        defaultEntrypointHandlers(kj::mv(defaultEntrypointHandlers)),
-        waitUntilTasks(*this), abortActorsCallback(kj::mv(abortActorsCallback)) {
 
-    namedEntrypoints.reserve(namedEntrypointsParam.size());
-    for (auto& ep: namedEntrypointsParam) {
-      kj::StringPtr epPtr = ep.key;
-      namedEntrypoints.insert(kj::mv(ep.key), EntrypointService(*this, epPtr, kj::mv(ep.value)));
+  explicit ModuleFallbackLoader(kj::String address)
+      : address(kj::mv(address)),
+        thread(kj::heap<kj::Thread>([this]() {
+          KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() { main(); })) {
+            KJ_LOG(ERROR, "module fallback loader thread failed", exception);
+          }
+        })) {}
+
+  ~ModuleFallbackLoader() noexcept(false) {
+    // Make sure the thread winds down, otherwise destroying `thread` would block forever.
+    auto lock = state.lockExclusive();
+    lock->shutdownRequested = true;
+    KJ_IF_SOME(r, lock->ready) {
+      r.shutdownFulfiller->fulfill();
     }
+  }
 
-    actorNamespaces.reserve(actorClasses.size());
-    for (auto& entry: actorClasses) {
-      auto ns = kj::heap<ActorNamespace>(*this, entry.key, entry.value, threadContext.getUnsafeTimer());
-      actorNamespaces.insert(entry.key, kj::mv(ns));
+  // Fetches the module from the fallback service, blocking the calling thread until done. Returns
+  // null if the service has no such module. Throws if the service could not be reached.
+  kj::Maybe<Response> fetch(kj::StringPtr specifier, kj::Maybe<kj::StringPtr> referrer,
+                            jsg::ModuleRegistry::ResolveMethod method) const;
+
+  // Returns the name a module fetched for `specifier` must have.
+  static kj::StringPtr getModuleName(kj::StringPtr specifier) {
+    // TODO(cleanup): This is a bit of a hack based on the current design of the module registry
+    // loader algorithms handling of prefixed modules. This will be simplified with the upcoming
+    // module registry refactor.
+    KJ_IF_SOME(prefixed, getPrefixedSpecifier(specifier)) {
+      return prefixed;
     }
+    return specifier.startsWith("/") ? specifier.slice(1) : specifier;
   }
 
-  kj::Maybe<Service&> getEntrypoint(kj::StringPtr name) {
-    return namedEntrypoints.find(name);
-  }
+private:
+  class Loop;
 
-  kj::Array<kj::StringPtr> getEntrypointNames() {
-    return KJ_MAP(e, namedEntrypoints) -> kj::StringPtr { return e.key; };
-  }
+  struct Ready {
+    kj::Own<const kj::Executor> executor;
+    Loop& loop;
+    kj::Own<kj::CrossThreadPromiseFulfiller<void>> shutdownFulfiller;
+  };
+  struct State {
+    // Set while the thread is running its event loop.
+    kj::Maybe<Ready> ready;
+    bool shutdownRequested = false;
+    bool exited = false;
+  };
+  kj::MutexGuarded<State> state;
 
-  void link() override {
-    LinkCallback callback = kj::mv(KJ_REQUIRE_NONNULL(
-        ioChannels.tryGet<LinkCallback>(), "already called link()"));
-    ioChannels = callback(*this);
+  kj::String address;
+
+  // Declared last, so that the thread is joined before anything it uses is destroyed.
+  kj::Own<kj::Thread> thread;
+
+  void main();
+
+  // If the last segment of `specifier` names a built-in module, e.g. `/foo/node:buffer`, returns
+  // that segment.
+  static kj::Maybe<kj::StringPtr> getPrefixedSpecifier(kj::StringPtr specifier) {
+    KJ_IF_SOME(pos, specifier.findLast('/')) {
+      auto segment = specifier.slice(pos + 1);
+      if (segment.startsWith("node:") ||
+          segment.startsWith("cloudflare:") ||
+          segment.startsWith("workerd:")) {
+        return segment;
+      }
+    }
+    return kj::none;
   }
 
-  kj::Maybe<ActorNamespace&> getActorNamespace(kj::StringPtr name) {
-    KJ_IF_SOME(a, actorNamespaces.find(name)) {
-      return *a;
-    } else {
-      return kj::none;
+  static kj::String makeUrl(kj::StringPtr specifier, kj::Maybe<kj::StringPtr> referrer) {
+    kj::Url url;
+    url.query.add(kj::Url::QueryParam {
+      .name = kj::str("specifier"),
+      .value = kj::str(getPrefixedSpecifier(specifier).orDefault(specifier)),
+    });
+    KJ_IF_SOME(ref, referrer) {
+      url.query.add(kj::Url::QueryParam { kj::str("referrer"), kj::str(ref) });
     }
+    return url.toString(kj::Url::HTTP_REQUEST);
   }
 
-  kj::HashMap<kj::StringPtr, kj::Own<ActorNamespace>>& getActorNamespaces() {
-    return actorNamespaces;
+  static kj::StringPtr methodName(jsg::ModuleRegistry::ResolveMethod method) {
+    switch (method) {
+      case jsg::ModuleRegistry::ResolveMethod::IMPORT: return "import"_kj;
+      case jsg::ModuleRegistry::ResolveMethod::REQUIRE: return "require"_kj;
+    }
+    KJ_UNREACHABLE;
   }
 
-  kj::Own<WorkerInterface> startRequest(
-      IoChannelFactory::SubrequestMetadata metadata) override {
+  // Returns the specifiers of what look like static imports and re-exports in ES module source:
+  // `import ... from "x"`, `import "x"` and `export ... from "x"`. This is a heuristic, not a
+  // parser, which is good enough for prefetching: anything missed is fetched on demand, and
+  // anything spurious only costs a request.
+  static kj::Vector<kj::String> findStaticImports(kj::StringPtr source) {
+    auto isIdentifierChar = [](char c) {
+      return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') ||
+             c == '_' || c == '$';
+    };
+
+    kj::Vector<kj::String> result;
+    for (size_t i = 0; i < source.size(); i++) {
+      kj::StringPtr rest = source.slice(i);
+      size_t keywordSize;
+      if (rest.startsWith("from")) {
+        keywordSize = 4;
+      } else if (rest.startsWith("import")) {
+        keywordSize = 6;
+      } else {
+        continue;
+      }
+      if (i > 0 && isIdentifierChar(source[i - 1])) continue;
+
+      size_t j = i + keywordSize;
+      while (j < source.size() && (source[j] == ' ' || source[j] == '\t' || source[j] == '\n')) {
+        ++j;
+      }
+      if (j >= source.size() || (source[j] != '"' && source[j] != '\'')) continue;
+
+      char quote = source[j];
+      size_t start = ++j;
+      while (j < source.size() && source[j] != quote && source[j] != '\n') ++j;
+      if (j < source.size() && source[j] == quote) {
+        result.add(kj::str(source.slice(start, j)));
+      }
+      i = j;
+    }
+    return result;
+  }
+};
+
+// The loader thread's state. Everything here is only touched on that thread.
+class Server::ModuleFallbackLoader::Loop {
+public:
+  Loop(kj::AsyncIoProvider& provider, kj::StringPtr address)
+      : network(provider.getNetwork()),
+        timer(provider.getTimer()),
+        address(address),
+        tasks(errorHandler) {}
+
+  kj::Promise<kj::Maybe<Response>> fetch(kj::String specifier, kj::Maybe<kj::String> referrer,
+                                         jsg::ModuleRegistry::ResolveMethod method) {
+    auto entry = getEntry(kj::mv(specifier), kj::mv(referrer), method);
+    co_await KJ_ASSERT_NONNULL(entry->done).addBranch();
+
+    if (entry->failed) {
+      KJ_FAIL_REQUIRE("fallback service request failed", entry->url);
+    }
+    co_return entry->response.map([](Response& r) {
+      return Response { kj::str(r.payload), r.redirect };
+    });
+  }
+
+private:
+  struct Entry: public kj::Refcounted {
+    kj::String url;
+    kj::Maybe<kj::ForkedPromise<void>> done;
+
+    // Set when `done` resolves. Only entries with a `response` are reused after that; the rest
+    // are replaced on next use, so that the request is retried.
+    kj::Maybe<Response> response;
+    bool failed = false;
+    bool finished = false;
+  };
+
+  struct ErrorHandler: public kj::TaskSet::ErrorHandler {
+    void taskFailed(kj::Exception&& exception) override {
+      KJ_LOG(ERROR, "module fallback prefetch failed", exception);
+    }
+  };
+
+  kj::Network& network;
+  kj::Timer& timer;
+  kj::StringPtr address;
+  kj::HttpHeaderTable::Builder headerTableBuilder;
+  kj::HttpHeaderId hResolveMethod = headerTableBuilder.add("x-resolve-method");
+  kj::Own<kj::HttpHeaderTable> headerTable = headerTableBuilder.build();
+  kj::Maybe<kj::Own<kj::HttpClient>> client;
+
+  // Resolves once `client` is set. Dropped if it fails, so that the next request tries again.
+  kj::Maybe<kj::ForkedPromise<void>> connecting;
+
+  // Responses (and requests in flight) by resolve method and URL.
+  kj::HashMap<kj::String, kj::Own<Entry>> entries;
+
+  ErrorHandler errorHandler;
+  kj::TaskSet tasks;
+
+  kj::Own<Entry> getEntry(kj::String specifier, kj::Maybe<kj::String> referrer,
+                          jsg::ModuleRegistry::ResolveMethod method) {
+    auto url = makeUrl(specifier, referrer);
+    auto key = kj::str(methodName(method), ' ', url);
+    KJ_IF_SOME(entry, entries.find(key)) {
+      if (!entry->finished || entry->response != kj::none) return kj::addRef(*entry);
+    }
+
+    auto entry = kj::refcounted<Entry>();
+    entry->url = kj::mv(url);
+    entry->done = request(*entry, kj::mv(specifier), method).fork();
+    auto result = kj::addRef(*entry);
+    entries.upsert(kj::mv(key), kj::mv(entry),
+        [](kj::Own<Entry>& existing, kj::Own<Entry>&& replacement) {
+      existing = kj::mv(replacement);
+    });
+    return result;
+  }
+
+  // Sets up `client`, unless that's already done.
+  kj::Promise<void> connect() {
+    if (client != kj::none) co_return;
+
+    if (connecting == kj::none) {
+      connecting = network.parseAddress(address, 80)
+          .then([this](kj::Own<kj::NetworkAddress> addr) {
+        client = kj::newHttpClient(timer, *headerTable, *addr, {}).attach(kj::mv(addr));
+      }).fork();
+    }
+    try {
+      co_await KJ_ASSERT_NONNULL(connecting).addBranch();
+    } catch (...) {
+      connecting = kj::none;
+      throw;
+    }
+  }
+
+  kj::Promise<void> request(Entry& entry, kj::String specifier,
+                            jsg::ModuleRegistry::ResolveMethod method) {
+    KJ_DEFER(entry.finished = true);
+    try {
+      co_await connect();
+
+      kj::HttpHeaders headers(*headerTable);
+      headers.set(hResolveMethod, methodName(method));
+      headers.set(kj::HttpHeaderId::HOST, "localhost"_kj);
+
+      auto req = KJ_ASSERT_NONNULL(client)->request(
+          kj::HttpMethod::GET, entry.url, headers, kj::none);
+      auto resp = co_await req.response;
+
+      // Read the whole body in every case, so that the connection can be reused.
+      auto payload = co_await resp.body->readAllText();
+
+      if (resp.statusCode == 301) {
+        // The fallback service responded with a redirect.
+        KJ_IF_SOME(loc, resp.headers->get(kj::HttpHeaderId::LOCATION)) {
+          entry.response = Response { kj::str(loc), true };
+        } else {
+          KJ_LOG(ERROR, "Fallback service returned a redirect with no location", entry.url);
+        }
+      } else if (resp.statusCode != 200) {
+        // Failed! Log the body of the response, if any, and leave `response` null to signal that
+        // the fallback service failed to return a module for this specifier.
+        KJ_LOG(ERROR, "Fallback service failed to fetch module", payload, entry.url);
+      } else {
+        if (method == jsg::ModuleRegistry::ResolveMethod::IMPORT) {
+          prefetchImports(specifier, payload);
+        }
+        entry.response = Response { kj::mv(payload), false };
+      }
+    } catch (...) {
+      auto exception = kj::getCaughtExceptionAsKj();
+      KJ_LOG(ERROR, "Fallback service failed to fetch module", exception, entry.url);
+      entry.failed = true;
+    }
+  }
+
+  // Starts fetching the modules that the ES module in `payload` statically imports by relative
+  // path. Errors are ignored here; they are reported when the isolate asks for the module itself.
+  void prefetchImports(kj::StringPtr specifier, kj::StringPtr payload) {
+    if (getPrefixedSpecifier(specifier) != kj::none) return;
+
+    KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() {
+      capnp::MallocMessageBuilder moduleMessage;
+      capnp::JsonCodec json;
+      json.handleByAnnotation<config::Worker::Module>();
+      auto module = moduleMessage.initRoot<config::Worker::Module>();
+      json.decode(payload, module);
+      if (!module.isEsModule()) return;
+
+      // Imports are resolved relative to the importing module, which is named after `specifier`
+      // (an absolute path).
+      auto base = kj::Path::parse(specifier.startsWith("/") ? specifier.slice(1) : specifier);
+      for (auto& import: findStaticImports(module.getEsModule())) {
+        if (!import.startsWith("./") && !import.startsWith("../") && !import.startsWith("/")) {
+          continue;
+        }
+        auto target = base.parent().eval(import).toString(true);
+        tasks.add(fetch(kj::mv(target), kj::str(specifier),
+            jsg::ModuleRegistry::ResolveMethod::IMPORT).ignoreResult());
+      }
+    })) {
+      KJ_LOG(WARNING, "could not prefetch module fallback imports", specifier, exception);
+    }
+  }
+};
+
+kj::Maybe<Server::ModuleFallbackLoader::Response> Server::ModuleFallbackLoader::fetch(
+    kj::StringPtr specifier, kj::Maybe<kj::StringPtr> referrer,
+    jsg::ModuleRegistry::ResolveMethod method) const {
+  kj::Own<const kj::Executor> executor;
+  Loop* loop = nullptr;
+
+  // This only blocks while the thread is still starting up.
+  state.when([](const State& s) { return s.ready != kj::none || s.exited; },
+             [&](const State& s) {
+    auto& r = KJ_REQUIRE_NONNULL(s.ready, "module fallback loader thread is not running");
+    executor = r.executor->addRef();
+    loop = &r.loop;
+  });
+
+  return executor->executeSync([&]() {
+    return loop->fetch(kj::str(specifier), referrer.map([](kj::StringPtr r) {
+      return kj::str(r);
+    }), method);
+  });
+}
+
+void Server::ModuleFallbackLoader::main() {
+  KJ_DEFER(state.lockExclusive()->exited = true);
+
+  kj::AsyncIoContext io = kj::setupAsyncIo();
+  Loop loop(*io.provider, address);
+
+  auto paf = kj::newPromiseAndCrossThreadFulfiller<void>();
+  {
+    auto lock = state.lockExclusive();
+    if (lock->shutdownRequested) return;
+    lock->ready = Ready {
+      .executor = kj::getCurrentThreadExecutor().addRef(),
+      .loop = loop,
+      .shutdownFulfiller = kj::mv(paf.fulfiller),
+    };
+  }
+  KJ_DEFER(state.lockExclusive()->ready = kj::none);
+
+  paf.promise.wait(io.waitScope);
+}
+
+// =======================================================================================
+
+class Server::WorkerService final: public Service, private kj::TaskSet::ErrorHandler,
+                                   private IoChannelFactory, private TimerChannel,
+                                   private LimitEnforcer {
+public:
+  class ActorNamespace;
+
+  // I/O channels, delivered when link() is called.
+  struct LinkedIoChannels {
+    kj::Array<Service*> subrequest;
+    kj::Array<kj::Maybe<ActorNamespace&>> actor;  // null = configuration error
+    kj::Maybe<Service&> cache;
+    kj::Maybe<kj::Own<SqliteDatabase::Vfs>> actorStorage;
+
+    // The directory `actorStorage` keeps its databases in.
+    kj::Maybe<const kj::Directory&> actorStorageDir;
+
+    // Batches commits to `actorStorage`, if `Config.actorGroupCommitMaxLatencyUs` is set.
+    kj::Maybe<GroupCommitScheduler&> actorGroupCommit;
+
+    // Options for the point-in-time recovery log kept for each object in `actorStorage`, unless
+    // `Worker.durableObjectPointInTimeRecovery` disables it.
+    kj::Maybe<SqlitePitr::Options> actorPitrOptions;
+
+    AlarmScheduler& alarmScheduler;
+  };
+  using LinkCallback = kj::Function<LinkedIoChannels(WorkerService&)>;
+  using AbortActorsCallback = kj::Function<void()>;
+
+  WorkerService(ThreadContext& threadContext, kj::StringPtr name, kj::Own<const Worker> worker,
+                kj::Maybe<kj::HashSet<kj::String>> defaultEntrypointHandlers,
+                kj::HashMap<kj::String, kj::HashSet<kj::String>> namedEntrypointsParam,
+                const kj::HashMap<kj::String, ActorConfig>& actorClasses,
+                LinkCallback linkCallback, AbortActorsCallback abortActorsCallback,
+                kj::Maybe<ThreadShard&> shard)
+      : threadContext(threadContext),
+        name(name),
+        shard(shard),
+        ioChannels(kj::mv(linkCallback)),
+        worker(kj::mv(worker)),
+        defaultEntrypointHandlers(kj::mv(defaultEntrypointHandlers)),
+        waitUntilTasks(*this), abortActorsCallback(kj::mv(abortActorsCallback)) {
+
+    namedEntrypoints.reserve(namedEntrypointsParam.size());
+    for (auto& ep: namedEntrypointsParam) {
+      kj::StringPtr epPtr = ep.key;
+      namedEntrypoints.insert(kj::mv(ep.key), EntrypointService(*this, epPtr, kj::mv(ep.value)));
+    }
+
+    actorNamespaces.reserve(actorClasses.size());
+    for (auto& entry: actorClasses) {
+      auto ns = kj::heap<ActorNamespace>(*this, entry.key, entry.value, threadContext.getUnsafeTimer());
+      actorNamespaces.insert(entry.key, kj::mv(ns));
+    }
+  }
+
+  kj::Maybe<Service&> getEntrypoint(kj::StringPtr name) {
+    return namedEntrypoints.find(name);
+  }
+
+  kj::Array<kj::StringPtr> getEntrypointNames() {
+    return KJ_MAP(e, namedEntrypoints) -> kj::StringPtr { return e.key; };
+  }
+
+  void link() override {
+    LinkCallback callback = kj::mv(KJ_REQUIRE_NONNULL(
+        ioChannels.tryGet<LinkCallback>(), "already called link()"));
+    ioChannels = callback(*this);
+  }
+
+  kj::Maybe<ActorNamespace&> getActorNamespace(kj::StringPtr name) {
+    KJ_IF_SOME(a, actorNamespaces.find(name)) {
+      return *a;
+    } else {
+      return kj::none;
+    }
+  }
+
+  kj::HashMap<kj::StringPtr, kj::Own<ActorNamespace>>& getActorNamespaces() {
+    return actorNamespaces;
+  }
+
+  // Measures the used size of this Worker's V8 heap.
+  kj::Promise<size_t> getHeapSize() {
+    auto asyncLock = co_await worker->takeAsyncLockWithoutRequest(nullptr);
+    size_t result = 0;
+    worker->runInLockScope(asyncLock, [&](Worker::Lock& lock) {
+      v8::HeapStatistics stats;
+      lock.getIsolate()->GetHeapStatistics(&stats);
+      result = stats.used_heap_size();
+    });
+    co_return result;
+  }
+
+  kj::Own<WorkerInterface> startRequest(
+      IoChannelFactory::SubrequestMetadata metadata) override {
     return startRequest(kj::mv(metadata), kj::none);
   }
 
@@ -1476,6 +2388,18 @@ public:
 
     const ActorConfig& getConfig() { return config; }
 
+    kj::Duration getIdleTimeout() {
+      KJ_SWITCH_ONEOF(config) {
+        KJ_CASE_ONEOF(c, Durable) {
+          return c.idleTimeout;
+        }
+        KJ_CASE_ONEOF(c, Ephemeral) {
+          return c.idleTimeout;
+        }
+      }
+      KJ_UNREACHABLE;
+    }
+
     kj::Own<WorkerInterface> getActor(Worker::Actor::Id id,
         IoChannelFactory::SubrequestMetadata metadata) {
       kj::String idStr;
@@ -1495,6 +2419,14 @@ public:
 
     kj::Own<WorkerInterface> getActor(kj::String id,
         IoChannelFactory::SubrequestMetadata metadata) {
+      KJ_IF_SOME(s, service.shard) {
+        uint owner = s.ownerOf(className, id);
+        if (owner != s.index) {
+          // The actor lives on another thread; forward the event there.
+          return service.startRemoteActorRequest(s, owner, className, id, kj::mv(metadata));
+        }
+      }
+
       return newPromisedWorkerInterface(service.waitUntilTasks,
           getActorThenStartRequest(kj::mv(id), kj::mv(metadata)));
     }
@@ -1512,8 +2444,8 @@ public:
     //
     // We use a RequestTracker to track strong references to this ActorContainer's Worker::Actor.
     // Once there are no Worker::Actor's left (excluding our own), `inactive()` is triggered and we
-    // initiate the eviction of the Durable Object. If no requests arrive in the next 10 seconds,
-    // the DO is evicted, otherwise we cancel the eviction task.
+    // initiate the eviction of the Durable Object. If no requests arrive within the namespace's
+    // idle timeout, the DO is evicted, otherwise we cancel the eviction task.
     class ActorContainer final: public RequestTracker::Hooks {
     public:
       ActorContainer(kj::StringPtr key, ActorNamespace& parent, kj::Timer& timer)
@@ -1571,16 +2503,26 @@ public:
               manager = m.addRef();
             }
           }
-          shutdownTask = handleShutdown().eagerlyEvaluate([](kj::Exception&& e) { KJ_LOG(ERROR, e); });
+          shutdownTask = handleShutdown(parent.getIdleTimeout())
+              .eagerlyEvaluate([](kj::Exception&& e) { KJ_LOG(ERROR, e); });
         }
       }
 
+      // True if the actor is loaded but handling no requests, i.e. its eviction is pending.
+      bool isIdle() { return actor != kj::none && shutdownTask != kj::none; }
+
+      // Evicts an idle actor right away rather than waiting out the idle timeout.
+      void evictNow() {
+        KJ_REQUIRE(isIdle());
+        shutdownTask = handleShutdown(0 * kj::SECONDS)
+            .eagerlyEvaluate([](kj::Exception&& e) { KJ_LOG(ERROR, e); });
+      }
+
       // Processes the eviction of the Durable Object and hibernates active websockets.
-      kj::Promise<void> handleShutdown() {
-        // After 10 seconds of inactivity, we destroy the Worker::Actor and hibernate any active
+      kj::Promise<void> handleShutdown(kj::Duration delay) {
+        // After `delay` of inactivity, we destroy the Worker::Actor and hibernate any active
         // JS WebSockets.
-        // TODO(someday): We could make this timeout configurable to make testing less burdensome.
-        co_await timer.afterDelay(10 * kj::SECONDS);
+        co_await timer.afterDelay(delay);
         KJ_IF_SOME(onBroken, parent.onBrokenTasks.findEntry(getKey())) {
           // Cancel the onBroken promise, since we're about to destroy the actor anyways and don't
           // want to trigger it.
@@ -1657,8 +2599,8 @@ public:
 
     // This class tracks clients that a have reference to the given actor.
     // Upon destruction, we update the lastAccess time for the actor and
-    // `ActorContainer::hasClients()` starts returning false. After 70 seconds, the cleanupLoop
-    // will remove the `ActorContainer` from `actors`.
+    // `ActorContainer::hasClients()` starts returning false. A minute after the idle timeout, the
+    // cleanupLoop will remove the `ActorContainer` from `actors`.
     class ActorContainerRef: public kj::Refcounted {
     public:
       ActorContainerRef(ActorContainer& container): container(container) {
@@ -1687,6 +2629,15 @@ public:
       actors.clear();
     }
 
+    // Adds the actors that could be evicted right now to `candidates`.
+    void addEvictionCandidates(kj::Vector<ActorContainer*>& candidates) {
+      for (auto& entry: actors) {
+        if (entry.value->isIdle()) {
+          candidates.add(entry.value.get());
+        }
+      }
+    }
+
   private:
     WorkerService& service;
     kj::StringPtr className;
@@ -1720,9 +2671,9 @@ public:
           .attach(kj::mv(refTracker));
     }
 
-    // Removes actors from `actors` after 70 seconds of last access.
+    // Removes actors from `actors` a minute after they would have been evicted for inactivity.
     kj::Promise<void> cleanupLoop() {
-      constexpr auto EXPIRATION = 70 * kj::SECONDS;
+      const auto EXPIRATION = getIdleTimeout() + 60 * kj::SECONDS;
 
       while (true) {
         auto now = timer.now();
@@ -1771,8 +2722,9 @@ public:
 
     class ActorSqliteHooks final : public ActorSqlite::Hooks {
     public:
-      ActorSqliteHooks(AlarmScheduler& alarmScheduler, ActorKey actor)
-          : alarmScheduler(alarmScheduler), actor(actor) {}
+      ActorSqliteHooks(AlarmScheduler& alarmScheduler, ActorKey actor,
+                       kj::Maybe<SqlitePitr&> pitr)
+          : alarmScheduler(alarmScheduler), actor(actor), pitr(pitr) {}
 
       kj::Promise<kj::Maybe<kj::Date>> getAlarm() override {
         return alarmScheduler.getAlarm(actor);
@@ -1798,9 +2750,33 @@ public:
 
       void cancelDeferredAlarmDeletion() override {}
 
+      kj::Promise<kj::String> getCurrentBookmark() override {
+        KJ_IF_SOME(p, pitr) {
+          return p.getCurrentBookmark();
+        }
+        return ActorSqlite::Hooks::getCurrentBookmark();
+      }
+
+      kj::Promise<kj::String> getBookmarkForTime(kj::Date timestamp) override {
+        KJ_IF_SOME(p, pitr) {
+          return JSG_REQUIRE_NONNULL(p.getBookmarkForTime(timestamp), Error,
+              "The requested point in time is older than this Durable Object's recovery window.");
+        }
+        return ActorSqlite::Hooks::getBookmarkForTime(timestamp);
+      }
+
+      kj::Promise<kj::String> onNextSessionRestoreBookmark(kj::StringPtr bookmark) override {
+        KJ_IF_SOME(p, pitr) {
+          return JSG_REQUIRE_NONNULL(p.requestRestore(bookmark), Error,
+              "Invalid or expired bookmark: ", bookmark);
+        }
+        return ActorSqlite::Hooks::onNextSessionRestoreBookmark(bookmark);
+      }
+
     private:
       AlarmScheduler& alarmScheduler;
       ActorKey actor;
+      kj::Maybe<SqlitePitr&> pitr;
     };
 
     kj::Promise<GetActorResult> getActorImpl(kj::String id) {
@@ -1842,6 +2818,16 @@ public:
             return config.tryGet<Durable>()
                 .map([&](const Durable& d) -> kj::Own<ActorCacheInterface> {
               KJ_IF_SOME(as, channels.actorStorage) {
+                auto path = kj::Path({d.uniqueKey, kj::str(idPtr, ".sqlite")});
+
+                // The point-in-time recovery log must be opened first, since it applies any
+                // restore requested in the previous session, and must outlive the database.
+                kj::Maybe<kj::Own<SqlitePitr>> pitr;
+                KJ_IF_SOME(options, channels.actorPitrOptions) {
+                  pitr = kj::heap<SqlitePitr>(KJ_ASSERT_NONNULL(channels.actorStorageDir),
+                      path, kj::systemPreciseCalendarClock(), options);
+                }
+
                 // The idPtr can end up being freed if the Actor gets hibernated so we need
                 // to create a copy that is ensured to live as long as the ActorSqliteHooks
                 // instance we're creating here.
@@ -1849,14 +2835,32 @@ public:
                 auto idStr = kj::str(idPtr);
                 auto sqliteHooks = kj::heap<ActorSqliteHooks>(channels.alarmScheduler, ActorKey{
                   .uniqueKey = d.uniqueKey, .actorId = idStr
-                }).attach(kj::mv(idStr));
+                }, pitr.map([](kj::Own<SqlitePitr>& p) -> SqlitePitr& { return *p; }))
+                    .attach(kj::mv(idStr));
 
-                auto db = kj::heap<SqliteDatabase>(*as,
-                    kj::Path({d.uniqueKey, kj::str(idPtr, ".sqlite")}),
+                auto db = kj::heap<SqliteDatabase>(*as, path,
                     kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT);
-                return kj::heap<ActorSqlite>(kj::mv(db), outputGate,
-                    []() -> kj::Promise<void> { return kj::READY_NOW; },
-                    *sqliteHooks).attach(kj::mv(sqliteHooks));
+                KJ_IF_SOME(p, pitr) {
+                  p->attach(*db);
+                }
+
+                kj::Function<kj::Promise<void>()> commitCallback =
+                    []() -> kj::Promise<void> { return kj::READY_NOW; };
+                KJ_IF_SOME(groupCommit, channels.actorGroupCommit) {
+                  // SQLite no longer syncs the WAL on each commit; instead the output gate waits
+                  // for the scheduler to sync it along with other objects' commits. (The main
+                  // database file is still synced by checkpoints, as usual.)
+                  db->run("PRAGMA synchronous=NORMAL;");
+                  auto& dir = KJ_ASSERT_NONNULL(channels.actorStorageDir);
+                  commitCallback = [&groupCommit, &dir,
+                                    walPath = path.parent().append(kj::str(idPtr, ".sqlite-wal"))]
+                      () -> kj::Promise<void> {
+                    return groupCommit.sync(dir.openFile(walPath));
+                  };
+                }
+
+                return kj::heap<ActorSqlite>(kj::mv(db), outputGate, kj::mv(commitCallback),
+                    *sqliteHooks, sharedLru).attach(kj::mv(sqliteHooks), kj::mv(pitr));
               } else {
                 // Create an ActorCache backed by a fake, empty storage. Elsewhere, we configure
                 // ActorCache never to flush, so this effectively creates in-memory storage.
@@ -1952,6 +2956,8 @@ private:
   };
 
   ThreadContext& threadContext;
+  kj::StringPtr name;
+  kj::Maybe<ThreadShard&> shard;
 
   // LinkedIoChannels owns the SqliteDatabase::Vfs, so make sure it is destroyed last.
   kj::OneOf<LinkCallback, LinkedIoChannels> ioChannels;
@@ -1963,6 +2969,20 @@ private:
   kj::TaskSet waitUntilTasks;
   AbortActorsCallback abortActorsCallback;
 
+  kj::Own<WorkerInterface> startRemoteActorRequest(ThreadShard& threadShard, uint owner,
+      kj::StringPtr className, kj::StringPtr id, IoChannelFactory::SubrequestMetadata metadata) {
+    auto& peer = *KJ_ASSERT_NONNULL(threadShard.peers[owner]);
+    auto req = peer.router.startActorEventRequest();
+    req.setServiceName(name);
+    req.setClassName(className);
+    req.setActorId(id);
+    KJ_IF_SOME(cf, metadata.cfBlobJson) {
+      req.setCfBlobJson(cf);
+    }
+    return kj::heap<RpcWorkerInterface>(threadContext.getHttpOverCapnpFactory(),
+        threadContext.getByteStreamFactory(), waitUntilTasks, req.send().getDispatcher());
+  }
+
   class ActorChannelImpl final: public IoChannelFactory::ActorChannel {
   public:
     ActorChannelImpl(ActorNamespace& ns, Worker::Actor::Id id)
@@ -2550,6 +3570,46 @@ void Server::abortAllActors() {
   }
 }
 
+kj::Promise<void> Server::enforceActorMemoryBudget(size_t budget) {
+  using ActorContainer = WorkerService::ActorNamespace::ActorContainer;
+
+  for (;;) {
+    co_await timer.afterDelay(1 * kj::SECONDS);
+
+    kj::Vector<WorkerService*> workers;
+    size_t total = 0;
+    for (auto& service: services) {
+      if (WorkerService* worker = dynamic_cast<WorkerService*>(&*service.value)) {
+        if (worker->getActorNamespaces().size() > 0) {
+          workers.add(worker);
+          total += co_await worker->getHeapSize();
+        }
+      }
+    }
+    if (total <= budget) continue;
+
+    kj::Vector<ActorContainer*> candidates;
+    for (auto worker: workers) {
+      for (auto& [className, ns]: worker->getActorNamespaces()) {
+        ns->addEvictionCandidates(candidates);
+      }
+    }
+    if (candidates.empty()) continue;
+
+    // We can't tell how much each actor contributes to its isolate's heap, so evict the least
+    // recently used tenth of the candidates (at least one) and measure again next time around.
+    std::sort(candidates.begin(), candidates.end(), [](ActorContainer* a, ActorContainer* b) {
+      return a->getLastAccess() < b->getLastAccess();
+    });
+    auto count = (candidates.size() + 9) / 10;
+    for (auto container: candidates.asPtr().first(count)) {
+      container->evictNow();
+    }
+    KJ_LOG(INFO, "evicted idle actors to stay within the actor memory budget",
+        count, total, budget);
+  }
+}
+
 kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name, config::Worker::Reader conf,
     capnp::List<config::Extension>::Reader extensions) {
   TRACE_EVENT("workerd", "Server::makeWorker()", "name", name.cStr());
@@ -2644,7 +3704,12 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name, config::Worker::
     }
   };
 
-  auto observer = kj::atomicRefcounted<IsolateObserver>();
+  kj::Own<IsolateObserver> observer;
+  KJ_IF_SOME(c, codeCache) {
+    observer = kj::atomicRefcounted<CodeCachingIsolateObserver>(*c);
+  } else {
+    observer = kj::atomicRefcounted<IsolateObserver>();
+  }
   auto limitEnforcer = kj::heap<NullIsolateLimitEnforcer>();
   auto api = kj::heap<WorkerdApi>(globalContext->v8System,
                                   featureFlags.asReader(),
@@ -2676,130 +3741,45 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name, config::Worker::
                "You must run workerd with `--experimental` to use this feature.");
     // If the config has the moduleFallback option, then we are going to set up the ability
     // to load certain modules from a fallback service. This is generally intended for local
-    // dev/testing purposes only.
+    // dev/testing purposes only. Workers using the same service share a loader, and with it
+    // connections and cached modules.
+    auto& loader = moduleFallbackLoaders.findOrCreate(conf.getModuleFallback(), [&]() {
+      return decltype(moduleFallbackLoaders)::Entry {
+        kj::str(conf.getModuleFallback()),
+        kj::atomicRefcounted<ModuleFallbackLoader>(kj::str(conf.getModuleFallback()))
+      };
+    });
     auto& apiIsolate = isolate->getApi();
     apiIsolate.setModuleFallbackCallback(
-        [address=kj::str(conf.getModuleFallback()), featureFlags=apiIsolate.getFeatureFlags()]
+        [loader=kj::atomicAddRef(*loader), featureFlags=apiIsolate.getFeatureFlags()]
         (jsg::Lock& js,
          kj::StringPtr specifier,
          kj::Maybe<kj::String> referrer,
          jsg::CompilationObserver& observer,
          jsg::ModuleRegistry::ResolveMethod method) mutable
             -> kj::Maybe<kj::OneOf<kj::String, jsg::ModuleRegistry::ModuleInfo>> {
-      kj::Maybe<kj::String> jsonPayload;
-      bool redirect = false;
-      bool prefixed = false;
-      kj::Url url;
-      kj::StringPtr actualSpecifier = nullptr;
-      // TODO(cleanup): This is a bit of a hack based on the current
-      // design of the module registry loader algorithms handling of
-      // prefixed modules. This will be simplified with the upcoming
-      // module registry refactor.
-      KJ_IF_SOME(pos, specifier.findLast('/')) {
-        auto segment = specifier.slice(pos + 1);
-        if (segment.startsWith("node:") ||
-            segment.startsWith("cloudflare:") ||
-            segment.startsWith("workerd:")) {
-          actualSpecifier = segment;
-          url.query.add(kj::Url::QueryParam {
-            .name = kj::str("specifier"),
-            .value = kj::str(segment)
-          });
-          prefixed = true;
-        }
-      }
-      if (!prefixed) {
-        actualSpecifier = specifier;
-        if (actualSpecifier.startsWith("/")) {
-          actualSpecifier = specifier.slice(1);
-        }
-        url.query.add(
-          kj::Url::QueryParam { kj::str("specifier"), kj::str(specifier) }
-        );
-      }
-      KJ_IF_SOME(ref, referrer) {
-        url.query.add(
-          kj::Url::QueryParam { kj::str("referrer"), kj::mv(ref) }
-        );
-      }
-
-      auto spec = url.toString(kj::Url::HTTP_REQUEST);
-
-      {
-        // Module loading in workerd is expected to be synchronous but we need to perform
-        // an async HTTP request to the fallback service. To accomplish that we wrap the
-        // actual request in a kj::Thread, perform the GET, and drop the thread immediately
-        // so that the destructor joins the current thread (blocking it). The thread will
-        // either set the jsonPayload variable or not.
-        kj::Thread loaderThread(
-          [&spec,
-           referrer=kj::mv(referrer),
-           address=address.asPtr(),
-           &jsonPayload,
-           &redirect,
-           method]() mutable {
-          try {
-            const auto toStr = [](jsg::ModuleRegistry::ResolveMethod method) {
-              switch (method) {
-                case jsg::ModuleRegistry::ResolveMethod::IMPORT: return "import"_kjc;
-                case jsg::ModuleRegistry::ResolveMethod::REQUIRE: return "require"_kjc;
-              }
-              KJ_UNREACHABLE;
-            };
-
-            kj::AsyncIoContext io = kj::setupAsyncIo();
-
-            kj::HttpHeaderTable::Builder builder;
-            kj::HttpHeaderId kMethod = builder.add("x-resolve-method");
-            auto headerTable = builder.build();
-
-            auto addr = io.provider->getNetwork().parseAddress(address, 80).wait(io.waitScope);
-
-            auto client = kj::newHttpClient(
-                io.provider->getTimer(),
-                *headerTable,
-                *addr, { });
-
-            kj::HttpHeaders headers(*headerTable);
-            headers.set(kMethod, toStr(method));
-            headers.set(kj::HttpHeaderId::HOST, "localhost"_kj);
-
-            auto request = client->request(kj::HttpMethod::GET, spec, headers, kj::none);
-
-            kj::HttpClient::Response resp = request.response.wait(io.waitScope);
-
-            if (resp.statusCode == 301) {
-              // The fallback service responded with a redirect.
-              KJ_IF_SOME(loc, resp.headers->get(kj::HttpHeaderId::LOCATION)) {
-                redirect = true;
-                jsonPayload = kj::str(loc);
-              } else {
-                KJ_LOG(ERROR, "Fallback service returned a redirect with no location", spec);
-              }
-            } else if (resp.statusCode != 200) {
-              // Failed! Log the body of the respnose, if any, and fall through without
-              // setting jsonPayload to signal that the fallback service failed to return
-              // a module for this specifier.
-              auto payload = resp.body->readAllText().wait(io.waitScope);
-              KJ_LOG(ERROR, "Fallback service failed to fetch module", payload, spec);
-            } else {
-              jsonPayload = resp.body->readAllText().wait(io.waitScope);
-            }
-          } catch (...) {
-            auto exception = kj::getCaughtExceptionAsKj();
-            KJ_LOG(ERROR, "Fallback service failed to fetch module", exception, spec);
-          }
-        });
+      kj::StringPtr actualSpecifier = ModuleFallbackLoader::getModuleName(specifier);
+
+      // Module loading in workerd is expected to be synchronous, so this blocks until the
+      // loader thread has the response.
+      kj::Maybe<ModuleFallbackLoader::Response> response;
+      KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() {
+        response = loader->fetch(specifier, referrer.map([](kj::String& r) -> kj::StringPtr {
+          return r;
+        }), method);
+      })) {
+        KJ_LOG(ERROR, "Fallback service failed to fetch module", exception, specifier);
+        return kj::none;
       }
 
-      KJ_IF_SOME(payload, jsonPayload) {
+      KJ_IF_SOME(r, response) {
         // If the payload is empty then the fallback service failed to fetch the module.
-        if (payload.size() == 0) return kj::none;
+        if (r.payload.size() == 0) return kj::none;
 
         // If redirect is true then the fallback service returned a 301 redirect. The
         // payload is the specifier of the new target module.
-        if (redirect) {
-          return kj::Maybe(kj::mv(payload));
+        if (r.redirect) {
+          return kj::Maybe(kj::mv(r.payload));
         }
 
         // The response from the fallback service must be a valid JSON serialization
@@ -2810,7 +3790,7 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name, config::Worker::
           capnp::JsonCodec json;
           json.handleByAnnotation<config::Worker::Module>();
           auto moduleBuilder = moduleMessage.initRoot<config::Worker::Module>();
-          json.decode(payload, moduleBuilder);
+          json.decode(r.payload, moduleBuilder);
 
           // If the module fallback service returns a name in the module then it has to
           // match the specifier we passed in. This is an optional sanity check.
@@ -2834,12 +3814,12 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name, config::Worker::
           return module;
         } catch (...) {
           auto exception = kj::getCaughtExceptionAsKj();
-          KJ_LOG(ERROR, "Fallback service failed to fetch module", exception, spec);
+          KJ_LOG(ERROR, "Fallback service failed to fetch module", exception, specifier);
           return kj::none;
         }
       }
 
-      // If we got here, no jsonPayload was received and we return nothing.
+      // If we got here, the service had no module for us and we return nothing.
       return kj::none;
     });
   }
@@ -2936,6 +3916,17 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name, config::Worker::
               "to the service \"", diskName, "\", but that service is not a local disk service."));
         } else KJ_IF_SOME(dir, diskSvc->getWritable()) {
           result.actorStorage = kj::heap<SqliteDatabase::Vfs>(dir);
+          result.actorStorageDir = dir;
+          auto pitrConf = conf.getDurableObjectPointInTimeRecovery();
+          if (pitrConf.getEnabled()) {
+            result.actorPitrOptions = SqlitePitr::Options {
+              .retention = pitrConf.getRetentionDays() * kj::DAYS,
+              .maxLogSize = uint64_t(pitrConf.getMaxLogSizeMb()) << 20,
+            };
+          }
+          KJ_IF_SOME(options, actorGroupCommitOptions) {
+            result.actorGroupCommit = diskSvc->getGroupCommitScheduler(timer, options);
+          }
         } else {
           reportConfigError(kj::str("service ", name, ": durableObjectStorage config refers "
               "to the disk service \"", diskName, "\", but that service is defined read-only."));
@@ -2961,10 +3952,16 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name, config::Worker::
     return result;
   };
 
-  return kj::heap<WorkerService>(globalContext->threadContext, kj::mv(worker),
+  kj::Maybe<ThreadShard&> threadShard;
+  KJ_IF_SOME(s, shard) {
+    threadShard = *s;
+  }
+
+  return kj::heap<WorkerService>(globalContext->threadContext, name, kj::mv(worker),
                                  kj::mv(errorReporter.defaultEntrypoint),
                                  kj::mv(errorReporter.namedEntrypoints), localActorConfigs,
-                                 kj::mv(linkCallback), KJ_BIND_METHOD(*this, abortAllActors));
+                                 kj::mv(linkCallback), KJ_BIND_METHOD(*this, abortAllActors),
+                                 threadShard);
 }
 
 // =======================================================================================
@@ -2992,6 +3989,9 @@ kj::Own<Server::Service> Server::makeService(
 
     case config::Service::DISK:
       return makeDiskDirectoryService(name, conf.getDisk(), headerTableBuilder);
+
+    case config::Service::CACHE:
+      return kj::heap<CacheService>(*this, name, conf.getCache(), headerTableBuilder);
   }
 
   reportConfigError(kj::str(
@@ -3039,6 +4039,70 @@ Server::Service& Server::lookupService(
 
 // =======================================================================================
 
+// Exposes a single WorkerInterface as an rpc::EventDispatcher, for serving events delivered over
+// Cap'n Proto.
+class EventDispatcherImpl final: public rpc::EventDispatcher::Server {
+public:
+  EventDispatcherImpl(capnp::HttpOverCapnpFactory& httpOverCapnpFactory,
+                      kj::Own<WorkerInterface> worker)
+      : httpOverCapnpFactory(httpOverCapnpFactory), worker(kj::mv(worker)) {}
+
+  kj::Promise<void> getHttpService(GetHttpServiceContext context) override {
+    context.initResults(capnp::MessageSize{4, 1})
+        .setHttp(httpOverCapnpFactory.kjToCapnp(getWorker()));
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> sendTraces(SendTracesContext context) override {
+    throwUnsupported();
+  }
+
+  kj::Promise<void> prewarm(PrewarmContext context) override {
+    throwUnsupported();
+  }
+
+  kj::Promise<void> runScheduled(RunScheduledContext context) override {
+    throwUnsupported();
+  }
+
+  kj::Promise<void> runAlarm(RunAlarmContext context) override {
+    throwUnsupported();
+  }
+
+  kj::Promise<void> queue(QueueContext context) override {
+    throwUnsupported();
+  }
+
+  kj::Promise<void> jsRpcSession(JsRpcSessionContext context) override {
+    auto customEvent = kj::heap<api::JsRpcSessionCustomEventImpl>(
+        api::JsRpcSessionCustomEventImpl::WORKER_RPC_EVENT_TYPE);
+
+    auto cap = customEvent->getCap();
+    capnp::PipelineBuilder<JsRpcSessionResults> pipelineBuilder;
+    pipelineBuilder.setTopLevel(cap);
+    context.setPipeline(pipelineBuilder.build());
+    context.getResults().setTopLevel(kj::mv(cap));
+
+    auto worker = getWorker();
+    return worker->customEvent(kj::mv(customEvent)).ignoreResult().attach(kj::mv(worker));
+  }
+
+private:
+  capnp::HttpOverCapnpFactory& httpOverCapnpFactory;
+  kj::Maybe<kj::Own<WorkerInterface>> worker;
+
+  kj::Own<WorkerInterface> getWorker() {
+    auto result = kj::mv(KJ_ASSERT_NONNULL(worker,
+        "EventDispatcher can only be used for one request"));
+    worker = kj::none;
+    return result;
+  }
+
+  [[noreturn]] void throwUnsupported() {
+    JSG_FAIL_REQUIRE(Error, "RPC connections don't yet support this event type.");
+  }
+};
+
 class Server::HttpListener final: public kj::Refcounted {
 public:
   HttpListener(Server& owner, kj::Own<kj::ConnectionReceiver> listener, Service& service,
@@ -3051,6 +4115,13 @@ public:
         physicalProtocol(physicalProtocol),
         rewriter(kj::mv(rewriter)) {}
 
+  ~HttpListener() noexcept(false) {
+    if (compressionStats.responses > 0) {
+      KJ_LOG(INFO, "compressed responses", compressionStats.responses,
+          compressionStats.identityBytes, compressionStats.encodedBytes);
+    }
+  }
+
   kj::Promise<void> run() {
     TRACE_EVENT("workerd", "HttpListener::run");
     for (;;) {
@@ -3122,6 +4193,14 @@ private:
   kj::StringPtr physicalProtocol;
   kj::Own<HttpRewriter> rewriter;
 
+  // Totals for `HttpOptions.compressResponses`.
+  struct CompressionStats {
+    uint64_t responses = 0;
+    uint64_t identityBytes = 0;
+    uint64_t encodedBytes = 0;
+  };
+  CompressionStats compressionStats;
+
   kj::Maybe<capnp::TwoPartyServer> capnpServer;
 
   kj::Promise<void> acceptCapnpConnection(kj::AsyncIoStream& conn) {
@@ -3145,7 +4224,8 @@ private:
       //   configrued, which hints that this service trusts the client to provide the cf blob.)
 
       context.initResults(capnp::MessageSize {4, 1}).setDispatcher(
-          kj::heap<EventDispatcherImpl>(parent, parent.service.startRequest({})));
+          kj::heap<EventDispatcherImpl>(parent.httpOverCapnpFactory,
+              parent.service.startRequest({})));
       return kj::READY_NOW;
     }
 
@@ -3153,67 +4233,6 @@ private:
     HttpListener& parent;
   };
 
-  class EventDispatcherImpl final: public rpc::EventDispatcher::Server {
-  public:
-    EventDispatcherImpl(HttpListener& parent, kj::Own<WorkerInterface> worker)
-        : parent(parent), worker(kj::mv(worker)) {}
-
-    kj::Promise<void> getHttpService(GetHttpServiceContext context) override {
-      context.initResults(capnp::MessageSize{4, 1})
-          .setHttp(parent.httpOverCapnpFactory.kjToCapnp(getWorker()));
-      return kj::READY_NOW;
-    }
-
-    kj::Promise<void> sendTraces(SendTracesContext context) override {
-      throwUnsupported();
-    }
-
-    kj::Promise<void> prewarm(PrewarmContext context) override {
-      throwUnsupported();
-    }
-
-    kj::Promise<void> runScheduled(RunScheduledContext context) override {
-      throwUnsupported();
-    }
-
-    kj::Promise<void> runAlarm(RunAlarmContext context) override {
-      throwUnsupported();
-    }
-
-    kj::Promise<void> queue(QueueContext context) override {
-      throwUnsupported();
-    }
-
-    kj::Promise<void> jsRpcSession(JsRpcSessionContext context) override {
-      auto customEvent = kj::heap<api::JsRpcSessionCustomEventImpl>(
-          api::JsRpcSessionCustomEventImpl::WORKER_RPC_EVENT_TYPE);
-
-      auto cap = customEvent->getCap();
-      capnp::PipelineBuilder<JsRpcSessionResults> pipelineBuilder;
-      pipelineBuilder.setTopLevel(cap);
-      context.setPipeline(pipelineBuilder.build());
-      context.getResults().setTopLevel(kj::mv(cap));
-
-      auto worker = getWorker();
-      return worker->customEvent(kj::mv(customEvent)).ignoreResult().attach(kj::mv(worker));
-    }
-
-  private:
-    HttpListener& parent;
-    kj::Maybe<kj::Own<WorkerInterface>> worker;
-
-    kj::Own<WorkerInterface> getWorker() {
-      auto result = kj::mv(KJ_ASSERT_NONNULL(worker,
-          "EventDispatcher can only be used for one request"));
-      worker = kj::none;
-      return result;
-    }
-
-    [[noreturn]] void throwUnsupported() {
-      JSG_FAIL_REQUIRE(Error, "RPC connections don't yet support this event type.");
-    }
-  };
-
   struct Connection final: public kj::HttpService, public kj::HttpServerErrorHandler {
     Connection(HttpListener& parent, kj::Maybe<kj::String> cfBlobJson)
         : parent(parent), cfBlobJson(kj::mv(cfBlobJson)),
@@ -3228,8 +4247,11 @@ private:
 
     class ResponseWrapper final: public kj::HttpService::Response {
     public:
-      ResponseWrapper(kj::HttpService::Response& inner, HttpRewriter& rewriter)
-          : inner(inner), rewriter(rewriter) {}
+      ResponseWrapper(kj::HttpService::Response& inner, HttpRewriter& rewriter,
+                      kj::Maybe<HttpRewriter::ResponseEncoding> encoding,
+                      CompressionStats& compressionStats)
+          : inner(inner), rewriter(rewriter), encoding(encoding),
+            compressionStats(compressionStats) {}
 
       kj::Own<kj::AsyncOutputStream> send(
           uint statusCode, kj::StringPtr statusText, const kj::HttpHeaders& headers,
@@ -3237,6 +4259,18 @@ private:
         TRACE_EVENT("workerd", "ResponseWrapper::send()");
         auto rewrite = headers.cloneShallow();
         rewriter.rewriteResponse(rewrite);
+        if (rewriter.rewriteCompressedResponse(statusCode, rewrite, expectedBodySize, encoding)) {
+          // The body is written into a pipe, and compressed on its way from the pipe to the
+          // client. Unlike wrapping the body stream directly, this finds out where the body
+          // ends (so that we can finish the compressed stream) when the writer drops its end,
+          // which every writer does.
+          auto& e = KJ_ASSERT_NONNULL(encoding);
+          auto body = inner.send(statusCode, statusText, rewrite, kj::none);
+          auto pipe = kj::newOneWayPipe();
+          compressionTask = compressBody(kj::mv(pipe.in), kj::mv(body), e,
+              rewriter.getCompressionLevel(e)).eagerlyEvaluate(nullptr);
+          return kj::mv(pipe.out);
+        }
         return inner.send(statusCode, statusText, rewrite, expectedBodySize);
       }
 
@@ -3247,9 +4281,41 @@ private:
         return inner.acceptWebSocket(rewrite);
       }
 
+      // Waits for the compressed body, if any, to be written out in full. Must be called after
+      // the request has completed, when the body's writer has dropped the stream.
+      kj::Promise<void> finish() {
+        KJ_IF_SOME(task, compressionTask) {
+          co_await kj::mv(task);
+        }
+      }
+
     private:
       kj::HttpService::Response& inner;
       HttpRewriter& rewriter;
+      kj::Maybe<HttpRewriter::ResponseEncoding> encoding;
+      CompressionStats& compressionStats;
+      kj::Maybe<kj::Promise<void>> compressionTask;
+
+      kj::Promise<void> compressBody(kj::Own<kj::AsyncInputStream> in,
+                                     kj::Own<kj::AsyncOutputStream> out,
+                                     HttpRewriter::ResponseEncoding encoding, int level) {
+        ++compressionStats.responses;
+        ByteCountingOutputStream counted(*out, compressionStats.encodedBytes);
+        switch (encoding) {
+          case HttpRewriter::ResponseEncoding::GZIP: {
+            kj::GzipAsyncOutputStream gzip(counted, level);
+            compressionStats.identityBytes += co_await in->pumpTo(gzip);
+            co_await gzip.end();
+            break;
+          }
+          case HttpRewriter::ResponseEncoding::BROTLI: {
+            kj::BrotliAsyncOutputStream brotli(counted, level);
+            compressionStats.identityBytes += co_await in->pumpTo(brotli);
+            co_await brotli.end();
+            break;
+          }
+        }
+      }
     };
 
     // ---------------------------------------------------------------------------
@@ -3264,8 +4330,10 @@ private:
 
       Response* wrappedResponse = &response;
       kj::Own<ResponseWrapper> ownResponse;
-      if (parent.rewriter->needsRewriteResponse()) {
-        wrappedResponse = ownResponse = kj::heap<ResponseWrapper>(response, *parent.rewriter);
+      auto encoding = parent.rewriter->negotiateResponseEncoding(method, headers);
+      if (parent.rewriter->needsRewriteResponse() || parent.rewriter->compressesResponses()) {
+        wrappedResponse = ownResponse = kj::heap<ResponseWrapper>(
+            response, *parent.rewriter, encoding, parent.compressionStats);
       }
 
       if (parent.rewriter->needsRewriteRequest() || cfBlobJson != kj::none) {
@@ -3275,11 +4343,14 @@ private:
           co_return co_await response.sendError(400, "Bad Request", parent.headerTable);
         });
         auto worker = parent.service.startRequest(kj::mv(metadata));
-        co_return co_await worker->request(method, url, *rewrite.headers, requestBody,
-                                           *wrappedResponse);
+        co_await worker->request(method, url, *rewrite.headers, requestBody, *wrappedResponse);
       } else {
         auto worker = parent.service.startRequest(kj::mv(metadata));
-        co_return co_await worker->request(method, url, headers, requestBody, *wrappedResponse);
+        co_await worker->request(method, url, headers, requestBody, *wrappedResponse);
+      }
+
+      if (ownResponse.get() != nullptr) {
+        co_await ownResponse->finish();
       }
     }
 
@@ -3324,12 +4395,394 @@ kj::Promise<void> Server::listenHttp(
   co_return co_await obj->run();
 }
 
+// =======================================================================================
+// Worker threads
+
+// Served by every thread to every other thread, to start events on the Durable Objects it owns.
+class Server::ActorRouterImpl final: public rpc::WorkerdActorRouter::Server {
+public:
+  ActorRouterImpl(workerd::server::Server& owner): owner(owner) {}
+
+  kj::Promise<void> startActorEvent(StartActorEventContext context) override {
+    auto params = context.getParams();
+    auto serviceName = params.getServiceName();
+    auto className = params.getClassName();
+
+    auto& service = KJ_REQUIRE_NONNULL(owner.services.find(serviceName),
+        "no such service", serviceName);
+    auto& worker = KJ_REQUIRE_NONNULL(kj::dynamicDowncastIfAvailable<WorkerService>(*service),
+        "service is not a Worker", serviceName);
+    auto& ns = KJ_REQUIRE_NONNULL(worker.getActorNamespace(className),
+        "no such actor namespace", serviceName, className);
+
+    IoChannelFactory::SubrequestMetadata metadata;
+    if (params.hasCfBlobJson()) {
+      metadata.cfBlobJson = kj::str(params.getCfBlobJson());
+    }
+
+    context.initResults(capnp::MessageSize {4, 1}).setDispatcher(
+        kj::heap<EventDispatcherImpl>(owner.globalContext->httpOverCapnpFactory,
+            ns.getActor(kj::str(params.getActorId()), kj::mv(metadata))));
+    return kj::READY_NOW;
+  }
+
+private:
+  workerd::server::Server& owner;
+};
+
+// Stands in for a listening socket on a replica thread, producing the connections that the
+// primary thread's ShardingConnectionReceiver handed to us.
+class Server::ConnectionQueue final: public kj::ConnectionReceiver {
+public:
+  ConnectionQueue(kj::LowLevelAsyncIoProvider& provider, kj::Network& network)
+      : provider(provider), network(network) {}
+
+  void push(kj::AutoCloseFd fd) {
+    KJ_IF_SOME(w, waiter) {
+      if (w->isWaiting()) {
+        w->fulfill(kj::mv(fd));
+        waiter = kj::none;
+        return;
+      }
+      waiter = kj::none;
+    }
+    pending.push_back(kj::mv(fd));
+  }
+
+  kj::Promise<kj::Own<kj::AsyncIoStream>> accept() override {
+    auto result = co_await acceptAuthenticated();
+    co_return kj::mv(result.stream);
+  }
+
+  kj::Promise<kj::AuthenticatedStream> acceptAuthenticated() override {
+    kj::AutoCloseFd fd;
+    if (pending.empty()) {
+      auto paf = kj::newPromiseAndFulfiller<kj::AutoCloseFd>();
+      waiter = kj::mv(paf.fulfiller);
+      fd = co_await paf.promise;
+    } else {
+      fd = kj::mv(pending.front());
+      pending.pop_front();
+    }
+
+    // Recover the client address so that the cf blob still reports it. Unix socket credentials
+    // are not recovered.
+    kj::Own<kj::PeerIdentity> peerIdentity;
+#if !_WIN32
+    struct sockaddr_storage addr;
+    socklen_t addrLen = sizeof(addr);
+    if (getpeername(fd, reinterpret_cast<struct sockaddr*>(&addr), &addrLen) == 0 &&
+        (addr.ss_family == AF_INET || addr.ss_family == AF_INET6)) {
+      peerIdentity = kj::NetworkPeerIdentity::newInstance(network.getSockaddr(&addr, addrLen));
+    }
+#endif
+    if (peerIdentity.get() == nullptr) {
+      peerIdentity = kj::UnknownPeerIdentity::newInstance();
+    }
+
+    co_return kj::AuthenticatedStream {
+      .stream = provider.wrapSocketFd(fd.release(),
+          kj::LowLevelAsyncIoProvider::TAKE_OWNERSHIP |
+          kj::LowLevelAsyncIoProvider::ALREADY_CLOEXEC),
+      .peerIdentity = kj::mv(peerIdentity),
+    };
+  }
+
+  uint getPort() override {
+    // The real port belongs to the primary thread.
+    return 0;
+  }
+
+private:
+  kj::LowLevelAsyncIoProvider& provider;
+  kj::Network& network;
+  std::deque<kj::AutoCloseFd> pending;
+  kj::Maybe<kj::Own<kj::PromiseFulfiller<kj::AutoCloseFd>>> waiter;
+};
+
+// A replica thread. It runs its own `Server` -- and so its own ThreadContext and its own instance
+// of every Worker -- over a private copy of the config, but doesn't listen on any sockets itself.
+class Server::ReplicaThread {
+public:
+  ReplicaThread(Server& primary, uint index, jsg::V8System& v8System,
+                config::Config::Reader config, kj::Array<kj::AutoCloseFd> peerFds)
+      : done(nullptr) {
+    // Copy everything the thread needs from the primary now, since the primary's config reader and
+    // overrides aren't safe to touch from another thread.
+    kj::HashMap<kj::String, kj::String> directoryOverrides;
+    for (auto& entry: primary.directoryOverrides) {
+      directoryOverrides.insert(kj::str(entry.key), kj::str(entry.value));
+    }
+    kj::HashMap<kj::String, kj::String> externalOverrides;
+    for (auto& entry: primary.externalOverrides) {
+      externalOverrides.insert(kj::str(entry.key), kj::str(entry.value));
+    }
+
+    auto paf = kj::newPromiseAndCrossThreadFulfiller<void>();
+    done = kj::mv(paf.promise);
+
+    thread = kj::heap<kj::Thread>(
+        [this, &primary, index, &v8System, config = capnp::clone(config),
+         peerFds = kj::mv(peerFds), directoryOverrides = kj::mv(directoryOverrides),
+         externalOverrides = kj::mv(externalOverrides),
+         doneFulfiller = kj::mv(paf.fulfiller)]() mutable {
+      KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() {
+        main(primary, index, v8System, *config, kj::mv(peerFds),
+             kj::mv(directoryOverrides), kj::mv(externalOverrides));
+      })) {
+        KJ_LOG(ERROR, "worker thread failed", index, exception);
+        doneFulfiller->reject(kj::mv(exception));
+      } else {
+        doneFulfiller->fulfill();
+      }
+    });
+  }
+
+  ~ReplicaThread() noexcept(false) {
+    // Make sure the thread winds down, otherwise destroying `thread` would block forever.
+    drain();
+  }
+
+  // Gives the thread a connection accepted on the socket named `socketName`. Never blocks: if the
+  // thread is still starting up, the connection waits in a backlog that the thread picks up once
+  // it is ready.
+  void handOff(kj::StringPtr socketName, kj::AutoCloseFd fd) {
+    auto lock = state.lockExclusive();
+    KJ_IF_SOME(r, lock->ready) {
+      r.executor->executeAsync(
+          [&queues = r.queues, name = kj::str(socketName), fd = kj::mv(fd)]() mutable {
+        KJ_IF_SOME(queue, queues.find(name)) {
+          queue->push(kj::mv(fd));
+        }
+      }).detach([](kj::Exception&& e) {
+        KJ_LOG(ERROR, "failed to hand off connection to worker thread", e);
+      });
+    } else if (!lock->exited) {
+      lock->backlog.add(Pending { kj::str(socketName), kj::mv(fd) });
+    }
+    // Otherwise the thread has exited, and dropping `fd` closes the connection.
+  }
+
+  // Tells the thread to drain, as `drainWhen` does for the primary.
+  void drain() {
+    auto lock = state.lockExclusive();
+    if (lock->drainRequested) return;
+    lock->drainRequested = true;
+    KJ_IF_SOME(r, lock->ready) {
+      r.drainFulfiller->fulfill();
+    }
+  }
+
+  // Resolves when the thread's server has finished running. Can only be called once.
+  kj::Promise<void> onDone() {
+    return kj::mv(done);
+  }
+
+private:
+  struct Ready {
+    kj::Own<const kj::Executor> executor;
+    kj::HashMap<kj::String, kj::Own<ConnectionQueue>>& queues;
+    kj::Own<kj::CrossThreadPromiseFulfiller<void>> drainFulfiller;
+  };
+  struct Pending {
+    kj::String socketName;
+    kj::AutoCloseFd fd;
+  };
+  struct State {
+    // Set once the thread is ready to accept connections.
+    kj::Maybe<Ready> ready;
+    // Connections handed off before `ready` was set.
+    kj::Vector<Pending> backlog;
+    bool drainRequested = false;
+    bool exited = false;
+  };
+  kj::MutexGuarded<State> state;
+
+  kj::Promise<void> done;
+
+  // Declared last, so that the thread is joined before anything it uses is destroyed.
+  kj::Own<kj::Thread> thread;
+
+  void main(Server& primary, uint index, jsg::V8System& v8System,
+            config::Config::Reader config, kj::Array<kj::AutoCloseFd> peerFds,
+            kj::HashMap<kj::String, kj::String> directoryOverrides,
+            kj::HashMap<kj::String, kj::String> externalOverrides) {
+    KJ_DEFER({
+      auto lock = state.lockExclusive();
+      lock->ready = kj::none;
+      lock->exited = true;
+      lock->backlog.clear();
+    });
+
+    kj::AsyncIoContext io = kj::setupAsyncIo();
+    auto& network = io.provider->getNetwork();
+
+    kj::HashMap<kj::String, kj::Own<ConnectionQueue>> queues;
+    for (auto sock: config.getSockets()) {
+      if (queues.find(sock.getName()) == kj::none) {
+        queues.insert(kj::str(sock.getName()),
+                      kj::heap<ConnectionQueue>(*io.lowLevelProvider, network));
+      }
+    }
+
+    auto [drainPromise, drainFulfiller] = kj::newPromiseAndCrossThreadFulfiller<void>();
+
+    // Config errors are the same on every thread, so we leave reporting them to the primary.
+    Server server(primary.fs, io.provider->getTimer(), network, primary.entropySource,
+                  primary.consoleMode, [](kj::String) {});
+    server.experimental = primary.experimental;
+    server.memoryCacheProvider = kj::Own<api::MemoryCacheProvider>(
+        primary.memoryCacheProvider.get(), kj::NullDisposer::instance);
+    server.httpCaches = kj::Own<const HttpCaches>(
+        primary.httpCaches.get(), kj::NullDisposer::instance);
+    server.directoryOverrides = kj::mv(directoryOverrides);
+    server.externalOverrides = kj::mv(externalOverrides);
+    for (auto& queue: queues) {
+      server.overrideSocket(kj::str(queue.key),
+          kj::Own<kj::ConnectionReceiver>(queue.value.get(), kj::NullDisposer::instance));
+    }
+    server.shard = server.makeThreadShard(index, kj::mv(peerFds), *io.lowLevelProvider);
+
+    {
+      auto lock = state.lockExclusive();
+      auto& ready = lock->ready.emplace(Ready {
+        .executor = kj::getCurrentThreadExecutor().addRef(),
+        .queues = queues,
+        .drainFulfiller = kj::mv(drainFulfiller),
+      });
+      for (auto& pending: lock->backlog) {
+        KJ_IF_SOME(queue, queues.find(pending.socketName)) {
+          queue->push(kj::mv(pending.fd));
+        }
+      }
+      lock->backlog.clear();
+      if (lock->drainRequested) {
+        ready.drainFulfiller->fulfill();
+      }
+    }
+
+    server.run(v8System, config, kj::mv(drainPromise)).wait(io.waitScope);
+  }
+};
+
+// Wraps a listening socket on the primary thread, spreading accepted connections round-robin
+// over all threads. Connections destined for a replica are handed off as a raw file descriptor
+// before any TLS handshake, so the replica does the handshake itself.
+class Server::ShardingConnectionReceiver final: public kj::ConnectionReceiver {
+public:
+  ShardingConnectionReceiver(Server& owner, kj::StringPtr socketName,
+                             kj::Own<kj::ConnectionReceiver> inner)
+      : owner(owner), socketName(socketName), inner(kj::mv(inner)) {}
+
+  kj::Promise<kj::Own<kj::AsyncIoStream>> accept() override {
+    auto result = co_await acceptAuthenticated();
+    co_return kj::mv(result.stream);
+  }
+
+  kj::Promise<kj::AuthenticatedStream> acceptAuthenticated() override {
+    for (;;) {
+      auto result = co_await inner->acceptAuthenticated();
+
+      // Thread 0 is this one; the rest are replicas.
+      uint thread = nextThread++ % (owner.replicas.size() + 1);
+#if !_WIN32
+      if (thread > 0) {
+        KJ_IF_SOME(fd, result.stream->getFd()) {
+          int ownFd;
+          KJ_SYSCALL(ownFd = fcntl(fd, F_DUPFD_CLOEXEC, 0));
+          owner.replicas[thread - 1]->handOff(socketName, kj::AutoCloseFd(ownFd));
+          continue;
+        }
+        // Not backed by a file descriptor, so it can't move threads. Serve it here.
+      }
+#endif
+      co_return kj::mv(result);
+    }
+  }
+
+  uint getPort() override {
+    return inner->getPort();
+  }
+
+private:
+  Server& owner;
+  kj::StringPtr socketName;
+  kj::Own<kj::ConnectionReceiver> inner;
+  uint nextThread = 0;
+};
+
+kj::Own<Server::ThreadShard> Server::makeThreadShard(
+    uint index, kj::Array<kj::AutoCloseFd> peerFds, kj::LowLevelAsyncIoProvider& provider) {
+  auto result = kj::heap<ThreadShard>();
+  result->index = index;
+
+  auto peers = kj::heapArrayBuilder<kj::Maybe<kj::Own<ThreadShard::Peer>>>(peerFds.size());
+  for (auto i: kj::indices(peerFds)) {
+    if (i == index) {
+      peers.add(kj::none);
+      continue;
+    }
+
+    // Both ends serve the same bootstrap interface; the sides only need to differ.
+    auto side = i < index ? capnp::rpc::twoparty::Side::SERVER
+                          : capnp::rpc::twoparty::Side::CLIENT;
+    peers.add(kj::heap<ThreadShard::Peer>(
+        provider.wrapSocketFd(peerFds[i].release(),
+            kj::LowLevelAsyncIoProvider::TAKE_OWNERSHIP |
+            kj::LowLevelAsyncIoProvider::ALREADY_CLOEXEC),
+        kj::heap<ActorRouterImpl>(*this), side));
+  }
+  result->peers = peers.finish();
+
+  return result;
+}
+
+void Server::startWorkerThreads(jsg::V8System& v8System, config::Config::Reader config,
+                                uint threadCount) {
+#if _WIN32
+  reportConfigError(kj::str(
+      "`workerThreads` is not supported on Windows. Serving on a single thread."));
+#else
+  auto& provider = KJ_UNWRAP_OR(lowLevelProvider, {
+    reportConfigError(kj::str(
+        "`workerThreads` is not supported in this environment. Serving on a single thread."));
+    return;
+  });
+
+  // Connect every pair of threads with a socketpair. peerFds[i][j] is thread i's end of its
+  // connection to thread j.
+  auto peerFds = KJ_MAP(i, kj::zeroTo(threadCount)) {
+    return kj::heapArray<kj::AutoCloseFd>(threadCount);
+  };
+  for (uint i: kj::zeroTo(threadCount)) {
+    for (uint j: kj::range(i + 1, threadCount)) {
+      int fds[2];
+      KJ_SYSCALL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+      peerFds[i][j] = kj::AutoCloseFd(fds[0]);
+      peerFds[j][i] = kj::AutoCloseFd(fds[1]);
+      KJ_SYSCALL(fcntl(fds[0], F_SETFD, FD_CLOEXEC));
+      KJ_SYSCALL(fcntl(fds[1], F_SETFD, FD_CLOEXEC));
+    }
+  }
+
+  shard = makeThreadShard(0, kj::mv(peerFds[0]), provider);
+
+  for (uint i: kj::range(1u, threadCount)) {
+    replicas.add(kj::heap<ReplicaThread>(*this, i, v8System, config, kj::mv(peerFds[i])));
+  }
+#endif
+}
+
 // =======================================================================================
 // Server::run()
 
 kj::Promise<void> Server::handleDrain(kj::Promise<void> drainWhen) {
   co_await drainWhen;
   TRACE_EVENT("workerd", "Server::handleDrain()");
+  for (auto& replica: replicas) {
+    replica->drain();
+  }
+
   // Tell all HttpServers to drain. This causes them to disconnect any connections that don't
   // have a request in-flight.
   auto drainPromises = kj::heapArrayBuilder<kj::Promise<void>>(httpServers.size());
@@ -3351,8 +4804,23 @@ kj::Promise<void> Server::run(jsg::V8System& v8System, config::Config::Reader co
 
   auto forkedDrainWhen = handleDrain(kj::mv(drainWhen)).fork();
 
+  // Replicas are started with `shard` already set, and must not start threads of their own.
+  if (config.getWorkerThreads() > 1 && shard == kj::none) {
+    startWorkerThreads(v8System, config, config.getWorkerThreads());
+  }
+
   startServices(v8System, config, headerTableBuilder, forkedDrainWhen);
 
+  KJ_IF_SOME(c, codeCache) {
+    auto stats = c->getStats();
+    KJ_LOG(INFO, "V8 code cache after startup", stats.hits, stats.misses, stats.rejected);
+  }
+
+  if (uint budgetMb = config.getActorMemoryBudgetMb(); budgetMb > 0) {
+    size_t budget = size_t(budgetMb) * 1024 * 1024 / kj::max(config.getWorkerThreads(), 1u);
+    tasks.add(enforceActorMemoryBudget(budget).exclusiveJoin(forkedDrainWhen.addBranch()));
+  }
+
   auto listenPromise = listenOnSockets(config, headerTableBuilder, forkedDrainWhen);
 
   // We should have registered all headers synchronously. This is important because we want to
@@ -3360,7 +4828,12 @@ kj::Promise<void> Server::run(jsg::V8System& v8System, config::Config::Reader co
   // services take longer to get ready.
   auto ownHeaderTable = headerTableBuilder.build();
 
-  co_return co_await listenPromise.exclusiveJoin(kj::mv(fatalPromise));
+  co_await listenPromise.exclusiveJoin(kj::mv(fatalPromise));
+
+  // The replicas were told to drain along with us. Wait for them to finish too.
+  for (auto& replica: replicas) {
+    co_await replica->onDone();
+  }
 }
 
 void Server::startAlarmScheduler(config::Config::Reader config) {
@@ -3444,7 +4917,8 @@ void Server::startServices(jsg::V8System& v8System, config::Config::Reader confi
             serviceActorConfigs.insert(kj::str(ns.getClassName()),
                 Durable {
                     .uniqueKey = kj::str(ns.getUniqueKey()),
-                    .isEvictable = !ns.getPreventEviction() });
+                    .isEvictable = !ns.getPreventEviction(),
+                    .idleTimeout = ns.getIdleTimeoutMs() * kj::MILLISECONDS });
             continue;
           case config::Worker::DurableObjectNamespace::EPHEMERAL_LOCAL:
             if (!experimental) {
@@ -3454,7 +4928,9 @@ void Server::startServices(jsg::V8System& v8System, config::Config::Reader confi
                   "workerd with `--experimental` to use this feature."));
             }
             serviceActorConfigs.insert(kj::str(ns.getClassName()),
-                Ephemeral { .isEvictable = !ns.getPreventEviction() });
+                Ephemeral {
+                    .isEvictable = !ns.getPreventEviction(),
+                    .idleTimeout = ns.getIdleTimeoutMs() * kj::MILLISECONDS });
             continue;
         }
         reportConfigError(kj::str(
@@ -3509,7 +4985,48 @@ void Server::startServices(jsg::V8System& v8System, config::Config::Reader confi
   }
 
   // Second pass: Build services.
-  for (auto serviceConf: config.getServices()) {
+  //
+  // Workers are compiled as they are built, so the code cache's disk service, if any, is built
+  // ahead of the rest.
+  auto serviceConfs = config.getServices();
+  size_t codeCacheServiceIndex = serviceConfs.size();  // i.e. none
+  if (config.hasV8CodeCache()) {
+    kj::StringPtr diskName = config.getV8CodeCache();
+    for (auto i: kj::indices(serviceConfs)) {
+      auto serviceConf = serviceConfs[i];
+      if (serviceConf.getName() != diskName) continue;
+
+      auto service = makeService(serviceConf, headerTableBuilder, config.getExtensions());
+      auto diskSvc = dynamic_cast<DiskDirectoryService*>(service.get());
+      if (diskSvc == nullptr) {
+        if (serviceConf.isDisk()) {
+          // The directory couldn't be opened, which was already reported.
+        } else {
+          reportConfigError(kj::str("v8CodeCache config refers to the service \"", diskName,
+              "\", but that service is not a local disk service."));
+        }
+      } else KJ_IF_SOME(dir, diskSvc->getWritable()) {
+        codeCache = kj::heap<CodeCache>(dir, config.getV8CodeCacheAfterStartup());
+      } else {
+        reportConfigError(kj::str("v8CodeCache config refers to the disk service \"", diskName,
+            "\", but that service is defined read-only."));
+      }
+
+      services.insert(kj::str(diskName), kj::mv(service));
+      codeCacheServiceIndex = i;
+      break;
+    }
+
+    if (codeCacheServiceIndex == serviceConfs.size()) {
+      reportConfigError(kj::str("v8CodeCache config refers to a service \"", diskName,
+          "\", but no such service is defined."));
+    }
+  }
+
+  for (auto i: kj::indices(serviceConfs)) {
+    if (codeCacheServiceIndex == i) continue;
+
+    auto serviceConf = serviceConfs[i];
     kj::StringPtr name = serviceConf.getName();
     auto service = makeService(serviceConf, headerTableBuilder, config.getExtensions());
 
@@ -3541,6 +5058,13 @@ void Server::startServices(jsg::V8System& v8System, config::Config::Reader confi
   // Start the alarm scheduler before linking services
   startAlarmScheduler(config);
 
+  if (uint latencyUs = config.getActorGroupCommitMaxLatencyUs(); latencyUs > 0) {
+    actorGroupCommitOptions = GroupCommitScheduler::Options {
+      .maxLatency = latencyUs * kj::MICROSECONDS,
+      .maxBatchSize = kj::max(config.getActorGroupCommitMaxBatch(), 1u),
+    };
+  }
+
   // Third pass: Cross-link services.
   for (auto& service: services) {
     service.value->link();
@@ -3619,6 +5143,14 @@ kj::Promise<void> Server::listenOnSockets(config::Config::Reader config,
       })(network.parseAddress(addrStr, defaultPort));
     }
 
+    if (!replicas.empty()) {
+      listener = ([](Server& server, kj::StringPtr name, PromisedReceived promise)
+          -> PromisedReceived {
+        auto port = co_await promise;
+        co_return kj::heap<ShardingConnectionReceiver>(server, name, kj::mv(port));
+      })(*this, name, kj::mv(listener));
+    }
+
     KJ_IF_SOME(t, tls) {
       listener = ([](kj::Promise<kj::Own<kj::ConnectionReceiver>> promise,
                      kj::Own<kj::TlsContext> tls)
@@ -13,6 +13,7 @@
 #include <workerd/server/workerd.capnp.h>
 #include <workerd/util/sqlite.h>
 #include <workerd/server/alarm-scheduler.h>
+#include <workerd/server/group-commit.h>
 #include <kj/compat/http.h>
 
 namespace kj {
@@ -59,6 +60,14 @@ public:
     controlOverride = kj::heap<kj::FdOutputStream>(fd);
   }
 
+  // Provides the low-level I/O provider needed to honor `Config.workerThreads`, which hands
+  // connections and Durable Object traffic between threads as raw file descriptors. If this is
+  // never called, a config that asks for more than one thread is reported as an error and served
+  // on a single thread.
+  void enableWorkerThreads(kj::LowLevelAsyncIoProvider& provider) {
+    lowLevelProvider = provider;
+  }
+
   // Runs the server using the given config.
   kj::Promise<void> run(jsg::V8System& v8System, config::Config::Reader conf,
                         kj::Promise<void> drainWhen = kj::NEVER_DONE);
@@ -75,9 +84,11 @@ public:
   struct Durable {
     kj::String uniqueKey;
     bool isEvictable;
+    kj::Duration idleTimeout = 10 * kj::SECONDS;
   };
   struct Ephemeral {
     bool isEvictable;
+    kj::Duration idleTimeout = 10 * kj::SECONDS;
   };
   using ActorConfig = kj::OneOf<Durable, Ephemeral>;
 
@@ -97,6 +108,11 @@ private:
 
   kj::Own<api::MemoryCacheProvider> memoryCacheProvider;
 
+  // The HTTP caches of cache services, by service name. Replica threads (see `ThreadShard`) point
+  // at the primary's, so that all threads share each cache.
+  struct HttpCaches;
+  kj::Own<const HttpCaches> httpCaches;
+
   kj::HashMap<kj::String, kj::OneOf<kj::String, kj::Own<kj::ConnectionReceiver>>> socketOverrides;
   kj::HashMap<kj::String, kj::String> directoryOverrides;
 
@@ -110,6 +126,8 @@ private:
   kj::Maybe<kj::Own<InspectorServiceIsolateRegistrar>> inspectorIsolateRegistrar;
   kj::Maybe<kj::Own<kj::FdOutputStream>> controlOverride;
 
+  kj::Maybe<kj::LowLevelAsyncIoProvider&> lowLevelProvider;
+
   struct GlobalContext;
   // General context needed to construct workers. Initilaized early in run().
   kj::Own<GlobalContext> globalContext;
@@ -117,6 +135,15 @@ private:
   class Service;
   kj::Own<Service> invalidConfigServiceSingleton;
 
+  // Set up by startServices() if the config specifies `v8CodeCache`. Must outlive `services`,
+  // whose isolates refer to it.
+  class CodeCache;
+  kj::Maybe<kj::Own<CodeCache>> codeCache;
+
+  // Loaders for module fallback services, by address. Shared by all Workers using the service.
+  class ModuleFallbackLoader;
+  kj::HashMap<kj::String, kj::Own<const ModuleFallbackLoader>> moduleFallbackLoaders;
+
   // Information about all known actor namespaces. Maps serviceName -> className -> config.
   // This needs to be populated in advance of constructing any services, in order to be able to
   // correctly construct dependent services.
@@ -129,6 +156,9 @@ private:
   // Initialized in startAlarmScheduler().
   kj::Own<AlarmScheduler> alarmScheduler;
 
+  // Set by startServices() if the config enables `actorGroupCommitMaxLatencyUs`.
+  kj::Maybe<GroupCommitScheduler::Options> actorGroupCommitOptions;
+
   // An HttpServer object maintained in a linked list.
   struct ListedHttpServer {
     Server& owner;
@@ -148,6 +178,22 @@ private:
   // All active HttpServer objects -- used to implement drain().
   kj::List<ListedHttpServer, &ListedHttpServer::link> httpServers;
 
+  // State for running with `Config.workerThreads` greater than one. The thread that calls run()
+  // is the "primary": it starts the other threads ("replicas"), each of which runs its own
+  // `Server` over the same config, and listens on the sockets on behalf of all of them.
+  struct ThreadShard;
+  class ReplicaThread;
+  class ActorRouterImpl;
+  class ConnectionQueue;
+  class ShardingConnectionReceiver;
+
+  // Replica threads. Only non-empty on the primary.
+  kj::Vector<kj::Own<ReplicaThread>> replicas;
+
+  // Set on every thread when running with multiple threads. Declared after `replicas` so that
+  // connections to the replicas are closed before we wait for them to exit.
+  kj::Maybe<kj::Own<ThreadShard>> shard;
+
   // Especially includes server loop tasks to listen on sockets. Any error is considered fatal.
   kj::TaskSet tasks;
 
@@ -184,6 +230,10 @@ private:
   // Aborts all actors in this server except those in namespaces marked with `preventEviction`.
   void abortAllActors();
 
+  // Periodically measures the heaps of Workers hosting actors, evicting the least recently used
+  // idle actors while the total exceeds `budget` bytes. Implements `Config.actorMemoryBudgetMb`.
+  kj::Promise<void> enforceActorMemoryBudget(size_t budget);
+
   // Can only be called in the link stage.
   Service& lookupService(config::ServiceDesignator::Reader designator, kj::String errorContext);
 
@@ -195,6 +245,7 @@ private:
   class ExternalTcpService;
   class NetworkService;
   class DiskDirectoryService;
+  class CacheService;
   class WorkerService;
   class WorkerEntrypointService;
   class HttpListener;
@@ -203,6 +254,12 @@ private:
                      kj::HttpHeaderTable::Builder& headerTableBuilder,
                      kj::ForkedPromise<void>& forkedDrainWhen);
 
+  // Must be called before startServices, since it copies overrides that startServices consumes.
+  void startWorkerThreads(jsg::V8System& v8System, config::Config::Reader config,
+                          uint threadCount);
+  kj::Own<ThreadShard> makeThreadShard(uint index, kj::Array<kj::AutoCloseFd> peerFds,
+                                       kj::LowLevelAsyncIoProvider& provider);
+
   // Must be called after startServices!
   void startAlarmScheduler(config::Config::Reader config);
 
@@ -1210,6 +1210,8 @@ public:
   }
 
   [[noreturn]] void serve() noexcept {
+    server.enableWorkerThreads(*io.lowLevelProvider);
+
     serveImpl([&](jsg::V8System& v8System, config::Config::Reader config) {
 #if _WIN32
       return server.run(v8System, config);
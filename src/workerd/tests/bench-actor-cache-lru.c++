@@ -0,0 +1,61 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+// Measures contention on ActorCache::SharedLru's locks when caches on several threads share one
+// LRU, as every cache read takes its shard's lock.
+// Run with `bazel run //src/workerd/tests:bench-actor-cache-lru`.
+
+#include <workerd/io/actor-cache.h>
+#include <workerd/io/io-gate.h>
+#include <workerd/tests/bench-tools.h>
+
+namespace workerd {
+namespace {
+
+constexpr uint KEY_COUNT = 1024;
+constexpr size_t VALUE_SIZE = 64;
+
+const ActorCache::SharedLru& getSharedLru() {
+  // `neverFlush` lets the caches work without any storage behind them. Values written that way
+  // stay dirty, so reads don't reorder the clean list, but each read still takes the lock that
+  // protects it, which is what we're measuring.
+  static const ActorCache::SharedLru lru({
+    .softLimit = 64 * (1ull << 20),
+    .hardLimit = 128 * (1ull << 20),
+    .staleTimeout = 30 * kj::SECONDS,
+    .dirtyListByteLimit = 64 * (1ull << 20),
+    .maxKeysPerRpc = 128,
+    .neverFlush = true,
+  });
+  return lru;
+}
+
+// Each thread reads from a cache of its own, as each thread would be running different actors.
+void ActorCacheReadContention(benchmark::State& state) {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+  OutputGate gate;
+  ActorCache cache(nullptr, getSharedLru(), gate);
+
+  auto keys = KJ_MAP(k, kj::zeroTo(KEY_COUNT)) { return kj::str("key-", k); };
+  for (auto& key: keys) {
+    auto value = kj::heapArray<byte>(VALUE_SIZE);
+    value.asPtr().fill('x');
+    KJ_ASSERT(cache.put(kj::str(key), kj::mv(value), {}) == kj::none);
+  }
+
+  uint i = 0;
+  for (auto _: state) {
+    auto result = cache.get(kj::str(keys[(i++ * 7919) % KEY_COUNT]), {});
+    benchmark::DoNotOptimize(KJ_ASSERT_NONNULL(
+        KJ_ASSERT_NONNULL(result.tryGet<kj::Maybe<ActorCache::Value>>())).begin());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(ActorCacheReadContention)->Threads(1)->Threads(2)->Threads(4)->Threads(8)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace workerd
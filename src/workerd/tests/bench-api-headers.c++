@@ -5,12 +5,82 @@
 #include <workerd/tests/bench-tools.h>
 #include <workerd/tests/test-fixture.h>
 #include <workerd/api/http.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
 
 // A benchmark for js Header class.
 
+// Count the heap allocations the benchmarks make, which are most of what building and copying
+// Headers costs.
+//
+// Every form of operator new and delete is replaced, so that they all agree on where memory
+// comes from whatever malloc the binary is linked with (tcmalloc by default on Linux). Windows
+// has no aligned allocation that free() can release, so allocations aren't counted there.
+static std::atomic<uint64_t> allocationCount = 0;
+
+#if !_WIN32
+static void* countedAlloc(size_t size, size_t alignment) noexcept {
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  if (size == 0) size = 1;
+  if (alignment <= alignof(std::max_align_t)) return malloc(size);
+  void* result;
+  return posix_memalign(&result, alignment, size) == 0 ? result : nullptr;
+}
+
+static void* countedAllocOrThrow(size_t size, size_t alignment) {
+  if (void* result = countedAlloc(size, alignment)) return result;
+  throw std::bad_alloc();
+}
+
+void* operator new(size_t size) { return countedAllocOrThrow(size, 0); }
+void* operator new[](size_t size) { return countedAllocOrThrow(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) {
+  return countedAllocOrThrow(size, static_cast<size_t>(alignment));
+}
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return countedAllocOrThrow(size, static_cast<size_t>(alignment));
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return countedAlloc(size, 0);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return countedAlloc(size, 0);
+}
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+  return countedAlloc(size, static_cast<size_t>(alignment));
+}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+  return countedAlloc(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { free(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { free(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { free(ptr); }
+#endif
+
 namespace workerd {
 namespace {
 
+// Reports the allocations made since `start`, per iteration.
+void reportAllocations(benchmark::State& state, uint64_t start) {
+#if !_WIN32
+  state.counters["allocations"] = benchmark::Counter(
+      allocationCount.load(std::memory_order_relaxed) - start,
+      benchmark::Counter::kAvgIterations);
+#endif
+}
+
 struct ApiHeaders: public benchmark::Fixture {
   virtual ~ApiHeaders() noexcept(true) {}
 
@@ -51,9 +121,35 @@ struct ApiHeaders: public benchmark::Fixture {
 // initialization performs a lot of copying, benchmark it
 BENCHMARK_F(ApiHeaders, constructor)(benchmark::State& state) {
   fixture->runInIoContext([&](const TestFixture::Environment& env) {
+    auto start = allocationCount.load(std::memory_order_relaxed);
     for (auto _ : state) {
       auto jsHeaders = jsg::alloc<api::Headers>(*kjHeaders, api::Headers::Guard::REQUEST);
     }
+    reportAllocations(state, start);
+  });
+}
+
+// `new Request(request)` and `request.clone()` copy the headers, but rarely modify the copy.
+BENCHMARK_F(ApiHeaders, copy)(benchmark::State& state) {
+  fixture->runInIoContext([&](const TestFixture::Environment& env) {
+    auto jsHeaders = jsg::alloc<api::Headers>(*kjHeaders, api::Headers::Guard::REQUEST);
+    auto start = allocationCount.load(std::memory_order_relaxed);
+    for (auto _ : state) {
+      auto copy = jsHeaders->clone();
+    }
+    reportAllocations(state, start);
+  });
+}
+
+BENCHMARK_F(ApiHeaders, copyAndSet)(benchmark::State& state) {
+  fixture->runInIoContext([&](const TestFixture::Environment& env) {
+    auto jsHeaders = jsg::alloc<api::Headers>(*kjHeaders, api::Headers::Guard::REQUEST);
+    auto start = allocationCount.load(std::memory_order_relaxed);
+    for (auto _ : state) {
+      auto copy = jsg::alloc<api::Headers>(*jsHeaders);
+      copy->set(jsg::ByteString(kj::str("Accept")), jsg::ByteString(kj::str("*/*")));
+    }
+    reportAllocations(state, start);
   });
 }
 
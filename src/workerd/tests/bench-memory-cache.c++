@@ -0,0 +1,108 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+// Measures contention on SharedMemoryCache when isolates on several threads share one cache.
+// Run with `bazel run //src/workerd/tests:bench-memory-cache`.
+
+#include <workerd/api/memory-cache.h>
+#include <workerd/tests/bench-tools.h>
+#include <kj/async.h>
+
+namespace workerd::api {
+namespace {
+
+constexpr uint KEY_COUNT = 8192;
+constexpr size_t VALUE_SIZE = 256;
+
+// Leave enough headroom that the shared keys are never evicted, even when the hash happens to
+// distribute them unevenly across shards.
+const SharedMemoryCache::Limits LIMITS = {
+  .maxKeys = KEY_COUNT * 2,
+  .maxValueSize = 4096,
+  .maxTotalValueSize = KEY_COUNT * VALUE_SIZE * 4,
+};
+
+kj::Own<CacheValue> makeValue() {
+  return kj::atomicRefcounted<CacheValue>(kj::heapArray<kj::byte>(VALUE_SIZE));
+}
+
+kj::String sharedKey(uint k) {
+  return kj::str("shared-", k);
+}
+
+// Reads the key, filling it through the fallback path on a miss. Each thread only ever misses on
+// keys of its own, so no fallback ever has to wait on another thread's (which would require an
+// IoContext).
+void getOrFill(const SharedMemoryCache::Use& use, const kj::String& key, kj::WaitScope& ws) {
+  KJ_IF_SOME(value, use.getWithoutFallback(key)) {
+    benchmark::DoNotOptimize(value->bytes.begin());
+    return;
+  }
+  auto result = use.getWithFallback(key);
+  KJ_SWITCH_ONEOF(result) {
+    KJ_CASE_ONEOF(value, kj::Own<CacheValue>) {
+      benchmark::DoNotOptimize(value->bytes.begin());
+    }
+    KJ_CASE_ONEOF(promise, kj::Promise<SharedMemoryCache::Use::GetWithFallbackOutcome>) {
+      auto outcome = promise.wait(ws);
+      auto& callback =
+          KJ_ASSERT_NONNULL(outcome.tryGet<SharedMemoryCache::Use::FallbackDoneCallback>());
+      callback(SharedMemoryCache::Use::FallbackResult{makeValue(), kj::none});
+    }
+  }
+}
+
+// A cache that is shared by all benchmark threads. The shared keys are filled up front, so that
+// no two threads ever race to fill the same key.
+struct SharedCache {
+  kj::Own<const SharedMemoryCache> cache =
+      SharedMemoryCache::create(kj::none, "bench"_kj, kj::none);
+  SharedMemoryCache::Use use{kj::atomicAddRef(*cache), LIMITS};
+
+  SharedCache() {
+    kj::EventLoop loop;
+    kj::WaitScope ws(loop);
+    for (uint k = 0; k < KEY_COUNT / 2; k++) {
+      getOrFill(use, sharedKey(k), ws);
+    }
+  }
+};
+
+const SharedMemoryCache& getSharedCache() {
+  static const SharedCache shared;
+  return *shared.cache;
+}
+
+// Every thread reads from a set of keys that all threads share (mostly hits), and writes one of
+// its own keys every 16 operations (misses followed by a fill).
+void MemoryCacheContention(benchmark::State& state) {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+
+  SharedMemoryCache::Use use(kj::atomicAddRef(getSharedCache()), LIMITS);
+  kj::Vector<kj::String> sharedKeys(KEY_COUNT / 2);
+  for (uint k = 0; k < KEY_COUNT / 2; k++) {
+    sharedKeys.add(sharedKey(k));
+  }
+  kj::Vector<kj::String> ownKeys(KEY_COUNT / 16);
+  for (uint k = 0; k < KEY_COUNT / 16; k++) {
+    ownKeys.add(kj::str("thread-", state.thread_index(), "-", k));
+  }
+
+  uint i = 0;
+  for (auto _: state) {
+    if (i % 16 == 0) {
+      getOrFill(use, ownKeys[(i / 16) % ownKeys.size()], ws);
+    } else {
+      getOrFill(use, sharedKeys[(i * 7919) % sharedKeys.size()], ws);
+    }
+    i++;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(MemoryCacheContention)->Threads(1)->Threads(2)->Threads(4)->Threads(8)->UseRealTime();
+
+}  // namespace
+}  // namespace workerd::api
@@ -0,0 +1,104 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+// Compares SqliteKv's single-key get() and put() against its multi-key overloads, for the batch
+// sizes that storage.get([...]) and storage.put({...}) typically see.
+// Run with `bazel run //src/workerd/tests:bench-sqlite-kv`.
+
+#include <workerd/util/sqlite-kv.h>
+#include <workerd/tests/bench-tools.h>
+
+namespace workerd {
+namespace {
+
+constexpr uint KEY_COUNT = 4096;
+constexpr size_t VALUE_SIZE = 64;
+
+struct KvFixture {
+  kj::Own<const kj::Directory> dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs{*dir};
+  SqliteDatabase db{vfs, kj::Path({"bench"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY};
+  SqliteKv kv{db};
+
+  kj::Array<kj::String> keys = KJ_MAP(i, kj::zeroTo(KEY_COUNT)) { return kj::str("key-", i); };
+  kj::Array<kj::StringPtr> keyPtrs = KJ_MAP(key, keys) -> kj::StringPtr { return key; };
+  kj::Array<byte> value = kj::heapArray<byte>(VALUE_SIZE);
+
+  KvFixture() {
+    value.asPtr().fill('x');
+    for (auto key: keyPtrs) {
+      kv.put(key, value);
+    }
+  }
+
+  // A window of `batchSize` consecutive keys, which moves along the table with each iteration.
+  kj::ArrayPtr<const kj::StringPtr> batch(uint iteration, uint batchSize) {
+    uint start = (iteration * batchSize) % (KEY_COUNT - batchSize);
+    return keyPtrs.slice(start, start + batchSize);
+  }
+};
+
+void PerKeyGet(benchmark::State& state) {
+  KvFixture fixture;
+  uint batchSize = static_cast<uint>(state.range(0));
+  uint iteration = 0;
+  for (auto _: state) {
+    for (auto key: fixture.batch(iteration++, batchSize)) {
+      fixture.kv.get(key, [&](SqliteKv::ValuePtr value) {
+        benchmark::DoNotOptimize(value.begin());
+      });
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * batchSize);
+}
+
+void BatchedGet(benchmark::State& state) {
+  KvFixture fixture;
+  uint batchSize = static_cast<uint>(state.range(0));
+  uint iteration = 0;
+  for (auto _: state) {
+    fixture.kv.get(fixture.batch(iteration++, batchSize),
+        [&](SqliteKv::KeyPtr key, SqliteKv::ValuePtr value) {
+      benchmark::DoNotOptimize(value.begin());
+    });
+  }
+  state.SetItemsProcessed(state.iterations() * batchSize);
+}
+
+void PerKeyPut(benchmark::State& state) {
+  KvFixture fixture;
+  uint batchSize = static_cast<uint>(state.range(0));
+  uint iteration = 0;
+  for (auto _: state) {
+    fixture.db.run("BEGIN TRANSACTION");
+    for (auto key: fixture.batch(iteration++, batchSize)) {
+      fixture.kv.put(key, fixture.value);
+    }
+    fixture.db.run("COMMIT TRANSACTION");
+  }
+  state.SetItemsProcessed(state.iterations() * batchSize);
+}
+
+void BatchedPut(benchmark::State& state) {
+  KvFixture fixture;
+  uint batchSize = static_cast<uint>(state.range(0));
+  uint iteration = 0;
+  for (auto _: state) {
+    auto pairs = KJ_MAP(key, fixture.batch(iteration++, batchSize)) {
+      return SqliteKv::KeyValuePtrPair { key, fixture.value };
+    };
+    fixture.db.run("BEGIN TRANSACTION");
+    fixture.kv.put(pairs);
+    fixture.db.run("COMMIT TRANSACTION");
+  }
+  state.SetItemsProcessed(state.iterations() * batchSize);
+}
+
+WD_BENCHMARK(PerKeyGet)->Arg(8)->Arg(32)->Arg(128);
+WD_BENCHMARK(BatchedGet)->Arg(8)->Arg(32)->Arg(128);
+WD_BENCHMARK(PerKeyPut)->Arg(8)->Arg(32)->Arg(128);
+WD_BENCHMARK(BatchedPut)->Arg(8)->Arg(32)->Arg(128);
+
+}  // namespace
+}  // namespace workerd
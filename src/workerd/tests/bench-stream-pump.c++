@@ -0,0 +1,191 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+// Measures the throughput of ReadableStreamSource::pumpTo() when the sink can't optimize the pump,
+// i.e. the read/write loop in api::pumpTo(), for plain, tee'd, and gzip-compressed bodies.
+// Run with `bazel run //src/workerd/tests:bench-stream-pump`.
+
+#include <workerd/api/streams/common.h>
+#include <workerd/tests/bench-tools.h>
+#include <kj/compat/gzip.h>
+
+namespace workerd {
+namespace {
+
+using api::ReadableStreamSource;
+using api::StreamEncoding;
+using api::WritableStreamSink;
+
+// The bytes our sources produce, over and over.
+kj::ArrayPtr<const kj::byte> getPattern() {
+  static const kj::Array<kj::byte> pattern = []() {
+    auto result = kj::heapArray<kj::byte>(65536);
+    for (auto i: kj::indices(result)) {
+      result[i] = "abcdefghijklmnopqrstuvwxyz0123456789 \n"[(i * 7 + i / 13) % 38];
+    }
+    return result;
+  }();
+  return pattern;
+}
+
+// Copies `size` bytes of the pattern into the buffer passed to each read, like an identity pipe
+// would. Optionally reports its length.
+class PatternInputStream final: public kj::AsyncInputStream {
+public:
+  PatternInputStream(uint64_t size, bool knownLength): remaining(size), knownLength(knownLength) {}
+
+  kj::Promise<size_t> tryRead(void* buffer, size_t minBytes, size_t maxBytes) override {
+    auto pattern = getPattern();
+    auto out = reinterpret_cast<kj::byte*>(buffer);
+    size_t n = kj::min(maxBytes, remaining);
+    for (size_t done = 0; done < n;) {
+      size_t chunk = kj::min(n - done, pattern.size() - position);
+      memcpy(out + done, pattern.begin() + position, chunk);
+      done += chunk;
+      position = (position + chunk) % pattern.size();
+    }
+    remaining -= n;
+    return n;
+  }
+
+  kj::Maybe<uint64_t> tryGetLength() override {
+    if (knownLength) return remaining;
+    return kj::none;
+  }
+
+private:
+  uint64_t remaining;
+  size_t position = 0;
+  bool knownLength;
+};
+
+// Reads an in-memory buffer.
+class ArrayAsyncInputStream final: public kj::AsyncInputStream {
+public:
+  explicit ArrayAsyncInputStream(kj::ArrayPtr<const kj::byte> data): data(data) {}
+
+  kj::Promise<size_t> tryRead(void* buffer, size_t minBytes, size_t maxBytes) override {
+    size_t n = kj::min(maxBytes, data.size());
+    memcpy(buffer, data.begin(), n);
+    data = data.slice(n, data.size());
+    return n;
+  }
+
+private:
+  kj::ArrayPtr<const kj::byte> data;
+};
+
+// Adapts a kj::AsyncInputStream to a ReadableStreamSource without overriding pumpTo(), so that
+// pumping it goes through api::pumpTo().
+class KjSource final: public ReadableStreamSource {
+public:
+  explicit KjSource(kj::Own<kj::AsyncInputStream> inner): inner(kj::mv(inner)) {}
+
+  kj::Promise<size_t> tryRead(void* buffer, size_t minBytes, size_t maxBytes) override {
+    return inner->tryRead(buffer, minBytes, maxBytes);
+  }
+
+  kj::Maybe<uint64_t> tryGetLength(StreamEncoding encoding) override {
+    if (encoding == StreamEncoding::IDENTITY) return inner->tryGetLength();
+    return kj::none;
+  }
+
+private:
+  kj::Own<kj::AsyncInputStream> inner;
+};
+
+// Discards everything written to it.
+class NullSink final: public WritableStreamSink {
+public:
+  kj::Promise<void> write(const void* buffer, size_t size) override {
+    benchmark::DoNotOptimize(buffer);
+    written += size;
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> write(kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> pieces) override {
+    for (auto& piece: pieces) written += piece.size();
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> end() override { return kj::READY_NOW; }
+
+  void abort(kj::Exception reason) override {}
+
+  uint64_t written = 0;
+};
+
+void pump(kj::WaitScope& ws, ReadableStreamSource& source, NullSink& sink) {
+  source.pumpTo(sink, true).wait(ws).proxyTask.wait(ws);
+}
+
+void IdentityPump(benchmark::State& state) {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+  uint64_t size = state.range(0);
+  bool knownLength = state.range(1);
+
+  for (auto _: state) {
+    KjSource source(kj::heap<PatternInputStream>(size, knownLength));
+    NullSink sink;
+    pump(ws, source, sink);
+    KJ_ASSERT(sink.written == size);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+
+void TeePump(benchmark::State& state) {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+  uint64_t size = state.range(0);
+
+  for (auto _: state) {
+    auto tee = kj::newTee(kj::heap<PatternInputStream>(size, true));
+    KjSource left(kj::mv(tee.branches[0]));
+    KjSource right(kj::mv(tee.branches[1]));
+    NullSink leftSink;
+    NullSink rightSink;
+    kj::joinPromises(kj::arr(
+        left.pumpTo(leftSink, true).ignoreResult(),
+        right.pumpTo(rightSink, true).ignoreResult())).wait(ws);
+    KJ_ASSERT(leftSink.written == size && rightSink.written == size);
+  }
+  state.SetBytesProcessed(state.iterations() * size * 2);
+}
+
+void GzipPump(benchmark::State& state) {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+  uint64_t size = state.range(0);
+
+  kj::VectorOutputStream compressed;
+  {
+    kj::GzipOutputStream gzip(compressed);
+    PatternInputStream input(size, false);
+    auto buffer = kj::heapArray<kj::byte>(65536);
+    while (auto n = input.tryRead(buffer.begin(), 1, buffer.size()).wait(ws)) {
+      gzip.write(buffer.begin(), n);
+    }
+  }
+  auto data = kj::heapArray(compressed.getArray());
+
+  for (auto _: state) {
+    auto raw = kj::heap<ArrayAsyncInputStream>(data);
+    auto gunzip = kj::heap<kj::GzipAsyncInputStream>(*raw);
+    KjSource source(gunzip.attach(kj::mv(raw)));
+    NullSink sink;
+    pump(ws, source, sink);
+    KJ_ASSERT(sink.written == size);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+
+WD_BENCHMARK(IdentityPump)
+    ->Args({1 << 20, false})->Args({1 << 20, true})
+    ->Args({16 << 20, false})->Args({16 << 20, true});
+WD_BENCHMARK(TeePump)->Arg(1 << 20)->Arg(16 << 20);
+WD_BENCHMARK(GzipPump)->Arg(1 << 20)->Arg(16 << 20);
+
+}  // namespace
+}  // namespace workerd
@@ -0,0 +1,136 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+// Compares writing a body as one piecewise write() against writing it chunk by chunk, both
+// straight into a pipe and through an IdentityTransformStream, counting the write system calls
+// each makes along with the time taken.
+// Run with `bazel run //src/workerd/tests:bench-stream-writev`.
+
+#include <workerd/api/streams/internal.h>
+#include <workerd/tests/bench-tools.h>
+
+namespace workerd {
+namespace {
+
+using api::WritableStreamSink;
+
+constexpr size_t CHUNK_SIZE = 1024;
+constexpr size_t CHUNK_COUNT = 16;
+
+// Forwards to a file descriptor stream, counting the writes that reach it. kj::AsyncStreamFd makes
+// one write() or writev() system call for each of them, unless the pipe fills up.
+class CountingOutputStream final: public kj::AsyncOutputStream {
+public:
+  explicit CountingOutputStream(kj::AsyncOutputStream& inner): inner(inner) {}
+
+  kj::Promise<void> write(const void* buffer, size_t size) override {
+    ++syscalls;
+    return inner.write(buffer, size);
+  }
+
+  kj::Promise<void> write(kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> pieces) override {
+    ++syscalls;
+    return inner.write(pieces);
+  }
+
+  kj::Promise<void> whenWriteDisconnected() override {
+    return inner.whenWriteDisconnected();
+  }
+
+  uint64_t syscalls = 0;
+
+private:
+  kj::AsyncOutputStream& inner;
+};
+
+// Adapts a kj::AsyncOutputStream to a WritableStreamSink, passing pieces straight through.
+class KjSink final: public WritableStreamSink {
+public:
+  explicit KjSink(kj::AsyncOutputStream& inner): inner(inner) {}
+
+  kj::Promise<void> write(const void* buffer, size_t size) override {
+    return inner.write(buffer, size);
+  }
+
+  kj::Promise<void> write(kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> pieces) override {
+    return inner.write(pieces);
+  }
+
+  kj::Promise<void> end() override { return kj::READY_NOW; }
+
+  void abort(kj::Exception reason) override {}
+
+private:
+  kj::AsyncOutputStream& inner;
+};
+
+struct WritevFixture {
+  kj::AsyncIoContext io = kj::setupAsyncIo();
+  kj::OneWayPipe pipe = io.provider->newOneWayPipe();
+  CountingOutputStream counter{*pipe.out};
+  KjSink sink{counter};
+
+  kj::Array<kj::Array<kj::byte>> chunks = KJ_MAP(i, kj::zeroTo(CHUNK_COUNT)) {
+    auto chunk = kj::heapArray<kj::byte>(CHUNK_SIZE);
+    chunk.asPtr().fill('a' + i);
+    return chunk;
+  };
+  kj::Array<kj::ArrayPtr<const kj::byte>> pieces =
+      KJ_MAP(chunk, chunks) -> kj::ArrayPtr<const kj::byte> { return chunk; };
+  kj::Array<kj::byte> readBuffer = kj::heapArray<kj::byte>(CHUNK_SIZE * CHUNK_COUNT);
+
+  kj::Promise<void> writeBody(WritableStreamSink& output, bool vectored) {
+    if (vectored) {
+      co_await output.write(pieces);
+    } else {
+      for (auto piece: pieces) {
+        co_await output.write(piece.begin(), piece.size());
+      }
+    }
+  }
+
+  // Drains the pipe as the body is written to it, so that writes never block.
+  kj::Promise<void> readBody() {
+    return pipe.in->read(readBuffer.begin(), readBuffer.size()).ignoreResult();
+  }
+
+  void report(benchmark::State& state) {
+    state.SetBytesProcessed(state.iterations() * CHUNK_SIZE * CHUNK_COUNT);
+    state.counters["syscalls"] = benchmark::Counter(counter.syscalls,
+        benchmark::Counter::kAvgIterations);
+  }
+};
+
+void PipeWrite(benchmark::State& state) {
+  WritevFixture fixture;
+  bool vectored = state.range(0);
+
+  for (auto _: state) {
+    kj::joinPromises(kj::arr(fixture.writeBody(fixture.sink, vectored), fixture.readBody()))
+        .wait(fixture.io.waitScope);
+  }
+  fixture.report(state);
+}
+
+void IdentityTransformWrite(benchmark::State& state) {
+  WritevFixture fixture;
+  bool vectored = state.range(0);
+
+  for (auto _: state) {
+    auto transform = kj::refcounted<api::IdentityTransformStreamImpl>();
+    auto pump = transform->pumpTo(fixture.sink, false)
+        .then([](DeferredProxy<void> proxy) { return kj::mv(proxy.proxyTask); });
+    auto write = fixture.writeBody(*transform, vectored)
+        .then([&transform = *transform]() { return transform.end(); });
+    kj::joinPromises(kj::arr(kj::mv(write), kj::mv(pump), fixture.readBody()))
+        .wait(fixture.io.waitScope);
+  }
+  fixture.report(state);
+}
+
+WD_BENCHMARK(PipeWrite)->Arg(false)->Arg(true);
+WD_BENCHMARK(IdentityTransformWrite)->Arg(false)->Arg(true);
+
+}  // namespace
+}  // namespace workerd
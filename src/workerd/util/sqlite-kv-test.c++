@@ -91,5 +91,64 @@ KJ_TEST("SQLite-KV") {
   KJ_EXPECT(list(nullptr, kj::none, kj::none, F) == "");
 }
 
+KJ_TEST("SQLite-KV multi-get and multi-put") {
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs(*dir);
+  SqliteDatabase db(vfs, kj::Path({"foo"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+  SqliteKv kv(db);
+
+  // Enough pairs for a few full batches plus some left over. Key 10 repeats key 5, so only the
+  // later value should stick.
+  auto keys = KJ_MAP(i, kj::zeroTo(100)) { return kj::str("key", i == 10 ? 5 : i); };
+  auto values = KJ_MAP(i, kj::zeroTo(100)) { return kj::str("value", i); };
+  auto pairs = KJ_MAP(i, kj::zeroTo(100)) {
+    return SqliteKv::KeyValuePtrPair { keys[i], values[i].asBytes() };
+  };
+  kv.put(pairs);
+
+  auto list = [&]() {
+    kj::HashMap<kj::String, kj::String> results;
+    kv.list(nullptr, kj::none, kj::none, SqliteKv::FORWARD,
+        [&](kj::StringPtr key, kj::ArrayPtr<const byte> value) {
+      results.insert(kj::str(key), kj::str(value.asChars()));
+    });
+    return results;
+  };
+  {
+    auto listed = list();
+    KJ_EXPECT(listed.size() == 99);
+    KJ_EXPECT(KJ_ASSERT_NONNULL(listed.find("key0"_kj)) == "value0");
+    KJ_EXPECT(KJ_ASSERT_NONNULL(listed.find("key5"_kj)) == "value10");
+    KJ_EXPECT(KJ_ASSERT_NONNULL(listed.find("key99"_kj)) == "value99");
+  }
+
+  // Look up every other key, plus some that don't exist.
+  auto getKeys = KJ_MAP(i, kj::zeroTo(80)) { return kj::str("key", i * 2); };
+  auto getKeyPtrs = KJ_MAP(key, getKeys) -> kj::StringPtr { return key; };
+  kj::HashMap<kj::String, kj::String> results;
+  auto n = kv.get(getKeyPtrs, [&](kj::StringPtr key, kj::ArrayPtr<const byte> value) {
+    results.insert(kj::str(key), kj::str(value.asChars()));
+  });
+  KJ_EXPECT(n == 49);
+  KJ_EXPECT(results.size() == 49);
+  KJ_EXPECT(KJ_ASSERT_NONNULL(results.find("key0"_kj)) == "value0");
+  KJ_EXPECT(results.find("key10"_kj) == kj::none);
+  KJ_EXPECT(KJ_ASSERT_NONNULL(results.find("key98"_kj)) == "value98");
+  KJ_EXPECT(results.find("key100"_kj) == kj::none);
+
+  // Batched puts overwrite existing values too.
+  auto newValue = "new"_kj;
+  for (auto& pair: pairs) {
+    pair.value = newValue.asBytes();
+  }
+  kv.put(pairs.first(40));
+  {
+    auto listed = list();
+    KJ_EXPECT(listed.size() == 99);
+    KJ_EXPECT(KJ_ASSERT_NONNULL(listed.find("key39"_kj)) == "new");
+    KJ_EXPECT(KJ_ASSERT_NONNULL(listed.find("key40"_kj)) == "value40");
+  }
+}
+
 }  // namespace
 }  // namespace workerd
@@ -22,10 +22,34 @@ SqliteDatabase& SqliteKv::ensureInitialized(SqliteDatabase& db) {
   return db;
 }
 
+kj::String SqliteKv::batchSql(kj::StringPtr prefix, kj::StringPtr item, kj::StringPtr suffix) {
+  kj::Vector<kj::StringPtr> items(BATCH_SIZE);
+  for (auto i KJ_UNUSED: kj::zeroTo(BATCH_SIZE)) {
+    items.add(item);
+  }
+  return kj::str(prefix, kj::delimited(items, ", "), suffix);
+}
+
 void SqliteKv::put(KeyPtr key, ValuePtr value) {
   stmtPut.run(key, value);
 }
 
+void SqliteKv::put(kj::ArrayPtr<const KeyValuePtrPair> pairs) {
+  SqliteDatabase::Query::ValuePtr bindings[BATCH_SIZE * 2];
+  while (pairs.size() >= BATCH_SIZE) {
+    for (auto i: kj::zeroTo(BATCH_SIZE)) {
+      bindings[i * 2] = pairs[i].key;
+      bindings[i * 2 + 1] = pairs[i].value;
+    }
+    stmtPutBatch.run(kj::arrayPtr(bindings, BATCH_SIZE * 2).asConst());
+    pairs = pairs.slice(BATCH_SIZE, pairs.size());
+  }
+
+  for (auto& pair: pairs) {
+    put(pair.key, pair.value);
+  }
+}
+
 bool SqliteKv::delete_(KeyPtr key) {
   auto query = stmtDelete.run(key);
   return query.changeCount() > 0;
@@ -28,6 +28,12 @@ public:
   template <typename Func>
   bool get(KeyPtr key, Func&& callback);
 
+  // Search for many keys at once, calling the callback (with KeyPtr and ValuePtr parameters) for
+  // each match. Matches are reported in no particular order. Returns the number of matches. (If
+  // `keys` contains duplicates, a key may be matched more than once.)
+  template <typename Func>
+  uint get(kj::ArrayPtr<const KeyPtr> keys, Func&& callback);
+
   enum Order {
     FORWARD,
     REVERSE
@@ -43,26 +49,44 @@ public:
   // Store a value into the table.
   void put(KeyPtr key, ValuePtr value);
 
+  struct KeyValuePtrPair {
+    KeyPtr key;
+    ValuePtr value;
+  };
+
+  // Store many values into the table. If a key appears more than once, the last value wins.
+  void put(kj::ArrayPtr<const KeyValuePtrPair> pairs);
+
   // Delete the key and return whether it was matched.
   bool delete_(KeyPtr key);
 
   uint deleteAll();
 
-  // TODO(perf): Should we provide multi-get, multi-put, and multi-delete? It's a bit tricky to
-  //   implement them as single SQL queries, while still using prepared statements. The c-array
-  //   extension might help here, though it can only support arrays of NUL-terminated strings, not
-  //   byte blobs or strings containing NUL bytes.
+  // TODO(perf): Should we provide multi-delete too? It could work the same way as multi-get.
 
 private:
+  // Multi-get and multi-put work through statements that take exactly this many keys (or
+  // key/value pairs) at a time, so that they can be prepared once like the rest. Whatever is left
+  // over after the last full batch goes through the single-key statements. (The c-array extension
+  // can't help here, since it only supports arrays of NUL-terminated strings, not byte blobs or
+  // strings containing NUL bytes.)
+  static constexpr uint BATCH_SIZE = 32;
+
   SqliteDatabase& db;
 
   SqliteDatabase::Statement stmtGet = db.prepare(R"(
     SELECT value FROM _cf_KV WHERE key = ?
   )");
+  SqliteDatabase::Statement stmtGetBatch = db.prepare(SqliteDatabase::TRUSTED, batchSql(
+    "SELECT key, value FROM _cf_KV WHERE key IN (", "?", ")"));
   SqliteDatabase::Statement stmtPut = db.prepare(R"(
     INSERT INTO _cf_KV VALUES(?, ?)
       ON CONFLICT DO UPDATE SET value = excluded.value;
   )");
+  // Within one statement, rows are inserted in order, so a later duplicate key updates the row
+  // inserted by an earlier one.
+  SqliteDatabase::Statement stmtPutBatch = db.prepare(SqliteDatabase::TRUSTED, batchSql(
+    "INSERT INTO _cf_KV VALUES", "(?, ?)", " ON CONFLICT DO UPDATE SET value = excluded.value;"));
   SqliteDatabase::Statement stmtDelete = db.prepare(R"(
     DELETE FROM _cf_KV WHERE key = ?
   )");
@@ -114,6 +138,9 @@ private:
     DELETE FROM _cf_KV
   )");
 
+  // Returns `prefix`, then BATCH_SIZE copies of `item` separated by commas, then `suffix`.
+  static kj::String batchSql(kj::StringPtr prefix, kj::StringPtr item, kj::StringPtr suffix);
+
   SqliteDatabase& ensureInitialized(SqliteDatabase& db);
   // Make sure the KV table is created, then return the same object.
 
@@ -123,7 +150,7 @@ private:
 // =======================================================================================
 // inline implementation details
 //
-// We define these two methods as templates rather than ues kj::Function since they're not too
+// We define these methods as templates rather than ues kj::Function since they're not too
 // complicated and avoiding the virtual call is nice. Plus in list()'s case, the actual call sites
 // pass constants for `order` so the `order ==` branch can be eliminated.
 
@@ -139,6 +166,30 @@ bool SqliteKv::get(KeyPtr key, Func&& callback) {
   }
 }
 
+template <typename Func>
+uint SqliteKv::get(kj::ArrayPtr<const KeyPtr> keys, Func&& callback) {
+  uint count = 0;
+
+  SqliteDatabase::Query::ValuePtr bindings[BATCH_SIZE];
+  while (keys.size() >= BATCH_SIZE) {
+    for (auto i: kj::zeroTo(BATCH_SIZE)) {
+      bindings[i] = keys[i];
+    }
+    auto query = stmtGetBatch.run(kj::arrayPtr(bindings, BATCH_SIZE).asConst());
+    while (!query.isDone()) {
+      callback(query.getText(0), query.getBlob(1));
+      query.nextRow();
+      ++count;
+    }
+    keys = keys.slice(BATCH_SIZE, keys.size());
+  }
+
+  for (auto key: keys) {
+    count += get(key, [&](ValuePtr value) { callback(key, value); });
+  }
+  return count;
+}
+
 template <typename Func>
 uint SqliteKv::list(KeyPtr begin, kj::Maybe<KeyPtr> end, kj::Maybe<uint> limit, Order order,
                     Func&& callback) {
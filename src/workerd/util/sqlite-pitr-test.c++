@@ -0,0 +1,130 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "sqlite-pitr.h"
+#include <kj/test.h>
+
+namespace workerd {
+namespace {
+
+class PitrTest final: private kj::Clock {
+public:
+  kj::Date time = kj::UNIX_EPOCH + 1'700'000'000 * kj::SECONDS;
+  SqlitePitr::Options options { .checkpointFrames = 8 };
+
+  kj::Date now() const override { return time; }
+
+  // Opens the database, with a fresh SqlitePitr attached, and calls `func` with it.
+  template <typename Func>
+  void open(Func&& func) {
+    SqlitePitr pitr(*dir, kj::Path({"db.sqlite"}), *this, options);
+    SqliteDatabase db(vfs, kj::Path({"db.sqlite"}),
+                      kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+    pitr.attach(db);
+    db.run("PRAGMA journal_mode=WAL;");
+    db.run("CREATE TABLE IF NOT EXISTS t (id INTEGER PRIMARY KEY, data BLOB)");
+    func(db, pitr);
+  }
+
+  // Inserts `count` rows, one commit each, each big enough to take a page of its own.
+  void insert(SqliteDatabase& db, int from, int count) {
+    for (auto i: kj::range(from, from + count)) {
+      db.run("INSERT INTO t VALUES (?, zeroblob(3000))", i);
+      time += 1 * kj::SECONDS;
+    }
+  }
+
+  int64_t countRows(SqliteDatabase& db) {
+    return db.run("SELECT count(*) FROM t").getInt64(0);
+  }
+
+private:
+  kj::Own<const kj::Directory> dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs{*dir};
+};
+
+KJ_TEST("SqlitePitr: restore to a bookmark and back") {
+  PitrTest test;
+
+  kj::String beforeAll;
+  kj::String afterTen;
+  kj::String undo;
+  test.open([&](SqliteDatabase& db, SqlitePitr& pitr) {
+    beforeAll = pitr.getCurrentBookmark();
+    test.insert(db, 0, 10);
+    afterTen = pitr.getCurrentBookmark();
+    KJ_EXPECT(afterTen != beforeAll);
+
+    // Enough commits to go through several checkpoints.
+    test.insert(db, 10, 40);
+    KJ_EXPECT(test.countRows(db) == 50);
+
+    undo = KJ_ASSERT_NONNULL(pitr.requestRestore(afterTen));
+
+    // Nothing changes until the database is reopened.
+    test.insert(db, 50, 5);
+    KJ_EXPECT(test.countRows(db) == 55);
+  });
+
+  test.open([&](SqliteDatabase& db, SqlitePitr& pitr) {
+    KJ_EXPECT(test.countRows(db) == 10);
+    KJ_EXPECT(db.run("SELECT max(id) FROM t").getInt64(0) == 9);
+    test.insert(db, 100, 3);
+
+    // The restore can itself be undone.
+    KJ_ASSERT_NONNULL(pitr.requestRestore(undo));
+  });
+
+  test.open([&](SqliteDatabase& db, SqlitePitr& pitr) {
+    KJ_EXPECT(test.countRows(db) == 55);
+    KJ_ASSERT_NONNULL(pitr.requestRestore(beforeAll));
+  });
+
+  test.open([&](SqliteDatabase& db, SqlitePitr& pitr) {
+    KJ_EXPECT(test.countRows(db) == 0);
+  });
+}
+
+KJ_TEST("SqlitePitr: bookmarks for times") {
+  PitrTest test;
+
+  test.open([&](SqliteDatabase& db, SqlitePitr& pitr) {
+    auto start = test.time;
+    KJ_EXPECT(pitr.getBookmarkForTime(start - 1 * kj::SECONDS) == kj::none);
+
+    test.insert(db, 0, 20);
+    auto middle = KJ_ASSERT_NONNULL(pitr.getBookmarkForTime(start + 10 * kj::SECONDS));
+    test.insert(db, 20, 20);
+    KJ_EXPECT(KJ_ASSERT_NONNULL(pitr.getBookmarkForTime(test.time)) ==
+              pitr.getCurrentBookmark());
+
+    KJ_ASSERT_NONNULL(pitr.requestRestore(middle));
+  });
+
+  test.open([&](SqliteDatabase& db, SqlitePitr& pitr) {
+    // Row 10 was inserted at `start + 10s`.
+    KJ_EXPECT(test.countRows(db) == 11);
+  });
+}
+
+KJ_TEST("SqlitePitr: rejects bookmarks not in the log") {
+  PitrTest test;
+  test.options.retention = 1 * kj::MINUTES;
+
+  test.open([&](SqliteDatabase& db, SqlitePitr& pitr) {
+    KJ_EXPECT(pitr.requestRestore("not a bookmark") == kj::none);
+    KJ_EXPECT(pitr.requestRestore("00000000000000ff-00000000") == kj::none);
+
+    auto old = pitr.getCurrentBookmark();
+    test.insert(db, 0, 10);
+    test.time += 1 * kj::HOURS;
+    test.insert(db, 10, 20);
+
+    // The epochs from an hour ago have been discarded.
+    KJ_EXPECT(pitr.requestRestore(old) == kj::none);
+  });
+}
+
+}  // namespace
+}  // namespace workerd
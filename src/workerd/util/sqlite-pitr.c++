@@ -0,0 +1,600 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "sqlite-pitr.h"
+#include <kj/debug.h>
+#include <kj/vector.h>
+#include <sqlite3.h>
+#include <algorithm>
+#include <string.h>
+
+namespace workerd {
+
+// Layout of the log directory, for epoch N (as 16 hex digits):
+//
+// - `N.idx`: The epoch's index. A 16-byte header holding the salts of the epoch's WAL
+//   incarnation (zero until the first commit), followed by a 16-byte record per commit: the time
+//   in nanoseconds since the epoch, and the number of frames in the WAL after it.
+// - `N.undo`: Pages of the main database as they were at the start of the epoch, for every page
+//   that has been (or is about to be) overwritten by a checkpoint. An 8-byte header holding the
+//   page size and the number of pages in the database at the start of the epoch, followed by
+//   records holding a page number and the page's content.
+// - `N.wal`: The epoch's WAL, as of its last checkpoint. Absent for the current epoch.
+// - `restore`: The bookmark to restore to when the database is next opened, if any.
+//
+// Our own files are little-endian. SQLite's headers are big-endian.
+
+namespace {
+
+constexpr uint WAL_HEADER_SIZE = 32;
+constexpr uint WAL_FRAME_HEADER_SIZE = 24;
+constexpr uint INDEX_HEADER_SIZE = 16;
+constexpr uint INDEX_RECORD_SIZE = 16;
+constexpr uint UNDO_HEADER_SIZE = 8;
+
+// The page size assumed when SQLite hasn't told us one, i.e. for an empty database.
+constexpr uint32_t DEFAULT_PAGE_SIZE = 4096;
+
+// Undo records are written in batches of about this size.
+constexpr size_t UNDO_BATCH_SIZE = 1 << 20;
+
+constexpr kj::StringPtr RESTORE_FILE = "restore"_kj;
+
+uint32_t getBigEndian32(const byte* p) {
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+uint64_t getLittleEndian(const byte* p, uint size) {
+  uint64_t result = 0;
+  for (uint i = 0; i < size; i++) {
+    result |= uint64_t(p[i]) << (8 * i);
+  }
+  return result;
+}
+
+void putLittleEndian(byte* p, uint64_t value, uint size) {
+  for (uint i = 0; i < size; i++) {
+    p[i] = byte(value >> (8 * i));
+  }
+}
+
+kj::String zeroPaddedHex(uint64_t value, uint digits) {
+  auto result = kj::heapString(digits);
+  for (uint i = digits; i-- > 0;) {
+    result[i] = "0123456789abcdef"[value & 15];
+    value >>= 4;
+  }
+  return result;
+}
+
+kj::Maybe<uint64_t> parseHex(kj::StringPtr text) {
+  if (text.size() == 0 || text.size() > 16) return kj::none;
+  uint64_t result = 0;
+  for (char c: text) {
+    if (c >= '0' && c <= '9') {
+      result = (result << 4) | (c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      result = (result << 4) | (c - 'a' + 10);
+    } else {
+      return kj::none;
+    }
+  }
+  return result;
+}
+
+kj::Path epochFile(uint64_t epoch, kj::StringPtr suffix) {
+  return kj::Path(kj::str(zeroPaddedHex(epoch, 16), '.', suffix));
+}
+
+int64_t toNanoseconds(kj::Date date) {
+  return (date - kj::UNIX_EPOCH) / kj::NANOSECONDS;
+}
+
+// The page size recorded in the database header, or zero if the database is empty.
+uint32_t getDatabasePageSize(const kj::ReadableFile& main) {
+  byte header[18];
+  if (main.read(0, header) < sizeof(header)) return 0;
+  uint32_t size = (uint32_t(header[16]) << 8) | header[17];
+  return size == 1 ? 65536 : size;
+}
+
+// Where to find the content a page is to be given.
+struct PageSource {
+  const kj::ReadableFile* file;
+  uint64_t offset;
+};
+using PageSources = kj::HashMap<uint32_t, PageSource>;
+
+void setPageSource(PageSources& sources, uint32_t page, PageSource source) {
+  sources.upsert(page, source, [](PageSource& existing, PageSource&& replacement) {
+    existing = replacement;
+  });
+}
+
+// Writes the given pages to the main database and sets its size to `pageCount` pages, as a
+// checkpoint would.
+void writePages(const kj::File& main, uint32_t pageSize,
+                const PageSources& sources, uint32_t pageCount) {
+  auto buffer = kj::heapArray<byte>(pageSize);
+  for (auto& entry: sources) {
+    if (entry.key > pageCount) continue;
+    auto n = entry.value.file->read(entry.value.offset, buffer);
+    KJ_REQUIRE(n == pageSize, "point-in-time recovery log is truncated");
+    main.write(uint64_t(entry.key - 1) * pageSize, buffer);
+  }
+  main.truncate(uint64_t(pageCount) * pageSize);
+  main.datasync();
+}
+
+}  // namespace
+
+SqlitePitr::SqlitePitr(const kj::Directory& directory, kj::PathPtr path, const kj::Clock& clock,
+                       Options options)
+    : directory(directory), path(path.clone()),
+      walPath(path.parent().append(kj::str(path.basename()[0], "-wal"))),
+      shmPath(path.parent().append(kj::str(path.basename()[0], "-shm"))),
+      clock(clock), options(options),
+      logDir(directory.openSubdir(path.parent().append(kj::str(path.basename()[0], "-pitr")),
+          kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT)) {
+  auto epochs = listEpochs();
+  if (epochs.size() == 0) {
+    openEpoch(1, clock.now());
+  } else {
+    openEpoch(epochs.back(), kj::none);
+  }
+
+  KJ_IF_SOME(file, logDir->tryOpenFile(kj::Path(RESTORE_FILE))) {
+    auto text = file->readAllText();
+    KJ_IF_SOME(bookmark, parseBookmark(text)) {
+      restore(bookmark);
+    } else {
+      KJ_LOG(ERROR, "ignoring malformed point-in-time recovery request", text);
+    }
+    logDir->remove(kj::Path(RESTORE_FILE));
+  }
+}
+
+SqlitePitr::~SqlitePitr() noexcept(false) {}
+
+kj::String SqlitePitr::formatBookmark(Bookmark bookmark) {
+  return kj::str(zeroPaddedHex(bookmark.epoch, 16), '-', zeroPaddedHex(bookmark.frames, 8));
+}
+
+kj::Maybe<SqlitePitr::Bookmark> SqlitePitr::parseBookmark(kj::StringPtr text) {
+  if (text.size() != 25 || text[16] != '-') return kj::none;
+  auto epoch = KJ_UNWRAP_OR(parseHex(kj::str(text.slice(0, 16))), return kj::none);
+  auto frames = KJ_UNWRAP_OR(parseHex(text.slice(17)), return kj::none);
+  return Bookmark { .epoch = epoch, .frames = uint32_t(frames) };
+}
+
+kj::Array<uint64_t> SqlitePitr::listEpochs() {
+  kj::Vector<uint64_t> result;
+  for (auto& name: logDir->listNames()) {
+    if (name.size() == 20 && name.endsWith(".idx")) {
+      KJ_IF_SOME(epoch, parseHex(kj::str(name.slice(0, 16)))) {
+        result.add(epoch);
+      }
+    }
+  }
+  std::sort(result.begin(), result.end());
+  return result.releaseAsArray();
+}
+
+kj::Array<SqlitePitr::Commit> SqlitePitr::readIndex(uint64_t epoch) {
+  auto file = KJ_UNWRAP_OR(logDir->tryOpenFile(epochFile(epoch, "idx")), return nullptr);
+  auto bytes = file->readAllBytes();
+  kj::Vector<Commit> result;
+  for (size_t offset = INDEX_HEADER_SIZE; offset + INDEX_RECORD_SIZE <= bytes.size();
+       offset += INDEX_RECORD_SIZE) {
+    result.add(Commit {
+      .time = kj::UNIX_EPOCH + int64_t(getLittleEndian(&bytes[offset], 8)) * kj::NANOSECONDS,
+      .frames = uint32_t(getLittleEndian(&bytes[offset + 8], 4)),
+    });
+  }
+  return result.releaseAsArray();
+}
+
+void SqlitePitr::openEpoch(uint64_t newEpoch, kj::Maybe<kj::Date> startTime) {
+  epoch = newEpoch;
+  walHeader = kj::none;
+  frames = 0;
+  undoPages.clear();
+
+  KJ_IF_SOME(time, startTime) {
+    indexFile = logDir->openFile(epochFile(epoch, "idx"),
+        kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+    byte bytes[INDEX_HEADER_SIZE + INDEX_RECORD_SIZE] = {};
+    putLittleEndian(bytes + INDEX_HEADER_SIZE, toNanoseconds(time), 8);
+    indexFile->truncate(0);
+    indexFile->write(0, bytes);
+    indexSize = sizeof(bytes);
+    return;
+  }
+
+  indexFile = logDir->openFile(epochFile(epoch, "idx"), kj::WriteMode::MODIFY);
+  auto bytes = indexFile->readAllBytes();
+  indexSize = bytes.size();
+  if (bytes.size() >= INDEX_HEADER_SIZE) {
+    uint32_t salt1 = getLittleEndian(&bytes[0], 4);
+    uint32_t salt2 = getLittleEndian(&bytes[4], 4);
+    if (salt1 != 0 || salt2 != 0) {
+      walHeader = WalHeader { .pageSize = 0, .salt1 = salt1, .salt2 = salt2 };
+    }
+  }
+  if (bytes.size() >= INDEX_HEADER_SIZE + INDEX_RECORD_SIZE) {
+    frames = getLittleEndian(&bytes[indexSize - INDEX_RECORD_SIZE + 8], 4);
+  }
+
+  KJ_IF_SOME(undo, logDir->tryOpenFile(epochFile(epoch, "undo"))) {
+    byte header[UNDO_HEADER_SIZE];
+    auto size = undo->stat().size;
+    if (undo->read(0, header) == sizeof(header)) {
+      uint32_t pageSize = getLittleEndian(header, 4);
+      byte pageNumber[4];
+      for (uint64_t offset = UNDO_HEADER_SIZE; offset + 4 + pageSize <= size;
+           offset += 4 + pageSize) {
+        undo->read(offset, pageNumber);
+        undoPages.insert(getLittleEndian(pageNumber, 4));
+      }
+    }
+  }
+}
+
+void SqlitePitr::startEpoch(uint64_t next) {
+  openEpoch(next, clock.now());
+  prune();
+}
+
+void SqlitePitr::attach(SqliteDatabase& database) {
+  db = database;
+
+  // SQLite keeps the WAL file around (only truncating it) for as long as the database is open,
+  // and we turn off the checkpoint on close below, so one handle serves every commit.
+  walFile = directory.openFile(walPath, kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+
+  // Registering a WAL hook replaces SQLite's automatic checkpointing.
+  sqlite3_wal_hook(database, [](void* ctx, sqlite3*, const char* dbName, int walFrames) -> int {
+    // Attached databases are not logged.
+    if (strcmp(dbName, "main") != 0) return SQLITE_OK;
+
+    KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() {
+      reinterpret_cast<SqlitePitr*>(ctx)->onCommit(walFrames);
+    })) {
+      // The commit has already happened, so there's nobody to report this to. The log will be
+      // missing this commit, but remains consistent.
+      KJ_LOG(ERROR, "failed to log commit for point-in-time recovery", exception);
+    }
+    return SQLITE_OK;
+  }, this);
+
+  // A checkpoint on close would bypass the log. The WAL is recovered when the database is next
+  // opened instead.
+  int unused;
+  sqlite3_db_config(database, SQLITE_DBCONFIG_NO_CKPT_ON_CLOSE, 1, &unused);
+}
+
+kj::Maybe<SqlitePitr::WalHeader> SqlitePitr::readWalHeader(const kj::ReadableFile& wal) {
+  byte header[WAL_HEADER_SIZE];
+  if (wal.read(0, header) < sizeof(header)) return kj::none;
+  uint32_t magic = getBigEndian32(header);
+  if ((magic & ~1u) != 0x377f0682) return kj::none;
+  return WalHeader {
+    .pageSize = getBigEndian32(header + 8),
+    .salt1 = getBigEndian32(header + 16),
+    .salt2 = getBigEndian32(header + 20),
+  };
+}
+
+void SqlitePitr::onCommit(uint32_t walFrames) {
+  auto header = KJ_ASSERT_NONNULL(readWalHeader(*walFile), "WAL has no header after a commit");
+
+  KJ_IF_SOME(current, walHeader) {
+    if (current.salt1 != header.salt1 || current.salt2 != header.salt2) {
+      // SQLite started the WAL over, which it only does once the previous one has been fully
+      // checkpointed, i.e. after the last checkpoint() didn't manage to truncate it but did
+      // copy everything.
+      startEpoch(epoch + 1);
+    }
+  }
+  if (walHeader == kj::none) {
+    byte salts[8];
+    putLittleEndian(salts, header.salt1, 4);
+    putLittleEndian(salts + 4, header.salt2, 4);
+    indexFile->write(0, salts);
+    walHeader = header;
+  }
+
+  byte record[INDEX_RECORD_SIZE] = {};
+  putLittleEndian(record, toNanoseconds(clock.now()), 8);
+  putLittleEndian(record + 8, walFrames, 4);
+  indexFile->write(indexSize, record);
+  indexSize += sizeof(record);
+  frames = walFrames;
+
+  if (!restoreRequested && walFrames >= options.checkpointFrames) {
+    if (checkpoint(KJ_ASSERT_NONNULL(db), walFrames)) {
+      startEpoch(epoch + 1);
+    }
+  }
+}
+
+bool SqlitePitr::checkpoint(SqliteDatabase& database, uint32_t walFrames) {
+  archive(*walFile, KJ_ASSERT_NONNULL(readWalHeader(*walFile)), walFrames);
+
+  // If another statement is still reading, this fails with SQLITE_BUSY, possibly after copying
+  // some of the frames. We'll try again after a later commit; the pages saved so far remain
+  // valid, since only pages that were saved can have been overwritten.
+  int logFrames = -1;
+  int checkpointedFrames = -1;
+  int result = sqlite3_wal_checkpoint_v2(database, nullptr, SQLITE_CHECKPOINT_TRUNCATE,
+                                         &logFrames, &checkpointedFrames);
+  return result == SQLITE_OK && logFrames == 0;
+}
+
+void SqlitePitr::archive(const kj::ReadableFile& wal, const WalHeader& header,
+                         uint32_t walFrames) {
+  uint64_t frameSize = WAL_FRAME_HEADER_SIZE + header.pageSize;
+  uint64_t size = WAL_HEADER_SIZE + walFrames * frameSize;
+
+  kj::Vector<uint32_t> pages(walFrames);
+  uint32_t pageCount = 0;
+  byte frameHeader[WAL_FRAME_HEADER_SIZE];
+  for (uint32_t i = 0; i < walFrames; i++) {
+    KJ_REQUIRE(wal.read(WAL_HEADER_SIZE + i * frameSize, frameHeader) == sizeof(frameHeader),
+               "WAL is shorter than SQLite says");
+    pages.add(getBigEndian32(frameHeader));
+    uint32_t commitPageCount = getBigEndian32(frameHeader + 4);
+    if (commitPageCount != 0) pageCount = commitPageCount;
+  }
+
+  auto main = directory.openFile(path);
+  if (walFrames == 0) {
+    pageCount = main->stat().size / header.pageSize;
+  }
+  saveUndo(*main, header.pageSize, pages.asPtr(), pageCount);
+
+  auto replacer = logDir->replaceFile(epochFile(epoch, "wal"),
+      kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+  auto& copy = replacer->get();
+  KJ_REQUIRE(copy.copy(0, wal, 0, size) == size, "WAL is shorter than SQLite says");
+  copy.datasync();
+  replacer->commit();
+}
+
+void SqlitePitr::saveUndo(const kj::ReadableFile& main, uint32_t pageSize,
+                          kj::ArrayPtr<const uint32_t> pages, uint32_t newPageCount) {
+  auto undo = logDir->openFile(epochFile(epoch, "undo"),
+      kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+  uint64_t size = undo->stat().size;
+
+  uint32_t oldPageCount;
+  if (size < UNDO_HEADER_SIZE) {
+    oldPageCount = main.stat().size / pageSize;
+    byte header[UNDO_HEADER_SIZE];
+    putLittleEndian(header, pageSize, 4);
+    putLittleEndian(header + 4, oldPageCount, 4);
+    undo->truncate(0);
+    undo->write(0, header);
+    size = UNDO_HEADER_SIZE;
+  } else {
+    byte header[UNDO_HEADER_SIZE];
+    undo->read(0, header);
+    KJ_REQUIRE(getLittleEndian(header, 4) == pageSize, "page size changed within an epoch");
+    oldPageCount = getLittleEndian(header + 4, 4);
+  }
+
+  kj::Vector<byte> batch;
+  auto flush = [&]() {
+    undo->write(size, batch);
+    size += batch.size();
+    batch.clear();
+  };
+  auto save = [&](uint32_t page) {
+    // Pages beyond the original end of the database didn't exist at the start of the epoch, and
+    // are dropped by truncation when it is undone.
+    if (page == 0 || page > oldPageCount || undoPages.contains(page)) return;
+
+    auto offset = batch.size();
+    batch.resize(offset + 4 + pageSize);
+    putLittleEndian(&batch[offset], page, 4);
+    auto content = batch.asPtr().slice(offset + 4, batch.size());
+    auto n = main.read(uint64_t(page - 1) * pageSize, content);
+    memset(content.begin() + n, 0, content.size() - n);
+    undoPages.insert(page);
+
+    if (batch.size() >= UNDO_BATCH_SIZE) flush();
+  };
+
+  for (auto page: pages) {
+    save(page);
+  }
+  for (uint32_t page = newPageCount + 1; page <= oldPageCount; page++) {
+    save(page);
+  }
+  flush();
+  undo->datasync();
+}
+
+kj::String SqlitePitr::getCurrentBookmark() {
+  return formatBookmark({ .epoch = epoch, .frames = frames });
+}
+
+kj::Maybe<kj::String> SqlitePitr::getBookmarkForTime(kj::Date time) {
+  auto epochs = listEpochs();
+  for (auto i = epochs.size(); i-- > 0;) {
+    auto commits = readIndex(epochs[i]);
+    for (auto j = commits.size(); j-- > 0;) {
+      if (commits[j].time <= time) {
+        return formatBookmark({ .epoch = epochs[i], .frames = commits[j].frames });
+      }
+    }
+  }
+  return kj::none;
+}
+
+bool SqlitePitr::isRestorable(Bookmark bookmark) {
+  if (bookmark.epoch > epoch) return false;
+
+  auto commits = readIndex(bookmark.epoch);
+  if (!std::any_of(commits.begin(), commits.end(),
+                   [&](const Commit& c) { return c.frames == bookmark.frames; })) {
+    return false;
+  }
+
+  // Undoing each later epoch requires its saved pages, and replaying the bookmark's own epoch
+  // requires its WAL. (The current epoch's are created when it ends.)
+  for (auto e: listEpochs()) {
+    if (e >= bookmark.epoch && e < epoch) {
+      if (logDir->tryOpenFile(epochFile(e, "undo")) == kj::none) return false;
+    }
+  }
+  if (bookmark.epoch < epoch && bookmark.frames > 0 &&
+      logDir->tryOpenFile(epochFile(bookmark.epoch, "wal")) == kj::none) {
+    return false;
+  }
+  return true;
+}
+
+kj::Maybe<kj::String> SqlitePitr::requestRestore(kj::StringPtr text) {
+  auto bookmark = KJ_UNWRAP_OR(parseBookmark(text), return kj::none);
+  if (!isRestorable(bookmark)) return kj::none;
+
+  auto replacer = logDir->replaceFile(kj::Path(RESTORE_FILE),
+      kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+  replacer->get().writeAll(text);
+  replacer->commit();
+  restoreRequested = true;
+
+  // When the restore is applied, the current epoch is ended and the restore itself is logged as
+  // the next epoch, which thus starts from the state at the end of this session.
+  return formatBookmark({ .epoch = epoch + 1, .frames = 0 });
+}
+
+void SqlitePitr::restore(Bookmark bookmark) {
+  auto main = directory.openFile(path, kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+
+  // First end the current epoch, checkpointing the live WAL ourselves.
+  uint32_t pageSize = getDatabasePageSize(*main);
+  KJ_IF_SOME(wal, directory.tryOpenFile(walPath)) {
+    KJ_IF_SOME(header, readWalHeader(*wal)) {
+      // Only the frames of commits we logged are taken; SQLite would have recovered the same ones
+      // unless a commit happened right before a crash.
+      uint32_t walFrames = 0;
+      KJ_IF_SOME(current, walHeader) {
+        if (current.salt1 == header.salt1 && current.salt2 == header.salt2) {
+          walFrames = frames;
+        }
+      }
+      archive(*wal, header, walFrames);
+
+      PageSources sources;
+      uint32_t pageCount = main->stat().size / header.pageSize;
+      uint64_t frameSize = WAL_FRAME_HEADER_SIZE + header.pageSize;
+      byte frameHeader[WAL_FRAME_HEADER_SIZE];
+      for (uint32_t i = 0; i < walFrames; i++) {
+        uint64_t offset = WAL_HEADER_SIZE + i * frameSize;
+        wal->read(offset, frameHeader);
+        setPageSource(sources, getBigEndian32(frameHeader),
+                      { wal.get(), offset + WAL_FRAME_HEADER_SIZE });
+        uint32_t commitPageCount = getBigEndian32(frameHeader + 4);
+        if (commitPageCount != 0) pageCount = commitPageCount;
+      }
+      writePages(*main, header.pageSize, sources, pageCount);
+      pageSize = header.pageSize;
+    }
+  }
+  if (pageSize == 0) pageSize = DEFAULT_PAGE_SIZE;
+  // Make sure the epoch has an undo log even if nothing was checkpointed.
+  saveUndo(*main, pageSize, nullptr, main->stat().size / pageSize);
+  directory.tryRemove(walPath);
+  directory.tryRemove(shmPath);
+  startEpoch(epoch + 1);
+
+  if (!isRestorable(bookmark)) {
+    KJ_LOG(ERROR, "point-in-time recovery bookmark is no longer in the log",
+           formatBookmark(bookmark));
+    return;
+  }
+
+  // Work out the content of every page that changed since the bookmark: undo the later epochs,
+  // newest first, so that the oldest saved content of each page wins, then replay the bookmark's
+  // epoch up to the bookmark.
+  kj::Vector<kj::Own<const kj::ReadableFile>> files;
+  PageSources sources;
+  uint32_t pageCount = 0;
+  auto epochs = listEpochs();
+  for (auto i = epochs.size(); i-- > 0;) {
+    auto e = epochs[i];
+    if (e == epoch) continue;
+    if (e < bookmark.epoch) break;
+
+    auto& undo = *files.add(logDir->openFile(epochFile(e, "undo")));
+    byte header[UNDO_HEADER_SIZE];
+    KJ_REQUIRE(undo.read(0, header) == sizeof(header), "point-in-time recovery log is truncated");
+    pageSize = getLittleEndian(header, 4);
+    pageCount = getLittleEndian(header + 4, 4);
+    auto size = undo.stat().size;
+    byte pageNumber[4];
+    for (uint64_t offset = UNDO_HEADER_SIZE; offset + 4 + pageSize <= size;
+         offset += 4 + pageSize) {
+      undo.read(offset, pageNumber);
+      setPageSource(sources, getLittleEndian(pageNumber, 4), { &undo, offset + 4 });
+    }
+  }
+  if (bookmark.frames > 0) {
+    auto& wal = *files.add(logDir->openFile(epochFile(bookmark.epoch, "wal")));
+    auto header = KJ_REQUIRE_NONNULL(readWalHeader(wal), "archived WAL is corrupt");
+    KJ_REQUIRE(header.pageSize == pageSize, "page size changed within an epoch");
+    uint64_t frameSize = WAL_FRAME_HEADER_SIZE + pageSize;
+    byte frameHeader[WAL_FRAME_HEADER_SIZE];
+    for (uint32_t i = 0; i < bookmark.frames; i++) {
+      uint64_t offset = WAL_HEADER_SIZE + i * frameSize;
+      KJ_REQUIRE(wal.read(offset, frameHeader) == sizeof(frameHeader),
+                 "point-in-time recovery log is truncated");
+      setPageSource(sources, getBigEndian32(frameHeader),
+                    { &wal, offset + WAL_FRAME_HEADER_SIZE });
+      uint32_t commitPageCount = getBigEndian32(frameHeader + 4);
+      if (commitPageCount != 0) pageCount = commitPageCount;
+    }
+  }
+
+  // Log the restore as an epoch of its own, with no WAL, so that it can be undone.
+  auto pages = KJ_MAP(entry, sources) { return entry.key; };
+  saveUndo(*main, pageSize, pages, pageCount);
+  writePages(*main, pageSize, sources, pageCount);
+  startEpoch(epoch + 1);
+}
+
+void SqlitePitr::prune() {
+  auto epochs = listEpochs();
+  auto cutoff = clock.now() - options.retention;
+
+  auto sizeOf = [&](uint64_t e) {
+    uint64_t size = 0;
+    for (auto suffix: { "idx"_kj, "undo"_kj, "wal"_kj }) {
+      KJ_IF_SOME(file, logDir->tryOpenFile(epochFile(e, suffix))) {
+        size += file->stat().size;
+      }
+    }
+    return size;
+  };
+  uint64_t total = 0;
+  for (auto e: epochs) {
+    total += sizeOf(e);
+  }
+
+  // Never remove the current epoch. An epoch's states are all older than the start of the next.
+  for (size_t i = 0; i + 1 < epochs.size(); i++) {
+    auto next = readIndex(epochs[i + 1]);
+    bool expired = next.size() > 0 && next[0].time < cutoff;
+    if (!expired && total <= options.maxLogSize) break;
+
+    total -= sizeOf(epochs[i]);
+    for (auto suffix: { "idx"_kj, "undo"_kj, "wal"_kj }) {
+      logDir->tryRemove(epochFile(epochs[i], suffix));
+    }
+  }
+}
+
+}  // namespace workerd
@@ -0,0 +1,162 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include "sqlite.h"
+#include <kj/map.h>
+#include <kj/time.h>
+
+namespace workerd {
+
+// Keeps a bounded log of the changes made to a SQLite database in WAL mode, so that the database
+// can be restored to any committed state in the recent past ("point-in-time recovery"). This backs
+// the Durable Object bookmark APIs for SQLite-backed objects stored on local disk.
+//
+// The log is organized in epochs, one per incarnation of the write-ahead log. Once SqlitePitr is
+// attached to a database, it takes over checkpointing: before each checkpoint it archives the
+// WAL's frames, and saves the pages of the main database file that the checkpoint is about to
+// overwrite, so that the checkpoint can be undone. A bookmark names an epoch and a commit within
+// it, and is cheap to issue: it is just the number of WAL frames at that commit. Restoring
+// rewinds the main database file with the saved pages of every later epoch and then replays the
+// archived frames up to the bookmark, so the cost is proportional to the amount of data changed
+// since the bookmark rather than to the size of the database. The restore itself is logged as an
+// epoch of its own, so it can be undone in turn.
+//
+// Epochs older than `Options::retention`, or beyond `Options::maxLogSize`, are discarded.
+//
+// The log lives in a directory next to the database file, named after it with the suffix `-pitr`.
+class SqlitePitr {
+public:
+  struct Options {
+    // How far back the database can be restored to.
+    kj::Duration retention = 30 * kj::DAYS;
+
+    // The maximum total size of the log. The oldest epochs are discarded to stay within it.
+    uint64_t maxLogSize = 1ull << 30;
+
+    // A checkpoint is started once the WAL contains this many frames (pages).
+    uint checkpointFrames = 1000;
+  };
+
+  // `path` is the path of the database file within `directory`. If a restore was requested in a
+  // previous session (with `requestRestore()`), it is applied now, so this must be constructed
+  // before the database is opened.
+  SqlitePitr(const kj::Directory& directory, kj::PathPtr path, const kj::Clock& clock,
+             Options options);
+  SqlitePitr(const kj::Directory& directory, kj::PathPtr path, const kj::Clock& clock)
+      : SqlitePitr(directory, path, clock, Options()) {}
+  ~SqlitePitr() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(SqlitePitr);
+
+  // Starts logging commits to `db`, which must be the database at `path`, in WAL mode. SQLite's
+  // own automatic checkpoints, including the one on close, are disabled. `db` must be destroyed
+  // before this object.
+  void attach(SqliteDatabase& db);
+
+  // Returns a bookmark for the state as of the last commit.
+  kj::String getCurrentBookmark();
+
+  // Returns a bookmark for the last state committed at or before `time`, or null if that is
+  // before the oldest state still in the log.
+  kj::Maybe<kj::String> getBookmarkForTime(kj::Date time);
+
+  // Arranges for the database to be restored to `bookmark` the next time it is opened. Returns
+  // a bookmark for the state the database will be in just before the restore, which can be used
+  // to undo it, or null if `bookmark` is malformed or no longer in the log.
+  //
+  // No checkpoints are made for the rest of the session, so that the state the returned bookmark
+  // refers to stays put.
+  kj::Maybe<kj::String> requestRestore(kj::StringPtr bookmark);
+
+private:
+  struct Bookmark {
+    uint64_t epoch;
+    uint32_t frames;
+  };
+
+  // A record in an epoch's index: the time of a commit, and the number of frames in the WAL
+  // after it. Every epoch starts with a record with zero frames, for the state it started from.
+  struct Commit {
+    kj::Date time;
+    uint32_t frames;
+  };
+
+  struct WalHeader {
+    uint32_t pageSize;
+    uint32_t salt1;
+    uint32_t salt2;
+  };
+
+  const kj::Directory& directory;
+  kj::Path path;
+  kj::Path walPath;
+  kj::Path shmPath;
+  const kj::Clock& clock;
+  Options options;
+  kj::Own<const kj::Directory> logDir;
+
+  kj::Maybe<SqliteDatabase&> db;
+  kj::Own<const kj::File> walFile;  // Opened by attach().
+
+  // The current epoch, whose frames are in the live WAL.
+  uint64_t epoch = 0;
+  kj::Own<const kj::File> indexFile;
+  uint64_t indexSize = 0;
+
+  // Salts of the WAL incarnation the current epoch belongs to, if known yet. SQLite picks new
+  // salts whenever it starts the WAL over, which is how we tell that an epoch has ended.
+  kj::Maybe<WalHeader> walHeader;
+
+  // Number of frames in the WAL as of the last commit.
+  uint32_t frames = 0;
+
+  // Pages whose content before the current epoch has been saved in its undo log.
+  kj::HashSet<uint32_t> undoPages;
+
+  bool restoreRequested = false;
+
+  static kj::String formatBookmark(Bookmark bookmark);
+  static kj::Maybe<Bookmark> parseBookmark(kj::StringPtr text);
+
+  // Returns the epochs in the log, in ascending order. The last one is the current epoch.
+  kj::Array<uint64_t> listEpochs();
+
+  kj::Array<Commit> readIndex(uint64_t epoch);
+
+  // Opens the index of the current epoch, creating it if `startTime` is given.
+  void openEpoch(uint64_t epoch, kj::Maybe<kj::Date> startTime);
+
+  // Ends the current epoch, starting epoch `next`.
+  void startEpoch(uint64_t next);
+
+  // Returns whether `bookmark` is a commit in the log whose state can still be restored.
+  bool isRestorable(Bookmark bookmark);
+
+  kj::Maybe<WalHeader> readWalHeader(const kj::ReadableFile& wal);
+
+  // Called by SQLite after each commit, with the number of frames in the WAL.
+  void onCommit(uint32_t walFrames);
+
+  // Saves the WAL's first `walFrames` frames and the pages they will overwrite in the main
+  // database, then checkpoints. Returns whether the WAL was fully checkpointed and truncated.
+  bool checkpoint(SqliteDatabase& db, uint32_t walFrames);
+
+  // Saves the first `walFrames` frames of `wal` as the current epoch's archive, and the pages
+  // of the main database they (and the truncation at the end of them) will overwrite.
+  void archive(const kj::ReadableFile& wal, const WalHeader& header, uint32_t walFrames);
+
+  // Adds the current content of the given pages to the current epoch's undo log, along with the
+  // pages beyond `newPageCount`, except those already there.
+  void saveUndo(const kj::ReadableFile& main, uint32_t pageSize,
+                kj::ArrayPtr<const uint32_t> pages, uint32_t newPageCount);
+
+  // Applies a restore requested in a previous session.
+  void restore(Bookmark bookmark);
+
+  // Removes epochs that are beyond the retention period or size limit.
+  void prune();
+};
+
+}  // namespace workerd
@@ -464,6 +464,35 @@ KJ_TEST("SQLite onWrite callback") {
   KJ_EXPECT(sawWrite);
 }
 
+KJ_TEST("SQLite onRollback callback") {
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs(*dir);
+  SqliteDatabase db(vfs, kj::Path({"foo"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+
+  uint rollbacks = 0;
+  db.onRollback([&]() { ++rollbacks; });
+
+  setupSql(db);
+  db.run("BEGIN TRANSACTION");
+  db.run("DELETE FROM people");
+  db.run("COMMIT TRANSACTION");
+  KJ_EXPECT(rollbacks == 0);
+
+  db.run("BEGIN TRANSACTION");
+  db.run("INSERT INTO people (id, name, email) VALUES (1, 'Bob', 'bob@example.com')");
+  db.run("ROLLBACK TRANSACTION");
+  KJ_EXPECT(rollbacks == 1);
+
+  // SQLite doesn't report rolling back to a savepoint.
+  db.run("SAVEPOINT foo");
+  db.run("INSERT INTO people (id, name, email) VALUES (1, 'Bob', 'bob@example.com')");
+  db.run("ROLLBACK TO foo");
+  db.run("RELEASE foo");
+  KJ_EXPECT(rollbacks == 1);
+  db.notifyRollback();
+  KJ_EXPECT(rollbacks == 2);
+}
+
 struct RowCounts {
   uint64_t found;
   uint64_t read;
@@ -736,5 +765,23 @@ KJ_TEST("DELETE with LIMIT") {
   KJ_EXPECT(q.getInt(0) == 3);
 }
 
+KJ_TEST("tryPrepare() refuses multiple statements without running them") {
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs(*dir);
+  SqliteDatabase db(vfs, kj::Path({"foo"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+
+  db.run("CREATE TABLE things (id INTEGER PRIMARY KEY)");
+
+  KJ_EXPECT(db.tryPrepare(SqliteDatabase::TRUSTED,
+      "INSERT INTO things VALUES (1); INSERT INTO things VALUES (2)") == kj::none);
+  KJ_EXPECT(db.run("SELECT COUNT(*) FROM things").getInt(0) == 0);
+
+  auto stmt = KJ_ASSERT_NONNULL(db.tryPrepare(SqliteDatabase::TRUSTED,
+      "INSERT INTO things VALUES (?)"));
+  stmt.run(1);
+  stmt.run(2);
+  KJ_EXPECT(db.run("SELECT COUNT(*) FROM things").getInt(0) == 2);
+}
+
 }  // namespace
 }  // namespace workerd
@@ -374,6 +374,19 @@ void SqliteDatabase::notifyWrite() {
   }
 }
 
+void SqliteDatabase::onRollback(kj::Function<void()> callback) {
+  onRollbackCallback = kj::mv(callback);
+  sqlite3_rollback_hook(db, [](void* userdata) {
+    reinterpret_cast<SqliteDatabase*>(userdata)->notifyRollback();
+  }, this);
+}
+
+void SqliteDatabase::notifyRollback() {
+  KJ_IF_SOME(cb, onRollbackCallback) {
+    cb();
+  }
+}
+
 kj::StringPtr SqliteDatabase::getCurrentQueryForDebug() {
   KJ_IF_SOME(s, currentStatement) {
     return sqlite3_normalized_sql(&s);
@@ -406,6 +419,10 @@ kj::Own<sqlite3_stmt> SqliteDatabase::prepareSql(
             "A prepared SQL statement must contain only one statement.", tail);
         break;
 
+      case SINGLE_OR_NULL:
+        if (tail != sqlCode.end()) return nullptr;
+        break;
+
       case MULTI:
         if (tail != sqlCode.end()) {
           // There are more statements after this one, so execute this statement now.
@@ -465,6 +482,32 @@ kj::StringPtr SqliteDatabase::ingestSql(Regulator& regulator, kj::StringPtr sqlC
   return sqlCode;
 }
 
+bool SqliteDatabase::finishIngestSql(Regulator& regulator, kj::StringPtr rest) {
+  // Skip leading whitespace and comments. We only need to find out whether anything else is
+  // left, so there's no need to understand string literals.
+  const char* pos = rest.begin();
+  for (;;) {
+    if (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r' || *pos == '\f') {
+      ++pos;
+    } else if (pos[0] == '-' && pos[1] == '-') {
+      // A line comment runs to the end of the line, or the end of the input.
+      while (*pos != '\0' && *pos != '\n') ++pos;
+    } else if (pos[0] == '/' && pos[1] == '*') {
+      // Like SQLite's tokenizer, accept a block comment left unterminated at the end of input.
+      pos += 2;
+      while (*pos != '\0' && !(pos[0] == '*' && pos[1] == '/')) ++pos;
+      if (*pos != '\0') pos += 2;
+    } else {
+      break;
+    }
+  }
+  if (*pos == '\0') return true;
+
+  if (!sqlite3_complete(rest.cStr())) return false;
+  auto leftover = ingestSql(regulator, rest);
+  return leftover.size() == 0 || finishIngestSql(regulator, leftover);
+}
+
 bool SqliteDatabase::isAuthorized(int actionCode,
     kj::Maybe<kj::StringPtr> param1, kj::Maybe<kj::StringPtr> param2,
     kj::Maybe<kj::StringPtr> dbName, kj::Maybe<kj::StringPtr> triggerName) {
@@ -797,6 +840,13 @@ SqliteDatabase::Statement SqliteDatabase::prepare(Regulator& regulator, kj::Stri
       prepareSql(regulator, sqlCode, SQLITE_PREPARE_PERSISTENT, SINGLE));
 }
 
+kj::Maybe<SqliteDatabase::Statement> SqliteDatabase::tryPrepare(
+    Regulator& regulator, kj::StringPtr sqlCode) {
+  auto stmt = prepareSql(regulator, sqlCode, SQLITE_PREPARE_PERSISTENT, SINGLE_OR_NULL);
+  if (stmt.get() == nullptr) return kj::none;
+  return Statement(*this, regulator, kj::mv(stmt));
+}
+
 SqliteDatabase::Query::Query(SqliteDatabase& db, Regulator& regulator, Statement& statement,
                              kj::ArrayPtr<const ValuePtr> bindings)
     : db(db), regulator(regulator), statement(statement) {
@@ -52,6 +52,10 @@ public:
   // Don't use this for one-off queries; pass the code to the Query constructor.
   Statement prepare(Regulator& regulator, kj::StringPtr sqlCode);
 
+  // Like prepare(), but returns null instead of throwing if `sqlCode` contains more than one
+  // statement (in which case it can only be executed with run()). Nothing is executed either way.
+  kj::Maybe<Statement> tryPrepare(Regulator& regulator, kj::StringPtr sqlCode);
+
   // Convenience method to start a query. This is equivalent to `prepare(sqlCode).run(bindings...)`
   // except:
   // - It may be more efficient for one-off use caes.
@@ -84,6 +88,16 @@ public:
   // start before the SAVEPOINT.
   void notifyWrite();
 
+  // Registers a callback to call whenever writes are rolled back. SQLite reports the rollback of
+  // a whole transaction itself, including one it performs automatically after an error, but not
+  // `ROLLBACK TO` a savepoint, so code that runs that statement must call notifyRollback().
+  //
+  // ActorSqlite uses this to drop cached values that the database may no longer contain.
+  void onRollback(kj::Function<void()> callback);
+
+  // Invoke the onRollback() callback.
+  void notifyRollback();
+
   // Get the currently-executing SQL query for debug purposes. The query is normalized to hide
   // any literal values that might contain sensitive information. This is intended to be safe for
   // debug logs.
@@ -94,6 +108,11 @@ public:
   // that was not processed. This is used for streaming SQL ingestion.
   kj::StringPtr ingestSql(Regulator& regulator, kj::StringPtr sqlCode);
 
+  // Handles what ingestSql() left over once the input has ended. Whitespace and comments are
+  // ignored, and a remainder that sqlite3_complete() accepts is executed. Returns false if the
+  // remainder is an incomplete statement.
+  bool finishIngestSql(Regulator& regulator, kj::StringPtr rest);
+
 private:
   sqlite3* db;
 
@@ -104,15 +123,18 @@ private:
   kj::Maybe<sqlite3_stmt&> currentStatement;
 
   kj::Maybe<kj::Function<void()>> onWriteCallback;
+  kj::Maybe<kj::Function<void()>> onRollbackCallback;
 
   void close();
 
-  enum Multi { SINGLE, MULTI };
+  enum Multi { SINGLE, SINGLE_OR_NULL, MULTI };
 
   // Helper to call sqlite3_prepare_v3().
   //
   // In SINGLE mode, an exception is thrown if `sqlCode` contains multiple statements.
   //
+  // In SINGLE_OR_NULL mode, null is returned if `sqlCode` contains multiple statements.
+  //
   // In MULTI mode, if `sqlCode` contains multiple statements, each statement before the last one
   // is executed immediately. The returned object represents the last statement.
   kj::Own<sqlite3_stmt> prepareSql(
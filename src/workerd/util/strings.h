@@ -23,4 +23,17 @@ inline kj::String toLowerCopy(kj::ArrayPtr<const char> ptr) {
   return kj::mv(str);
 }
 
+// Compares two strings, ignoring the case of ASCII letters only, as HTTP tokens are compared.
+inline bool equalsIgnoreCase(kj::ArrayPtr<const char> a, kj::ArrayPtr<const char> b) {
+  if (a.size() != b.size()) return false;
+  for (auto i: kj::indices(a)) {
+    char ca = a[i];
+    char cb = b[i];
+    if ('A' <= ca && ca <= 'Z') ca += 'a' - 'A';
+    if ('A' <= cb && cb <= 'Z') cb += 'a' - 'A';
+    if (ca != cb) return false;
+  }
+  return true;
+}
+
 }  // namespace workerd